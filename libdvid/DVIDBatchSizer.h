@@ -0,0 +1,115 @@
+/*!
+ * This file provides the adaptive batch size used to split labelgraph
+ * updates and property transactions into requests.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDBATCHSIZER_H
+#define DVIDBATCHSIZER_H
+
+#include "Globals.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <cstddef>
+
+namespace libdvid {
+
+/*!
+ * Chooses the number of vertices per transaction batch with additive
+ * increase, multiplicative decrease (AIMD).  Each finished batch is
+ * reported with its latency, payload size and number of failed
+ * transactions.  The size grows by a fixed step after a full batch
+ * that stayed within the targets and is cut by a factor after a batch
+ * that exceeded any of them (or failed).  The size always stays within
+ * the configured bounds.
+ *
+ * The sizer is thread safe and is shared by the copies of a
+ * node service (see DVIDNodeService::set_graph_batch_sizer).
+*/
+class AdaptiveBatchSizer {
+  public:
+    /*!
+     * Create a sizer starting at the given size.
+     * \param min_size_ smallest batch size
+     * \param max_size_ largest batch size
+     * \param initial_size first batch size (clamped to the bounds)
+    */
+    AdaptiveBatchSizer(size_t min_size_ = TransactionLimit / 10,
+            size_t max_size_ = 4 * TransactionLimit,
+            size_t initial_size = TransactionLimit);
+
+    /*!
+     * Change the bounds of the batch size.
+     * \param min_size_ smallest batch size (at least 2)
+     * \param max_size_ largest batch size
+    */
+    void set_bounds(size_t min_size_, size_t max_size_);
+
+    /*!
+     * Change what is considered an overloaded batch.
+     * \param max_latency_ seconds a batch may take
+     * \param max_payload_bytes_ bytes sent and received by a batch
+     * \param max_failure_rate_ fraction of failed transactions in a batch
+    */
+    void set_targets(double max_latency_, size_t max_payload_bytes_,
+            double max_failure_rate_);
+
+    /*!
+     * Change the AIMD steps.
+     * \param increase_ size added after a good batch
+     * \param decrease_ factor (between 0 and 1) applied after a bad batch
+    */
+    void set_steps(size_t increase_, double decrease_);
+
+    //! Current batch size
+    size_t batch_size() const;
+
+    /*!
+     * Report a finished batch.
+     * \param num_items size of the batch (in the units of batch_size)
+     * \param payload_bytes bytes sent and received
+     * \param seconds time taken by the request
+     * \param num_failed number of failed transactions
+     * \param error true if the request failed
+    */
+    void record(size_t num_items, size_t payload_bytes, double seconds,
+            size_t num_failed, bool error);
+
+  private:
+    mutable boost::mutex mutex;
+
+    size_t current_size;
+    size_t min_size, max_size;
+
+    double max_latency;
+    size_t max_payload_bytes;
+    double max_failure_rate;
+
+    size_t increase;
+    double decrease;
+};
+
+typedef boost::shared_ptr<AdaptiveBatchSizer> AdaptiveBatchSizerPtr;
+
+//! Measures the latency of a batch for AdaptiveBatchSizer::record
+class BatchTimer {
+  public:
+    BatchTimer() : start(boost::posix_time::microsec_clock::universal_time()) {}
+
+    //! seconds since the timer was created
+    double elapsed() const
+    {
+        return (boost::posix_time::microsec_clock::universal_time() -
+                start).total_microseconds() / 1e6;
+    }
+
+  private:
+    boost::posix_time::ptime start;
+};
+
+}
+
+#endif
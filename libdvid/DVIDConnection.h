@@ -9,7 +9,9 @@
 #define DVIDCONNECTION_H
 
 #include "BinaryData.h"
+#include "Globals.h"
 #include <string>
+#include <boost/function.hpp>
 
 namespace libdvid {
 
@@ -17,7 +19,21 @@ namespace libdvid {
 enum ConnectionMethod { GET, POST, PUT, DELETE};
 
 //! Define connection types
-enum ConnectionType {DEFAULT, JSON, BINARY};
+enum ConnectionType {DEFAULT, JSON, BINARY, PROTOBUF};
+
+//! Receives pieces of a response body as they are downloaded
+typedef boost::function<void (const char* data, size_t length)> ResponseCallback;
+
+//! Fills buffer with the next piece of a request body and returns
+//! its length (0 at the end of the body)
+typedef boost::function<size_t (char* buffer, size_t max_length)> RequestSource;
+
+//! Receives the number of bytes transferred so far and the total
+//! (0 if the total is not known)
+typedef boost::function<void (uint64 transferred, uint64 total)> TransferProgress;
+
+//! Streamed payload and progress state of a request (see DVIDConnection.cpp)
+struct TransferOptions;
 
 /*!
  * Creates a libcurl connection and 
@@ -70,6 +86,57 @@ class DVIDConnection {
             BinaryDataPtr results, std::string& error_msg, ConnectionType type=DEFAULT,
             int timeout=DEFAULT_TIMEOUT);
 
+    /*!
+     * Performs a request where the response body is sent to a callback
+     * as it is downloaded, which allows processing to overlap with
+     * the transfer.  The callback only receives data for successful
+     * (2xx) responses; otherwise the body is written to results so
+     * that it can be reported.  An exception thrown by the callback
+     * aborts the transfer and is rethrown as an ErrMsg.
+     *
+     * \param url endpoint where request is performed
+     * \param method http verb (GET, POST, PUT, DELETE)
+     * \param payload binary data containing data to be posted
+     * \param callback receives the response body
+     * \param results binary data containing the body of unsuccessful requests
+     * \param error_msg error message if there is an error
+     * \param type connection type for request
+     * \param timeout timeout for the request
+     * \return html status code
+    */ 
+    int make_request(std::string endpoint, ConnectionMethod method,
+            BinaryDataPtr payload, ResponseCallback callback,
+            BinaryDataPtr results, std::string& error_msg,
+            ConnectionType type=DEFAULT, int timeout=DEFAULT_TIMEOUT);
+
+    /*!
+     * Performs a request whose payload is read from a callback as it is
+     * uploaded and whose response body is sent to a callback as it is
+     * downloaded, so neither has to be held in memory.  If the payload
+     * size is not known, the payload is sent with chunked transfer
+     * encoding.  An exception thrown by a callback aborts the transfer
+     * and is rethrown as an ErrMsg.
+     *
+     * \param url endpoint where request is performed
+     * \param method http verb (GET, POST, PUT, DELETE)
+     * \param source provides the payload (empty for no payload)
+     * \param payload_size size of the payload (-1 if not known)
+     * \param callback receives the response body (empty to discard it)
+     * \param progress called as data is transferred with the progress of
+     * the upload (if there is a payload) or the download (may be empty)
+     * \param results binary data containing the body of unsuccessful requests
+     * \param error_msg error message if there is an error
+     * \param type connection type for request
+     * \param timeout seconds without any transfer before the request is
+     * aborted (the total time is not limited)
+     * \return html status code
+    */
+    int make_request(std::string endpoint, ConnectionMethod method,
+            RequestSource source, int64 payload_size,
+            ResponseCallback callback, TransferProgress progress,
+            BinaryDataPtr results, std::string& error_msg,
+            ConnectionType type=DEFAULT, int timeout=DEFAULT_TIMEOUT);
+
     /*!
      * Get the address for the DVID connection.
     */
@@ -95,6 +162,16 @@ class DVIDConnection {
     */
     DVIDConnection& operator=(const DVIDConnection& connection);
 
+    /*!
+     * Sets up and performs the curl request with the given
+     * write function (libcurl signature) and data.
+    */
+    int perform_request(std::string endpoint, ConnectionMethod method,
+            BinaryDataPtr payload, size_t (*write_function)(void*, size_t, size_t, void*),
+            void* write_data, std::string& error_msg, ConnectionType type,
+            int timeout, std::string* callback_error,
+            TransferOptions* options = 0);
+
     //! reuse curl connection -- eventually make this thread static and
     //! initialize once (CURL typedef is actually a void*)
     void* curl_connection;
@@ -71,6 +71,12 @@ class DVIDException : public ErrMsg {
     */
     ~DVIDException() throw() {}
 
+    //! http status code of the failed request
+    int get_status() const
+    {
+        return status;
+    }
+
   private:
     //! http status
     int status;
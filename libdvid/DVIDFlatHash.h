@@ -0,0 +1,250 @@
+/*!
+ * This file provides a small open-addressing hash map that stores
+ * entries in one contiguous array (linear probing).  It is used for
+ * the large vertex and edge lookups in graph processing where node
+ * based maps spend most of their time in allocation.  Entries cannot
+ * be removed individually.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDFLATHASH_H
+#define DVIDFLATHASH_H
+
+#include "DVIDGraph.h"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace libdvid {
+
+/*!
+ * Mixes the bits of a 64 bit number (splitmix64 finalizer) so
+ * that sequential ids spread across the table.
+ * \param value number to hash
+ * \return hash value
+*/
+inline uint64 hash_mix64(uint64 value)
+{
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+//! Hash for vertex ids
+struct VertexIDHash {
+    size_t operator()(VertexID id) const
+    {
+        return size_t(hash_mix64(id));
+    }
+};
+
+/*!
+ * Edge identifier with the vertex ids in canonical (ascending)
+ * order so that both orientations of an edge compare and hash
+ * the same.
+*/
+struct EdgeKey {
+    EdgeKey() : id1(0), id2(0) {}
+
+    EdgeKey(VertexID a, VertexID b) : id1(a < b ? a : b), id2(a < b ? b : a) {}
+
+    explicit EdgeKey(const Edge& edge) : id1(edge.id1 < edge.id2 ? edge.id1 : edge.id2),
+        id2(edge.id1 < edge.id2 ? edge.id2 : edge.id1) {}
+
+    bool operator==(const EdgeKey& other) const
+    {
+        return (id1 == other.id1) && (id2 == other.id2);
+    }
+
+    //! smaller vertex id
+    VertexID id1;
+
+    //! larger vertex id
+    VertexID id2;
+};
+
+//! Hash for canonical edges
+struct EdgeKeyHash {
+    size_t operator()(const EdgeKey& key) const
+    {
+        return size_t(hash_mix64(key.id1 ^ hash_mix64(key.id2)));
+    }
+};
+
+/*!
+ * Open-addressing hash map with linear probing.  Key and Value must
+ * be default constructible and Key must support ==.  The table is kept
+ * at most half full and grows by doubling.
+*/
+template <typename Key, typename Value, typename Hash>
+class FlatHashMap {
+  public:
+    /*!
+     * Create a map sized for the expected number of entries.
+     * \param expected number of entries expected
+    */
+    explicit FlatHashMap(size_t expected = 0) : num_entries(0)
+    {
+        reserve(expected);
+    }
+
+    /*!
+     * Ensure space for the number of entries without rehashing.
+     * \param expected number of entries expected
+    */
+    void reserve(size_t expected)
+    {
+        size_t capacity = 16;
+        while (capacity < expected * 2) {
+            capacity *= 2;
+        }
+        if (capacity > slots.size()) {
+            rehash(capacity);
+        }
+    }
+
+    /*!
+     * Get the value for the key, inserting a default value if
+     * the key is not in the map.
+     * \param key key to find
+     * \return reference to the value (valid until the next insertion)
+    */
+    Value& operator[](const Key& key)
+    {
+        if ((num_entries + 1) * 2 > slots.size()) {
+            rehash(slots.size() * 2);
+        }
+        size_t pos = find_slot(key);
+        if (!used[pos]) {
+            used[pos] = 1;
+            slots[pos].first = key;
+            slots[pos].second = Value();
+            ++num_entries;
+        }
+        return slots[pos].second;
+    }
+
+    /*!
+     * Find the value for the key.
+     * \param key key to find
+     * \return pointer to the value or 0 if the key is not in the map
+    */
+    Value* find(const Key& key)
+    {
+        size_t pos = find_slot(key);
+        return used[pos] ? &slots[pos].second : 0;
+    }
+
+    const Value* find(const Key& key) const
+    {
+        size_t pos = find_slot(key);
+        return used[pos] ? &slots[pos].second : 0;
+    }
+
+    /*!
+     * Remove the key.  Later entries of its probe run are shifted back
+     * so that lookups need no tombstones.  References to values are
+     * invalidated.
+     * \param key key to remove
+     * \return true if the key was in the map
+    */
+    bool erase(const Key& key)
+    {
+        size_t pos = find_slot(key);
+        if (!used[pos]) {
+            return false;
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t next = (pos + 1) & mask; used[next];
+                next = (next + 1) & mask) {
+            // move the entry unless its home slot lies after the hole
+            size_t home = hasher(slots[next].first) & mask;
+            if (((next - home) & mask) >= ((next - pos) & mask)) {
+                slots[pos] = slots[next];
+                pos = next;
+            }
+        }
+        used[pos] = 0;
+        slots[pos] = std::pair<Key, Value>();
+        --num_entries;
+        return true;
+    }
+
+    //! number of entries in the map
+    size_t size() const
+    {
+        return num_entries;
+    }
+
+    //! remove all entries (keeps the allocated table)
+    void clear()
+    {
+        std::fill(used.begin(), used.end(), 0);
+        num_entries = 0;
+    }
+
+    //! number of slots (for iterating with occupied, key_at, value_at)
+    size_t bucket_count() const
+    {
+        return slots.size();
+    }
+
+    //! true if the slot holds an entry
+    bool occupied(size_t slot) const
+    {
+        return used[slot] != 0;
+    }
+
+    //! key stored in an occupied slot
+    const Key& key_at(size_t slot) const
+    {
+        return slots[slot].first;
+    }
+
+    //! value stored in an occupied slot
+    Value& value_at(size_t slot)
+    {
+        return slots[slot].second;
+    }
+
+  private:
+    //! position of the key or of the empty slot where it belongs
+    size_t find_slot(const Key& key) const
+    {
+        size_t mask = slots.size() - 1;
+        size_t pos = hasher(key) & mask;
+        while (used[pos] && !(slots[pos].first == key)) {
+            pos = (pos + 1) & mask;
+        }
+        return pos;
+    }
+
+    void rehash(size_t capacity)
+    {
+        std::vector<std::pair<Key, Value> > old_slots(capacity);
+        std::vector<unsigned char> old_used(capacity, 0);
+        old_slots.swap(slots);
+        old_used.swap(used);
+        for (size_t i = 0; i < old_slots.size(); ++i) {
+            if (old_used[i]) {
+                size_t pos = find_slot(old_slots[i].first);
+                used[pos] = 1;
+                slots[pos] = old_slots[i];
+            }
+        }
+    }
+
+    std::vector<std::pair<Key, Value> > slots;
+    std::vector<unsigned char> used;
+    size_t num_entries;
+    Hash hasher;
+};
+
+}
+
+#endif
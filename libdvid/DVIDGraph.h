@@ -153,9 +153,10 @@ struct Edge {
             tid2 = edge.id1;
         }
        
-        // requires conversion to 32bit number 
-        boost::hash_combine(seed, std::size_t(edge.id1));
-        boost::hash_combine(seed, std::size_t(edge.id2));
+        // hash the canonical order so that equal edges hash the same
+        // (requires conversion to 32bit number)
+        boost::hash_combine(seed, std::size_t(tid1));
+        boost::hash_combine(seed, std::size_t(tid2));
         return seed;
     }
 };
@@ -191,6 +192,82 @@ size_t load_transactions_from_binary(std::string& data,
 */
 BinaryDataPtr write_transactions_to_binary(VertexTransactions& transactions); 
 
+/*!
+ * Serialize vertices and edges directly into a buffer using the
+ * labelgraph JSON format (same output as Graph::export_json) without
+ * building a JSON document.  Either list can be empty.
+ * \param vertices array of vertices
+ * \param num_vertices number of vertices in the array
+ * \param edges array of edges
+ * \param num_edges number of edges in the array
+ * \param buffer string that the JSON is appended to
+*/
+void write_graph_json(const Vertex* vertices, size_t num_vertices,
+        const Edge* edges, size_t num_edges, std::string& buffer);
+
+/*!
+ * Refers to a property stored inside a larger response buffer
+ * without copying it.  The buffer is kept alive by the view.
+ * A view without a buffer means that no property was returned.
+*/
+struct PropertyView {
+    PropertyView() : offset(0), length(0) {}
+
+    PropertyView(BinaryDataPtr buffer_, size_t offset_, size_t length_) :
+        buffer(buffer_), offset(offset_), length(length_) {}
+
+    //! pointer to the property bytes (0 if there is no property)
+    const unsigned char* data() const
+    {
+        return buffer ? (buffer->get_raw() + offset) : 0;
+    }
+
+    //! number of bytes in the property
+    size_t size() const
+    {
+        return length;
+    }
+
+    /*!
+     * Copy the property into its own binary.
+     * \return property (null if there is no property)
+    */
+    BinaryDataPtr copy() const
+    {
+        if (!buffer) {
+            return BinaryDataPtr();
+        }
+        return BinaryData::create_binary_data((const char*) data(), length);
+    }
+
+    //! buffer containing the property
+    BinaryDataPtr buffer;
+
+    //! location of the property in the buffer
+    size_t offset;
+
+    //! size of the property
+    size_t length;
+};
+
+/*!
+ * Describes a batch of a graph update that DVID rejected.  The
+ * batch covers elements [start, start+count) of the submitted list.
+*/
+struct GraphBatchError {
+    GraphBatchError(size_t start_, size_t count_, std::string message_) :
+        start(start_), count(count_), message(message_) {}
+
+    //! index of the first element in the batch
+    size_t start;
+
+    //! number of elements in the batch
+    size_t count;
+
+    //! error reported for the batch
+    std::string message;
+};
+
 /*!
  * Graph contains the vertices and edges in the DVID graph.
  * Only basic serialization and deserialization from JSON
@@ -220,6 +297,13 @@ struct Graph {
     */
     void export_json(Json::Value& data);
 
+    /*!
+     * Serialize labelgraph to a JSON string (format defined by DVID)
+     * without building a JSON document.
+     * \param buffer string that the JSON is appended to
+    */
+    void export_json(std::string& buffer) const;
+
     //! Vertices in the graph
     std::vector<Vertex> vertices;
 
@@ -0,0 +1,159 @@
+/*!
+ * This file provides a compressed sparse row (CSR) version of the
+ * labelgraph for answering neighborhood queries in memory.  Graphs
+ * retrieved from DVID (e.g., with get_subgraph) can be loaded and
+ * later results merged in.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDGRAPHCSR_H
+#define DVIDGRAPHCSR_H
+
+#include "DVIDGraph.h"
+#include "DVIDFlatHash.h"
+
+#include <vector>
+
+namespace libdvid {
+
+/*!
+ * Undirected graph stored in CSR form.  Vertex ids are mapped to dense
+ * indices (0..num_vertices()-1) which do not change when graphs are
+ * merged in.  Each edge is stored in the rows of both of its vertices;
+ * rows are sorted by neighbor index.  Weights are kept in separate
+ * arrays (structure of arrays).  Vertices only referenced by edges
+ * are added with a weight of 0.
+*/
+class GraphCSR {
+  public:
+    /*!
+     * Construct empty graph.
+    */
+    GraphCSR() : offsets(1, 0), edge_count(0) {}
+
+    /*!
+     * Build from a labelgraph.
+     * \param graph vertices and edges to load
+     * \param num_threads number of threads used for the build
+    */
+    explicit GraphCSR(const Graph& graph, int num_threads = 1);
+
+    /*!
+     * Merge vertices and edges into the graph.  Weights in graph
+     * replace the weights of existing vertices and edges.  If an edge
+     * is listed more than once, the last occurrence is used.
+     * \param graph vertices and edges to merge
+     * \param num_threads number of threads used for the merge
+    */
+    void merge(const Graph& graph, int num_threads = 1);
+
+    //! number of vertices
+    size_t num_vertices() const
+    {
+        return ids.size();
+    }
+
+    //! number of (undirected) edges
+    size_t num_edges() const
+    {
+        return edge_count;
+    }
+
+    /*!
+     * Find the dense index of a vertex.
+     * \param id vertex id
+     * \param index set to the dense index if found
+     * \return true if the vertex is in the graph
+    */
+    bool index_of(VertexID id, unsigned int& index) const;
+
+    /*!
+     * Number of neighbors of a vertex.
+     * \param id vertex id
+     * \return degree (0 if the vertex is not in the graph)
+    */
+    size_t degree(VertexID id) const;
+
+    /*!
+     * Neighbors of a vertex (ordered by dense index).
+     * \param id vertex id
+     * \param neighbors cleared and filled with the neighbor ids
+    */
+    void neighbors(VertexID id, std::vector<VertexID>& neighbors) const;
+
+    /*!
+     * Weight of a vertex.
+     * \param id vertex id
+     * \param weight set to the vertex weight if found
+     * \return true if the vertex is in the graph
+    */
+    bool vertex_weight(VertexID id, double& weight) const;
+
+    /*!
+     * Weight of an edge (the vertex order does not matter).
+     * \param id1 vertex id
+     * \param id2 vertex id
+     * \param weight set to the edge weight if found
+     * \return true if the edge is in the graph
+    */
+    bool edge_weight(VertexID id1, VertexID id2, double& weight) const;
+
+    /*!
+     * Export to the labelgraph format (each edge once, with the
+     * smaller dense index first).
+     * \param graph vertices and edges are appended to this graph
+    */
+    void export_graph(Graph& graph) const;
+
+    //! vertex id for each dense index
+    const std::vector<VertexID>& vertex_ids() const
+    {
+        return ids;
+    }
+
+    //! vertex weight for each dense index
+    const std::vector<double>& vertex_weights() const
+    {
+        return weights;
+    }
+
+    //! start of each row in the adjacency arrays (num_vertices()+1 entries)
+    const std::vector<size_t>& row_offsets() const
+    {
+        return offsets;
+    }
+
+    //! neighbor dense index for each adjacency entry
+    const std::vector<unsigned int>& adjacency() const
+    {
+        return neighbor_indices;
+    }
+
+    //! edge weight for each adjacency entry
+    const std::vector<double>& adjacency_weights() const
+    {
+        return edge_weights;
+    }
+
+  private:
+    //! dense index of a vertex (added with weight 0 if new)
+    unsigned int add_vertex(VertexID id);
+
+    //! position of the edge in the adjacency arrays (or npos)
+    size_t find_entry(unsigned int index1, unsigned int index2) const;
+
+    //! map from vertex id to dense index
+    FlatHashMap<VertexID, unsigned int, VertexIDHash> index_map;
+
+    std::vector<VertexID> ids;
+    std::vector<double> weights;
+    std::vector<size_t> offsets;
+    std::vector<unsigned int> neighbor_indices;
+    std::vector<double> edge_weights;
+    size_t edge_count;
+};
+
+}
+
+#endif
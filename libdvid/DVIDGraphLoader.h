@@ -0,0 +1,210 @@
+/*!
+ * This file provides bulk loading of labelgraphs.  Vertices and edges
+ * are streamed into pipelined uploads (GraphUploader) so that graphs
+ * much larger than memory can be loaded from local files.  Graph files
+ * are either the labelgraph JSON format or a compact binary edge list:
+ *
+ *  "DVIDGRF1" (8 bytes), number of vertices (uint64),
+ *  number of edges (uint64), vertices (uint64 id, double weight),
+ *  edges (uint64 id1, uint64 id2, double weight)
+ *
+ * All numbers are little-endian.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDGRAPHLOADER_H
+#define DVIDGRAPHLOADER_H
+
+#include "DVIDNodeService.h"
+#include "DVIDTaskPool.h"
+#include "DVIDGraph.h"
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <string>
+#include <vector>
+
+namespace libdvid {
+
+/*!
+ * Streams vertex and edge updates to a labelgraph.  Elements are
+ * collected into transactions that are serialized by the caller's thread
+ * and posted by a pool of threads.  The number of vertices per transaction
+ * is chosen by the service's graph batch sizer.  At most a few batches are waiting
+ * at any time, so adding elements blocks when DVID falls behind and
+ * memory use stays bounded.  Batches that share a vertex are never posted
+ * concurrently: a batch waits until the batches in flight that touch
+ * any of its vertices have finished.
+*/
+class GraphUploader {
+  public:
+    /*!
+     * Prepare uploads to the given labelgraph.
+     * \param service node service copied for each upload thread
+     * \param graph_name name of labelgraph instance
+     * \param num_threads number of batches sent concurrently
+    */
+    GraphUploader(DVIDNodeService& service, std::string graph_name,
+            int num_threads = 1);
+
+    /*!
+     * Create or increment the weight of vertices.
+     * \param vertices array of vertices
+     * \param num_vertices number of vertices in the array
+    */
+    void add_vertices(const Vertex* vertices, size_t num_vertices);
+
+    /*!
+     * Create or increment the weight of edges.  The vertices must
+     * already exist in DVID, so call flush after adding vertices.
+     * \param edges array of edges
+     * \param num_edges number of edges in the array
+    */
+    void add_edges(const Edge* edges, size_t num_edges);
+
+    /*!
+     * Send the partially filled batches and block until all
+     * batches are finished.
+    */
+    void flush();
+
+    //! vertex batches that failed (ordered by start)
+    const std::vector<GraphBatchError>& vertex_errors() const
+    {
+        return failed_vertices;
+    }
+
+    //! edge batches that failed (ordered by start)
+    const std::vector<GraphBatchError>& edge_errors() const
+    {
+        return failed_edges;
+    }
+
+    //! number of vertices added so far
+    size_t num_vertices() const
+    {
+        return vertex_count;
+    }
+
+    //! number of edges added so far
+    size_t num_edges() const
+    {
+        return edge_count;
+    }
+
+  private:
+    //! Disable copying
+    GraphUploader(const GraphUploader&);
+    GraphUploader& operator=(const GraphUploader&);
+
+    //! Serialize and submit the pending vertices
+    void send_vertices();
+
+    //! Serialize and submit the pending edges
+    void send_edges();
+
+    //! Wait until no batch in flight has one of the vertices, then claim them
+    void claim_vertices(const VertexSet& vertices);
+
+    //! Release the vertices of a finished batch (called by the upload threads)
+    void release_vertices(const VertexSet& vertices);
+
+    friend struct PostGraphBatch;
+
+    std::string endpoint;
+
+    //! vertices of the batches in flight (declared before the pool
+    //! so that they outlive its threads)
+    VertexSet busy_vertices;
+    boost::mutex busy_mutex;
+    boost::condition_variable vertices_released;
+
+    //! filled by the upload threads (declared before the pool
+    //! so that they outlive its threads)
+    std::vector<GraphBatchError> failed_vertices;
+    std::vector<GraphBatchError> failed_edges;
+    boost::mutex errors_mutex;
+
+    DVIDTaskPool pool;
+
+    //! elements waiting for a full batch
+    std::vector<Vertex> pending_vertices;
+    std::vector<Edge> pending_edges;
+    VertexSet pending_edge_vertices;
+
+    size_t vertex_count, edge_count;
+
+    //! adapts the number of vertices per batch
+    AdaptiveBatchSizerPtr sizer;
+    size_t batch_limit;
+};
+
+//! Receives vertices as they are read from a graph file
+typedef boost::function<void (const std::vector<Vertex>&)> VertexBatchHandler;
+
+//! Receives edges as they are read from a graph file
+typedef boost::function<void (const std::vector<Edge>&)> EdgeBatchHandler;
+
+/*!
+ * Read a graph file (JSON or binary) in chunks.  Each chunk of the JSON
+ * format is split at record boundaries and parsed by several threads.
+ * Records are passed to the handlers in file order; a section is
+ * skipped (without being decoded) if its handler is empty.
+ * \param filename name of the JSON or binary graph file
+ * \param vertex_handler called for each chunk of vertices
+ * \param edge_handler called for each chunk of edges
+ * \param num_threads number of threads parsing each chunk
+ * \param chunk_size number of bytes read at a time
+*/
+void read_graph_file(std::string filename, VertexBatchHandler vertex_handler,
+        EdgeBatchHandler edge_handler, int num_threads = 1,
+        size_t chunk_size = 64 << 20);
+
+/*!
+ * Read a whole graph file (JSON or binary) into memory.
+ * \param filename name of the JSON or binary graph file
+ * \param graph vertices and edges are appended to the graph
+ * \param num_threads number of threads parsing the file
+*/
+void read_graph_file(std::string filename, Graph& graph, int num_threads = 1);
+
+/*!
+ * Write a graph in the binary edge list format.
+ * \param filename name of the file written
+ * \param graph graph to write
+*/
+void write_graph_binary(std::string filename, const Graph& graph);
+
+//! Summary of a bulk graph load
+struct GraphLoadResult {
+    GraphLoadResult() : num_vertices(0), num_edges(0) {}
+
+    //! number of vertices and edges read from the file
+    size_t num_vertices, num_edges;
+
+    //! batches that DVID rejected (start is the position in the file)
+    std::vector<GraphBatchError> vertex_errors;
+    std::vector<GraphBatchError> edge_errors;
+};
+
+/*!
+ * Load a graph file (JSON or binary) into a labelgraph.  The file is
+ * read twice: once for the vertices and once for the edges, since
+ * DVID requires the vertices of an edge to exist.  Parsing and uploads
+ * run concurrently and only a few chunks are held in memory.
+ * \param service node service containing the labelgraph
+ * \param graph_name name of labelgraph instance
+ * \param filename name of the JSON or binary graph file
+ * \param num_threads number of parsing threads and concurrent uploads
+ * \param chunk_size number of bytes read at a time
+ * \return number of elements loaded and the failed batches
+*/
+GraphLoadResult load_graph_file(DVIDNodeService& service,
+        std::string graph_name, std::string filename, int num_threads = 4,
+        size_t chunk_size = 64 << 20);
+
+}
+
+#endif
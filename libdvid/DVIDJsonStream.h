@@ -0,0 +1,326 @@
+/*!
+ * This file provides light-weight helpers for writing and parsing the
+ * fixed-schema JSON documents exchanged with DVID.  Documents are
+ * written directly into a string buffer and parsed incrementally
+ * (SAX-style) as data arrives.  This avoids building a Json::Value
+ * document for large payloads.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDJSONSTREAM_H
+#define DVIDJSONSTREAM_H
+
+#include "Globals.h"
+#include "DVIDGraph.h"
+#include "DVIDRoi.h"
+
+#include <string>
+#include <vector>
+
+namespace libdvid {
+
+/*!
+ * Append a signed integer to the buffer.
+ * \param buffer string to append to
+ * \param value integer to write
+*/
+void json_append_int(std::string& buffer, int value);
+
+/*!
+ * Append an unsigned 64-bit integer to the buffer.
+ * \param buffer string to append to
+ * \param value integer to write
+*/
+void json_append_uint64(std::string& buffer, uint64 value);
+
+/*!
+ * Append a double to the buffer.  Integral values are written
+ * as integers; other values use the fewest significant digits
+ * (15 to 17) that read back as the same double.
+ * \param buffer string to append to
+ * \param value double to write
+*/
+void json_append_double(std::string& buffer, double value);
+
+/*!
+ * Append a quoted string to the buffer (quotes, backslashes and
+ * control characters are escaped).
+ * \param buffer string to append to
+ * \param value string to write
+*/
+void json_append_string(std::string& buffer, const std::string& value);
+
+/*!
+ * Convert JSON number text to an unsigned 64-bit integer.
+ * \param text number as written in the JSON
+ * \return integer value
+*/
+uint64 json_to_uint64(const std::string& text);
+
+/*!
+ * Convert JSON number text to an integer.
+ * \param text number as written in the JSON
+ * \return integer value
+*/
+int json_to_int(const std::string& text);
+
+/*!
+ * Convert JSON number text to a double.
+ * \param text number as written in the JSON
+ * \return double value
+*/
+double json_to_double(const std::string& text);
+
+/*!
+ * Receives the events produced by JsonStreamParser.  Numbers are
+ * passed as their JSON text so that handlers can choose the
+ * conversion (see json_to_uint64, json_to_double).  The default
+ * implementations ignore the event.
+*/
+class JsonHandler {
+  public:
+    virtual ~JsonHandler() {}
+    virtual void start_object() {}
+    virtual void end_object() {}
+    virtual void start_array() {}
+    virtual void end_array() {}
+    virtual void key(const std::string& name) {}
+    virtual void string_value(const std::string& value) {}
+    virtual void number_value(const std::string& text) {}
+    virtual void bool_value(bool value) {}
+    virtual void null_value() {}
+};
+
+/*!
+ * Incremental JSON parser.  Data can be fed in arbitrary pieces
+ * (e.g., as it is received from DVID) and events are sent to the handler
+ * as soon as each token is complete.  Only the current token is buffered.
+ * An ErrMsg is thrown for malformed JSON.
+*/
+class JsonStreamParser {
+  public:
+    /*!
+     * Create a parser that sends events to the handler.
+     * \param handler_ receives parsing events
+    */
+    explicit JsonStreamParser(JsonHandler& handler_);
+
+    /*!
+     * Parse the next piece of the document.
+     * \param data JSON text
+     * \param length number of bytes in data
+    */
+    void feed(const char* data, size_t length);
+
+    /*!
+     * Indicate that the document is complete.  Throws an error
+     * if the document is truncated.
+    */
+    void finish();
+
+  private:
+    //! What kind of token is expected next
+    enum Expect { EXPECT_VALUE, EXPECT_VALUE_OR_END, EXPECT_KEY,
+        EXPECT_KEY_OR_END, EXPECT_COLON, EXPECT_COMMA_OR_END, EXPECT_DONE };
+
+    //! Token currently being read
+    enum Token { TOKEN_NONE, TOKEN_STRING, TOKEN_ESCAPE, TOKEN_UNICODE,
+        TOKEN_NUMBER, TOKEN_LITERAL };
+
+    void finish_string();
+    void finish_number();
+    void finish_literal();
+    void finish_value();
+    void append_code_point(unsigned int code_point);
+    void structural(char c);
+
+    JsonHandler& handler;
+
+    //! containers currently open ('{' or '[')
+    std::vector<char> stack;
+
+    Expect expect;
+    Token token;
+
+    //! text of the current token
+    std::string token_text;
+
+    //! true if the current string is an object key
+    bool string_is_key;
+
+    //! \u escape being decoded
+    unsigned int unicode_value;
+    int unicode_digits;
+
+    //! pending high surrogate of a \u escape pair
+    unsigned int high_surrogate;
+};
+
+/*!
+ * Fills a graph from the labelgraph JSON format as it is parsed.
+ * Subclasses can override add_vertex and add_edge to consume the
+ * graph without storing it.
+*/
+class GraphJsonHandler : public JsonHandler {
+  public:
+    /*!
+     * Vertices and edges are appended to the graph.
+     * \param graph_ graph that is filled
+    */
+    explicit GraphJsonHandler(Graph& graph_);
+
+    void start_object();
+    void end_object();
+    void start_array();
+    void end_array();
+    void key(const std::string& name);
+    void number_value(const std::string& text);
+
+  protected:
+    //! Handle a parsed vertex (default: add to the graph)
+    virtual void add_vertex(const Vertex& vertex);
+
+    //! Handle a parsed edge (default: add to the graph)
+    virtual void add_edge(const Edge& edge);
+
+  private:
+    Graph& graph;
+    int depth;
+    enum Section { SECTION_NONE, SECTION_VERTICES, SECTION_EDGES };
+    Section section;
+    std::string current_key;
+    VertexID id1, id2;
+    double weight;
+};
+
+/*!
+ * Decodes the DVID ROI JSON format (array of [z, y, x0, x1] runs)
+ * into block coordinates or spans as it is parsed.  Blocks or spans
+ * are appended in the order of the runs.
+*/
+class RoiJsonHandler : public JsonHandler {
+  public:
+    /*!
+     * Blocks are appended to blockcoords.
+     * \param blockcoords_ vector of block coordinates that is filled
+    */
+    explicit RoiJsonHandler(std::vector<BlockXYZ>& blockcoords_);
+
+    /*!
+     * Runs are appended to spans without expanding them.
+     * \param spans_ vector of spans that is filled
+    */
+    explicit RoiJsonHandler(std::vector<BlockSpan>& spans_);
+
+    void start_array();
+    void end_array();
+    void number_value(const std::string& text);
+
+  protected:
+    /*!
+     * Handle a parsed run (default: add the span or expand
+     * it into blocks).
+     * \param z z block coordinate
+     * \param y y block coordinate
+     * \param x0 first x block coordinate
+     * \param x1 last x block coordinate (inclusive)
+    */
+    virtual void add_run(int z, int y, int x0, int x1);
+
+  private:
+    //! only one of these is set
+    std::vector<BlockXYZ>* blockcoords;
+    std::vector<BlockSpan>* spans;
+    int depth;
+    int run[4];
+    int run_pos;
+};
+
+/*!
+ * Decodes a JSON array of booleans (e.g., the result of an ROI point
+ * query) into a byte buffer (1 for true, 0 for false).
+*/
+class BoolArrayJsonHandler : public JsonHandler {
+  public:
+    /*!
+     * Values are written to values_ in order.
+     * \param values_ buffer that is filled
+     * \param max_values_ size of the buffer
+    */
+    BoolArrayJsonHandler(unsigned char* values_, size_t max_values_);
+
+    void bool_value(bool value);
+
+    //! number of values decoded
+    size_t num_values;
+
+  private:
+    unsigned char* values;
+    size_t max_values;
+};
+
+/*!
+ * Decodes a JSON array of strings (e.g., a DVID key listing).
+ * Subclasses can override add_string to consume the strings
+ * without storing them.
+*/
+class StringArrayJsonHandler : public JsonHandler {
+  public:
+    /*!
+     * Strings are appended to values.
+     * \param values_ vector of strings that is filled
+    */
+    explicit StringArrayJsonHandler(std::vector<std::string>& values_);
+
+    void string_value(const std::string& value);
+
+  protected:
+    //! Handle a parsed string (default: add to the vector)
+    virtual void add_string(const std::string& value);
+
+  private:
+    std::vector<std::string>& values;
+};
+
+/*!
+ * Decodes the DVID ROI partition JSON format into substacks
+ * as it is parsed.
+*/
+class PartitionJsonHandler : public JsonHandler {
+  public:
+    /*!
+     * Substacks are appended to substacks.
+     * \param substacks_ vector of substacks that is filled
+     * \param substack_size_ size of each substack in voxels
+    */
+    PartitionJsonHandler(std::vector<SubstackXYZ>& substacks_,
+            int substack_size_);
+
+    void start_object();
+    void end_object();
+    void start_array();
+    void end_array();
+    void key(const std::string& name);
+    void number_value(const std::string& text);
+
+    //! total number of blocks covered by the substacks
+    unsigned int total_blocks;
+
+    //! number of ROI blocks covered by the substacks
+    unsigned int active_blocks;
+
+  private:
+    std::vector<SubstackXYZ>& substacks;
+    int substack_size;
+    int depth;
+    bool in_subvolumes;
+    bool in_minpoint;
+    std::string current_key;
+    int point[3];
+    int point_pos;
+};
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*!
+ * This file defines types used for transferring many keys of a
+ * DVID keyvalue instance at once.  DVID's multi-key GET returns the
+ * keys and values as a tar archive (one file per key) and its
+ * multi-key POST takes them as a KeyValues protobuf message.  It also
+ * defines the tagged encoding of compressed values.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDKEYVALUE_H
+#define DVIDKEYVALUE_H
+
+#include "BinaryData.h"
+
+#include <boost/function.hpp>
+#include <string>
+#include <vector>
+
+namespace libdvid {
+
+/*!
+ * Outcome of one key of a multi-key get or put.
+*/
+struct KeyValueResult {
+    KeyValueResult() : status(0) {}
+
+    //! true if the key was transferred
+    bool ok() const
+    {
+        return status == 200;
+    }
+
+    //! http status for the key (0 if the request failed without one)
+    int status;
+
+    //! error message (empty on success)
+    std::string error;
+
+    //! value read from the key (only set by get_many on success)
+    BinaryDataPtr value;
+};
+
+//! Receives a page of keys from a key listing
+typedef boost::function<void (const std::vector<std::string>&)> KeyPageHandler;
+
+//! Receives a page of keys and their values from a key range scan
+typedef boost::function<void (const std::vector<std::string>&,
+        const std::vector<KeyValueResult>&)> KeyValuePageHandler;
+
+/*!
+ * Append keys and values to a buffer as a tar archive (one regular
+ * file per key, named by the key).  Keys longer than 100 characters
+ * use GNU long name entries.
+ * \param keys array of keys
+ * \param values array of values (one per key)
+ * \param num_keys number of keys
+ * \param buffer string that the archive is appended to
+*/
+void write_keyvalue_tar(const std::string* keys, const BinaryDataPtr* values,
+        size_t num_keys, std::string& buffer);
+
+/*!
+ * Decode the files of a tar archive into keys and values.  Long names
+ * given by GNU or PAX entries are supported; other entry types are
+ * skipped.  An ErrMsg is thrown for truncated or corrupt archives.
+ * \param data tar archive
+ * \param keys set to the file names
+ * \param values set to the file contents
+*/
+void read_keyvalue_tar(const std::string& data, std::vector<std::string>& keys,
+        std::vector<BinaryDataPtr>& values);
+
+/*!
+ * Append keys and values to a buffer as a KeyValues protobuf message
+ * (message KeyValue { string key = 1; bytes value = 2; } and
+ * message KeyValues { repeated KeyValue kvs = 1; }).
+ * \param keys array of keys
+ * \param values array of values (one per key, null for empty)
+ * \param num_keys number of keys
+ * \param buffer string that the message is appended to
+*/
+void write_keyvalue_protobuf(const std::string* keys,
+        const BinaryDataPtr* values, size_t num_keys, std::string& buffer);
+
+/*!
+ * Decode a KeyValues protobuf message into keys and values.  Unknown
+ * fields are skipped.  An ErrMsg is thrown for truncated or corrupt
+ * messages.
+ * \param data protobuf message
+ * \param keys set to the keys
+ * \param values set to the values
+*/
+void read_keyvalue_protobuf(const std::string& data,
+        std::vector<std::string>& keys, std::vector<BinaryDataPtr>& values);
+
+/*!
+ * Encode a value for storage with a small header that tags it as
+ * compressed (lz4).  Values smaller than min_size, or that do not
+ * shrink, are stored as is unless they could be mistaken for an
+ * encoded value (then they are tagged as uncompressed).
+ * \param value value to encode
+ * \param min_size smallest value that is compressed
+ * \return encoded value (value itself if it is stored as is)
+*/
+BinaryDataPtr encode_keyvalue(BinaryDataPtr value, size_t min_size);
+
+/*!
+ * Decode a value written by encode_keyvalue.  Values without the
+ * header are returned as is.  An ErrMsg is thrown for corrupt
+ * encoded values.
+ * \param value value read from DVID
+ * \return decoded value (value itself if it is not encoded)
+*/
+BinaryDataPtr decode_keyvalue(BinaryDataPtr value);
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*!
+ * This file provides a client-side cache for keyvalue reads.  Values of
+ * committed (locked) nodes cannot change, so they never expire; values
+ * of other nodes are reused for a limited time.  The cache is bounded
+ * by a byte budget.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDKEYVALUECACHE_H
+#define DVIDKEYVALUECACHE_H
+
+#include "BinaryData.h"
+#include "Globals.h"
+
+#include <json/json.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+namespace libdvid {
+
+//! Parsed JSON value shared by the cache and its readers
+typedef boost::shared_ptr<const Json::Value> JsonValuePtr;
+
+/*!
+ * Caches values by (uuid, instance, key) along with their parsed JSON
+ * (see DVIDNodeService::get_json).  Entries of locked nodes never
+ * expire; other entries are fresh for max_age seconds, so writes by
+ * other clients are seen after at most that delay.  Local writes
+ * invalidate their keys.  When the cached values exceed max_bytes, the
+ * least recently used entries are evicted.
+ *
+ * A value read before an invalidation is not stored after it (see
+ * generation), so a slow read cannot overwrite a local write.  The
+ * cache is thread safe and can be shared by several node services
+ * (see DVIDNodeService::set_keyvalue_cache).
+*/
+class KeyValueCache {
+  public:
+    /*!
+     * Create an empty cache.
+     * \param max_age_ seconds that values of unlocked nodes stay fresh
+     * \param max_bytes_ byte budget of the cached values
+    */
+    explicit KeyValueCache(double max_age_ = 10.0,
+            size_t max_bytes_ = 64 << 20);
+
+    /*!
+     * Find a fresh value.
+     * \param uuid node of the value
+     * \param instance name of keyvalue instance
+     * \param key name of key
+     * \param value set to the cached value (shared, must not be modified)
+     * \param json if not null, set to the parsed value (null if the
+     * value has not been parsed)
+     * \return true if a fresh value is cached
+    */
+    bool find(const std::string& uuid, const std::string& instance,
+            const std::string& key, BinaryDataPtr& value,
+            JsonValuePtr* json = 0);
+
+    /*!
+     * Store a value read from DVID.  The value is dropped if any key
+     * was invalidated since generation was read or if it is larger
+     * than the byte budget.
+     * \param generation result of generation() before the read
+    */
+    void store(const std::string& uuid, const std::string& instance,
+            const std::string& key, BinaryDataPtr value, uint64 generation);
+
+    /*!
+     * Attach the parsed JSON of a cached value (ignored if the entry
+     * no longer holds value).
+    */
+    void store_json(const std::string& uuid, const std::string& instance,
+            const std::string& key, BinaryDataPtr value, JsonValuePtr json);
+
+    /*!
+     * Remove a key (e.g., after it was written).
+    */
+    void invalidate(const std::string& uuid, const std::string& instance,
+            const std::string& key);
+
+    //! Mark a node as locked (its entries no longer expire)
+    void set_locked(const std::string& uuid);
+
+    //! Counter that changes whenever a key is invalidated
+    uint64 generation() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return current_generation;
+    }
+
+    //! Remove all entries
+    void clear();
+
+    //! bytes of cached values
+    size_t bytes() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return cached_bytes;
+    }
+
+    //! number of fresh lookups
+    size_t hits() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return num_hits;
+    }
+
+    //! number of lookups that required a fetch
+    size_t misses() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return num_misses;
+    }
+
+  private:
+    //! Cached value, its parsed JSON, when it was read and its
+    //! position in the LRU list
+    struct Entry {
+        BinaryDataPtr value;
+        JsonValuePtr json;
+        boost::posix_time::ptime read_time;
+        std::list<std::string>::iterator lru_position;
+    };
+
+    //! Map key for (uuid, instance, key)
+    static std::string entry_key(const std::string& uuid,
+            const std::string& instance, const std::string& key);
+
+    //! Remove an entry (mutex held)
+    void remove(std::map<std::string, Entry>::iterator iter);
+
+    boost::posix_time::time_duration max_age;
+    size_t max_bytes;
+
+    mutable boost::mutex mutex;
+    std::map<std::string, Entry> entries;
+    std::list<std::string> lru;
+    size_t cached_bytes;
+    std::set<std::string> locked_nodes;
+    uint64 current_generation;
+    size_t num_hits, num_misses;
+};
+
+//! Keyvalue caches are shared between node services
+typedef boost::shared_ptr<KeyValueCache> KeyValueCachePtr;
+
+}
+
+#endif
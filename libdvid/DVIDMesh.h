@@ -0,0 +1,106 @@
+/*!
+ * This file provides functionality for building triangle meshes
+ * of bodies from DVID label blocks.  Meshes are built on the client
+ * one block at a time (in parallel) and stitched together so that the
+ * resulting surface is closed.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDMESH_H
+#define DVIDMESH_H
+
+#include "DVIDNodeService.h"
+
+#include <vector>
+#include <string>
+
+namespace libdvid {
+
+/*!
+ * Indexed triangle mesh.  Vertices are in voxel coordinates.
+ * The binary export writes the number of vertices and triangles
+ * (uint32 each) followed by the vertex positions (3 float32 each) and
+ * the triangle vertex indices (3 uint32 each), all little endian.
+*/
+struct Mesh {
+    /*!
+     * Construct empty mesh.
+    */
+    Mesh() {}
+
+    /*!
+     * Deserialize a mesh written by export_binary.
+     * \param binary mesh in the compact binary format
+    */
+    explicit Mesh(BinaryDataPtr binary);
+
+    /*!
+     * Serialize the mesh to the compact binary format.
+     * \return binary mesh
+    */
+    BinaryDataPtr export_binary() const;
+
+    //! number of vertices in the mesh
+    size_t num_vertices() const
+    {
+        return vertices.size() / 3;
+    }
+
+    //! number of triangles in the mesh
+    size_t num_triangles() const
+    {
+        return triangles.size() / 3;
+    }
+
+    //! vertex positions (x,y,z for each vertex)
+    std::vector<float> vertices;
+
+    //! triangle vertex indices (3 for each triangle, counter-clockwise
+    //! when viewed from outside)
+    std::vector<unsigned int> triangles;
+};
+
+/*!
+ * Builds a closed surface mesh around the voxels set in a list of
+ * block masks.  Each block is meshed independently (spread across
+ * the threads) by splitting every voxel cube into six tetrahedra along
+ * the same diagonal, which avoids the ambiguous cases of classic
+ * marching cubes.  Vertices lie halfway between inside and outside
+ * voxels and are welded across block boundaries.  Voxels in blocks
+ * that are not listed are treated as outside.
+ * \param blockcoords block location of each mask
+ * \param masks DEFBLOCKSIZE^3 byte masks (non-zero inside) in X, Y, Z order
+ * \param num_threads number of threads used to mesh blocks
+ * \return mesh of the masked region
+*/
+Mesh generate_mesh(const std::vector<BlockXYZ>& blockcoords,
+        const std::vector<BinaryDataPtr>& masks, int num_threads = 1);
+
+/*!
+ * Simplifies a mesh by clustering vertices on a regular grid.
+ * All vertices in a grid cell are replaced by their average and
+ * triangles that collapse are removed.
+ * \param mesh mesh to simplify (modified in place)
+ * \param cluster_size size of a grid cell in voxels
+*/
+void simplify_mesh(Mesh& mesh, float cluster_size);
+
+/*!
+ * Builds a mesh for a body.  The coarse body determines which label
+ * blocks are fetched (in parallel) and meshed (see generate_mesh).
+ * \param service name of dvid node service
+ * \param labelvol_name name of label volume with body id
+ * \param labels_name name of labelblk instance synced with the label volume
+ * \param bodyid body to mesh
+ * \param num_threads number of threads used to fetch and mesh blocks
+ * \param simplify_size cluster size for simplify_mesh (0 for no simplification)
+ * \return mesh of the body
+*/
+Mesh generate_body_mesh(DVIDNodeService& service, std::string labelvol_name,
+        std::string labels_name, uint64 bodyid, int num_threads = 1,
+        float simplify_size = 0);
+
+}
+
+#endif
@@ -19,9 +19,14 @@
 #include "DVIDConnection.h"
 #include "DVIDBlocks.h"
 #include "DVIDRoi.h"
+#include "DVIDPropertyCache.h"
+#include "DVIDKeyValueCache.h"
+#include "DVIDBatchSizer.h"
+#include "DVIDKeyValue.h"
 
 #include <json/value.h>
 #include <vector>
+#include <algorithm>
 #include <fstream>
 #include <string>
 
@@ -33,6 +38,9 @@ typedef std::string UUID;
 //! Used to define the relevant orthogonal cut-plane
 enum Slice2D { XY, XZ, YZ };
 
+//! Receives streamed JSON parsing events (see DVIDJsonStream.h)
+class JsonHandler;
+
 
 /*!
  * Class that helps access different DVID version node actions.
@@ -55,10 +63,22 @@ class DVIDNodeService {
      * \param endpoint REST endpoint given the node's uuid
      * \param payload binary data to be sent in the request
      * \param method http verb (GET, PUT, POST, DELETE)
+     * \param type content type of the payload (default: binary)
      * \return http response as binary data
     */
     BinaryDataPtr custom_request(std::string endpoint, BinaryDataPtr payload,
-            ConnectionMethod method);
+            ConnectionMethod method, ConnectionType type = BINARY);
+
+    /*!
+     * Custom http request where the JSON response is parsed as it
+     * is downloaded (see JsonStreamParser) instead of being buffered.
+     * \param endpoint REST endpoint given the node's uuid
+     * \param payload binary data to be sent in the request
+     * \param method http verb (GET, PUT, POST, DELETE)
+     * \param handler receives the JSON parsing events
+    */
+    void custom_request(std::string endpoint, BinaryDataPtr payload,
+            ConnectionMethod method, JsonHandler& handler);
 
     /*!
      * Retrieves meta data for a given datatype instance
@@ -365,13 +385,42 @@ class DVIDNodeService {
     
     /*!
      * Put data in a file at a given key location.  It will overwrite
-     * data that exists at the key for the given node version.
+     * data that exists at the key for the given node version.  The
+     * file is streamed (see put_stream) unless keyvalue compression is
+     * enabled, in which case it is read into memory and compressed.
      * \param keyvalue name of keyvalue instance
      * \param key name of key to the keyvalue instance
      * \param fin file stream that contains binary to store
     */
     void put(std::string keyvalue, std::string key, std::ifstream& fin);
 
+    /*!
+     * Put a value that is read from a callback as it is uploaded, so
+     * that large values never have to fit in memory.  If the size is not
+     * known, the value is sent with chunked transfer encoding.
+     * \param keyvalue name of keyvalue instance
+     * \param key name of key to the keyvalue instance
+     * \param source fills a buffer with the next piece of the value
+     * (returns 0 at the end)
+     * \param progress called with the bytes uploaded and the total
+     * \param size size of the value (-1 if not known)
+    */
+    void put_stream(std::string keyvalue, std::string key,
+            RequestSource source, TransferProgress progress = TransferProgress(),
+            int64 size = -1);
+
+    /*!
+     * Put the rest of an input stream (e.g., a large file) as a value
+     * without reading it into memory.  The size is sent if the stream
+     * is seekable.
+     * \param keyvalue name of keyvalue instance
+     * \param key name of key to the keyvalue instance
+     * \param in stream containing the value
+     * \param progress called with the bytes uploaded and the total
+    */
+    void put_stream(std::string keyvalue, std::string key, std::istream& in,
+            TransferProgress progress = TransferProgress());
+
     /*!
      * Put JSON data at a given key location.  It will overwrite data
      * that exists at the key for the given node version.
@@ -391,12 +440,176 @@ class DVIDNodeService {
     // could return a reference but assuming that this is used for short messages
     
     /*!
-     * Retrieve json of data at a given key location.
+     * Retrieve a value in pieces as it is downloaded, so that large
+     * values never have to fit in memory.  The keyvalue cache is not
+     * used.
+     * \param keyvalue name of keyvalue instance
+     * \param key name of key to the keyvalue instance
+     * \param sink receives each piece of the value
+     * \param progress called with the bytes downloaded and the total
+     * (0 if the server does not report it)
+    */
+    void get_stream(std::string keyvalue, std::string key,
+            ResponseCallback sink, TransferProgress progress = TransferProgress());
+
+    /*!
+     * Write a value to an output stream (e.g., a file) as it is
+     * downloaded (see get_stream).
+     * \param keyvalue name of keyvalue instance
+     * \param key name of key to the keyvalue instance
+     * \param out stream the value is written to
+     * \param progress called with the bytes downloaded and the total
+    */
+    void get_stream(std::string keyvalue, std::string key, std::ostream& out,
+            TransferProgress progress = TransferProgress());
+
+    /*!
+     * Retrieve json of data at a given key location.  With a keyvalue
+     * cache, the parsed JSON is cached along with the value.
      * \param keyvalue name of keyvalue instance
      * \param key name of key to the keyvalue instance
      * \return json stored at key
     */
     Json::Value get_json(std::string keyvalue, std::string key);
+
+    /*!
+     * Attach a cache used by get and get_json.  Keys written with put
+     * or put_many are invalidated.  If the node is locked, its cached
+     * values never expire.  Copies of this service share the cache.
+     * \param cache keyvalue cache (null to disable caching)
+    */
+    void set_keyvalue_cache(KeyValueCachePtr cache);
+
+    //! Get the attached keyvalue cache (null if there is none)
+    KeyValueCachePtr get_keyvalue_cache() const
+    {
+        return keyvalue_cache;
+    }
+
+    /*!
+     * Compress values written with put and put_many (lz4 with a
+     * small header).  Values read with get, get_json and get_many are
+     * decompressed automatically whether or not compression is
+     * enabled.  Files written with put are also compressed (they are
+     * then read into memory rather than streamed).  Streamed values
+     * (put_stream, get_stream) are transferred as is.
+     * \param enable true to compress values
+     * \param min_size values smaller than this are not compressed
+    */
+    void set_keyvalue_compression(bool enable, size_t min_size = 256)
+    {
+        keyvalue_compress_size = enable ? std::max(min_size, size_t(1)) : 0;
+    }
+
+    //! Smallest value that is compressed (0 if compression is disabled)
+    size_t get_keyvalue_compression() const
+    {
+        return keyvalue_compress_size;
+    }
+
+    /*!
+     * Check whether the node is committed (locked).  The data of
+     * a locked node cannot change.
+     * \return true if the node is locked
+    */
+    bool is_locked();
+
+    /*!
+     * Retrieve the values of many keys.  Keys are requested in batches
+     * with DVID's multi-key endpoint (tar archives) and num_threads
+     * batches are in flight at once, each on its own connection.  If the
+     * server rejects the endpoint as unsupported (400, 404 or 405), later
+     * batches use single-key requests.  Keys of a batch that failed for
+     * another reason, or that are missing from the archive, are
+     * requested individually.  Errors are reported per key rather
+     * than thrown.
+     * \param keyvalue name of keyvalue instance
+     * \param keys keys to retrieve
+     * \param results set to the value and status of each key (in order)
+     * \param num_threads number of requests in flight
+     * \param max_keys_per_request max keys in one batch
+    */
+    void get_many(std::string keyvalue, const std::vector<std::string>& keys,
+            std::vector<KeyValueResult>& results, int num_threads = 1,
+            size_t max_keys_per_request = 1000);
+
+    /*!
+     * Put the values of many keys (see get_many).  Batches are sent
+     * as KeyValues protobuf messages and are also limited to about
+     * 32 MB of values.
+     * \param keyvalue name of keyvalue instance
+     * \param keys keys to store
+     * \param values value of each key
+     * \param results set to the status of each key (in order)
+     * \param num_threads number of requests in flight
+     * \param max_keys_per_request max keys in one batch
+    */
+    void put_many(std::string keyvalue, const std::vector<std::string>& keys,
+            const std::vector<BinaryDataPtr>& values,
+            std::vector<KeyValueResult>& results, int num_threads = 1,
+            size_t max_keys_per_request = 1000);
+    
+    /*!
+     * List the keys of a keyvalue instance.  The listing is parsed as
+     * it is downloaded and passed to the handler in pages, so the
+     * whole listing is never held in memory.  Listings are only timed
+     * out when the transfer stalls (a handler that blocks for longer
+     * than that also aborts the listing).
+     * \param keyvalue name of keyvalue instance
+     * \param handler called with each page of keys (in order)
+     * \param page_size max keys in one page
+    */
+    void get_keys(std::string keyvalue, KeyPageHandler handler,
+            size_t page_size = 10000);
+
+    /*!
+     * List the keys of a keyvalue instance.
+     * \param keyvalue name of keyvalue instance
+     * \param keys set to the keys
+    */
+    void get_keys(std::string keyvalue, std::vector<std::string>& keys);
+
+    /*!
+     * List the keys between key1 and key2 (inclusive, in key order).
+     * The listing is streamed in pages as in get_keys.
+     * \param keyvalue name of keyvalue instance
+     * \param key1 first key of the range
+     * \param key2 last key of the range
+     * \param handler called with each page of keys (in order)
+     * \param page_size max keys in one page
+    */
+    void get_keyrange(std::string keyvalue, std::string key1,
+            std::string key2, KeyPageHandler handler,
+            size_t page_size = 10000);
+
+    /*!
+     * List the keys between key1 and key2 (inclusive, in key order).
+     * \param keyvalue name of keyvalue instance
+     * \param key1 first key of the range
+     * \param key2 last key of the range
+     * \param keys set to the keys
+    */
+    void get_keyrange(std::string keyvalue, std::string key1,
+            std::string key2, std::vector<std::string>& keys);
+
+    /*!
+     * Visit the keys and values between key1 and key2.  The keys are
+     * listed first (only the keys are held in memory); then the values
+     * of each page are fetched with get_many on num_threads separate
+     * connections.  Pages are passed to the handler in key order, one
+     * call at a time; at most a few pages of values per thread are held
+     * in memory.  No request is held open while the handler runs, so
+     * slow handlers and long scans are not timed out.
+     * \param keyvalue name of keyvalue instance
+     * \param key1 first key of the range
+     * \param key2 last key of the range
+     * \param handler called with each page of keys and values
+     * \param num_threads number of pages fetched concurrently
+     * \param page_size max keys in one page (and one value request)
+    */
+    void scan_keyrange(std::string keyvalue, std::string key1,
+            std::string key2, KeyValuePageHandler handler,
+            int num_threads = 1, size_t page_size = 1000);
     
     /************** API to access labelgraph interface **************/
    
@@ -421,16 +634,51 @@ class DVIDNodeService {
     void get_vertex_neighbors(std::string graph_name, Vertex vertex,
             Graph& graph);
 
+    /*!
+     * Breadth-first expansion from a set of seed vertices.  The
+     * neighbors of every vertex in the current frontier are requested
+     * concurrently; vertices already visited are not requested again.
+     * The graph contains the vertices within num_hops of a seed and
+     * the edges of the vertices within num_hops - 1 (each edge once).
+     * With 0 hops, the subgraph induced by the seeds is returned.
+     * \param graph_name name of labelgraph instance
+     * \param seeds vertices to start from
+     * \param num_hops number of hops from the seeds
+     * \param graph vertices and edges found are added to the graph
+     * (those already in it are not added again)
+     * \param num_threads number of neighbor requests sent concurrently
+    */
+    void get_neighborhood(std::string graph_name,
+            const std::vector<Vertex>& seeds, int num_hops, Graph& graph,
+            int num_threads = 1);
+
     /*!
      * Add the provided vertices to the labelgraph with the associated
      * vertex weights.  If the vertex already exists, it will increment
      * the vertex weight by the weight specified.  This function
      * can be used for creation and incrementing vertex weights in parallel.
+     * Vertices are sent in batches; the next batch is serialized while
+     * earlier ones are in flight and several batches can be sent
+     * concurrently.  An error is thrown after all batches finish if
+     * any batch failed.
      * \param graph_name name of labelgraph instance
      * \param vertices list of vertices to create or update
+     * \param num_threads number of batches sent concurrently
     */ 
     void update_vertices(std::string graph_name,
-            const std::vector<Vertex>& vertices);
+            const std::vector<Vertex>& vertices, int num_threads = 1);
+
+    /*!
+     * Same as update_vertices but reports the batches that failed
+     * instead of throwing an error.
+     * \param graph_name name of labelgraph instance
+     * \param vertices list of vertices to create or update
+     * \param num_threads number of batches sent concurrently
+     * \param failed_batches batches that failed (ordered by start)
+    */ 
+    void update_vertices(std::string graph_name,
+            const std::vector<Vertex>& vertices, int num_threads,
+            std::vector<GraphBatchError>& failed_batches);
     
     /*!
      * Add the provided edges to the labelgraph with the associated
@@ -439,11 +687,26 @@ class DVIDNodeService {
      * can be used for creation and incrementing edge weights in parallel.
      * The command will fail if the vertices for the given edges
      * were not created first.
+     * Edges are sent in batches as in update_vertices; batches that
+     * share a vertex are not sent concurrently.
      * \param graph_name name of labelgraph instance
-     * \param vertices list of vertices to create or update
+     * \param edges list of edges to create or update
+     * \param num_threads number of batches sent concurrently
+    */ 
+    void update_edges(std::string graph_name,
+            const std::vector<Edge>& edges, int num_threads = 1);
+
+    /*!
+     * Same as update_edges but reports the batches that failed
+     * instead of throwing an error.
+     * \param graph_name name of labelgraph instance
+     * \param edges list of edges to create or update
+     * \param num_threads number of batches sent concurrently
+     * \param failed_batches batches that failed (ordered by start)
     */ 
     void update_edges(std::string graph_name,
-            const std::vector<Edge>& edges);
+            const std::vector<Edge>& edges, int num_threads,
+            std::vector<GraphBatchError>& failed_batches);
 
     /*!
      * Retrieve properties associated with a list of vertices.  Binary
@@ -452,16 +715,34 @@ class DVIDNodeService {
      * These transaction IDs must be used when one wants to update
      * a property.  It ensures that the property was not modified
      * by another client.
+     * Batches of vertices are requested concurrently and vertices
+     * whose transaction failed are retried in later batches.
      * \param graph_name name of labelgraph instance
      * \param vertices properties are retrieved for these vertices
      * \param key name of property
      * \param properties properties corresponding to the vertex list
      * \param transactions returns transaction ids for all vertices
+     * \param num_threads number of batches requested concurrently
     */
     void get_properties(std::string graph_name,
             std::vector<Vertex> vertices, std::string key,
             std::vector<BinaryDataPtr>& properties,
-            VertexTransactions& transactions);
+            VertexTransactions& transactions, int num_threads = 1);
+
+    /*!
+     * Same as get_properties but returns views into the response
+     * buffers instead of copying each property.
+     * \param graph_name name of labelgraph instance
+     * \param vertices properties are retrieved for these vertices
+     * \param key name of property
+     * \param properties properties corresponding to the vertex list
+     * \param transactions returns transaction ids for all vertices
+     * \param num_threads number of batches requested concurrently
+    */
+    void get_properties(std::string graph_name,
+            const std::vector<Vertex>& vertices, std::string key,
+            std::vector<PropertyView>& properties,
+            VertexTransactions& transactions, int num_threads = 1);
 
     /*!
      * Retrieve properties associated with a list of edges.  Binary
@@ -476,10 +757,25 @@ class DVIDNodeService {
      * \param key name of property
      * \param properties properties corresponding to the edge list
      * \param transactions returns transaction ids for all edge vertices
+     * \param num_threads number of batches requested concurrently
     */
     void get_properties(std::string graph_name, std::vector<Edge> edges,
             std::string key, std::vector<BinaryDataPtr>& properties,
-            VertexTransactions& transactions);
+            VertexTransactions& transactions, int num_threads = 1);
+
+    /*!
+     * Same as get_properties but returns views into the response
+     * buffers instead of copying each property.
+     * \param graph_name name of labelgraph instance
+     * \param edges properties are retrieved for these edges
+     * \param key name of property
+     * \param properties properties corresponding to the edge list
+     * \param transactions returns transaction ids for all edge vertices
+     * \param num_threads number of batches requested concurrently
+    */
+    void get_properties(std::string graph_name, const std::vector<Edge>& edges,
+            std::string key, std::vector<PropertyView>& properties,
+            VertexTransactions& transactions, int num_threads = 1);
 
     /*!
      * Set properties as binary blobs for a list of vertices.
@@ -492,12 +788,13 @@ class DVIDNodeService {
      * \param properties binary blobs to be set
      * \param transaction specify transactions for set call
      * \param leftover_vertices vertices that could not be written
+     * \param num_threads number of batches written concurrently
     */
     void set_properties(std::string graph_name,
             std::vector<Vertex>& vertices, std::string key,
             std::vector<BinaryDataPtr>& properties,
             VertexTransactions& transactions,
-            std::vector<Vertex>& leftover_vertices);
+            std::vector<Vertex>& leftover_vertices, int num_threads = 1);
 
     /*!
      * Set properties as binary blobs for a list of edges.
@@ -510,21 +807,74 @@ class DVIDNodeService {
      * \param key name of property
      * \param properties binary blobs to be set
      * \param transaction specify transactions for set call
-     * \param leftover_vertices vertices that could not be written
+     * \param leftover_edges edges that could not be written
+     * \param num_threads number of batches written concurrently
     */
     void set_properties(std::string graph_name,
             std::vector<Edge>& edges, std::string key,
             std::vector<BinaryDataPtr>& properties,
             VertexTransactions& transactions,
-            std::vector<Edge>& leftover_edges);
+            std::vector<Edge>& leftover_edges, int num_threads = 1);
+
+    /*!
+     * Attach a property cache used by get_properties and
+     * set_properties.  Only properties that are missing or whose
+     * transaction ids are out of date are fetched.  Copies of this
+     * service share the cache.
+     * \param cache property cache (null to disable caching)
+    */
+    void set_property_cache(PropertyCachePtr cache)
+    {
+        property_cache = cache;
+    }
+
+    //! Get the attached property cache (null if there is none)
+    PropertyCachePtr get_property_cache() const
+    {
+        return property_cache;
+    }
+
+    /*!
+     * Set the batch sizer used to split update_vertices and
+     * update_edges into transactions.  The batch size adapts to the
+     * observed latency and payload size.  Copies of this service share
+     * the sizer.
+     * \param sizer adaptive batch sizer (must not be null)
+    */
+    void set_graph_batch_sizer(AdaptiveBatchSizerPtr sizer)
+    {
+        graph_batch_sizer = sizer;
+    }
+
+    //! Get the batch sizer used for graph updates
+    AdaptiveBatchSizerPtr get_graph_batch_sizer() const
+    {
+        return graph_batch_sizer;
+    }
+
+    /*!
+     * Set the batch sizer used to split get_properties and
+     * set_properties into transactions.  Besides latency and payload
+     * size, the batch size shrinks when many transactions fail.
+     * Copies of this service share the sizer.
+     * \param sizer adaptive batch sizer (must not be null)
+    */
+    void set_property_batch_sizer(AdaptiveBatchSizerPtr sizer)
+    {
+        property_batch_sizer = sizer;
+    }
+
+    //! Get the batch sizer used for property transactions
+    AdaptiveBatchSizerPtr get_property_batch_sizer() const
+    {
+        return property_batch_sizer;
+    }
     
     /************** API to access ROI interface **************/
-    // Currently, there is no API to work directly on the RLE
-    // encoded blocks.  This might lead to excessive memory use
-    // and runtime for some use cases.  Furthermore, this API
-    // handles block and substack ordering (regardless of whether
-    // it is necessary or whether it is already sorted).  This
-    // might lead to some runtime inefficiencies.
+    // ROIs are transferred as run-length spans (see BlockSpan).
+    // The block interfaces encode or expand the spans in linear
+    // time when the blocks are ordered; large ROIs should use the
+    // span interfaces to avoid expanding them.
 
     /*!
      * Load an ROI defined by a list of blocks.  This command
@@ -536,6 +886,14 @@ class DVIDNodeService {
     */
     void post_roi(std::string roi_name,
             const std::vector<BlockXYZ>& blockcoords);
+
+    /*!
+     * Load an ROI defined by runs of blocks.  The spans can be
+     * provided in any order and may overlap.
+     * \param roi_name name of the roi instance
+     * \param spans runs of blocks
+    */
+    void post_roi(std::string roi_name, const std::vector<BlockSpan>& spans);
    
     /*!
      * Retrieve an ROI and store in a vector of block coordinates.
@@ -545,6 +903,15 @@ class DVIDNodeService {
     */
     void get_roi(std::string roi_name,
             std::vector<BlockXYZ>& blockcoords);
+
+    /*!
+     * Retrieve an ROI as runs of blocks without expanding them.
+     * The spans are in canonical order (see normalize_spans) and
+     * can be used to build an ROIIndex for local queries.
+     * \param roi_name name of the roi instance
+     * \param spans vector of spans covering the ROI
+    */
+    void get_roi(std::string roi_name, std::vector<BlockSpan>& spans);
     
     /*!
      * Retrieve a partition of the ROI covered by substacks
@@ -558,17 +925,38 @@ class DVIDNodeService {
     double get_roi_partition(std::string roi_name,
             std::vector<SubstackXYZ>& substacks, unsigned int partition_size);
 
+    /*!
+     * Retrieve a partition of the ROI computed locally from its spans
+     * where each subvolume has a similar number of ROI blocks
+     * (see partition_roi).
+     * \param roi_name name of the roi instance
+     * \param subvolumes subvolumes that cover the ROI
+     * \param max_active_blocks maximum number of ROI blocks in a subvolume
+     * \param method partitioning strategy (default: k-d splits)
+     * \return fraction of subvolume volume that cover blocks (packing factor)
+    */
+    double get_roi_partition(std::string roi_name,
+            std::vector<ROISubvolume>& subvolumes, uint64 max_active_blocks,
+            PartitionMethod method = KDTreePartition);
+
     /*!
      * Check whether a list of points (any order) exists in
      * the given ROI.  A vector of true and false has the same order
-     * as the list of points.
+     * as the list of points.  Large lists are split into requests of
+     * at most max_points_per_request points that are sent concurrently.
+     * (ROIIndex answers the same query without contacting DVID.)
      * \param roi_name name of the roi instance
      * \param points list of X,Y,Z points
      * \param inroi list of true/false on whether points are in the ROI
+     * \param num_threads number of requests sent at the same time
+     * \param max_points_per_request max points in one request
+     * \param encoding payload encoding (binary falls back to JSON)
     */
     void roi_ptquery(std::string roi_name,
             const std::vector<PointXYZ>& points,
-            std::vector<bool>& inroi);
+            std::vector<bool>& inroi, int num_threads = 1,
+            size_t max_points_per_request = 100000,
+            PointEncoding encoding = JSONPointEncoding);
 
     /************** API to access sparse body interface **************/
     // The current functionality is working over the coarse volume
@@ -615,6 +1003,36 @@ class DVIDNodeService {
     //! uuid for instance
     const UUID uuid;
 
+    //! cache for labelgraph properties (optional)
+    PropertyCachePtr property_cache;
+
+    //! cache for keyvalue reads (optional)
+    KeyValueCachePtr keyvalue_cache;
+
+    //! smallest keyvalue value that is compressed (0 to disable)
+    size_t keyvalue_compress_size;
+
+    //! batch sizes for graph updates and property transactions
+    AdaptiveBatchSizerPtr graph_batch_sizer;
+    AdaptiveBatchSizerPtr property_batch_sizer;
+
+    /*!
+     * Helper to stream a JSON listing to a handler.  Only stalls are
+     * timed out since long listings can take arbitrarily long.
+     * \param endpoint endpoint relative to the node
+     * \param handler receives the parsing events
+    */
+    void list_json(std::string endpoint, JsonHandler& handler);
+
+    /*!
+     * Helper to stream a key listing to a handler in pages.
+     * \param endpoint endpoint relative to the node
+     * \param handler called with each page of keys
+     * \param page_size max keys in one page
+    */
+    void list_keys(std::string endpoint, KeyPageHandler handler,
+            size_t page_size);
+
     /*!
      * Helper function to put a 3D volume to DVID with the specified
      * dimension and spatial offset.  THE DIMENSION AND OFFSET ARE
@@ -640,6 +1058,25 @@ class DVIDNodeService {
     BinaryDataPtr get_blocks(std::string datatype_instance,
         std::vector<int> block_coords, int span);
 
+    /*!
+     * Helper to read and decode a value (without the cache).
+     * \param keyvalue name of keyvalue instance
+     * \param key name of key to the keyvalue instance
+     * \return value stored at key
+    */
+    BinaryDataPtr fetch_value(std::string keyvalue, std::string key);
+
+    /*!
+     * Helper to read a key through the keyvalue cache (which must be
+     * set).  The returned value is shared with the cache.
+     * \param keyvalue name of keyvalue instance
+     * \param key name of key to the keyvalue instance
+     * \param json set to the cached parsed value (null if not parsed)
+     * \return value stored at key
+    */
+    BinaryDataPtr get_cached(std::string keyvalue, std::string key,
+            JsonValuePtr* json = 0);
+
     /*!
      * Helper to put blocks from DVID for labels and grayscale.
      * \param datatype_instance name of datatype instance
@@ -0,0 +1,40 @@
+/*!
+ * This file provides helpers for splitting in-memory work
+ * (e.g., over graph edges or voxels) across threads.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDPARALLEL_H
+#define DVIDPARALLEL_H
+
+#include <boost/function.hpp>
+#include <cstddef>
+
+namespace libdvid {
+
+//! Processes items [begin, end) on the given thread
+typedef boost::function<void (size_t, size_t, int)> RangeBody;
+
+/*!
+ * Splits [0, num_items) into one contiguous range per thread and
+ * runs the body on each range.  Returns when all ranges are done.
+ * \param num_items number of items
+ * \param num_threads number of threads (runs inline if 1 or less)
+ * \param body called with the range and the thread number
+*/
+void parallel_ranges(size_t num_items, int num_threads, RangeBody body);
+
+/*!
+ * Limit the threads so that each has a reasonable amount of work.
+ * \param num_items number of items
+ * \param num_threads maximum number of threads
+ * \param min_items_per_thread smallest amount of work for a thread
+ * \return number of threads to use (at least 1)
+*/
+int threads_for(size_t num_items, int num_threads,
+        size_t min_items_per_thread = 4096);
+
+}
+
+#endif
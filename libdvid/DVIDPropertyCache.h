@@ -0,0 +1,206 @@
+/*!
+ * This file provides a client-side cache for labelgraph properties.
+ * Cached properties are only used while the transaction id DVID last
+ * reported for their vertices matches the id the property was read
+ * (or written) with.  The cache is bounded by a byte budget.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDPROPERTYCACHE_H
+#define DVIDPROPERTYCACHE_H
+
+#include "DVIDGraph.h"
+#include "DVIDFlatHash.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+namespace libdvid {
+
+/*!
+ * Caches properties by (graph, key, vertex or edge).  Each entry stores
+ * the transaction id of its vertices when it was read or written.  The
+ * latest transaction id of every vertex is updated from each DVID
+ * response; an entry is fresh only if its ids match the latest ones.
+ * A failed transaction invalidates the vertex until DVID reports a new id.
+ * Stale entries are removed when they are found.  Properties are copied
+ * out of the response they were read from, and when they exceed
+ * max_bytes the least recently used entries are evicted.  Transaction
+ * ids are only kept for vertices of cached entries.
+ *
+ * Changes made by other clients are detected the next time DVID returns
+ * a transaction id for the vertex (e.g., a failed set_properties).
+ * The cache is thread safe and can be shared by several node services
+ * (see DVIDNodeService::set_property_cache).
+*/
+class PropertyCache {
+  public:
+    /*!
+     * Create an empty cache.
+     * \param max_bytes_ byte budget of the cached properties
+    */
+    explicit PropertyCache(size_t max_bytes_ = 64 << 20);
+
+    /*!
+     * Find a fresh vertex property.
+     * \param graph_name name of labelgraph instance
+     * \param key name of property
+     * \param id vertex id
+     * \param property set to the cached property
+     * \param tid set to the transaction id of the vertex
+     * \return true if a fresh property is cached
+    */
+    bool find(const std::string& graph_name, const std::string& key,
+            VertexID id, PropertyView& property, TransactionID& tid);
+
+    /*!
+     * Find a fresh edge property.
+     * \param graph_name name of labelgraph instance
+     * \param key name of property
+     * \param edge edge (canonical order)
+     * \param property set to the cached property
+     * \param tid1 set to the transaction id of edge.id1
+     * \param tid2 set to the transaction id of edge.id2
+     * \return true if a fresh property is cached
+    */
+    bool find(const std::string& graph_name, const std::string& key,
+            const EdgeKey& edge, PropertyView& property, TransactionID& tid1,
+            TransactionID& tid2);
+
+    /*!
+     * Store a copy of a vertex property read or written with the given
+     * transaction id (which becomes the latest id of the vertex).  The
+     * property is dropped if it is larger than the byte budget.
+    */
+    void store(const std::string& graph_name, const std::string& key,
+            VertexID id, const PropertyView& property, TransactionID tid);
+
+    /*!
+     * Store a copy of an edge property read or written with the given
+     * transaction ids (which become the latest ids of the vertices).
+     * The property is dropped if it is larger than the byte budget.
+    */
+    void store(const std::string& graph_name, const std::string& key,
+            const EdgeKey& edge, const PropertyView& property,
+            TransactionID tid1, TransactionID tid2);
+
+    /*!
+     * Record the latest transaction id DVID returned for a vertex
+     * (ignored if no cached property uses the vertex).
+    */
+    void update_transaction(const std::string& graph_name, VertexID id,
+            TransactionID tid);
+
+    /*!
+     * Mark all properties of a vertex as stale (e.g., after a
+     * failed transaction).
+    */
+    void invalidate(const std::string& graph_name, VertexID id);
+
+    //! Remove all entries
+    void clear();
+
+    //! bytes of cached properties
+    size_t bytes() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return cached_bytes;
+    }
+
+    //! number of fresh lookups
+    size_t hits() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return num_hits;
+    }
+
+    //! number of lookups that required a fetch
+    size_t misses() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return num_misses;
+    }
+
+  private:
+    struct GraphEntries;
+    struct KeyEntries;
+
+    //! Latest transaction id known for a vertex and the number of
+    //! cached entries that use the vertex
+    struct LatestTransaction {
+        LatestTransaction() : tid(0), known(false), num_entries(0) {}
+        TransactionID tid;
+        bool known;
+        size_t num_entries;
+    };
+
+    //! Identifies an entry in the LRU list (id2 is 0 for vertices)
+    struct EntryLocation {
+        EntryLocation(GraphEntries* graph_, KeyEntries* entries_,
+                VertexID id1_, VertexID id2_, bool edge_) : graph(graph_),
+            entries(entries_), id1(id1_), id2(id2_), edge(edge_) {}
+        GraphEntries* graph;
+        KeyEntries* entries;
+        VertexID id1, id2;
+        bool edge;
+    };
+
+    //! Cached property, the transaction ids it was read with and its
+    //! position in the LRU list
+    struct Entry {
+        Entry() : tid1(0), tid2(0) {}
+        PropertyView property;
+        TransactionID tid1, tid2;
+        std::list<EntryLocation>::iterator lru_position;
+    };
+
+    //! Entries for one property key
+    struct KeyEntries {
+        FlatHashMap<VertexID, Entry, VertexIDHash> vertices;
+        FlatHashMap<EdgeKey, Entry, EdgeKeyHash> edges;
+    };
+
+    //! Entries and transaction ids for one graph
+    struct GraphEntries {
+        FlatHashMap<VertexID, LatestTransaction, VertexIDHash> latest;
+        std::map<std::string, KeyEntries> keys;
+    };
+
+    //! true if the vertex's latest transaction id is tid (mutex held)
+    bool is_current(GraphEntries& entries, VertexID id, TransactionID tid);
+
+    //! Add a new entry to the LRU list and the byte count (mutex held)
+    void add(const EntryLocation& location, Entry& entry,
+            const PropertyView& property);
+
+    //! Set the latest id of a vertex used by a new entry (mutex held)
+    void hold_vertex(GraphEntries& entries, VertexID id, TransactionID tid);
+
+    //! Forget the latest id of a vertex no entry uses (mutex held)
+    void release_vertex(GraphEntries& entries, VertexID id);
+
+    //! Remove an entry (mutex held)
+    void remove(std::list<EntryLocation>::iterator location);
+
+    //! Evict the least recently used entries over budget (mutex held)
+    void evict();
+
+    size_t max_bytes;
+
+    mutable boost::mutex mutex;
+    std::map<std::string, GraphEntries> graphs;
+    std::list<EntryLocation> lru;
+    size_t cached_bytes;
+    size_t num_hits, num_misses;
+};
+
+//! Property caches are shared between node services
+typedef boost::shared_ptr<PropertyCache> PropertyCachePtr;
+
+}
+
+#endif
@@ -9,7 +9,11 @@
 #ifndef DVIDROI_H
 #define DVIDROI_H
 
+#include "Globals.h"
+
 #include <algorithm>
+#include <vector>
+#include <string>
 #include <boost/operators.hpp>
 
 namespace libdvid {
@@ -121,6 +125,289 @@ struct PointXYZ : boost::totally_ordered<PointXYZ>{
     }
 };
 
+/*!
+ * Defines a run of blocks along x (x0 to x1 inclusive) in block
+ * coordinate space.  This is the run-length form DVID uses for ROIs.
+*/
+struct BlockSpan : boost::totally_ordered<BlockSpan> {
+    /*!
+     * Constructs a run of blocks.
+     * \param z_ z block coordinate
+     * \param y_ y block coordinate
+     * \param x0_ first x block coordinate
+     * \param x1_ last x block coordinate (inclusive)
+    */
+    BlockSpan(int z_, int y_, int x0_, int x1_) : z(z_), y(y_), x0(x0_), x1(x1_) {}
+
+    //! Used to order spans by Z then Y then X
+    bool operator<(BlockSpan const & other) const
+    {
+        int params[] = {z, y, x0, x1};
+        int other_params[] = {other.z, other.y, other.x0, other.x1};
+        return std::lexicographical_compare(&params[0], &params[4],
+                &other_params[0], &other_params[4]);
+    }
+
+    bool operator==(BlockSpan const & other) const
+    {
+        return (z == other.z) && (y == other.y) && (x0 == other.x0) &&
+            (x1 == other.x1);
+    }
+
+    //! number of blocks in the span
+    unsigned int size() const
+    {
+        return (x1 >= x0) ? (unsigned int)(x1 - x0) + 1 : 0;
+    }
+
+    //! public access to member data
+    int z, y, x0, x1;
+};
+
+/*!
+ * Put spans in canonical form: ordered by z, y, x with overlapping or
+ * touching spans in a row joined and empty spans removed.  This is
+ * linear if the spans are already ordered.
+ * \param spans spans to normalize (modified in place)
+*/
+void normalize_spans(std::vector<BlockSpan>& spans);
+
+/*!
+ * Encode blocks as spans.  Blocks that are already ordered by z, y, x
+ * (e.g., from get_roi) are encoded in one linear pass; otherwise a
+ * sorted copy is made.  Duplicate blocks are ignored.
+ * \param blocks block coordinates
+ * \param spans set to the spans in canonical order
+*/
+void blocks_to_spans(const std::vector<BlockXYZ>& blocks,
+        std::vector<BlockSpan>& spans);
+
+/*!
+ * Expand spans into blocks (in the order of the spans).
+ * \param spans runs of blocks
+ * \param blocks set to the block coordinates
+*/
+void spans_to_blocks(const std::vector<BlockSpan>& spans,
+        std::vector<BlockXYZ>& blocks);
+
+/*!
+ * Serialize spans in the DVID ROI JSON format ([[z, y, x0, x1], ...])
+ * directly into a buffer without building a JSON document.
+ * \param spans array of spans
+ * \param num_spans number of spans in the array
+ * \param buffer string that the JSON is appended to
+*/
+void write_roi_json(const BlockSpan* spans, size_t num_spans,
+        std::string& buffer);
+
+/*!
+ * Serialize points in the DVID point query JSON format
+ * ([[x, y, z], ...]) directly into a buffer.
+ * \param points array of points
+ * \param num_points number of points in the array
+ * \param buffer string that the JSON is appended to
+*/
+void write_points_json(const PointXYZ* points, size_t num_points,
+        std::string& buffer);
+
+//! Payload encoding used for remote point queries
+enum PointEncoding {
+    //! JSON array of [x, y, z] (always supported)
+    JSONPointEncoding,
+    //! int32 x, y, z per point with one result byte per point; requests
+    //! fall back to JSON if the server does not accept it
+    BinaryPointEncoding
+};
+
+/*!
+ * Union of two ROIs given as spans.  The spans are merged in one
+ * linear pass; several threads merge disjoint ranges of z.  Inputs
+ * that are not in canonical form are normalized first.
+ * \param spans1 runs of blocks of the first ROI
+ * \param spans2 runs of blocks of the second ROI
+ * \param result set to the spans in canonical form (can be posted
+ * with post_roi)
+ * \param num_threads number of threads merging spans
+*/
+void roi_union(const std::vector<BlockSpan>& spans1,
+        const std::vector<BlockSpan>& spans2,
+        std::vector<BlockSpan>& result, int num_threads = 1);
+
+/*!
+ * Intersection of two ROIs given as spans (see roi_union).
+ * \param spans1 runs of blocks of the first ROI
+ * \param spans2 runs of blocks of the second ROI
+ * \param result set to the spans in canonical form
+ * \param num_threads number of threads merging spans
+*/
+void roi_intersection(const std::vector<BlockSpan>& spans1,
+        const std::vector<BlockSpan>& spans2,
+        std::vector<BlockSpan>& result, int num_threads = 1);
+
+/*!
+ * Blocks of the first ROI that are not in the second (see roi_union).
+ * \param spans1 runs of blocks of the first ROI
+ * \param spans2 runs of blocks removed from the first ROI
+ * \param result set to the spans in canonical form
+ * \param num_threads number of threads merging spans
+*/
+void roi_difference(const std::vector<BlockSpan>& spans1,
+        const std::vector<BlockSpan>& spans2,
+        std::vector<BlockSpan>& result, int num_threads = 1);
+
+/*!
+ * Part of an ROI produced by partition_roi.  The subvolume is the box
+ * from min_block to max_block (inclusive, block coordinates) and holds
+ * the ROI blocks given by its spans.
+*/
+struct ROISubvolume {
+    ROISubvolume() : min_block(0, 0, 0), max_block(0, 0, 0),
+        active_blocks(0) {}
+
+    //! smallest block coordinate of the bounding box
+    BlockXYZ min_block;
+
+    //! largest block coordinate of the bounding box (inclusive)
+    BlockXYZ max_block;
+
+    //! number of ROI blocks in the subvolume
+    uint64 active_blocks;
+
+    //! runs of ROI blocks in the subvolume (canonical order)
+    std::vector<BlockSpan> spans;
+};
+
+//! Strategy used to partition an ROI
+enum PartitionMethod {
+    //! recursively split at the median block along the longest axis
+    KDTreePartition,
+    //! cut the blocks ordered along a Morton (Z-order) curve into chunks
+    MortonPartition
+};
+
+/*!
+ * Partition an ROI into subvolumes of similar numbers of ROI blocks,
+ * unlike the fixed-size substacks of get_roi_partition.  K-d splits
+ * produce disjoint boxes with between about half and all of
+ * max_active_blocks blocks.  Morton chunks have exactly
+ * max_active_blocks blocks (except the last) but their bounding boxes
+ * can overlap; the spans of the subvolumes never overlap.
+ * \param spans runs of blocks in the ROI (need not be normalized)
+ * \param max_active_blocks maximum number of ROI blocks in a subvolume
+ * \param method partitioning strategy
+ * \param subvolumes set to the subvolumes (in traversal order)
+ * \return fraction of subvolume volume covered by ROI blocks
+ * (packing factor)
+*/
+double partition_roi(const std::vector<BlockSpan>& spans,
+        uint64 max_active_blocks, PartitionMethod method,
+        std::vector<ROISubvolume>& subvolumes);
+
+/*!
+ * In-memory ROI for answering block and point membership queries
+ * without contacting DVID.  The spans are stored in canonical order
+ * with an index of the (z, y) rows, so a query is a binary search over
+ * the rows and then over the spans of one row.  Batch queries are
+ * split across threads and reuse the row of the previous query.
+*/
+class ROIIndex {
+  public:
+    //! Construct an empty ROI
+    ROIIndex() : block_count(0) {}
+
+    /*!
+     * Build from spans (e.g., from get_roi), which need not be
+     * ordered or distinct.
+     * \param spans_ runs of blocks in the ROI
+    */
+    explicit ROIIndex(const std::vector<BlockSpan>& spans_);
+
+    /*!
+     * Check whether a block is in the ROI.
+     * \param block block coordinate
+     * \return true if inside
+    */
+    bool contains(const BlockXYZ& block) const;
+
+    /*!
+     * Check whether a point is in the ROI (i.e., whether its
+     * block is, assuming DEFBLOCKSIZE blocks).
+     * \param point voxel coordinate
+     * \return true if inside
+    */
+    bool contains(const PointXYZ& point) const;
+
+    /*!
+     * Check a list of points (same result as roi_ptquery).
+     * \param points voxel coordinates
+     * \param inroi set to true/false for each point
+     * \param num_threads number of threads checking points
+    */
+    void contains(const std::vector<PointXYZ>& points,
+            std::vector<bool>& inroi, int num_threads = 1) const;
+
+    /*!
+     * Check a list of blocks.
+     * \param blocks block coordinates
+     * \param inroi set to true/false for each block
+     * \param num_threads number of threads checking blocks
+    */
+    void contains(const std::vector<BlockXYZ>& blocks,
+            std::vector<bool>& inroi, int num_threads = 1) const;
+
+    //! spans of the ROI in canonical order (see normalize_spans)
+    const std::vector<BlockSpan>& get_spans() const
+    {
+        return spans;
+    }
+
+    //! number of blocks in the ROI
+    uint64 num_blocks() const
+    {
+        return block_count;
+    }
+
+    /*!
+     * Find the row containing the given z and y.
+     * \param z z block coordinate
+     * \param y y block coordinate
+     * \param row set to the row index if found
+     * \return true if the ROI has spans in the row
+    */
+    bool find_row(int z, int y, size_t& row) const;
+
+    /*!
+     * Check whether a row contains an x coordinate.
+     * \param row row index (from find_row)
+     * \param x x block coordinate
+     * \return true if a span of the row contains x
+    */
+    bool row_contains(size_t row, int x) const;
+
+  private:
+    std::vector<BlockSpan> spans;
+
+    //! (z, y) of each row as an ordered key (see row_key)
+    std::vector<uint64> row_keys;
+
+    //! first span of each row (one extra entry at the end)
+    std::vector<size_t> row_offsets;
+
+    uint64 block_count;
+};
+
+/*!
+ * Block coordinate containing a voxel coordinate (rounds down for
+ * negative coordinates).
+ * \param coord voxel coordinate
+ * \return block coordinate
+*/
+inline int block_coordinate(int coord)
+{
+    return (coord >= 0) ? (coord / DEFBLOCKSIZE) :
+        -((-coord + DEFBLOCKSIZE - 1) / DEFBLOCKSIZE);
+}
+
 }
 
 #endif
@@ -0,0 +1,106 @@
+/*!
+ * This file provides a small bounded thread pool for issuing many
+ * independent requests to DVID concurrently.  Each worker thread owns
+ * its own copy of the node service (and therefore its own connection).
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDTASKPOOL_H
+#define DVIDTASKPOOL_H
+
+#include "DVIDNodeService.h"
+
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+#include <string>
+
+namespace libdvid {
+
+//! Work item run by a pool thread with that thread's node service
+typedef boost::function<void (DVIDNodeService&)> DVIDTask;
+
+/*!
+ * Runs tasks on a fixed number of threads.  The number of queued tasks
+ * is bounded so that a producer (e.g., one serializing request payloads)
+ * is throttled to the rate at which the workers finish.
+ *
+ * Exceptions thrown by tasks are caught; the message of the first one
+ * is rethrown as an ErrMsg by wait().  Tasks that need per-task error
+ * handling should catch their own exceptions.
+*/
+class DVIDTaskPool {
+  public:
+    /*!
+     * Starts the worker threads.
+     * \param service node service copied for each worker
+     * \param num_threads number of worker threads (at least 1)
+     * \param max_queued maximum tasks waiting to run (0 for 2*num_threads)
+    */
+    DVIDTaskPool(DVIDNodeService& service, int num_threads,
+            size_t max_queued = 0);
+
+    /*!
+     * Finishes the submitted tasks and stops the workers.
+    */
+    ~DVIDTaskPool();
+
+    /*!
+     * Add a task to the queue.  Blocks while the queue is full.
+     * \param task work to be run on a pool thread
+    */
+    void submit(DVIDTask task);
+
+    /*!
+     * Block until all submitted tasks are finished.  Throws an
+     * ErrMsg if any task failed with an exception.
+    */
+    void wait();
+
+    //! number of worker threads
+    int num_threads() const
+    {
+        return thread_count;
+    }
+
+  private:
+    //! Body of each worker thread
+    struct Worker;
+
+    //! Disable copying
+    DVIDTaskPool(const DVIDTaskPool&);
+    DVIDTaskPool& operator=(const DVIDTaskPool&);
+
+    //! Get the next task (returns false when stopping)
+    bool next_task(DVIDTask& task);
+
+    //! Mark a task as done
+    void task_done(const std::string& error);
+
+    int thread_count;
+    size_t max_queued;
+
+    boost::mutex mutex;
+    boost::condition_variable task_available;
+    boost::condition_variable space_available;
+    boost::condition_variable tasks_finished;
+
+    std::deque<DVIDTask> tasks;
+
+    //! tasks queued or running
+    size_t num_pending;
+
+    bool stopping;
+
+    //! message of the first task that failed
+    std::string first_error;
+
+    boost::thread_group threads;
+};
+
+}
+
+#endif
@@ -13,8 +13,34 @@
 
 #include "DVIDNodeService.h"
 
+#include <boost/function.hpp>
+
 namespace libdvid {
 
+/*!
+ * Callback used by the streaming block visitors.  It receives the
+ * block location and a DEFBLOCKSIZE^3 grayscale buffer.  The visitor
+ * is called concurrently from the fetching threads and must be thread safe.
+*/
+typedef boost::function<void (const BlockXYZ&, BinaryDataPtr)> BlockVisitor;
+
+/*!
+ * Grayscale blocks intersecting one body.  Blocks shared with other
+ * bodies fetched in the same call reference the same buffer.
+*/
+struct BodyBlocks {
+    BodyBlocks() : bodyid(0) {}
+
+    //! body id
+    uint64 bodyid;
+
+    //! block coordinates of the coarse body (ordered by Z, Y, then X)
+    std::vector<BlockXYZ> blockcoords;
+
+    //! grayscale block for each block coordinate
+    std::vector<BinaryDataPtr> blocks;
+};
+
 /*!
  * Fetches all the grayscale blocks that intersect the body id in the specified
  * label volume.  If threading is enabled, multiple requests will be done
@@ -33,6 +59,146 @@ std::vector<BinaryDataPtr> get_body_blocks(DVIDNodeService& service,
         int num_threads = 1, bool use_blocks = false,
         int request_efficiency = 1);
 
+/*!
+ * Fetches the grayscale blocks for several bodies at once.  The coarse
+ * volumes of the bodies are fetched in parallel and combined so that
+ * a block shared by several bodies (e.g., touching neurons) is only
+ * fetched once.  Contiguous blocks are requested together.  A body
+ * that does not exist is returned without blocks.
+ * \param service name of dvid node service
+ * \param labelvol_name name of label volume with body ids
+ * \param grayscale_name name of grayscale data instance
+ * \param bodyids bodies to fetch
+ * \param num_threads number of threads used in the fetch
+ * \return blocks for each body in the order of bodyids
+*/
+std::vector<BodyBlocks> get_multibody_blocks(DVIDNodeService& service,
+        std::string labelvol_name, std::string grayscale_name,
+        const std::vector<uint64>& bodyids, int num_threads = 1);
+
+/*!
+ * Streams the grayscale blocks for a list of block coordinates to
+ * a visitor.  Contiguous blocks are fetched together (at most
+ * max_blocks_per_request at a time) and each thread visits the blocks
+ * of one request before fetching the next.  Blocks are not retained after
+ * the visitor returns, so the memory used is bounded by
+ * num_threads*max_blocks_per_request blocks rather than by the
+ * number of blocks.  Blocks are visited in no particular order.
+ * \param service name of dvid node service
+ * \param grayscale_name name of grayscale data instance
+ * \param blockcoords blocks to fetch (ordered by Z, Y, then X)
+ * \param visitor called with each block location and its data
+ * \param num_threads number of threads used in the fetch
+ * \param max_blocks_per_request max blocks fetched in one request
+*/
+void visit_blocks(DVIDNodeService& service, std::string grayscale_name,
+        const std::vector<BlockXYZ>& blockcoords, BlockVisitor visitor,
+        int num_threads = 1, int max_blocks_per_request = 64);
+
+/*!
+ * Streams all the grayscale blocks that intersect the body id in the
+ * specified label volume to a visitor (see visit_blocks).
+ * \param service name of dvid node service
+ * \param labelvol_name name of label volume with body id
+ * \param grayscale_name name of grayscale data instance
+ * \param bodyid body whose coarse volume determines the blocks
+ * \param visitor called with each block location and its data
+ * \param num_threads number of threads used in the fetch
+ * \param max_blocks_per_request max blocks fetched in one request
+*/
+void visit_body_blocks(DVIDNodeService& service, std::string labelvol_name,
+        std::string grayscale_name, uint64 bodyid, BlockVisitor visitor,
+        int num_threads = 1, int max_blocks_per_request = 64);
+
+/*!
+ * Streams all the grayscale blocks in an ROI to a visitor
+ * (see visit_blocks).
+ * \param service name of dvid node service
+ * \param roi_name name of the roi instance
+ * \param grayscale_name name of grayscale data instance
+ * \param visitor called with each block location and its data
+ * \param num_threads number of threads used in the fetch
+ * \param max_blocks_per_request max blocks fetched in one request
+*/
+void visit_roi_blocks(DVIDNodeService& service, std::string roi_name,
+        std::string grayscale_name, BlockVisitor visitor,
+        int num_threads = 1, int max_blocks_per_request = 64);
+
+/*!
+ * Grayscale blocks of an ROI.  Only the blocks inside the ROI are
+ * fetched and stored.
+*/
+struct ROIBlocks {
+    //! block coordinates in the ROI (ordered by Z, Y, then X)
+    std::vector<BlockXYZ> blockcoords;
+
+    //! grayscale block for each block coordinate
+    std::vector<BinaryDataPtr> blocks;
+};
+
+/*!
+ * Fetches the grayscale blocks of an ROI given as spans (e.g., the
+ * result of roi_intersection).  Runs of at most max_blocks_per_request
+ * blocks are fetched by several threads, so the data transferred is
+ * proportional to the ROI volume rather than its bounding box.
+ * \param service name of dvid node service
+ * \param spans runs of blocks in the ROI (need not be normalized)
+ * \param grayscale_name name of grayscale data instance
+ * \param num_threads number of threads used in the fetch
+ * \param max_blocks_per_request max blocks fetched in one request
+ * \return blocks of the ROI
+*/
+ROIBlocks get_roi_blocks(DVIDNodeService& service,
+        const std::vector<BlockSpan>& spans, std::string grayscale_name,
+        int num_threads = 1, int max_blocks_per_request = 64);
+
+/*!
+ * Fetches the grayscale blocks of an ROI instance (see above).
+ * \param service name of dvid node service
+ * \param roi_name name of the roi instance
+ * \param grayscale_name name of grayscale data instance
+ * \param num_threads number of threads used in the fetch
+ * \param max_blocks_per_request max blocks fetched in one request
+ * \return blocks of the ROI
+*/
+ROIBlocks get_roi_blocks(DVIDNodeService& service, std::string roi_name,
+        std::string grayscale_name, int num_threads = 1,
+        int max_blocks_per_request = 64);
+
+/*!
+ * Fetches a 3D grayscale volume masked by an ROI given as spans.  This
+ * is equivalent to get_gray3D with an roi, but only the parts of the
+ * ROI's runs inside the volume are requested (in parallel) and the
+ * rest of the volume is left 0.
+ * \param service name of dvid node service
+ * \param spans runs of blocks in the ROI (need not be normalized)
+ * \param grayscale_name name of grayscale data instance
+ * \param dims size of X, Y, Z dimensions in voxel coordinates
+ * \param offset X, Y, Z offset in voxel coordinates
+ * \param num_threads number of threads used in the fetch
+ * \param max_blocks_per_request max blocks fetched in one request
+ * \return 3D grayscale volume (0 outside the ROI)
+*/
+Grayscale3D get_roi_gray3D(DVIDNodeService& service,
+        const std::vector<BlockSpan>& spans, std::string grayscale_name,
+        Dims_t dims, std::vector<int> offset, int num_threads = 1,
+        int max_blocks_per_request = 64);
+
+/*!
+ * Fetches a 3D grayscale volume masked by an ROI instance (see above).
+ * \param service name of dvid node service
+ * \param roi_name name of the roi instance
+ * \param grayscale_name name of grayscale data instance
+ * \param dims size of X, Y, Z dimensions in voxel coordinates
+ * \param offset X, Y, Z offset in voxel coordinates
+ * \param num_threads number of threads used in the fetch
+ * \param max_blocks_per_request max blocks fetched in one request
+ * \return 3D grayscale volume (0 outside the ROI)
+*/
+Grayscale3D get_roi_gray3D(DVIDNodeService& service, std::string roi_name,
+        std::string grayscale_name, Dims_t dims, std::vector<int> offset,
+        int num_threads = 1, int max_blocks_per_request = 64);
+
 /*
  * Fetches all tile slices requested in parallel.
  * \param service name of dvid node service
@@ -0,0 +1,284 @@
+/*!
+ * This file provides a client-side cache for pre-computed tiles that
+ * serves the tiles of a viewer's viewport and prefetches the tiles
+ * around it (neighbouring tiles and adjacent planes) in the background.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDTILECACHE_H
+#define DVIDTILECACHE_H
+
+#include "DVIDNodeService.h"
+
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace libdvid {
+
+/*!
+ * Identifies a tile.  The location is given as in
+ * DVIDNodeService::get_tile_slice_binary (X, Y, Z order with tile
+ * coordinates for the two axes of the plane and a voxel coordinate
+ * for the third).
+*/
+struct TileKey {
+    TileKey(std::string instance_, Slice2D orientation_,
+            unsigned int scaling_, int x_, int y_, int z_) :
+        instance(instance_), orientation(orientation_), scaling(scaling_),
+        x(x_), y(y_), z(z_) {}
+
+    bool operator<(const TileKey& other) const
+    {
+        if (x != other.x) return x < other.x;
+        if (y != other.y) return y < other.y;
+        if (z != other.z) return z < other.z;
+        if (scaling != other.scaling) return scaling < other.scaling;
+        if (orientation != other.orientation) {
+            return orientation < other.orientation;
+        }
+        return instance < other.instance;
+    }
+
+    //! location passed to get_tile_slice_binary
+    std::vector<int> tile_loc() const
+    {
+        std::vector<int> loc;
+        loc.push_back(x); loc.push_back(y); loc.push_back(z);
+        return loc;
+    }
+
+    std::string instance;
+    Slice2D orientation;
+    unsigned int scaling;
+    int x, y, z;
+};
+
+/*!
+ * Visible region of a tile instance.  u and v are the tile coordinates
+ * of the two axes of the plane (in X, Y, Z order, e.g., X and Z for XZ
+ * slices) and w is the voxel coordinate of the third axis.  All ranges
+ * are inclusive.
+*/
+struct TileViewport {
+    TileViewport(std::string instance_, Slice2D orientation_,
+            unsigned int scaling_, int u0_, int v0_, int u1_, int v1_,
+            int w0_, int w1_) : instance(instance_),
+        orientation(orientation_), scaling(scaling_), u0(u0_), v0(v0_),
+        u1(u1_), v1(v1_), w0(w0_), w1(w1_) {}
+
+    //! Key of the tile at (u, v) on plane w
+    TileKey tile(int u, int v, int w) const;
+
+    std::string instance;
+    Slice2D orientation;
+    unsigned int scaling;
+
+    //! visible tiles
+    int u0, v0, u1, v1;
+
+    //! visible planes
+    int w0, w1;
+};
+
+//! Fetches one tile (each fetch thread calls its own copy)
+typedef boost::function<BinaryDataPtr (const TileKey&)> TileFetcher;
+
+/*!
+ * Caches raw (still compressed) tiles up to a byte budget, evicting
+ * the least recently used tiles.  Tiles are fetched by a fixed set of
+ * threads, each with its own copy of the node service, in priority
+ * order: tiles that a caller is waiting for come first, then the
+ * prefetched tiles closest to the last viewport (those in the
+ * direction the viewport last moved first).  A new viewport discards
+ * the queued prefetches of the previous one.
+ *
+ * Tiles that fail to prefetch (e.g., outside of the volume) are not
+ * requested again until clear() is called.  The cache is thread safe.
+*/
+class TileCache {
+  public:
+    /*!
+     * Starts the fetch threads.
+     * \param service node service copied for each thread
+     * \param max_bytes_ byte budget of the cached tiles
+     * \param num_threads number of concurrent tile requests
+    */
+    TileCache(DVIDNodeService& service, size_t max_bytes_ = 256 << 20,
+            int num_threads = 4);
+
+    /*!
+     * Starts the fetch threads with a custom tile source (e.g., a
+     * different server or a local store).
+     * \param fetcher copied for each thread; throws if a tile cannot
+     * be fetched
+     * \param max_bytes_ byte budget of the cached tiles
+     * \param num_threads number of concurrent tile requests
+    */
+    TileCache(TileFetcher fetcher, size_t max_bytes_ = 256 << 20,
+            int num_threads = 4);
+
+    /*!
+     * Stops the fetch threads (queued prefetches are dropped).
+    */
+    ~TileCache();
+
+    /*!
+     * Set how far around each viewport tiles are prefetched.
+     * \param margin_ rings of tiles around the visible tiles
+     * \param planes_ planes before and after the visible planes
+    */
+    void set_prefetch(int margin_, int planes_);
+
+    /*!
+     * Get a tile from the cache or DVID.  An error is thrown if the
+     * tile cannot be fetched.
+     * \param key tile to get
+     * \return raw tile (shared with the cache, must not be modified)
+    */
+    BinaryDataPtr get_tile(const TileKey& key);
+
+    /*!
+     * Get the visible tiles of a viewport and queue the prefetch of
+     * the tiles around it.  Missing visible tiles are fetched
+     * concurrently.  An error is thrown if a visible tile cannot be
+     * fetched.
+     * \param viewport visible region
+     * \param tiles set to the visible tiles (ordered by w, v, then u)
+    */
+    void get_viewport(const TileViewport& viewport,
+            std::vector<BinaryDataPtr>& tiles);
+
+    //! Remove all tiles (and forget failed prefetches)
+    void clear();
+
+    //! bytes of cached tiles
+    size_t bytes() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return cached_bytes;
+    }
+
+    //! number of tiles served from the cache
+    size_t hits() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return num_hits;
+    }
+
+    //! number of tiles a caller had to wait for
+    size_t misses() const
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return num_misses;
+    }
+
+  private:
+    //! Body of each fetch thread
+    struct Worker;
+
+    //! Queued or running fetch of one tile
+    struct Request {
+        Request() : priority(0), sequence(0), queued(true), done(false),
+            waiters(0) {}
+        int priority;
+        uint64 sequence;
+        bool queued, done;
+        int waiters;
+        BinaryDataPtr data;
+        std::string error;
+    };
+    typedef boost::shared_ptr<Request> RequestPtr;
+
+    //! Queue order (lowest priority, then first queued)
+    struct QueueEntry {
+        QueueEntry(int priority_, uint64 sequence_, const TileKey& key_) :
+            priority(priority_), sequence(sequence_), key(key_) {}
+        bool operator<(const QueueEntry& other) const
+        {
+            if (priority != other.priority) {
+                return priority < other.priority;
+            }
+            return sequence < other.sequence;
+        }
+        int priority;
+        uint64 sequence;
+        TileKey key;
+    };
+
+    //! Cached tile and its position in the LRU list
+    struct Entry {
+        BinaryDataPtr data;
+        std::list<TileKey>::iterator lru_position;
+    };
+
+    //! Disable copying
+    TileCache(const TileCache&);
+    TileCache& operator=(const TileCache&);
+
+    //! Start num_threads fetch threads
+    void start(TileFetcher fetcher, int num_threads);
+
+    //! Find a cached tile and mark it as recently used (mutex held)
+    BinaryDataPtr find(const TileKey& key);
+
+    //! Cache a tile and evict tiles over the budget (mutex held)
+    void insert(const TileKey& key, BinaryDataPtr data);
+
+    /*!
+     * Queue a tile fetch or raise the priority of a queued one
+     * (mutex held).  Returns null if a prefetch is not needed.
+    */
+    RequestPtr enqueue(const TileKey& key, int priority, bool wait);
+
+    //! Drop queued fetches that nobody waits for (mutex held)
+    void drop_prefetches();
+
+    //! Wait for a request and return its tile (mutex held by lock)
+    BinaryDataPtr wait_for(boost::mutex::scoped_lock& lock,
+            RequestPtr request, std::string& error);
+
+    //! Get the next fetch (returns false when stopping)
+    bool next_fetch(TileKey& key, RequestPtr& request);
+
+    //! Record a finished fetch
+    void fetch_done(const TileKey& key, RequestPtr request,
+            BinaryDataPtr data, const std::string& error);
+
+    size_t max_bytes;
+    int margin, planes;
+
+    //! previous viewport and the direction (-1, 0, 1) it moved in u, v, w
+    boost::shared_ptr<TileViewport> last_viewport;
+    int motion[3];
+
+    mutable boost::mutex mutex;
+    boost::condition_variable fetch_available;
+    boost::condition_variable fetch_finished;
+
+    std::map<TileKey, Entry> entries;
+    std::list<TileKey> lru;
+    size_t cached_bytes;
+
+    std::map<TileKey, RequestPtr> requests;
+    std::set<QueueEntry> queue;
+    std::set<TileKey> failed;
+    uint64 next_sequence;
+
+    bool stopping;
+    size_t num_hits, num_misses;
+
+    boost::thread_group threads;
+};
+
+}
+
+#endif
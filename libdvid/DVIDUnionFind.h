@@ -0,0 +1,136 @@
+/*!
+ * This file provides agglomeration of labelgraph vertices: a concurrent
+ * union-find over edge lists and the resulting label mapping, which can
+ * be applied to label volumes.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDUNIONFIND_H
+#define DVIDUNIONFIND_H
+
+#include "DVIDGraph.h"
+#include "DVIDVoxels.h"
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <vector>
+
+namespace libdvid {
+
+/*!
+ * Disjoint sets over the elements 0..size()-1 that can be merged and
+ * queried by several threads at once without locks.  Sets are linked by
+ * index (the larger root points to the smaller one) with compare-and-swap,
+ * and find compresses paths by halving.  The root of a set is therefore
+ * always its smallest element.
+*/
+class ConcurrentUnionFind {
+  public:
+    /*!
+     * Create singleton sets.
+     * \param num_elements number of elements
+    */
+    explicit ConcurrentUnionFind(size_t num_elements);
+
+    /*!
+     * Find the root (smallest element) of the set containing element.
+     * \param element element index
+     * \return root index
+    */
+    size_t find(size_t element);
+
+    /*!
+     * Merge the sets containing two elements.
+     * \param element1 element index
+     * \param element2 element index
+     * \return true if the sets were different
+    */
+    bool unite(size_t element1, size_t element2);
+
+    //! number of elements
+    size_t size() const
+    {
+        return num_elements;
+    }
+
+  private:
+    //! Disable copying
+    ConcurrentUnionFind(const ConcurrentUnionFind&);
+    ConcurrentUnionFind& operator=(const ConcurrentUnionFind&);
+
+    size_t num_elements;
+    boost::scoped_array<boost::atomic<size_t> > parents;
+};
+
+/*!
+ * Maps labels (vertex ids) to the label of the body they were merged
+ * into.  Labels not in the mapping map to themselves.
+*/
+class LabelMapping {
+  public:
+    LabelMapping() {}
+
+    /*!
+     * Create from a list of labels and their roots.
+     * \param labels_ labels (sorted and without duplicates)
+     * \param roots_ root of each label
+    */
+    LabelMapping(const std::vector<VertexID>& labels_,
+            const std::vector<VertexID>& roots_);
+
+    //! number of labels in the mapping
+    size_t size() const
+    {
+        return labels.size();
+    }
+
+    /*!
+     * Find the root of a label.
+     * \param label label to map
+     * \return root label (label itself if it is not in the mapping)
+    */
+    VertexID map(VertexID label) const;
+
+    //! labels in the mapping (sorted)
+    const std::vector<VertexID>& get_labels() const
+    {
+        return labels;
+    }
+
+    //! root label for each entry in get_labels()
+    const std::vector<VertexID>& get_roots() const
+    {
+        return roots;
+    }
+
+    /*!
+     * Replace each voxel label with its root.  The volume's
+     * buffer is modified in place.
+     * \param volume label volume to relabel
+     * \param num_threads number of threads relabeling the volume
+    */
+    void relabel(Labels3D& volume, int num_threads = 1) const;
+
+  private:
+    std::vector<VertexID> labels;
+    std::vector<VertexID> roots;
+};
+
+/*!
+ * Merge the vertices connected by edges whose weight is within
+ * [min_weight, max_weight].  Every vertex of those edges is mapped
+ * to the smallest vertex id in its body.  Edges are processed by
+ * several threads using ConcurrentUnionFind.
+ * \param edges list of edges
+ * \param min_weight smallest weight of an edge that is merged
+ * \param max_weight largest weight of an edge that is merged
+ * \param mapping set to the label of each merged vertex
+ * \param num_threads number of threads used
+*/
+void agglomerate_edges(const std::vector<Edge>& edges, double min_weight,
+        double max_weight, LabelMapping& mapping, int num_threads = 1);
+
+}
+
+#endif
@@ -15,11 +15,13 @@ namespace libdvid {
 
 typedef boost::uint8_t uint8;
 typedef boost::uint64_t uint64;
+typedef boost::int64_t int64;
 
 //! By default everything in DVID has 32x32x32 blocks
 const int DEFBLOCKSIZE = 32;
 
-//! Gives the limit for how many vertice can be operated on in one call
+//! Initial number of vertices operated on in one labelgraph call
+//! (see AdaptiveBatchSizer)
 const int TransactionLimit = 1000;
 
 }
@@ -0,0 +1,111 @@
+/*!
+ * This file measures the performance of bulk loading a large
+ * DVID labelgraph from a local JSON or binary graph file.  The
+ * graph can also be converted to the binary format.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDServerService.h>
+#include <libdvid/DVIDNodeService.h>
+#include <libdvid/DVIDGraphLoader.h>
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+#include "ScopeTime.h"
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::string;
+using std::vector;
+
+/*!
+ * Measure performance of parsing and loading a large graph
+ * (example graph in input folder).
+*/
+int main(int argc, char** argv)
+{
+    if (argc < 3 || argc > 5) {
+        cout << "Usage: <program> <server_name> <graph file> "
+            "[num threads] [binary graph output]" << endl;
+        return -1;
+    }
+    int num_threads = (argc > 3) ? atoi(argv[3]) : 4;
+
+    try {
+        ScopeTime overall_time;
+
+        // parse graph without loading it
+        size_t num_vertices = 0, num_edges = 0;
+        {
+            ScopeTime read_timer(false);
+            Graph graph;
+            read_graph_file(argv[2], graph, num_threads);
+            double read_time = read_timer.getElapsed();
+            num_vertices = graph.vertices.size();
+            num_edges = graph.edges.size();
+            cout << "Total vertices: " << num_vertices << endl;
+            cout << "Total edges: " << num_edges << endl;
+            cout << "Time to parse graph: " << read_time << endl;
+
+            if (argc > 4) {
+                write_graph_binary(argv[4], graph);
+                cout << "Wrote binary graph: " << argv[4] << endl;
+            }
+        }
+
+        DVIDServerService server(argv[1]);
+        std::string uuid = server.create_new_repo("newrepo",
+                "This is my new repo");
+        DVIDNodeService dvid_node(argv[1], uuid);
+
+        // name of graph to use
+        string graph_datatype_name = "graphtest";
+
+        // check existence (should be new)
+        if(!dvid_node.create_graph(graph_datatype_name)) {
+            cerr << graph_datatype_name << " already exists" << endl;
+            return -1;
+        }
+
+        // parse and load graph concurrently
+        {
+            ScopeTime write_timer(false);
+            GraphLoadResult result = load_graph_file(dvid_node,
+                    graph_datatype_name, argv[2], num_threads);
+            double write_time = write_timer.getElapsed();
+            cout << "Time to load graph: " << write_time << endl;
+            cout << "Vertices and edges written per second: "
+                << (result.num_vertices + result.num_edges) / write_time << endl;
+
+            if (!result.vertex_errors.empty() || !result.edge_errors.empty()) {
+                cerr << result.vertex_errors.size() << " vertex and " <<
+                    result.edge_errors.size() << " edge batches failed" << endl;
+                return -1;
+            }
+        }
+
+        // bulk get graph
+        {
+            ScopeTime read_timer(false);
+            vector<Vertex> vertices_temp;
+            Graph graph_read;
+            dvid_node.get_subgraph(graph_datatype_name, vertices_temp, graph_read);
+            double read_time = read_timer.getElapsed();
+            cout << "Time to read graph: " << read_time << endl;
+            cout << "Vertices and edges read per second: "
+                << (num_vertices + num_edges) / read_time << endl;
+            if (graph_read.vertices.size() != num_vertices) {
+                cerr << "Loaded graph has the wrong number of vertices" << endl;
+                return -1;
+            }
+        }
+
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
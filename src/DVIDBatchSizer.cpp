@@ -0,0 +1,67 @@
+#include "DVIDBatchSizer.h"
+
+#include <algorithm>
+
+namespace libdvid {
+
+AdaptiveBatchSizer::AdaptiveBatchSizer(size_t min_size_, size_t max_size_,
+        size_t initial_size) : current_size(initial_size), max_latency(2.0),
+    max_payload_bytes(32 << 20), max_failure_rate(0.1),
+    increase(TransactionLimit / 10), decrease(0.5)
+{
+    set_bounds(min_size_, max_size_);
+}
+
+void AdaptiveBatchSizer::set_bounds(size_t min_size_, size_t max_size_)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    // edge batches need room for both vertices of an edge
+    min_size = std::max(min_size_, size_t(2));
+    max_size = std::max(max_size_, min_size);
+    current_size = std::min(std::max(current_size, min_size), max_size);
+}
+
+void AdaptiveBatchSizer::set_targets(double max_latency_,
+        size_t max_payload_bytes_, double max_failure_rate_)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    max_latency = max_latency_;
+    max_payload_bytes = max_payload_bytes_;
+    max_failure_rate = max_failure_rate_;
+}
+
+void AdaptiveBatchSizer::set_steps(size_t increase_, double decrease_)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    increase = increase_;
+    decrease = std::min(std::max(decrease_, 0.0), 1.0);
+}
+
+size_t AdaptiveBatchSizer::batch_size() const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return current_size;
+}
+
+void AdaptiveBatchSizer::record(size_t num_items, size_t payload_bytes,
+        double seconds, size_t num_failed, bool error)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    bool overloaded = error || (seconds > max_latency) ||
+        (payload_bytes > max_payload_bytes) ||
+        (num_failed > max_failure_rate * num_items);
+
+    if (overloaded) {
+        // decrease relative to the size of the reported batch so that
+        // several batches in flight at the same size only cut it once
+        size_t reduced = size_t(std::min(current_size, num_items) * decrease);
+        current_size = std::max(std::min(current_size, reduced), min_size);
+    } else if (num_items + 1 >= current_size) {
+        // partially filled batches say little about larger ones (edge
+        // batches stop one vertex short of the size)
+        current_size = std::min(current_size + increase, max_size);
+    }
+}
+
+}
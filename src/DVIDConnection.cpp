@@ -31,6 +31,122 @@ WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
 
 namespace libdvid {
 
+/*!
+ * State for streaming a response body to a callback.  The status
+ * is checked when the first data arrives.
+*/
+struct StreamTarget {
+    StreamTarget(CURL* curl_, ResponseCallback& callback_, string& error_body_) :
+        curl(curl_), callback(callback_), error_body(error_body_),
+        status_known(false), success(false) {}
+
+    CURL* curl;
+    ResponseCallback& callback;
+    string& error_body;
+    bool status_known;
+    bool success;
+    string callback_error;
+};
+
+//! Function for libcurl that forwards results to a ResponseCallback
+static size_t
+WriteStreamCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    StreamTarget* target = (StreamTarget*) userp;
+    if (!target->status_known) {
+        long http_code = 0;
+        curl_easy_getinfo(target->curl, CURLINFO_RESPONSE_CODE, &http_code);
+        target->success = (http_code >= 200 && http_code < 300);
+        target->status_known = true;
+    }
+
+    if (!target->success) {
+        target->error_body.append((const char*) contents, realsize);
+        return realsize;
+    }
+
+    // exceptions cannot pass through libcurl -- abort the transfer instead
+    try {
+        target->callback((const char*) contents, realsize);
+    } catch (std::exception& e) {
+        target->callback_error = e.what();
+        return 0;
+    }
+    return realsize;
+}
+
+/*!
+ * Streamed payload and progress reporting of a request.  Errors
+ * raised by the callbacks are stored in error.
+*/
+struct TransferOptions {
+    TransferOptions(RequestSource& source_, int64 payload_size_,
+            TransferProgress& progress_, string& error_) : source(source_),
+        payload_size(payload_size_), progress(progress_),
+        last_transferred(-1), last_total(-1), error(error_) {}
+
+    RequestSource& source;
+    int64 payload_size;
+    TransferProgress& progress;
+
+    //! last values reported to progress
+    curl_off_t last_transferred, last_total;
+
+    string& error;
+};
+
+//! Function for libcurl that reads the payload from a RequestSource
+static size_t
+ReadStreamCallback(char* buffer, size_t size, size_t nitems, void* userp)
+{
+    TransferOptions* options = (TransferOptions*) userp;
+    size_t max_length = size * nitems;
+    try {
+        size_t length = options->source(buffer, max_length);
+        if (length > max_length) {
+            throw ErrMsg("Request source returned too much data");
+        }
+        return length;
+    } catch (std::exception& e) {
+        options->error = e.what();
+        return CURL_READFUNC_ABORT;
+    }
+}
+
+//! Function for libcurl used by requests without a streamed payload
+static size_t
+EmptyReadCallback(char* buffer, size_t size, size_t nitems, void* userp)
+{
+    return 0;
+}
+
+//! Function for libcurl that reports changes in progress
+static int
+ProgressCallback(void* userp, curl_off_t dltotal, curl_off_t dlnow,
+        curl_off_t ultotal, curl_off_t ulnow)
+{
+    TransferOptions* options = (TransferOptions*) userp;
+    curl_off_t transferred = options->source ? ulnow : dlnow;
+    curl_off_t total = options->source ? ultotal : dltotal;
+    if (transferred == options->last_transferred &&
+            total == options->last_total) {
+        return 0;
+    }
+    options->last_transferred = transferred;
+    options->last_total = total;
+    try {
+        options->progress(uint64(transferred), uint64(total));
+    } catch (std::exception& e) {
+        options->error = e.what();
+        return 1;
+    }
+    return 0;
+}
+
+//! Response callback that ignores the response body
+static void DiscardResponse(const char* data, size_t length) {}
+
 const int DVIDConnection::DEFAULT_TIMEOUT;
 
 //! Defines DVID prefix -- this might have a version ID eventually 
@@ -55,6 +171,53 @@ DVIDConnection::~DVIDConnection()
 int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
         BinaryDataPtr payload, BinaryDataPtr results, string& error_msg,
         ConnectionType type, int timeout)
+{
+    // results should be an empty binary array
+    assert(results);
+    assert(results->length() == 0);
+
+    // pass the raw pointer to the write data command
+    string& raw_data = results->get_data();
+
+    return perform_request(endpoint, method, payload, WriteMemoryCallback,
+            (void *)&raw_data, error_msg, type, timeout, 0);
+}
+
+int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
+        BinaryDataPtr payload, ResponseCallback callback, BinaryDataPtr results,
+        string& error_msg, ConnectionType type, int timeout)
+{
+    assert(results);
+    assert(results->length() == 0);
+
+    StreamTarget target(curl_connection, callback, results->get_data());
+    return perform_request(endpoint, method, payload, WriteStreamCallback,
+            (void *)&target, error_msg, type, timeout, &target.callback_error);
+}
+
+int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
+        RequestSource source, int64 payload_size, ResponseCallback callback,
+        TransferProgress progress, BinaryDataPtr results, string& error_msg,
+        ConnectionType type, int timeout)
+{
+    assert(results);
+    assert(results->length() == 0);
+
+    if (!callback) {
+        callback = DiscardResponse;
+    }
+    StreamTarget target(curl_connection, callback, results->get_data());
+    TransferOptions options(source, payload_size, progress,
+            target.callback_error);
+    return perform_request(endpoint, method, BinaryDataPtr(),
+            WriteStreamCallback, (void *)&target, error_msg, type, timeout,
+            &target.callback_error, &options);
+}
+
+int DVIDConnection::perform_request(string endpoint, ConnectionMethod method,
+        BinaryDataPtr payload, size_t (*write_function)(void*, size_t, size_t, void*),
+        void* write_data, string& error_msg, ConnectionType type, int timeout,
+        string* callback_error, TransferOptions* options)
 {
     CURLcode result;
 
@@ -64,7 +227,13 @@ int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
         headers = curl_slist_append(headers, "Content-Type: application/json");
     } else if (type == BINARY) {
         headers = curl_slist_append(headers, "Content-Type: application/octet-stream");
+    } else if (type == PROTOBUF) {
+        headers = curl_slist_append(headers, "Content-Type: application/x-protobuf");
     } 
+    bool stream_payload = options && options->source;
+    if (stream_payload && options->payload_size < 0) {
+        headers = curl_slist_append(headers, "Transfer-Encoding: chunked");
+    }
     curl_easy_setopt(curl_connection, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(curl_connection, CURLOPT_NOSIGNAL, 1);
 
@@ -86,11 +255,38 @@ int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
         curl_easy_setopt(curl_connection, CURLOPT_CUSTOMREQUEST, "DELETE");
     }
 
-    // set to 0 for infinite
-    curl_easy_setopt(curl_connection, CURLOPT_TIMEOUT, long(timeout));
+    if (options) {
+        // streamed transfers can take arbitrarily long, so only
+        // stalls are timed out
+        curl_easy_setopt(curl_connection, CURLOPT_TIMEOUT, 0L);
+        curl_easy_setopt(curl_connection, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(curl_connection, CURLOPT_LOW_SPEED_TIME, long(timeout));
+    } else {
+        // set to 0 for infinite
+        curl_easy_setopt(curl_connection, CURLOPT_TIMEOUT, long(timeout));
+        curl_easy_setopt(curl_connection, CURLOPT_LOW_SPEED_TIME, 0L);
+    }
+
+    // report progress
+    if (options && options->progress) {
+        curl_easy_setopt(curl_connection, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl_connection, CURLOPT_XFERINFOFUNCTION,
+                ProgressCallback);
+        curl_easy_setopt(curl_connection, CURLOPT_XFERINFODATA, options);
+    } else {
+        curl_easy_setopt(curl_connection, CURLOPT_NOPROGRESS, 1L);
+    }
 
     // post binary data
-    if (payload) {
+    if (stream_payload) {
+        // payload is read as it is sent (size -1 for chunked encoding)
+        curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDS, 0);
+        curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDSIZE_LARGE,
+                curl_off_t(options->payload_size));
+        curl_easy_setopt(curl_connection, CURLOPT_READFUNCTION,
+                ReadStreamCallback);
+        curl_easy_setopt(curl_connection, CURLOPT_READDATA, options);
+    } else if (payload) {
         // set binary payload and indicate size
         curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDS, payload->get_raw());
         curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDSIZE, long(payload->length()));
@@ -98,17 +294,14 @@ int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
         curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDS, 0);
         curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDSIZE, long(0));
     }
-    
-    // results should be an empty binary array
-    assert(results);
-    assert(results->length() == 0);
-
-    // pass the raw pointer to the write data command
-    string& raw_data = results->get_data();
+    if (!stream_payload) {
+        curl_easy_setopt(curl_connection, CURLOPT_READFUNCTION,
+                EmptyReadCallback);
+    }
 
     // set callback for writing data
-    curl_easy_setopt(curl_connection, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl_connection, CURLOPT_WRITEDATA, (void *)&raw_data);
+    curl_easy_setopt(curl_connection, CURLOPT_WRITEFUNCTION, write_function);
+    curl_easy_setopt(curl_connection, CURLOPT_WRITEDATA, write_data);
 
     // set verbose only for debug
     //curl_easy_setopt(curl_connection, CURLOPT_VERBOSE, 1L);
@@ -124,6 +317,11 @@ int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
     // get the error code
     long http_code = 0;
     curl_easy_getinfo (curl_connection, CURLINFO_RESPONSE_CODE, &http_code);
+
+    // report errors raised while processing streamed data
+    if (callback_error && !callback_error->empty()) {
+        throw ErrMsg(*callback_error);
+    }
     
     // throw exception if connection doesn't work
     if (result != CURLE_OK) {
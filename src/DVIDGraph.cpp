@@ -1,4 +1,5 @@
 #include "DVIDGraph.h"
+#include "DVIDJsonStream.h"
 
 using std::string;
 
@@ -71,6 +72,46 @@ void Graph::export_json(Json::Value& data)
     data["Edges"] = edges_data;
 }
 
+void Graph::export_json(string& buffer) const
+{
+    write_graph_json(vertices.empty() ? 0 : &vertices[0], vertices.size(),
+            edges.empty() ? 0 : &edges[0], edges.size(), buffer);
+}
+
+void write_graph_json(const Vertex* vertices, size_t num_vertices,
+        const Edge* edges, size_t num_edges, string& buffer)
+{
+    // rough upper estimate of the serialized size to avoid regrowth
+    buffer.reserve(buffer.size() + 32 + num_vertices*48 + num_edges*72);
+
+    buffer += "{\"Vertices\":[";
+    for (size_t i = 0; i < num_vertices; ++i) {
+        if (i) {
+            buffer += ',';
+        }
+        buffer += "{\"Id\":";
+        json_append_uint64(buffer, vertices[i].id);
+        buffer += ",\"Weight\":";
+        json_append_double(buffer, vertices[i].weight);
+        buffer += '}';
+    }
+
+    buffer += "],\"Edges\":[";
+    for (size_t i = 0; i < num_edges; ++i) {
+        if (i) {
+            buffer += ',';
+        }
+        buffer += "{\"Id1\":";
+        json_append_uint64(buffer, edges[i].id1);
+        buffer += ",\"Id2\":";
+        json_append_uint64(buffer, edges[i].id2);
+        buffer += ",\"Weight\":";
+        json_append_double(buffer, edges[i].weight);
+        buffer += '}';
+    }
+    buffer += "]}";
+}
+
 BinaryDataPtr write_transactions_to_binary(VertexTransactions& transactions)
 {
     uint64 * trans_array =
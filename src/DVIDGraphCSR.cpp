@@ -0,0 +1,395 @@
+#include "DVIDGraphCSR.h"
+#include "DVIDParallel.h"
+
+#include <algorithm>
+#include <utility>
+
+using std::vector; using std::pair;
+
+namespace libdvid {
+
+/*!
+ * Adjacency of new edges in CSR form.  Each thread counts the entries
+ * of its chunk of edges per row (histogram), so the chunks can be
+ * scattered without locking while keeping the input order in each row.
+*/
+struct DeltaRows {
+    vector<size_t> offsets;
+    vector<unsigned int> neighbors;
+    vector<double> weights;
+};
+
+struct CountEntries {
+    CountEntries(const vector<unsigned int>& src_, const vector<unsigned int>& dst_,
+            vector<vector<unsigned int> >& counts_) : src(src_), dst(dst_),
+        counts(counts_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        vector<unsigned int>& count = counts[thread];
+        for (size_t i = begin; i < end; ++i) {
+            ++count[src[i]];
+            if (src[i] != dst[i]) {
+                ++count[dst[i]];
+            }
+        }
+    }
+
+    const vector<unsigned int>& src;
+    const vector<unsigned int>& dst;
+    vector<vector<unsigned int> >& counts;
+};
+
+//! Turns the per-thread counts into per-thread write positions
+struct AssignPositions {
+    AssignPositions(const vector<size_t>& offsets_,
+            vector<vector<unsigned int> >& counts_) : offsets(offsets_),
+        counts(counts_) {}
+
+    void operator()(size_t begin, size_t end, int)
+    {
+        for (size_t row = begin; row < end; ++row) {
+            size_t pos = offsets[row];
+            for (size_t t = 0; t < counts.size(); ++t) {
+                unsigned int count = counts[t][row];
+                counts[t][row] = (unsigned int)(pos - offsets[row]);
+                pos += count;
+            }
+        }
+    }
+
+    const vector<size_t>& offsets;
+    vector<vector<unsigned int> >& counts;
+};
+
+struct ScatterEntries {
+    ScatterEntries(const vector<unsigned int>& src_, const vector<unsigned int>& dst_,
+            const vector<double>& weights_, vector<vector<unsigned int> >& positions_,
+            DeltaRows& delta_) : src(src_), dst(dst_), weights(weights_),
+        positions(positions_), delta(delta_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        vector<unsigned int>& position = positions[thread];
+        for (size_t i = begin; i < end; ++i) {
+            size_t pos = delta.offsets[src[i]] + position[src[i]]++;
+            delta.neighbors[pos] = dst[i];
+            delta.weights[pos] = weights[i];
+            if (src[i] != dst[i]) {
+                pos = delta.offsets[dst[i]] + position[dst[i]]++;
+                delta.neighbors[pos] = src[i];
+                delta.weights[pos] = weights[i];
+            }
+        }
+    }
+
+    const vector<unsigned int>& src;
+    const vector<unsigned int>& dst;
+    const vector<double>& weights;
+    vector<vector<unsigned int> >& positions;
+    DeltaRows& delta;
+};
+
+//! Orders row entries by neighbor
+static bool neighbor_less(const pair<unsigned int, double>& a,
+        const pair<unsigned int, double>& b)
+{
+    return a.first < b.first;
+}
+
+/*!
+ * Sorts each row by neighbor and removes duplicate entries (keeping
+ * the last one in input order).  The new row lengths are returned.
+*/
+struct SortRows {
+    SortRows(DeltaRows& delta_, vector<size_t>& lengths_) : delta(delta_),
+        lengths(lengths_) {}
+
+    void operator()(size_t begin, size_t end, int)
+    {
+        vector<pair<unsigned int, double> > row;
+        for (size_t r = begin; r < end; ++r) {
+            size_t start = delta.offsets[r];
+            size_t stop = delta.offsets[r+1];
+            row.clear();
+            for (size_t i = start; i < stop; ++i) {
+                row.push_back(std::make_pair(delta.neighbors[i], delta.weights[i]));
+            }
+            std::stable_sort(row.begin(), row.end(), neighbor_less);
+
+            size_t length = 0;
+            for (size_t i = 0; i < row.size(); ++i) {
+                if (i + 1 < row.size() && row[i+1].first == row[i].first) {
+                    continue;
+                }
+                delta.neighbors[start + length] = row[i].first;
+                delta.weights[start + length] = row[i].second;
+                ++length;
+            }
+            lengths[r] = length;
+        }
+    }
+
+    DeltaRows& delta;
+    vector<size_t>& lengths;
+};
+
+/*!
+ * Merges the existing rows with the sorted new rows.  The first pass
+ * (fill false) only computes the merged row lengths.
+*/
+struct MergeRows {
+    MergeRows(const vector<size_t>& old_offsets_,
+            const vector<unsigned int>& old_neighbors_,
+            const vector<double>& old_weights_, const DeltaRows& delta_,
+            const vector<size_t>& delta_lengths_, vector<size_t>& offsets_,
+            vector<unsigned int>& neighbors_, vector<double>& weights_,
+            vector<size_t>& self_loops_, bool fill_) :
+        old_offsets(old_offsets_), old_neighbors(old_neighbors_),
+        old_weights(old_weights_), delta(delta_), delta_lengths(delta_lengths_),
+        offsets(offsets_), neighbors(neighbors_), weights(weights_),
+        self_loops(self_loops_), fill(fill_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        size_t loops = 0;
+        for (size_t r = begin; r < end; ++r) {
+            size_t i = 0, i_end = 0;
+            if (r + 1 < old_offsets.size()) {
+                i = old_offsets[r];
+                i_end = old_offsets[r+1];
+            }
+            size_t j = delta.offsets[r];
+            size_t j_end = j + delta_lengths[r];
+            size_t pos = fill ? offsets[r] : 0;
+            size_t length = 0;
+
+            while (i < i_end || j < j_end) {
+                unsigned int neighbor;
+                double weight;
+                if (j == j_end || (i < i_end && old_neighbors[i] < delta.neighbors[j])) {
+                    neighbor = old_neighbors[i];
+                    weight = old_weights[i];
+                    ++i;
+                } else {
+                    // new values replace existing ones
+                    if (i < i_end && old_neighbors[i] == delta.neighbors[j]) {
+                        ++i;
+                    }
+                    neighbor = delta.neighbors[j];
+                    weight = delta.weights[j];
+                    ++j;
+                }
+                if (fill) {
+                    neighbors[pos + length] = neighbor;
+                    weights[pos + length] = weight;
+                    if (neighbor == r) {
+                        ++loops;
+                    }
+                }
+                ++length;
+            }
+            if (!fill) {
+                offsets[r] = length;
+            }
+        }
+        self_loops[thread] = loops;
+    }
+
+    const vector<size_t>& old_offsets;
+    const vector<unsigned int>& old_neighbors;
+    const vector<double>& old_weights;
+    const DeltaRows& delta;
+    const vector<size_t>& delta_lengths;
+    vector<size_t>& offsets;
+    vector<unsigned int>& neighbors;
+    vector<double>& weights;
+    vector<size_t>& self_loops;
+    bool fill;
+};
+
+GraphCSR::GraphCSR(const Graph& graph, int num_threads) : offsets(1, 0),
+    edge_count(0)
+{
+    merge(graph, num_threads);
+}
+
+unsigned int GraphCSR::add_vertex(VertexID id)
+{
+    unsigned int& index = index_map[id];
+    if (index == 0) {
+        // indices are stored off by one so that 0 means new
+        ids.push_back(id);
+        weights.push_back(0);
+        index = (unsigned int)(ids.size());
+    }
+    return index - 1;
+}
+
+void GraphCSR::merge(const Graph& graph, int num_threads)
+{
+    // map ids to dense indices (existing indices do not change)
+    index_map.reserve(ids.size() + graph.vertices.size());
+    for (size_t i = 0; i < graph.vertices.size(); ++i) {
+        weights[add_vertex(graph.vertices[i].id)] = graph.vertices[i].weight;
+    }
+    size_t num_new_edges = graph.edges.size();
+    vector<unsigned int> src(num_new_edges), dst(num_new_edges);
+    vector<double> new_weights(num_new_edges);
+    for (size_t i = 0; i < num_new_edges; ++i) {
+        src[i] = add_vertex(graph.edges[i].id1);
+        dst[i] = add_vertex(graph.edges[i].id2);
+        new_weights[i] = graph.edges[i].weight;
+    }
+    size_t num_rows = ids.size();
+
+    // build sorted rows for the new edges
+    DeltaRows delta;
+    int edge_threads = threads_for(num_new_edges, num_threads);
+    int row_threads = threads_for(num_rows, num_threads);
+    vector<vector<unsigned int> > counts(edge_threads,
+            vector<unsigned int>(num_rows, 0));
+    parallel_ranges(num_new_edges, edge_threads, CountEntries(src, dst, counts));
+
+    delta.offsets.resize(num_rows + 1, 0);
+    for (size_t r = 0; r < num_rows; ++r) {
+        size_t total = 0;
+        for (int t = 0; t < edge_threads; ++t) {
+            total += counts[t][r];
+        }
+        delta.offsets[r+1] = delta.offsets[r] + total;
+    }
+    delta.neighbors.resize(delta.offsets[num_rows]);
+    delta.weights.resize(delta.offsets[num_rows]);
+
+    parallel_ranges(num_rows, row_threads, AssignPositions(delta.offsets, counts));
+    parallel_ranges(num_new_edges, edge_threads,
+            ScatterEntries(src, dst, new_weights, counts, delta));
+    counts.clear();
+
+    vector<size_t> delta_lengths(num_rows, 0);
+    parallel_ranges(num_rows, row_threads, SortRows(delta, delta_lengths));
+
+    // merge with the existing rows
+    vector<size_t> merged_offsets(num_rows + 1, 0);
+    vector<unsigned int> merged_neighbors;
+    vector<double> merged_weights;
+    vector<size_t> self_loops(row_threads, 0);
+    parallel_ranges(num_rows, row_threads, MergeRows(offsets, neighbor_indices,
+                edge_weights, delta, delta_lengths, merged_offsets,
+                merged_neighbors, merged_weights, self_loops, false));
+
+    // convert lengths to offsets
+    size_t total = 0;
+    for (size_t r = 0; r < num_rows; ++r) {
+        size_t length = merged_offsets[r];
+        merged_offsets[r] = total;
+        total += length;
+    }
+    merged_offsets[num_rows] = total;
+    merged_neighbors.resize(total);
+    merged_weights.resize(total);
+
+    parallel_ranges(num_rows, row_threads, MergeRows(offsets, neighbor_indices,
+                edge_weights, delta, delta_lengths, merged_offsets,
+                merged_neighbors, merged_weights, self_loops, true));
+
+    size_t num_loops = 0;
+    for (size_t t = 0; t < self_loops.size(); ++t) {
+        num_loops += self_loops[t];
+    }
+
+    offsets.swap(merged_offsets);
+    neighbor_indices.swap(merged_neighbors);
+    edge_weights.swap(merged_weights);
+    edge_count = (total + num_loops) / 2;
+}
+
+bool GraphCSR::index_of(VertexID id, unsigned int& index) const
+{
+    const unsigned int* found = index_map.find(id);
+    if (!found) {
+        return false;
+    }
+    index = *found - 1;
+    return true;
+}
+
+size_t GraphCSR::degree(VertexID id) const
+{
+    unsigned int index;
+    if (!index_of(id, index)) {
+        return 0;
+    }
+    return offsets[index+1] - offsets[index];
+}
+
+void GraphCSR::neighbors(VertexID id, vector<VertexID>& neighbor_ids) const
+{
+    neighbor_ids.clear();
+    unsigned int index;
+    if (!index_of(id, index)) {
+        return;
+    }
+    for (size_t i = offsets[index]; i < offsets[index+1]; ++i) {
+        neighbor_ids.push_back(ids[neighbor_indices[i]]);
+    }
+}
+
+bool GraphCSR::vertex_weight(VertexID id, double& weight) const
+{
+    unsigned int index;
+    if (!index_of(id, index)) {
+        return false;
+    }
+    weight = weights[index];
+    return true;
+}
+
+size_t GraphCSR::find_entry(unsigned int index1, unsigned int index2) const
+{
+    vector<unsigned int>::const_iterator start = neighbor_indices.begin() + offsets[index1];
+    vector<unsigned int>::const_iterator stop = neighbor_indices.begin() + offsets[index1+1];
+    vector<unsigned int>::const_iterator iter = std::lower_bound(start, stop, index2);
+    if (iter == stop || *iter != index2) {
+        return size_t(-1);
+    }
+    return iter - neighbor_indices.begin();
+}
+
+bool GraphCSR::edge_weight(VertexID id1, VertexID id2, double& weight) const
+{
+    unsigned int index1, index2;
+    if (!index_of(id1, index1) || !index_of(id2, index2)) {
+        return false;
+    }
+    // search the shorter row
+    if ((offsets[index1+1] - offsets[index1]) > (offsets[index2+1] - offsets[index2])) {
+        std::swap(index1, index2);
+    }
+    size_t pos = find_entry(index1, index2);
+    if (pos == size_t(-1)) {
+        return false;
+    }
+    weight = edge_weights[pos];
+    return true;
+}
+
+void GraphCSR::export_graph(Graph& graph) const
+{
+    graph.vertices.reserve(graph.vertices.size() + ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        graph.vertices.push_back(Vertex(ids[i], weights[i]));
+    }
+    graph.edges.reserve(graph.edges.size() + edge_count);
+    for (size_t r = 0; r < ids.size(); ++r) {
+        for (size_t i = offsets[r]; i < offsets[r+1]; ++i) {
+            if (neighbor_indices[i] >= r) {
+                graph.edges.push_back(Edge(ids[r], ids[neighbor_indices[i]],
+                            edge_weights[i]));
+            }
+        }
+    }
+}
+
+}
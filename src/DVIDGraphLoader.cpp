@@ -0,0 +1,641 @@
+#include "DVIDGraphLoader.h"
+#include "DVIDException.h"
+
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+
+using std::string; using std::vector;
+
+namespace libdvid {
+
+//! Identifies the binary graph format
+static const char GraphBinaryMagic[] = "DVIDGRF1";
+static const size_t GraphBinaryMagicSize = 8;
+
+//! Bytes per record in the binary format
+static const size_t BinaryVertexSize = 16;
+static const size_t BinaryEdgeSize = 24;
+
+/*!
+ * Posts one serialized batch of a graph update, records the error
+ * if DVID rejects it and releases the vertices of the batch.
+*/
+struct PostGraphBatch {
+    PostGraphBatch(GraphUploader& uploader_, BinaryDataPtr payload_,
+            size_t start_, size_t count_,
+            boost::shared_ptr<VertexSet> vertices_,
+            vector<GraphBatchError>& errors_) :
+        uploader(uploader_), payload(payload_), start(start_), count(count_),
+        vertices(vertices_), sizer(uploader_.sizer), errors(errors_) {}
+
+    void operator()(DVIDNodeService& service)
+    {
+        BatchTimer timer;
+        try {
+            service.custom_request(uploader.endpoint, payload, POST);
+            sizer->record(vertices->size(), payload->length(),
+                    timer.elapsed(), 0, false);
+        } catch (std::exception& e) {
+            sizer->record(vertices->size(), payload->length(),
+                    timer.elapsed(), 0, true);
+            boost::mutex::scoped_lock lock(uploader.errors_mutex);
+            errors.push_back(GraphBatchError(start, count, e.what()));
+        }
+        uploader.release_vertices(*vertices);
+    }
+
+    GraphUploader& uploader;
+    BinaryDataPtr payload;
+    size_t start, count;
+
+    //! distinct vertices in the batch
+    boost::shared_ptr<VertexSet> vertices;
+
+    AdaptiveBatchSizerPtr sizer;
+    vector<GraphBatchError>& errors;
+};
+
+//! Orders batch errors by their position in the update
+static bool batch_error_less(const GraphBatchError& a, const GraphBatchError& b)
+{
+    return a.start < b.start;
+}
+
+GraphUploader::GraphUploader(DVIDNodeService& service, string graph_name,
+        int num_threads) : endpoint("/" + graph_name + "/weight"),
+    pool(service, num_threads), vertex_count(0), edge_count(0),
+    sizer(service.get_graph_batch_sizer()), batch_limit(sizer->batch_size())
+{
+}
+
+void GraphUploader::add_vertices(const Vertex* vertices, size_t num_vertices)
+{
+    while (num_vertices > 0) {
+        // fill the current batch up to the batch size
+        size_t count = std::min(num_vertices,
+                batch_limit - std::min(batch_limit, pending_vertices.size()));
+        pending_vertices.insert(pending_vertices.end(), vertices,
+                vertices + count);
+        vertex_count += count;
+        vertices += count;
+        num_vertices -= count;
+
+        if (pending_vertices.size() >= batch_limit) {
+            send_vertices();
+        }
+    }
+}
+
+void GraphUploader::add_edges(const Edge* edges, size_t num_edges)
+{
+    for (size_t i = 0; i < num_edges; ++i) {
+        // send the batch if it is not possible to add another edge
+        // transaction (assuming that both vertices of the edge will be
+        // new vertices for simplicity)
+        if (pending_edge_vertices.size() >= batch_limit - 1) {
+            send_edges();
+        }
+        pending_edge_vertices.insert(edges[i].id1);
+        pending_edge_vertices.insert(edges[i].id2);
+        pending_edges.push_back(edges[i]);
+        ++edge_count;
+    }
+}
+
+void GraphUploader::flush()
+{
+    send_vertices();
+    send_edges();
+    pool.wait();
+
+    boost::mutex::scoped_lock lock(errors_mutex);
+    std::sort(failed_vertices.begin(), failed_vertices.end(), batch_error_less);
+    std::sort(failed_edges.begin(), failed_edges.end(), batch_error_less);
+}
+
+void GraphUploader::send_vertices()
+{
+    if (pending_vertices.empty()) {
+        return;
+    }
+    BinaryDataPtr binary = BinaryData::create_binary_data();
+    write_graph_json(&pending_vertices[0], pending_vertices.size(), 0, 0,
+            binary->get_data());
+    boost::shared_ptr<VertexSet> vertices(new VertexSet);
+    for (size_t i = 0; i < pending_vertices.size(); ++i) {
+        vertices->insert(pending_vertices[i].id);
+    }
+    claim_vertices(*vertices);
+    pool.submit(PostGraphBatch(*this, binary,
+                vertex_count - pending_vertices.size(), pending_vertices.size(),
+                vertices, failed_vertices));
+    pending_vertices.clear();
+    batch_limit = sizer->batch_size();
+}
+
+void GraphUploader::send_edges()
+{
+    if (pending_edges.empty()) {
+        return;
+    }
+    BinaryDataPtr binary = BinaryData::create_binary_data();
+    write_graph_json(0, 0, &pending_edges[0], pending_edges.size(),
+            binary->get_data());
+    boost::shared_ptr<VertexSet> vertices(new VertexSet);
+    vertices->swap(pending_edge_vertices);
+    claim_vertices(*vertices);
+    pool.submit(PostGraphBatch(*this, binary,
+                edge_count - pending_edges.size(), pending_edges.size(),
+                vertices, failed_edges));
+    pending_edges.clear();
+    batch_limit = sizer->batch_size();
+}
+
+void GraphUploader::claim_vertices(const VertexSet& vertices)
+{
+    // only the caller's thread claims vertices, so a released
+    // vertex stays free until the batch is claimed
+    boost::mutex::scoped_lock lock(busy_mutex);
+    for (VertexSet::const_iterator iter = vertices.begin();
+            iter != vertices.end(); ++iter) {
+        while (busy_vertices.count(*iter)) {
+            vertices_released.wait(lock);
+        }
+    }
+    busy_vertices.insert(vertices.begin(), vertices.end());
+}
+
+void GraphUploader::release_vertices(const VertexSet& vertices)
+{
+    {
+        boost::mutex::scoped_lock lock(busy_mutex);
+        for (VertexSet::const_iterator iter = vertices.begin();
+                iter != vertices.end(); ++iter) {
+            busy_vertices.erase(*iter);
+        }
+    }
+    vertices_released.notify_all();
+}
+
+/************* Graph file parsing ******************/
+
+//! Arrays of the labelgraph JSON format
+enum GraphSection { SECTION_OTHER, SECTION_VERTICES, SECTION_EDGES };
+
+/*!
+ * Parses the records of a vertex or edge array in [begin, end).
+ * Records are flat objects ({"Id": 1, "Weight": 2} or
+ * {"Id1": 1, "Id2": 2, "Weight": 3}), so each ends at the next '}'.
+ * Errors are recorded rather than thrown since this runs on its own thread.
+*/
+struct ParseGraphRecords {
+    ParseGraphRecords(const char* begin_, const char* end_,
+            GraphSection section_, vector<Vertex>& vertices_,
+            vector<Edge>& edges_, string& error_) : begin(begin_), end(end_),
+        section(section_), vertices(vertices_), edges(edges_), error(error_) {}
+
+    void operator()()
+    {
+        const char* pos = begin;
+        while (pos < end) {
+            const char* start = (const char*) memchr(pos, '{', end - pos);
+            if (!start) {
+                break;
+            }
+            const char* stop = (const char*) memchr(start, '}', end - start);
+            if (!stop) {
+                error = "Could not decode graph file: unterminated record";
+                return;
+            }
+            if (!parse_record(start + 1, stop)) {
+                error = "Could not decode graph file: bad record " +
+                    string(start, stop + 1);
+                return;
+            }
+            pos = stop + 1;
+        }
+    }
+
+    //! Parse the fields of one record (the text between the braces)
+    bool parse_record(const char* pos, const char* stop)
+    {
+        VertexID id = 0, id1 = 0, id2 = 0;
+        double weight = 0;
+        bool has_id = false, has_id1 = false, has_id2 = false;
+
+        while (true) {
+            const char* key_start = (const char*) memchr(pos, '"', stop - pos);
+            if (!key_start) {
+                break;
+            }
+            ++key_start;
+            const char* key_end = (const char*) memchr(key_start, '"',
+                    stop - key_start);
+            if (!key_end) {
+                return false;
+            }
+            const char* value = (const char*) memchr(key_end, ':',
+                    stop - key_end);
+            if (!value) {
+                return false;
+            }
+            ++value;
+
+            string key(key_start, key_end);
+            char* value_end = const_cast<char*>(value);
+            if (key == "Weight") {
+                weight = strtod(value, &value_end);
+            } else if (key == "Id" || key == "Id1" || key == "Id2") {
+                VertexID number = parse_id(value, value_end);
+                if (key == "Id") {
+                    id = number; has_id = true;
+                } else if (key == "Id1") {
+                    id1 = number; has_id1 = true;
+                } else {
+                    id2 = number; has_id2 = true;
+                }
+            }
+
+            // skip the value (null or an unknown field)
+            if (value_end == value) {
+                value_end = (char*) memchr(value, ',', stop - value);
+                if (!value_end) {
+                    break;
+                }
+            }
+            pos = value_end;
+        }
+
+        if (section == SECTION_VERTICES) {
+            if (!has_id) {
+                return false;
+            }
+            vertices.push_back(Vertex(id, weight));
+        } else {
+            if (!has_id1 || !has_id2) {
+                return false;
+            }
+            edges.push_back(Edge(id1, id2, weight));
+        }
+        return true;
+    }
+
+    //! Parse an id (also accepts ids written as doubles)
+    static VertexID parse_id(const char* value, char*& value_end)
+    {
+        VertexID number = strtoull(value, &value_end, 10);
+        if (*value_end == '.' || *value_end == 'e' || *value_end == 'E') {
+            number = VertexID(strtod(value, &value_end));
+        }
+        return number;
+    }
+
+    const char* begin;
+    const char* end;
+    GraphSection section;
+    vector<Vertex>& vertices;
+    vector<Edge>& edges;
+    string& error;
+};
+
+/*!
+ * Finds the vertex and edge arrays in a JSON graph file read in chunks
+ * and parses the complete records of each chunk on several threads.
+ * Only the array brackets and keys are examined sequentially.
+*/
+class JsonGraphReader {
+  public:
+    JsonGraphReader(VertexBatchHandler vertex_handler_,
+            EdgeBatchHandler edge_handler_, int num_threads_) :
+        vertex_handler(vertex_handler_), edge_handler(edge_handler_),
+        num_threads(std::max(num_threads_, 1)), section(SECTION_OTHER),
+        in_array(false) {}
+
+    /*!
+     * Parse what can be parsed from buffer (starting at pos).  pos is
+     * moved past the data that is no longer needed.
+    */
+    void scan(const string& buffer, size_t& pos)
+    {
+        while (pos < buffer.size()) {
+            if (!in_array) {
+                size_t bracket = buffer.find('[', pos);
+                if (bracket == string::npos) {
+                    // the key of the next array might be incomplete
+                    return;
+                }
+                section = section_of(buffer, pos, bracket);
+                in_array = true;
+                pos = bracket + 1;
+                continue;
+            }
+
+            // records do not contain brackets
+            size_t array_end = buffer.find(']', pos);
+            size_t records_end = array_end;
+            if (array_end == string::npos) {
+                records_end = buffer.rfind('}');
+                if (records_end == string::npos || records_end < pos) {
+                    return;
+                }
+                ++records_end;
+            }
+            parse_records(buffer.data() + pos, buffer.data() + records_end);
+
+            if (array_end == string::npos) {
+                pos = records_end;
+                return;
+            }
+            in_array = false;
+            pos = array_end + 1;
+        }
+    }
+
+    //! Check that the file did not end inside of an array
+    void finish()
+    {
+        if (in_array) {
+            throw ErrMsg("Could not decode graph file: truncated array");
+        }
+    }
+
+  private:
+    //! Find the key preceding the array starting at bracket
+    GraphSection section_of(const string& buffer, size_t start, size_t bracket)
+    {
+        size_t key_end = buffer.rfind('"', bracket);
+        if (key_end == string::npos || key_end < start || key_end == 0) {
+            return SECTION_OTHER;
+        }
+        size_t key_start = buffer.rfind('"', key_end - 1);
+        if (key_start == string::npos || key_start < start) {
+            return SECTION_OTHER;
+        }
+        string key = buffer.substr(key_start + 1, key_end - key_start - 1);
+        if (key == "Vertices") {
+            return SECTION_VERTICES;
+        } else if (key == "Edges") {
+            return SECTION_EDGES;
+        }
+        return SECTION_OTHER;
+    }
+
+    //! Parse the records in [begin, end) and pass them to the handler
+    void parse_records(const char* begin, const char* end)
+    {
+        if ((section == SECTION_VERTICES && !vertex_handler) ||
+                (section == SECTION_EDGES && !edge_handler) ||
+                section == SECTION_OTHER || begin == end) {
+            return;
+        }
+
+        // split the records into one range per thread (small ranges
+        // are not worth a thread)
+        const size_t min_bytes_per_thread = 1 << 20;
+        size_t num_parts = std::min(size_t(num_threads),
+                size_t(end - begin) / min_bytes_per_thread + 1);
+        vector<const char*> bounds(1, begin);
+        for (size_t i = 1; i < num_parts; ++i) {
+            const char* split = begin + (end - begin) * i / num_parts;
+            split = std::max(split, bounds.back());
+            const char* record_end = (const char*) memchr(split, '}', end - split);
+            bounds.push_back(record_end ? record_end + 1 : end);
+        }
+        bounds.push_back(end);
+
+        vector<vector<Vertex> > vertices(num_parts);
+        vector<vector<Edge> > edges(num_parts);
+        vector<string> errors(num_parts);
+        if (num_parts == 1) {
+            ParseGraphRecords(begin, end, section, vertices[0], edges[0],
+                    errors[0])();
+        } else {
+            boost::thread_group threads;
+            for (size_t i = 0; i < num_parts; ++i) {
+                threads.create_thread(ParseGraphRecords(bounds[i], bounds[i+1],
+                            section, vertices[i], edges[i], errors[i]));
+            }
+            threads.join_all();
+        }
+
+        for (size_t i = 0; i < num_parts; ++i) {
+            if (!errors[i].empty()) {
+                throw ErrMsg(errors[i]);
+            }
+            if (section == SECTION_VERTICES && !vertices[i].empty()) {
+                vertex_handler(vertices[i]);
+            } else if (section == SECTION_EDGES && !edges[i].empty()) {
+                edge_handler(edges[i]);
+            }
+        }
+    }
+
+    VertexBatchHandler vertex_handler;
+    EdgeBatchHandler edge_handler;
+    int num_threads;
+
+    //! array currently being read
+    GraphSection section;
+    bool in_array;
+};
+
+//! Decode a binary vertex record
+static Vertex decode_record(const char* data, const Vertex*)
+{
+    VertexID id;
+    double weight;
+    memcpy(&id, data, 8);
+    memcpy(&weight, data + 8, 8);
+    return Vertex(id, weight);
+}
+
+//! Decode a binary edge record
+static Edge decode_record(const char* data, const Edge*)
+{
+    VertexID id1, id2;
+    double weight;
+    memcpy(&id1, data, 8);
+    memcpy(&id2, data + 8, 8);
+    memcpy(&weight, data + 16, 8);
+    return Edge(id1, id2, weight);
+}
+
+//! Read the records of one section of a binary graph file
+template <typename T>
+static void read_binary_section(std::ifstream& fin, uint64 num_records,
+        size_t record_size, size_t chunk_size,
+        boost::function<void (const vector<T>&)> handler)
+{
+    if (!handler) {
+        fin.seekg(std::streamoff(num_records * record_size), std::ios::cur);
+        return;
+    }
+
+    size_t records_per_chunk = std::max(chunk_size / record_size, size_t(1));
+    string buffer;
+    vector<T> records;
+    while (num_records > 0) {
+        size_t count = size_t(std::min(num_records, uint64(records_per_chunk)));
+        buffer.resize(count * record_size);
+        fin.read(&buffer[0], buffer.size());
+        if (size_t(fin.gcount()) != buffer.size()) {
+            throw ErrMsg("Could not decode graph file: truncated binary file");
+        }
+        records.clear();
+        for (size_t i = 0; i < count; ++i) {
+            records.push_back(decode_record(buffer.data() + i * record_size,
+                        (const T*) 0));
+        }
+        handler(records);
+        num_records -= count;
+    }
+}
+
+void read_graph_file(string filename, VertexBatchHandler vertex_handler,
+        EdgeBatchHandler edge_handler, int num_threads, size_t chunk_size)
+{
+    std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!fin) {
+        throw ErrMsg("Could not open graph file " + filename);
+    }
+    chunk_size = std::max(chunk_size, size_t(1024));
+
+    char magic[GraphBinaryMagicSize];
+    fin.read(magic, GraphBinaryMagicSize);
+    if (size_t(fin.gcount()) == GraphBinaryMagicSize &&
+            memcmp(magic, GraphBinaryMagic, GraphBinaryMagicSize) == 0) {
+        uint64 num_vertices = 0, num_edges = 0;
+        fin.read((char*) &num_vertices, 8);
+        fin.read((char*) &num_edges, 8);
+        if (!fin) {
+            throw ErrMsg("Could not decode graph file: truncated binary file");
+        }
+        read_binary_section(fin, num_vertices, BinaryVertexSize, chunk_size,
+                vertex_handler);
+        read_binary_section(fin, num_edges, BinaryEdgeSize, chunk_size,
+                edge_handler);
+        return;
+    }
+
+    // JSON: keep the bytes already read and parse each chunk
+    string buffer(magic, fin.gcount());
+    fin.clear();
+    size_t pos = 0;
+    JsonGraphReader reader(vertex_handler, edge_handler, num_threads);
+    while (true) {
+        buffer.erase(0, pos);
+        pos = 0;
+        size_t old_size = buffer.size();
+        buffer.resize(old_size + chunk_size);
+        fin.read(&buffer[old_size], chunk_size);
+        size_t bytes_read = fin.gcount();
+        buffer.resize(old_size + bytes_read);
+
+        reader.scan(buffer, pos);
+        if (bytes_read == 0) {
+            break;
+        }
+    }
+    reader.finish();
+}
+
+//! Appends vertices to a graph
+struct AppendVertices {
+    explicit AppendVertices(Graph& graph_) : graph(graph_) {}
+    void operator()(const vector<Vertex>& vertices)
+    {
+        graph.vertices.insert(graph.vertices.end(), vertices.begin(),
+                vertices.end());
+    }
+    Graph& graph;
+};
+
+//! Appends edges to a graph
+struct AppendEdges {
+    explicit AppendEdges(Graph& graph_) : graph(graph_) {}
+    void operator()(const vector<Edge>& edges)
+    {
+        graph.edges.insert(graph.edges.end(), edges.begin(), edges.end());
+    }
+    Graph& graph;
+};
+
+void read_graph_file(string filename, Graph& graph, int num_threads)
+{
+    read_graph_file(filename, AppendVertices(graph), AppendEdges(graph),
+            num_threads);
+}
+
+void write_graph_binary(string filename, const Graph& graph)
+{
+    std::ofstream fout(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!fout) {
+        throw ErrMsg("Could not open graph file " + filename);
+    }
+
+    string buffer(GraphBinaryMagic, GraphBinaryMagicSize);
+    uint64 num_vertices = graph.vertices.size();
+    uint64 num_edges = graph.edges.size();
+    buffer.append((const char*) &num_vertices, 8);
+    buffer.append((const char*) &num_edges, 8);
+    for (size_t i = 0; i < graph.vertices.size(); ++i) {
+        buffer.append((const char*) &graph.vertices[i].id, 8);
+        buffer.append((const char*) &graph.vertices[i].weight, 8);
+    }
+    for (size_t i = 0; i < graph.edges.size(); ++i) {
+        buffer.append((const char*) &graph.edges[i].id1, 8);
+        buffer.append((const char*) &graph.edges[i].id2, 8);
+        buffer.append((const char*) &graph.edges[i].weight, 8);
+    }
+
+    fout.write(buffer.data(), buffer.size());
+    if (!fout) {
+        throw ErrMsg("Could not write graph file " + filename);
+    }
+}
+
+//! Passes parsed vertices to the uploader
+struct UploadVertices {
+    explicit UploadVertices(GraphUploader& uploader_) : uploader(uploader_) {}
+    void operator()(const vector<Vertex>& vertices)
+    {
+        uploader.add_vertices(&vertices[0], vertices.size());
+    }
+    GraphUploader& uploader;
+};
+
+//! Passes parsed edges to the uploader
+struct UploadEdges {
+    explicit UploadEdges(GraphUploader& uploader_) : uploader(uploader_) {}
+    void operator()(const vector<Edge>& edges)
+    {
+        uploader.add_edges(&edges[0], edges.size());
+    }
+    GraphUploader& uploader;
+};
+
+GraphLoadResult load_graph_file(DVIDNodeService& service, string graph_name,
+        string filename, int num_threads, size_t chunk_size)
+{
+    GraphUploader uploader(service, graph_name, num_threads);
+
+    // all vertices must exist before edges are posted
+    read_graph_file(filename, UploadVertices(uploader), EdgeBatchHandler(),
+            num_threads, chunk_size);
+    uploader.flush();
+    read_graph_file(filename, VertexBatchHandler(), UploadEdges(uploader),
+            num_threads, chunk_size);
+    uploader.flush();
+
+    GraphLoadResult result;
+    result.num_vertices = uploader.num_vertices();
+    result.num_edges = uploader.num_edges();
+    result.vertex_errors = uploader.vertex_errors();
+    result.edge_errors = uploader.edge_errors();
+    return result;
+}
+
+}
@@ -0,0 +1,601 @@
+#include "DVIDJsonStream.h"
+#include "DVIDException.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+
+using std::string;
+
+namespace libdvid {
+
+void json_append_uint64(string& buffer, uint64 value)
+{
+    // write digits backwards into a small local buffer
+    char digits[20];
+    int pos = 20;
+    do {
+        digits[--pos] = char('0' + (value % 10));
+        value /= 10;
+    } while (value);
+    buffer.append(digits + pos, 20 - pos);
+}
+
+void json_append_int(string& buffer, int value)
+{
+    if (value < 0) {
+        buffer += '-';
+        // avoid overflow for INT_MIN
+        json_append_uint64(buffer, uint64(-(value + 1)) + 1);
+    } else {
+        json_append_uint64(buffer, uint64(value));
+    }
+}
+
+void json_append_string(string& buffer, const string& value)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    buffer += '"';
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = value[i];
+        if (c == '"' || c == '\\') {
+            buffer += '\\';
+            buffer += c;
+        } else if (c < 0x20) {
+            buffer += "\\u00";
+            buffer += hex_digits[c >> 4];
+            buffer += hex_digits[c & 0xf];
+        } else {
+            buffer += c;
+        }
+    }
+    buffer += '"';
+}
+
+void json_append_double(string& buffer, double value)
+{
+    if (value != value || value == HUGE_VAL || value == -HUGE_VAL) {
+        throw ErrMsg("Cannot write non-finite number to JSON");
+    }
+
+    // fast path for integral values (exactly representable below 2^53)
+    if (value == std::floor(value) && std::fabs(value) < 9007199254740992.0) {
+        if (value < 0) {
+            buffer += '-';
+            json_append_uint64(buffer, uint64(-value));
+        } else {
+            json_append_uint64(buffer, uint64(value));
+        }
+        return;
+    }
+
+    // fewest significant digits (at least 15) that read back exactly
+    char digits[32];
+    int length = 0;
+    for (int precision = 15; precision <= 17; ++precision) {
+        length = snprintf(digits, sizeof(digits), "%.*g", precision, value);
+        if (strtod(digits, 0) == value) {
+            break;
+        }
+    }
+    buffer.append(digits, length);
+}
+
+uint64 json_to_uint64(const string& text)
+{
+    // fractional or exponent notation is converted through a double
+    if (text.find_first_of(".eE") != string::npos) {
+        return uint64(json_to_double(text));
+    }
+    if (!text.empty() && text[0] == '-') {
+        return uint64(strtoll(text.c_str(), 0, 10));
+    }
+    return strtoull(text.c_str(), 0, 10);
+}
+
+int json_to_int(const string& text)
+{
+    if (text.find_first_of(".eE") != string::npos) {
+        return int(json_to_double(text));
+    }
+    return int(strtol(text.c_str(), 0, 10));
+}
+
+double json_to_double(const string& text)
+{
+    return strtod(text.c_str(), 0);
+}
+
+/************* Incremental JSON parser ******************/
+
+JsonStreamParser::JsonStreamParser(JsonHandler& handler_) :
+    handler(handler_), expect(EXPECT_VALUE), token(TOKEN_NONE),
+    string_is_key(false), unicode_value(0), unicode_digits(0),
+    high_surrogate(0) {}
+
+void JsonStreamParser::feed(const char* data, size_t length)
+{
+    const char* end = data + length;
+    const char* pos = data;
+
+    while (pos < end) {
+        char c = *pos;
+        switch (token) {
+          case TOKEN_STRING:
+            {
+                // copy the plain part of the string in one step
+                const char* start = pos;
+                while (pos < end && *pos != '"' && *pos != '\\') {
+                    ++pos;
+                }
+                token_text.append(start, pos - start);
+                if (pos == end) {
+                    break;
+                }
+                if (*pos == '"') {
+                    token = TOKEN_NONE;
+                    finish_string();
+                } else {
+                    token = TOKEN_ESCAPE;
+                }
+                ++pos;
+                break;
+            }
+          case TOKEN_ESCAPE:
+            token = TOKEN_STRING;
+            switch (c) {
+              case '"': token_text += '"'; break;
+              case '\\': token_text += '\\'; break;
+              case '/': token_text += '/'; break;
+              case 'b': token_text += '\b'; break;
+              case 'f': token_text += '\f'; break;
+              case 'n': token_text += '\n'; break;
+              case 'r': token_text += '\r'; break;
+              case 't': token_text += '\t'; break;
+              case 'u':
+                token = TOKEN_UNICODE;
+                unicode_value = 0;
+                unicode_digits = 0;
+                break;
+              default:
+                throw ErrMsg("Could not decode JSON: invalid escape");
+            }
+            ++pos;
+            break;
+          case TOKEN_UNICODE:
+            {
+                unsigned int digit;
+                if (c >= '0' && c <= '9') {
+                    digit = c - '0';
+                } else if (c >= 'a' && c <= 'f') {
+                    digit = c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'F') {
+                    digit = c - 'A' + 10;
+                } else {
+                    throw ErrMsg("Could not decode JSON: invalid unicode escape");
+                }
+                unicode_value = (unicode_value << 4) | digit;
+                if (++unicode_digits == 4) {
+                    token = TOKEN_STRING;
+                    append_code_point(unicode_value);
+                }
+                ++pos;
+                break;
+            }
+          case TOKEN_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '.' || c == 'e' ||
+                    c == 'E' || c == '+' || c == '-') {
+                token_text += c;
+                ++pos;
+            } else {
+                // the terminating character is handled as structural
+                token = TOKEN_NONE;
+                finish_number();
+            }
+            break;
+          case TOKEN_LITERAL:
+            if (c >= 'a' && c <= 'z') {
+                token_text += c;
+                ++pos;
+            } else {
+                token = TOKEN_NONE;
+                finish_literal();
+            }
+            break;
+          case TOKEN_NONE:
+            structural(c);
+            ++pos;
+            break;
+        }
+    }
+}
+
+void JsonStreamParser::structural(char c)
+{
+    switch (c) {
+      case ' ': case '\t': case '\n': case '\r':
+        return;
+      case '{':
+      case '[':
+        if (expect != EXPECT_VALUE && expect != EXPECT_VALUE_OR_END) {
+            break;
+        }
+        stack.push_back(c);
+        if (c == '{') {
+            expect = EXPECT_KEY_OR_END;
+            handler.start_object();
+        } else {
+            expect = EXPECT_VALUE_OR_END;
+            handler.start_array();
+        }
+        return;
+      case '}':
+        if ((expect != EXPECT_KEY_OR_END && expect != EXPECT_COMMA_OR_END) ||
+                stack.empty() || stack.back() != '{') {
+            break;
+        }
+        stack.pop_back();
+        handler.end_object();
+        finish_value();
+        return;
+      case ']':
+        if ((expect != EXPECT_VALUE_OR_END && expect != EXPECT_COMMA_OR_END) ||
+                stack.empty() || stack.back() != '[') {
+            break;
+        }
+        stack.pop_back();
+        handler.end_array();
+        finish_value();
+        return;
+      case ':':
+        if (expect != EXPECT_COLON) {
+            break;
+        }
+        expect = EXPECT_VALUE;
+        return;
+      case ',':
+        if (expect != EXPECT_COMMA_OR_END) {
+            break;
+        }
+        expect = (stack.back() == '{') ? EXPECT_KEY : EXPECT_VALUE;
+        return;
+      case '"':
+        if (expect == EXPECT_KEY || expect == EXPECT_KEY_OR_END) {
+            string_is_key = true;
+        } else if (expect == EXPECT_VALUE || expect == EXPECT_VALUE_OR_END) {
+            string_is_key = false;
+        } else {
+            break;
+        }
+        token = TOKEN_STRING;
+        token_text.clear();
+        high_surrogate = 0;
+        return;
+      default:
+        if (expect != EXPECT_VALUE && expect != EXPECT_VALUE_OR_END) {
+            break;
+        }
+        if ((c >= '0' && c <= '9') || c == '-') {
+            token = TOKEN_NUMBER;
+        } else if (c == 't' || c == 'f' || c == 'n') {
+            token = TOKEN_LITERAL;
+        } else {
+            break;
+        }
+        token_text.assign(1, c);
+        return;
+    }
+
+    throw ErrMsg(string("Could not decode JSON: unexpected character '") +
+            c + "'");
+}
+
+void JsonStreamParser::finish_value()
+{
+    expect = stack.empty() ? EXPECT_DONE : EXPECT_COMMA_OR_END;
+}
+
+void JsonStreamParser::finish_string()
+{
+    if (high_surrogate) {
+        append_code_point(0xFFFD);
+        high_surrogate = 0;
+    }
+    if (string_is_key) {
+        handler.key(token_text);
+        expect = EXPECT_COLON;
+    } else {
+        handler.string_value(token_text);
+        finish_value();
+    }
+}
+
+void JsonStreamParser::finish_number()
+{
+    handler.number_value(token_text);
+    finish_value();
+}
+
+void JsonStreamParser::finish_literal()
+{
+    if (token_text == "true") {
+        handler.bool_value(true);
+    } else if (token_text == "false") {
+        handler.bool_value(false);
+    } else if (token_text == "null") {
+        handler.null_value();
+    } else {
+        throw ErrMsg("Could not decode JSON: invalid literal " + token_text);
+    }
+    finish_value();
+}
+
+void JsonStreamParser::append_code_point(unsigned int code_point)
+{
+    // combine surrogate pairs
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+        if (high_surrogate) {
+            append_code_point(0xFFFD);
+        }
+        high_surrogate = code_point;
+        return;
+    }
+    if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+        if (!high_surrogate) {
+            code_point = 0xFFFD;
+        } else {
+            code_point = 0x10000 + ((high_surrogate - 0xD800) << 10) +
+                (code_point - 0xDC00);
+            high_surrogate = 0;
+        }
+    } else if (high_surrogate) {
+        high_surrogate = 0;
+        append_code_point(0xFFFD);
+    }
+
+    // write UTF-8
+    if (code_point < 0x80) {
+        token_text += char(code_point);
+    } else if (code_point < 0x800) {
+        token_text += char(0xC0 | (code_point >> 6));
+        token_text += char(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        token_text += char(0xE0 | (code_point >> 12));
+        token_text += char(0x80 | ((code_point >> 6) & 0x3F));
+        token_text += char(0x80 | (code_point & 0x3F));
+    } else {
+        token_text += char(0xF0 | (code_point >> 18));
+        token_text += char(0x80 | ((code_point >> 12) & 0x3F));
+        token_text += char(0x80 | ((code_point >> 6) & 0x3F));
+        token_text += char(0x80 | (code_point & 0x3F));
+    }
+}
+
+void JsonStreamParser::finish()
+{
+    // a number at the top level has no terminating character
+    if (token == TOKEN_NUMBER) {
+        token = TOKEN_NONE;
+        finish_number();
+    } else if (token == TOKEN_LITERAL) {
+        token = TOKEN_NONE;
+        finish_literal();
+    }
+
+    if (token != TOKEN_NONE || expect != EXPECT_DONE) {
+        throw ErrMsg("Could not decode JSON: truncated document");
+    }
+}
+
+/************* Fixed-schema handlers ******************/
+
+GraphJsonHandler::GraphJsonHandler(Graph& graph_) : graph(graph_),
+    depth(0), section(SECTION_NONE), id1(0), id2(0), weight(0) {}
+
+void GraphJsonHandler::start_object()
+{
+    ++depth;
+    if (depth == 3) {
+        id1 = id2 = 0;
+        weight = 0;
+    }
+}
+
+void GraphJsonHandler::end_object()
+{
+    if (depth == 3) {
+        if (section == SECTION_VERTICES) {
+            add_vertex(Vertex(id1, weight));
+        } else if (section == SECTION_EDGES) {
+            add_edge(Edge(id1, id2, weight));
+        }
+    }
+    --depth;
+}
+
+void GraphJsonHandler::start_array()
+{
+    ++depth;
+}
+
+void GraphJsonHandler::end_array()
+{
+    if (depth == 2) {
+        section = SECTION_NONE;
+    }
+    --depth;
+}
+
+void GraphJsonHandler::key(const string& name)
+{
+    if (depth == 1) {
+        if (name == "Vertices") {
+            section = SECTION_VERTICES;
+        } else if (name == "Edges") {
+            section = SECTION_EDGES;
+        } else {
+            section = SECTION_NONE;
+        }
+    } else if (depth == 3) {
+        current_key = name;
+    }
+}
+
+void GraphJsonHandler::number_value(const string& text)
+{
+    if (depth != 3 || section == SECTION_NONE) {
+        return;
+    }
+    if (current_key == "Weight") {
+        weight = json_to_double(text);
+    } else if (current_key == "Id" || current_key == "Id1") {
+        id1 = json_to_uint64(text);
+    } else if (current_key == "Id2") {
+        id2 = json_to_uint64(text);
+    }
+}
+
+void GraphJsonHandler::add_vertex(const Vertex& vertex)
+{
+    graph.vertices.push_back(vertex);
+}
+
+void GraphJsonHandler::add_edge(const Edge& edge)
+{
+    graph.edges.push_back(edge);
+}
+
+RoiJsonHandler::RoiJsonHandler(std::vector<BlockXYZ>& blockcoords_) :
+    blockcoords(&blockcoords_), spans(0), depth(0), run_pos(0) {}
+
+RoiJsonHandler::RoiJsonHandler(std::vector<BlockSpan>& spans_) :
+    blockcoords(0), spans(&spans_), depth(0), run_pos(0) {}
+
+void RoiJsonHandler::start_array()
+{
+    ++depth;
+    run_pos = 0;
+}
+
+void RoiJsonHandler::end_array()
+{
+    if (depth == 2) {
+        if (run_pos != 4) {
+            throw ErrMsg("Could not decode ROI: run does not have 4 values");
+        }
+        add_run(run[0], run[1], run[2], run[3]);
+    }
+    --depth;
+}
+
+void RoiJsonHandler::number_value(const string& text)
+{
+    if (depth == 2 && run_pos < 4) {
+        run[run_pos++] = json_to_int(text);
+    }
+}
+
+void RoiJsonHandler::add_run(int z, int y, int x0, int x1)
+{
+    if (spans) {
+        spans->push_back(BlockSpan(z, y, x0, x1));
+        return;
+    }
+    for (int x = x0; x <= x1; ++x) {
+        blockcoords->push_back(BlockXYZ(x, y, z));
+    }
+}
+
+BoolArrayJsonHandler::BoolArrayJsonHandler(unsigned char* values_,
+        size_t max_values_) : num_values(0), values(values_),
+    max_values(max_values_) {}
+
+void BoolArrayJsonHandler::bool_value(bool value)
+{
+    if (num_values >= max_values) {
+        throw ErrMsg("Too many values in boolean array");
+    }
+    values[num_values++] = value;
+}
+
+StringArrayJsonHandler::StringArrayJsonHandler(
+        std::vector<std::string>& values_) : values(values_) {}
+
+void StringArrayJsonHandler::string_value(const std::string& value)
+{
+    add_string(value);
+}
+
+void StringArrayJsonHandler::add_string(const std::string& value)
+{
+    values.push_back(value);
+}
+
+PartitionJsonHandler::PartitionJsonHandler(
+        std::vector<SubstackXYZ>& substacks_, int substack_size_) :
+    total_blocks(0), active_blocks(0), substacks(substacks_),
+    substack_size(substack_size_), depth(0), in_subvolumes(false),
+    in_minpoint(false), point_pos(0) {}
+
+void PartitionJsonHandler::start_object()
+{
+    ++depth;
+    if (depth == 3) {
+        point_pos = 0;
+    }
+}
+
+void PartitionJsonHandler::end_object()
+{
+    if (depth == 3 && in_subvolumes) {
+        if (point_pos != 3) {
+            throw ErrMsg("Could not decode partition: missing MinPoint");
+        }
+        substacks.push_back(SubstackXYZ(point[0], point[1], point[2],
+                    substack_size));
+    }
+    --depth;
+}
+
+void PartitionJsonHandler::start_array()
+{
+    ++depth;
+    if (depth == 4 && in_subvolumes && current_key == "MinPoint") {
+        in_minpoint = true;
+        point_pos = 0;
+    }
+}
+
+void PartitionJsonHandler::end_array()
+{
+    if (depth == 2) {
+        in_subvolumes = false;
+    } else if (depth == 4) {
+        in_minpoint = false;
+    }
+    --depth;
+}
+
+void PartitionJsonHandler::key(const string& name)
+{
+    current_key = name;
+    if (depth == 1) {
+        in_subvolumes = (name == "Subvolumes");
+    }
+}
+
+void PartitionJsonHandler::number_value(const string& text)
+{
+    if (depth == 1) {
+        if (current_key == "NumTotalBlocks") {
+            total_blocks = (unsigned int)(json_to_uint64(text));
+        } else if (current_key == "NumActiveBlocks") {
+            active_blocks = (unsigned int)(json_to_uint64(text));
+        }
+    } else if (in_minpoint && point_pos < 3) {
+        point[point_pos++] = json_to_int(text);
+    }
+}
+
+}
@@ -0,0 +1,432 @@
+#include "DVIDKeyValue.h"
+#include "DVIDException.h"
+#include "Globals.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+
+extern "C" {
+#include <lz4.h>
+}
+
+using std::string; using std::vector;
+
+//! Size of tar headers and of the unit that file contents are padded to
+static const size_t TAR_BLOCK = 512;
+
+//! Longest name that fits in a tar header
+static const size_t TAR_NAME_SIZE = 100;
+
+//! Start of encoded values (the first byte cannot begin JSON or text)
+static const char KEYVALUE_MAGIC[8] = {'\x89', 'D', 'V', 'I', 'D', 'K', 'V', '\n'};
+
+//! Magic, codec and uncompressed size (64-bit little endian)
+static const size_t KEYVALUE_HEADER_SIZE = 17;
+
+//! Codecs of encoded values
+enum KeyValueCodec { RAW_CODEC = 0, LZ4_CODEC = 1 };
+
+namespace libdvid {
+
+//! Writes a zero-padded octal number terminated by a NUL
+static void write_octal(char* field, size_t width, uint64 value)
+{
+    field[width-1] = '\0';
+    for (size_t i = width - 1; i > 0; --i) {
+        field[i-1] = char('0' + (value & 7));
+        value >>= 3;
+    }
+    if (value) {
+        throw ErrMsg("Value too large for tar header");
+    }
+}
+
+//! Reads an octal (or base-256) number from a header field
+static uint64 read_octal(const char* field, size_t width)
+{
+    // GNU base-256 encoding is flagged by the high bit
+    if ((unsigned char)(field[0]) & 0x80) {
+        uint64 value = (unsigned char)(field[0]) & 0x7f;
+        for (size_t i = 1; i < width; ++i) {
+            value = (value << 8) | (unsigned char)(field[i]);
+        }
+        return value;
+    }
+
+    size_t i = 0;
+    while (i < width && field[i] == ' ') {
+        ++i;
+    }
+    uint64 value = 0;
+    for (; i < width && field[i] != ' ' && field[i] != '\0'; ++i) {
+        if (field[i] < '0' || field[i] > '7') {
+            throw ErrMsg("Corrupt tar header");
+        }
+        value = (value << 3) | uint64(field[i] - '0');
+    }
+    return value;
+}
+
+//! Sum of the header bytes with the checksum field read as spaces
+static unsigned int header_checksum(const char* header)
+{
+    unsigned int sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; ++i) {
+        sum += (i >= 148 && i < 156) ? ' ' : (unsigned char)(header[i]);
+    }
+    return sum;
+}
+
+//! Reads a NUL-terminated (or full width) header string
+static string read_field(const char* field, size_t width)
+{
+    return string(field, std::find(field, field + width, '\0') - field);
+}
+
+static void append_tar_entry(string& buffer, const string& name, char type,
+        const char* data, size_t length)
+{
+    char header[TAR_BLOCK];
+    memset(header, 0, TAR_BLOCK);
+    memcpy(header, name.data(), std::min(name.size(), TAR_NAME_SIZE));
+    write_octal(header + 100, 8, 0644);
+    write_octal(header + 108, 8, 0);
+    write_octal(header + 116, 8, 0);
+    write_octal(header + 124, 12, length);
+    write_octal(header + 136, 12, 0);
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+
+    // six octal digits, a NUL and a space
+    write_octal(header + 148, 7, header_checksum(header));
+    header[155] = ' ';
+
+    buffer.append(header, TAR_BLOCK);
+    buffer.append(data, length);
+    buffer.append((TAR_BLOCK - length % TAR_BLOCK) % TAR_BLOCK, '\0');
+}
+
+void write_keyvalue_tar(const string* keys, const BinaryDataPtr* values,
+        size_t num_keys, string& buffer)
+{
+    static const string empty_value;
+    for (size_t i = 0; i < num_keys; ++i) {
+        const string& value = values[i] ? values[i]->get_data() : empty_value;
+        if (keys[i].size() > TAR_NAME_SIZE) {
+            append_tar_entry(buffer, "././@LongLink", 'L', keys[i].c_str(),
+                    keys[i].size() + 1);
+        }
+        append_tar_entry(buffer, keys[i], '0', value.data(), value.size());
+    }
+
+    // end of archive
+    buffer.append(2 * TAR_BLOCK, '\0');
+}
+
+//! Finds the path record of a PAX extended header
+static bool read_pax_path(const char* records, size_t length, string& path)
+{
+    bool found = false;
+    size_t pos = 0;
+    while (pos < length) {
+        // each record is "<length> <key>=<value>\n"
+        size_t space = pos;
+        while (space < length && records[space] != ' ') {
+            ++space;
+        }
+        size_t record_length = strtoul(string(records + pos, space - pos).c_str(),
+                0, 10);
+        if (space >= length || record_length == 0 ||
+                record_length > length - pos) {
+            throw ErrMsg("Corrupt tar extended header");
+        }
+        string record(records + space + 1, records + pos + record_length - 1);
+        if (record.compare(0, 5, "path=") == 0) {
+            path = record.substr(5);
+            found = true;
+        }
+        pos += record_length;
+    }
+    return found;
+}
+
+void read_keyvalue_tar(const string& data, vector<string>& keys,
+        vector<BinaryDataPtr>& values)
+{
+    keys.clear();
+    values.clear();
+
+    string long_name;
+    bool have_long_name = false;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        if (data.size() - pos < TAR_BLOCK) {
+            throw ErrMsg("Truncated tar archive");
+        }
+        const char* header = data.data() + pos;
+
+        // an empty block ends the archive
+        if (std::count(header, header + TAR_BLOCK, '\0') == int(TAR_BLOCK)) {
+            break;
+        }
+        if (read_octal(header + 148, 8) != header_checksum(header)) {
+            throw ErrMsg("Corrupt tar header");
+        }
+        uint64 size = read_octal(header + 124, 12);
+        pos += TAR_BLOCK;
+        if (size > data.size() - pos) {
+            throw ErrMsg("Truncated tar archive");
+        }
+        const char* contents = data.data() + pos;
+
+        char type = header[156];
+        if (type == 'L') {
+            long_name = read_field(contents, size);
+            have_long_name = true;
+        } else if (type == 'x') {
+            have_long_name = read_pax_path(contents, size, long_name) ||
+                have_long_name;
+        } else if (type == '0' || type == '\0' || type == '7') {
+            string name;
+            if (have_long_name) {
+                name = long_name;
+            } else {
+                name = read_field(header, TAR_NAME_SIZE);
+                string prefix = read_field(header + 345, 155);
+                if (!prefix.empty() && memcmp(header + 257, "ustar", 5) == 0) {
+                    name = prefix + "/" + name;
+                }
+            }
+            keys.push_back(name);
+            values.push_back(BinaryData::create_binary_data(contents, size));
+            have_long_name = false;
+        }
+        pos += (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        if (pos > data.size()) {
+            throw ErrMsg("Truncated tar archive");
+        }
+    }
+}
+
+//! Protobuf wire types
+enum WireType { VARINT_WIRE = 0, FIXED64_WIRE = 1, LENGTH_WIRE = 2,
+    FIXED32_WIRE = 5 };
+
+static void append_varint(string& buffer, uint64 value)
+{
+    while (value >= 0x80) {
+        buffer += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer += char(value);
+}
+
+//! Appends a length-delimited field
+static void append_bytes_field(string& buffer, int field, const char* data,
+        size_t length)
+{
+    append_varint(buffer, (uint64(field) << 3) | LENGTH_WIRE);
+    append_varint(buffer, length);
+    buffer.append(data, length);
+}
+
+//! Number of bytes of a varint
+static size_t varint_size(uint64 value)
+{
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+void write_keyvalue_protobuf(const string* keys, const BinaryDataPtr* values,
+        size_t num_keys, string& buffer)
+{
+    static const string empty_value;
+    for (size_t i = 0; i < num_keys; ++i) {
+        const string& value = values[i] ? values[i]->get_data() : empty_value;
+
+        // KeyValue is written in place after its length
+        size_t length = 1 + varint_size(keys[i].size()) + keys[i].size() +
+            1 + varint_size(value.size()) + value.size();
+        append_varint(buffer, (uint64(1) << 3) | LENGTH_WIRE);
+        append_varint(buffer, length);
+        append_bytes_field(buffer, 1, keys[i].data(), keys[i].size());
+        append_bytes_field(buffer, 2, value.data(), value.size());
+    }
+}
+
+//! Reads a varint at pos and advances pos past it
+static uint64 read_varint(const string& data, size_t& pos, size_t end)
+{
+    uint64 value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= end) {
+            throw ErrMsg("Truncated protobuf message");
+        }
+        unsigned char byte = (unsigned char)(data[pos++]);
+        value |= uint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw ErrMsg("Corrupt protobuf message");
+}
+
+/*!
+ * Reads the next field in [pos, end).  Length-delimited fields are
+ * returned as their offset and length; other fields are skipped.
+*/
+static int read_field_header(const string& data, size_t& pos, size_t end,
+        size_t& offset, size_t& length)
+{
+    uint64 tag = read_varint(data, pos, end);
+    int wire_type = int(tag & 7);
+    if (wire_type == VARINT_WIRE) {
+        read_varint(data, pos, end);
+        length = 0;
+    } else if (wire_type == LENGTH_WIRE) {
+        uint64 size = read_varint(data, pos, end);
+        if (size > end - pos) {
+            throw ErrMsg("Truncated protobuf message");
+        }
+        length = size_t(size);
+    } else if (wire_type == FIXED64_WIRE || wire_type == FIXED32_WIRE) {
+        length = (wire_type == FIXED64_WIRE) ? 8 : 4;
+        if (length > end - pos) {
+            throw ErrMsg("Truncated protobuf message");
+        }
+    } else {
+        throw ErrMsg("Corrupt protobuf message");
+    }
+    offset = pos;
+    pos += length;
+    return (wire_type == LENGTH_WIRE) ? int(tag >> 3) : 0;
+}
+
+void read_keyvalue_protobuf(const string& data, vector<string>& keys,
+        vector<BinaryDataPtr>& values)
+{
+    keys.clear();
+    values.clear();
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t offset, length;
+        if (read_field_header(data, pos, data.size(), offset, length) != 1) {
+            continue;
+        }
+
+        // fields of one KeyValue (missing fields are empty)
+        string key;
+        BinaryDataPtr value = BinaryData::create_binary_data();
+        size_t kv_pos = offset;
+        size_t kv_end = offset + length;
+        while (kv_pos < kv_end) {
+            size_t field_offset, field_length;
+            int field = read_field_header(data, kv_pos, kv_end, field_offset,
+                    field_length);
+            if (field == 1) {
+                key.assign(data, field_offset, field_length);
+            } else if (field == 2) {
+                value->get_data().assign(data, field_offset, field_length);
+            }
+        }
+        keys.push_back(key);
+        values.push_back(value);
+    }
+}
+
+//! Create an encoded value with room for length bytes after the header
+static BinaryDataPtr encoded_value(KeyValueCodec codec, uint64 size,
+        size_t length)
+{
+    BinaryDataPtr encoded = BinaryData::create_binary_data();
+    string& data = encoded->get_data();
+    data.resize(KEYVALUE_HEADER_SIZE + length);
+    memcpy(&data[0], KEYVALUE_MAGIC, sizeof(KEYVALUE_MAGIC));
+    data[8] = char(codec);
+    for (int i = 0; i < 8; ++i) {
+        data[9 + i] = char((size >> (8 * i)) & 0xff);
+    }
+    return encoded;
+}
+
+//! true if the data starts with the encoded value magic
+static bool has_keyvalue_magic(const string& data)
+{
+    return data.size() >= sizeof(KEYVALUE_MAGIC) &&
+        memcmp(data.data(), KEYVALUE_MAGIC, sizeof(KEYVALUE_MAGIC)) == 0;
+}
+
+BinaryDataPtr encode_keyvalue(BinaryDataPtr value, size_t min_size)
+{
+    const string& data = value->get_data();
+    bool ambiguous = has_keyvalue_magic(data);
+    if (data.size() >= min_size && data.size() <= size_t(LZ4_MAX_INPUT_SIZE)) {
+        int bound = LZ4_compressBound(int(data.size()));
+        BinaryDataPtr encoded = encoded_value(LZ4_CODEC, data.size(), bound);
+        string& buffer = encoded->get_data();
+        int compressed_size = LZ4_compress_default(data.data(),
+                &buffer[KEYVALUE_HEADER_SIZE], int(data.size()), bound);
+        if (compressed_size > 0 &&
+                KEYVALUE_HEADER_SIZE + compressed_size < data.size()) {
+            buffer.resize(KEYVALUE_HEADER_SIZE + compressed_size);
+            return encoded;
+        }
+    }
+    if (!ambiguous) {
+        return value;
+    }
+
+    BinaryDataPtr encoded = encoded_value(RAW_CODEC, data.size(), data.size());
+    memcpy(&encoded->get_data()[KEYVALUE_HEADER_SIZE], data.data(),
+            data.size());
+    return encoded;
+}
+
+BinaryDataPtr decode_keyvalue(BinaryDataPtr value)
+{
+    const string& data = value->get_data();
+    if (!has_keyvalue_magic(data)) {
+        return value;
+    }
+    if (data.size() < KEYVALUE_HEADER_SIZE) {
+        throw ErrMsg("Truncated compressed value");
+    }
+    uint64 size = 0;
+    for (int i = 7; i >= 0; --i) {
+        size = (size << 8) | (unsigned char)(data[9 + i]);
+    }
+    const char* payload = data.data() + KEYVALUE_HEADER_SIZE;
+    size_t payload_size = data.size() - KEYVALUE_HEADER_SIZE;
+
+    if (data[8] == char(RAW_CODEC)) {
+        if (size != payload_size) {
+            throw ErrMsg("Corrupt uncompressed value");
+        }
+        return BinaryData::create_binary_data(payload, payload_size);
+    }
+    if (data[8] != char(LZ4_CODEC)) {
+        throw ErrMsg("Unknown value compression");
+    }
+    if (size > uint64(LZ4_MAX_INPUT_SIZE) || payload_size > size_t(INT_MAX)) {
+        throw ErrMsg("Corrupt compressed value");
+    }
+    BinaryDataPtr decoded = BinaryData::create_binary_data();
+    string& buffer = decoded->get_data();
+    buffer.resize(size);
+    int decoded_size = LZ4_decompress_safe(payload,
+            size ? &buffer[0] : 0, int(payload_size), int(size));
+    if (decoded_size < 0 || uint64(decoded_size) != size) {
+        throw ErrMsg("Corrupt compressed value");
+    }
+    return decoded;
+}
+
+}
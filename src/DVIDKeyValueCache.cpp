@@ -0,0 +1,123 @@
+#include "DVIDKeyValueCache.h"
+
+using std::string;
+using namespace boost::posix_time;
+
+namespace libdvid {
+
+KeyValueCache::KeyValueCache(double max_age_, size_t max_bytes_) :
+    max_age(microseconds(long(max_age_ * 1e6))), max_bytes(max_bytes_),
+    cached_bytes(0), current_generation(0), num_hits(0), num_misses(0) {}
+
+string KeyValueCache::entry_key(const string& uuid, const string& instance,
+        const string& key)
+{
+    string combined(uuid);
+    combined += '\0';
+    combined += instance;
+    combined += '\0';
+    combined += key;
+    return combined;
+}
+
+void KeyValueCache::remove(std::map<string, Entry>::iterator iter)
+{
+    cached_bytes -= iter->second.value->length();
+    lru.erase(iter->second.lru_position);
+    entries.erase(iter);
+}
+
+bool KeyValueCache::find(const string& uuid, const string& instance,
+        const string& key, BinaryDataPtr& value, JsonValuePtr* json)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    std::map<string, Entry>::iterator iter =
+        entries.find(entry_key(uuid, instance, key));
+    if (iter == entries.end()) {
+        ++num_misses;
+        return false;
+    }
+    if (!locked_nodes.count(uuid) &&
+            (microsec_clock::universal_time() - iter->second.read_time) > max_age) {
+        remove(iter);
+        ++num_misses;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, iter->second.lru_position);
+    value = iter->second.value;
+    if (json) {
+        *json = iter->second.json;
+    }
+    ++num_hits;
+    return true;
+}
+
+void KeyValueCache::store(const string& uuid, const string& instance,
+        const string& key, BinaryDataPtr value, uint64 generation)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    if (generation != current_generation) {
+        return;
+    }
+    string combined = entry_key(uuid, instance, key);
+    std::map<string, Entry>::iterator iter = entries.find(combined);
+    if (iter != entries.end()) {
+        remove(iter);
+    }
+    // a value over the budget would evict everything else
+    if (size_t(value->length()) > max_bytes) {
+        return;
+    }
+
+    lru.push_front(combined);
+    Entry& entry = entries[combined];
+    entry.value = value;
+    entry.read_time = microsec_clock::universal_time();
+    entry.lru_position = lru.begin();
+    cached_bytes += value->length();
+
+    while (cached_bytes > max_bytes) {
+        remove(entries.find(lru.back()));
+    }
+}
+
+void KeyValueCache::store_json(const string& uuid, const string& instance,
+        const string& key, BinaryDataPtr value, JsonValuePtr json)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    std::map<string, Entry>::iterator iter =
+        entries.find(entry_key(uuid, instance, key));
+    if (iter != entries.end() && iter->second.value == value) {
+        iter->second.json = json;
+    }
+}
+
+void KeyValueCache::invalidate(const string& uuid, const string& instance,
+        const string& key)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    std::map<string, Entry>::iterator iter =
+        entries.find(entry_key(uuid, instance, key));
+    if (iter != entries.end()) {
+        remove(iter);
+    }
+    ++current_generation;
+}
+
+void KeyValueCache::set_locked(const string& uuid)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    locked_nodes.insert(uuid);
+}
+
+void KeyValueCache::clear()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    entries.clear();
+    lru.clear();
+    cached_bytes = 0;
+    ++current_generation;
+    num_hits = num_misses = 0;
+}
+
+}
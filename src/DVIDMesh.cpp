@@ -0,0 +1,633 @@
+#include "DVIDMesh.h"
+#include "DVIDException.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+using std::string;
+using std::vector;
+
+//! Max label blocks to request at one time
+static const int MAX_MESH_BLOCKS = 32;
+
+//! Number of voxels in a block
+static const int BLOCKVOXELS = libdvid::DEFBLOCKSIZE*libdvid::DEFBLOCKSIZE*
+    libdvid::DEFBLOCKSIZE;
+
+namespace libdvid {
+
+namespace {
+
+/*!
+ * Identifies a mesh vertex by the voxel edge it lies on.  Every edge
+ * used by the tetrahedral decomposition goes from a voxel to a voxel
+ * whose coordinates are the same or one larger, so the edge is stored
+ * as its smaller voxel and a direction (bit 0: x, bit 1: y, bit 2: z).
+*/
+struct MeshEdgeKey {
+    MeshEdgeKey() : x(0), y(0), z(0), dir(0) {}
+    MeshEdgeKey(int x_, int y_, int z_, int dir_) : x(x_), y(y_), z(z_), dir(dir_) {}
+
+    bool operator<(const MeshEdgeKey& other) const
+    {
+        if (z != other.z) {
+            return z < other.z;
+        }
+        if (y != other.y) {
+            return y < other.y;
+        }
+        if (x != other.x) {
+            return x < other.x;
+        }
+        return dir < other.dir;
+    }
+
+    bool operator==(const MeshEdgeKey& other) const
+    {
+        return (x == other.x) && (y == other.y) && (z == other.z) &&
+            (dir == other.dir);
+    }
+
+    int x, y, z, dir;
+};
+
+/*!
+ * The six tetrahedra of a voxel cube (Kuhn triangulation).  Cube corners
+ * are numbered with bit 0 for x, bit 1 for y, and bit 2 for z.  Every
+ * tetrahedron runs along the main diagonal from corner 0 to corner 7, so
+ * neighboring cubes split their shared faces the same way.
+*/
+static const int CUBE_TETS[6][4] = {
+    {0, 1, 3, 7}, {0, 1, 5, 7}, {0, 2, 3, 7},
+    {0, 2, 6, 7}, {0, 4, 5, 7}, {0, 4, 6, 7}
+};
+
+//! Work shared by the threads that fetch or mesh blocks
+struct MeshWorkState {
+    MeshWorkState() : next_item(0), failed(false) {}
+
+    //! protects the members below
+    boost::mutex mutex;
+
+    //! next item to be processed
+    unsigned int next_item;
+
+    //! set when any thread fails
+    bool failed;
+
+    //! error from the first failed thread
+    string error;
+
+    /*!
+     * Grabs the next item to process.
+     * \param num_items total number of items
+     * \param item next item
+     * \return false if there is no more work
+    */
+    bool next(unsigned int num_items, unsigned int& item)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (failed || next_item >= num_items) {
+            return false;
+        }
+        item = next_item;
+        ++next_item;
+        return true;
+    }
+
+    void fail(const string& msg)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (!failed) {
+            failed = true;
+            error = msg;
+        }
+    }
+};
+
+/*!
+ * Find the index of a block in a sorted block list.
+ * \return index of the block or -1 if not found
+*/
+static int find_block(const vector<BlockXYZ>& blockcoords, const BlockXYZ& block)
+{
+    vector<BlockXYZ>::const_iterator iter = std::lower_bound(
+            blockcoords.begin(), blockcoords.end(), block);
+    if (iter == blockcoords.end() || !(*iter == block)) {
+        return -1;
+    }
+    return int(iter - blockcoords.begin());
+}
+
+/*!
+ * Meshes the voxel cubes whose first corner lies in a given block.
+ * The cubes on the far sides of the block use voxels from the neighboring
+ * blocks so that the surfaces of adjacent blocks meet exactly.
+*/
+struct MeshCellBlocks {
+    MeshCellBlocks(const vector<BlockXYZ>& blockcoords_,
+            const vector<const uint8*>& masks_,
+            const vector<BlockXYZ>& cellblocks_,
+            vector<vector<MeshEdgeKey> >& triangle_keys_, MeshWorkState& state_) :
+            blockcoords(blockcoords_), masks(masks_), cellblocks(cellblocks_),
+            triangle_keys(triangle_keys_), state(state_) {}
+
+    void operator()()
+    {
+        try {
+            unsigned int item;
+            vector<uint8> local((DEFBLOCKSIZE+1)*(DEFBLOCKSIZE+1)*(DEFBLOCKSIZE+1));
+            while (state.next(cellblocks.size(), item)) {
+                mesh_block(cellblocks[item], local, triangle_keys[item]);
+            }
+        } catch (std::exception& e) {
+            state.fail(e.what());
+        }
+    }
+
+    void mesh_block(const BlockXYZ& block, vector<uint8>& local,
+            vector<MeshEdgeKey>& keys)
+    {
+        const int LSIZE = DEFBLOCKSIZE + 1;
+
+        // masks of this block and its 7 neighbors in +x,+y,+z
+        const uint8* neighbors[8];
+        for (int i = 0; i < 8; ++i) {
+            int index = find_block(blockcoords, BlockXYZ(block.x + (i & 1),
+                        block.y + ((i >> 1) & 1), block.z + ((i >> 2) & 1)));
+            neighbors[i] = (index >= 0) ? masks[index] : 0;
+        }
+
+        // load (DEFBLOCKSIZE+1)^3 voxels starting at the block origin
+        uint8* local_iter = &local[0];
+        for (int lz = 0; lz < LSIZE; ++lz) {
+            int bz = lz / DEFBLOCKSIZE; int vz = lz % DEFBLOCKSIZE;
+            for (int ly = 0; ly < LSIZE; ++ly) {
+                int by = ly / DEFBLOCKSIZE; int vy = ly % DEFBLOCKSIZE;
+                for (int lx = 0; lx < LSIZE; ++lx, ++local_iter) {
+                    int bx = lx / DEFBLOCKSIZE; int vx = lx % DEFBLOCKSIZE;
+                    const uint8* mask = neighbors[bx | (by << 1) | (bz << 2)];
+                    *local_iter = (mask && mask[(vz*DEFBLOCKSIZE + vy)*
+                            DEFBLOCKSIZE + vx]) ? 1 : 0;
+                }
+            }
+        }
+
+        int corner_offsets[8];
+        for (int c = 0; c < 8; ++c) {
+            corner_offsets[c] = ((c >> 2) & 1)*LSIZE*LSIZE +
+                ((c >> 1) & 1)*LSIZE + (c & 1);
+        }
+
+        int xstart = block.x * DEFBLOCKSIZE;
+        int ystart = block.y * DEFBLOCKSIZE;
+        int zstart = block.z * DEFBLOCKSIZE;
+        for (int z = 0; z < DEFBLOCKSIZE; ++z) {
+            for (int y = 0; y < DEFBLOCKSIZE; ++y) {
+                const uint8* cell = &local[(z*LSIZE + y)*LSIZE];
+                for (int x = 0; x < DEFBLOCKSIZE; ++x, ++cell) {
+                    int config = 0;
+                    for (int c = 0; c < 8; ++c) {
+                        config |= (cell[corner_offsets[c]] << c);
+                    }
+                    if (config == 0 || config == 255) {
+                        continue;
+                    }
+                    for (int t = 0; t < 6; ++t) {
+                        mesh_tet(CUBE_TETS[t], config, xstart + x,
+                                ystart + y, zstart + z, keys);
+                    }
+                }
+            }
+        }
+    }
+
+    /*!
+     * Adds the triangles for one tetrahedron.  Triangles are oriented
+     * so that their normal points from the inside corners to the outside.
+    */
+    void mesh_tet(const int* tet, int config, int x, int y, int z,
+            vector<MeshEdgeKey>& keys)
+    {
+        int inside[4]; int num_inside = 0;
+        int outside[4]; int num_outside = 0;
+        for (int i = 0; i < 4; ++i) {
+            if ((config >> tet[i]) & 1) {
+                inside[num_inside++] = tet[i];
+            } else {
+                outside[num_outside++] = tet[i];
+            }
+        }
+        if (num_inside == 0 || num_outside == 0) {
+            return;
+        }
+
+        // direction from the inside corners to the outside corners
+        double out_dir[3] = {0, 0, 0};
+        for (int d = 0; d < 3; ++d) {
+            for (int i = 0; i < num_outside; ++i) {
+                out_dir[d] += double((outside[i] >> d) & 1) / num_outside;
+            }
+            for (int i = 0; i < num_inside; ++i) {
+                out_dir[d] -= double((inside[i] >> d) & 1) / num_inside;
+            }
+        }
+
+        if (num_inside == 1) {
+            add_triangle(edge(inside[0], outside[0], x, y, z),
+                    edge(inside[0], outside[1], x, y, z),
+                    edge(inside[0], outside[2], x, y, z), out_dir, keys);
+        } else if (num_inside == 3) {
+            add_triangle(edge(inside[0], outside[0], x, y, z),
+                    edge(inside[1], outside[0], x, y, z),
+                    edge(inside[2], outside[0], x, y, z), out_dir, keys);
+        } else {
+            // quad around the edges between the two pairs of corners
+            MeshEdgeKey ac = edge(inside[0], outside[0], x, y, z);
+            MeshEdgeKey ad = edge(inside[0], outside[1], x, y, z);
+            MeshEdgeKey bd = edge(inside[1], outside[1], x, y, z);
+            MeshEdgeKey bc = edge(inside[1], outside[0], x, y, z);
+            add_triangle(ac, ad, bd, out_dir, keys);
+            add_triangle(ac, bd, bc, out_dir, keys);
+        }
+    }
+
+    //! edge between two corners of the cube at x,y,z
+    MeshEdgeKey edge(int corner1, int corner2, int x, int y, int z)
+    {
+        // corners in a tetrahedron are always nested (bitwise)
+        int low = corner1 & corner2;
+        int dir = corner1 ^ corner2;
+        return MeshEdgeKey(x + (low & 1), y + ((low >> 1) & 1),
+                z + ((low >> 2) & 1), dir);
+    }
+
+    void add_triangle(const MeshEdgeKey& v1, const MeshEdgeKey& v2, const MeshEdgeKey& v3,
+            const double* out_dir, vector<MeshEdgeKey>& keys)
+    {
+        double p1[3], p2[3], p3[3];
+        edge_position(v1, p1); edge_position(v2, p2); edge_position(v3, p3);
+        double e1[3] = {p2[0]-p1[0], p2[1]-p1[1], p2[2]-p1[2]};
+        double e2[3] = {p3[0]-p1[0], p3[1]-p1[1], p3[2]-p1[2]};
+        double normal[3] = {e1[1]*e2[2] - e1[2]*e2[1],
+            e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+        double dot = normal[0]*out_dir[0] + normal[1]*out_dir[1] +
+            normal[2]*out_dir[2];
+
+        keys.push_back(v1);
+        if (dot >= 0) {
+            keys.push_back(v2); keys.push_back(v3);
+        } else {
+            keys.push_back(v3); keys.push_back(v2);
+        }
+    }
+
+    static void edge_position(const MeshEdgeKey& key, double* pos)
+    {
+        pos[0] = key.x + 0.5*(key.dir & 1);
+        pos[1] = key.y + 0.5*((key.dir >> 1) & 1);
+        pos[2] = key.z + 0.5*((key.dir >> 2) & 1);
+    }
+
+    const vector<BlockXYZ>& blockcoords;
+    const vector<const uint8*>& masks;
+    const vector<BlockXYZ>& cellblocks;
+    vector<vector<MeshEdgeKey> >& triangle_keys;
+    MeshWorkState& state;
+};
+
+/*!
+ * Converts the edge keys of each block's triangles into indices of the
+ * welded vertex list.
+*/
+struct IndexTriangles {
+    IndexTriangles(const vector<MeshEdgeKey>& vertex_keys_,
+            const vector<vector<MeshEdgeKey> >& triangle_keys_,
+            const vector<size_t>& triangle_offsets_,
+            vector<unsigned int>& triangles_, MeshWorkState& state_) :
+            vertex_keys(vertex_keys_), triangle_keys(triangle_keys_),
+            triangle_offsets(triangle_offsets_), triangles(triangles_),
+            state(state_) {}
+
+    void operator()()
+    {
+        unsigned int item;
+        while (state.next(triangle_keys.size(), item)) {
+            const vector<MeshEdgeKey>& keys = triangle_keys[item];
+            size_t pos = triangle_offsets[item];
+            for (unsigned int i = 0; i < keys.size(); ++i, ++pos) {
+                triangles[pos] = std::lower_bound(vertex_keys.begin(),
+                        vertex_keys.end(), keys[i]) - vertex_keys.begin();
+            }
+        }
+    }
+
+    const vector<MeshEdgeKey>& vertex_keys;
+    const vector<vector<MeshEdgeKey> >& triangle_keys;
+    const vector<size_t>& triangle_offsets;
+    vector<unsigned int>& triangles;
+    MeshWorkState& state;
+};
+
+/*!
+ * Fetches label blocks for spans of a body and converts them to masks.
+*/
+struct FetchBodyMasks {
+    FetchBodyMasks(DVIDNodeService& service_, string labels_name_,
+            uint64 bodyid_, const vector<BlockXYZ>& blockcoords_,
+            const vector<std::pair<int, int> >& spans_,
+            vector<BinaryDataPtr>& masks_, MeshWorkState& state_) :
+            service(service_), labels_name(labels_name_), bodyid(bodyid_),
+            blockcoords(blockcoords_), spans(spans_), masks(masks_),
+            state(state_) {}
+
+    void operator()()
+    {
+        try {
+            unsigned int item;
+            while (state.next(spans.size(), item)) {
+                int start = spans[item].first;
+                int runlength = spans[item].second;
+                vector<int> block_coords;
+                block_coords.push_back(blockcoords[start].x);
+                block_coords.push_back(blockcoords[start].y);
+                block_coords.push_back(blockcoords[start].z);
+                LabelBlocks labels = service.get_labelblocks(labels_name,
+                        block_coords, runlength);
+
+                for (int j = 0; j < runlength; ++j) {
+                    const uint64* label_iter = labels[j];
+                    BinaryDataPtr mask = BinaryData::create_binary_data();
+                    string& maskstr = mask->get_data();
+                    maskstr.resize(BLOCKVOXELS);
+                    for (int i = 0; i < BLOCKVOXELS; ++i) {
+                        maskstr[i] = (label_iter[i] == bodyid) ? 1 : 0;
+                    }
+                    masks[start + j] = mask;
+                }
+            }
+        } catch (std::exception& e) {
+            state.fail(e.what());
+        }
+    }
+
+    DVIDNodeService service;
+    string labels_name;
+    uint64 bodyid;
+    const vector<BlockXYZ>& blockcoords;
+    const vector<std::pair<int, int> >& spans;
+    vector<BinaryDataPtr>& masks;
+    MeshWorkState& state;
+};
+
+}
+
+Mesh::Mesh(BinaryDataPtr binary)
+{
+    const byte* bytearray = binary->get_raw();
+    size_t length = binary->length();
+    if (length < 8) {
+        throw ErrMsg("Binary mesh is missing its header");
+    }
+    unsigned int num_vertices, num_triangles;
+    memcpy(&num_vertices, bytearray, 4);
+    memcpy(&num_triangles, bytearray + 4, 4);
+    if (length != (8 + size_t(num_vertices)*12 + size_t(num_triangles)*12)) {
+        throw ErrMsg("Binary mesh size does not match its header");
+    }
+
+    vertices.resize(size_t(num_vertices)*3);
+    triangles.resize(size_t(num_triangles)*3);
+    if (!vertices.empty()) {
+        memcpy(&vertices[0], bytearray + 8, vertices.size()*4);
+    }
+    if (!triangles.empty()) {
+        memcpy(&triangles[0], bytearray + 8 + vertices.size()*4,
+                triangles.size()*4);
+    }
+}
+
+BinaryDataPtr Mesh::export_binary() const
+{
+    unsigned int num_vertices = vertices.size() / 3;
+    unsigned int num_triangles = triangles.size() / 3;
+
+    BinaryDataPtr binary = BinaryData::create_binary_data();
+    string& data = binary->get_data();
+    data.resize(8 + vertices.size()*4 + triangles.size()*4);
+    char* iter = &data[0];
+    memcpy(iter, &num_vertices, 4);
+    memcpy(iter + 4, &num_triangles, 4);
+    if (!vertices.empty()) {
+        memcpy(iter + 8, &vertices[0], vertices.size()*4);
+    }
+    if (!triangles.empty()) {
+        memcpy(iter + 8 + vertices.size()*4, &triangles[0], triangles.size()*4);
+    }
+    return binary;
+}
+
+Mesh generate_mesh(const vector<BlockXYZ>& blockcoords,
+        const vector<BinaryDataPtr>& masks, int num_threads)
+{
+    if (blockcoords.size() != masks.size()) {
+        throw ErrMsg("Number of masks does not match the number of blocks");
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    // sort blocks so that neighbors can be found quickly
+    vector<std::pair<BlockXYZ, int> > order;
+    for (unsigned int i = 0; i < blockcoords.size(); ++i) {
+        if (!masks[i] || masks[i]->length() != BLOCKVOXELS) {
+            throw ErrMsg("Block masks must have DEFBLOCKSIZE^3 bytes");
+        }
+        order.push_back(std::make_pair(blockcoords[i], i));
+    }
+    std::sort(order.begin(), order.end());
+    vector<BlockXYZ> sorted_blocks;
+    vector<const uint8*> sorted_masks;
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        sorted_blocks.push_back(order[i].first);
+        sorted_masks.push_back(masks[order[i].second]->get_raw());
+    }
+
+    // cubes touching a block can start in that block or in the
+    // blocks before it in x, y, and z
+    vector<BlockXYZ> cellblocks;
+    for (unsigned int i = 0; i < sorted_blocks.size(); ++i) {
+        for (int c = 0; c < 8; ++c) {
+            cellblocks.push_back(BlockXYZ(sorted_blocks[i].x - (c & 1),
+                        sorted_blocks[i].y - ((c >> 1) & 1),
+                        sorted_blocks[i].z - ((c >> 2) & 1)));
+        }
+    }
+    std::sort(cellblocks.begin(), cellblocks.end());
+    cellblocks.erase(std::unique(cellblocks.begin(), cellblocks.end()),
+            cellblocks.end());
+
+    // mesh blocks in parallel
+    vector<vector<MeshEdgeKey> > triangle_keys(cellblocks.size());
+    {
+        MeshWorkState state;
+        boost::thread_group threads;
+        for (int i = 0; i < num_threads; ++i) {
+            threads.create_thread(MeshCellBlocks(sorted_blocks, sorted_masks,
+                        cellblocks, triangle_keys, state));
+        }
+        threads.join_all();
+        if (state.failed) {
+            throw ErrMsg("Mesh generation failed: " + state.error);
+        }
+    }
+
+    // weld vertices shared between triangles and blocks
+    vector<MeshEdgeKey> vertex_keys;
+    vector<size_t> triangle_offsets;
+    size_t total_keys = 0;
+    for (unsigned int i = 0; i < triangle_keys.size(); ++i) {
+        triangle_offsets.push_back(total_keys);
+        total_keys += triangle_keys[i].size();
+        vertex_keys.insert(vertex_keys.end(), triangle_keys[i].begin(),
+                triangle_keys[i].end());
+    }
+    std::sort(vertex_keys.begin(), vertex_keys.end());
+    vertex_keys.erase(std::unique(vertex_keys.begin(), vertex_keys.end()),
+            vertex_keys.end());
+
+    Mesh mesh;
+    mesh.vertices.reserve(vertex_keys.size()*3);
+    for (unsigned int i = 0; i < vertex_keys.size(); ++i) {
+        double pos[3];
+        MeshCellBlocks::edge_position(vertex_keys[i], pos);
+        mesh.vertices.push_back(float(pos[0]));
+        mesh.vertices.push_back(float(pos[1]));
+        mesh.vertices.push_back(float(pos[2]));
+    }
+
+    mesh.triangles.resize(total_keys);
+    {
+        MeshWorkState state;
+        boost::thread_group threads;
+        for (int i = 0; i < num_threads; ++i) {
+            threads.create_thread(IndexTriangles(vertex_keys, triangle_keys,
+                        triangle_offsets, mesh.triangles, state));
+        }
+        threads.join_all();
+    }
+
+    return mesh;
+}
+
+void simplify_mesh(Mesh& mesh, float cluster_size)
+{
+    if (cluster_size <= 0) {
+        throw ErrMsg("Cluster size must be positive");
+    }
+
+    // assign each vertex to a grid cell
+    size_t num_vertices = mesh.num_vertices();
+    vector<std::pair<BlockXYZ, unsigned int> > cells;
+    cells.reserve(num_vertices);
+    for (size_t i = 0; i < num_vertices; ++i) {
+        BlockXYZ cell(int(std::floor(mesh.vertices[i*3] / cluster_size)),
+                int(std::floor(mesh.vertices[i*3+1] / cluster_size)),
+                int(std::floor(mesh.vertices[i*3+2] / cluster_size)));
+        cells.push_back(std::make_pair(cell, (unsigned int)(i)));
+    }
+    std::sort(cells.begin(), cells.end());
+
+    // one vertex per cell at the average position
+    vector<unsigned int> remap(num_vertices);
+    vector<float> vertices;
+    size_t start = 0;
+    while (start < cells.size()) {
+        size_t end = start;
+        double sum[3] = {0, 0, 0};
+        while (end < cells.size() && cells[end].first == cells[start].first) {
+            unsigned int vertex = cells[end].second;
+            sum[0] += mesh.vertices[vertex*3];
+            sum[1] += mesh.vertices[vertex*3+1];
+            sum[2] += mesh.vertices[vertex*3+2];
+            remap[vertex] = vertices.size() / 3;
+            ++end;
+        }
+        for (int d = 0; d < 3; ++d) {
+            vertices.push_back(float(sum[d] / (end - start)));
+        }
+        start = end;
+    }
+
+    // drop triangles that collapsed
+    vector<unsigned int> triangles;
+    for (size_t i = 0; i < mesh.triangles.size(); i += 3) {
+        unsigned int v1 = remap[mesh.triangles[i]];
+        unsigned int v2 = remap[mesh.triangles[i+1]];
+        unsigned int v3 = remap[mesh.triangles[i+2]];
+        if (v1 != v2 && v2 != v3 && v1 != v3) {
+            triangles.push_back(v1);
+            triangles.push_back(v2);
+            triangles.push_back(v3);
+        }
+    }
+
+    mesh.vertices.swap(vertices);
+    mesh.triangles.swap(triangles);
+}
+
+Mesh generate_body_mesh(DVIDNodeService& service, string labelvol_name,
+        string labels_name, uint64 bodyid, int num_threads, float simplify_size)
+{
+    vector<BlockXYZ> blockcoords;
+    if (!service.get_coarse_body(labelvol_name, bodyid, blockcoords)) {
+        throw ErrMsg("Body not found, no mesh could be generated");
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    // group contiguous blocks along x into requests
+    vector<std::pair<int, int> > spans;
+    for (unsigned int i = 0; i < blockcoords.size(); ++i) {
+        if (!spans.empty()) {
+            std::pair<int, int>& last = spans.back();
+            const BlockXYZ& prev = blockcoords[last.first + last.second - 1];
+            if ((last.second < MAX_MESH_BLOCKS) && (prev.z == blockcoords[i].z) &&
+                    (prev.y == blockcoords[i].y) &&
+                    ((prev.x + 1) == blockcoords[i].x)) {
+                ++last.second;
+                continue;
+            }
+        }
+        spans.push_back(std::make_pair(int(i), 1));
+    }
+
+    // fetch label blocks and convert them to masks in parallel
+    vector<BinaryDataPtr> masks(blockcoords.size());
+    {
+        MeshWorkState state;
+        boost::thread_group threads;
+        int fetch_threads = (int(spans.size()) < num_threads) ?
+            int(spans.size()) : num_threads;
+        for (int i = 0; i < fetch_threads; ++i) {
+            threads.create_thread(FetchBodyMasks(service, labels_name, bodyid,
+                        blockcoords, spans, masks, state));
+        }
+        threads.join_all();
+        if (state.failed) {
+            throw ErrMsg("Could not fetch label blocks: " + state.error);
+        }
+    }
+
+    Mesh mesh = generate_mesh(blockcoords, masks, num_threads);
+    if (simplify_size > 0) {
+        simplify_mesh(mesh, simplify_size);
+    }
+    return mesh;
+}
+
+}
@@ -1,22 +1,34 @@
 #include "DVIDNodeService.h"
 #include "DVIDException.h"
+#include "DVIDJsonStream.h"
+#include "DVIDTaskPool.h"
+#include "DVIDGraphLoader.h"
+#include "DVIDFlatHash.h"
 
 #include <json/json.h>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <deque>
+#include <cstring>
+#include <algorithm>
 #include <set>
+#include <map>
 
 using std::string; using std::vector;
 
-using std::ifstream; using std::set; using std::stringstream;
+using std::ifstream; using std::set; using std::stringstream; using std::map;
 //Json::Reader json_reader;
 
-//! Gives the limit for how many vertice can be operated on in one call
-static const unsigned int TransactionLimit = 1000;
-
 
 namespace libdvid {
 
 DVIDNodeService::DVIDNodeService(string web_addr_, UUID uuid_) :
-    connection(web_addr_), uuid(uuid_)
+    connection(web_addr_), uuid(uuid_), keyvalue_compress_size(0),
+    graph_batch_sizer(new AdaptiveBatchSizer),
+    property_batch_sizer(new AdaptiveBatchSizer)
 {
     string endpoint = "/repo/" + uuid + "/info";
     string respdata;
@@ -29,7 +41,7 @@ DVIDNodeService::DVIDNodeService(string web_addr_, UUID uuid_) :
 }
 
 BinaryDataPtr DVIDNodeService::custom_request(string endpoint,
-        BinaryDataPtr payload, ConnectionMethod method)
+        BinaryDataPtr payload, ConnectionMethod method, ConnectionType type)
 {
     // append '/' to the endpoint if it is not provided
     if (!endpoint.empty() && (endpoint[0] != '/')) {
@@ -39,13 +51,34 @@ BinaryDataPtr DVIDNodeService::custom_request(string endpoint,
     string node_endpoint = "/node/" + uuid + endpoint;
     BinaryDataPtr resp_binary = BinaryData::create_binary_data();
     int status_code = connection.make_request(node_endpoint, method, payload,
-            resp_binary, respdata, BINARY);
+            resp_binary, respdata, type);
     if (status_code != 200) {
         throw DVIDException(respdata + "\n" + resp_binary->get_data(), status_code);
     }
 
     return resp_binary; 
 }
+
+void DVIDNodeService::custom_request(string endpoint, BinaryDataPtr payload,
+        ConnectionMethod method, JsonHandler& handler)
+{
+    if (!endpoint.empty() && (endpoint[0] != '/')) {
+        endpoint = '/' + endpoint;
+    }
+    string respdata;
+    string node_endpoint = "/node/" + uuid + endpoint;
+    BinaryDataPtr resp_binary = BinaryData::create_binary_data();
+
+    // parse each piece of the response as it arrives
+    JsonStreamParser parser(handler);
+    int status_code = connection.make_request(node_endpoint, method, payload,
+            boost::bind(&JsonStreamParser::feed, &parser, _1, _2),
+            resp_binary, respdata, BINARY);
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" + resp_binary->get_data(), status_code);
+    }
+    parser.finish();
+}
     
 Json::Value DVIDNodeService::get_typeinfo(string datatype_name)
 {
@@ -272,8 +305,13 @@ void DVIDNodeService::put_labelblocks(string datatype_instance,
 
 void DVIDNodeService::put(string keyvalue, string key, ifstream& fin)
 {
-    BinaryDataPtr data = BinaryData::create_binary_data(fin);
-    put(keyvalue, key, data);
+    // values are compressed whole, so the file is only streamed
+    // when compression is disabled
+    if (keyvalue_compress_size) {
+        put(keyvalue, key, BinaryData::create_binary_data(fin));
+    } else {
+        put_stream(keyvalue, key, fin);
+    }
 }
 
 void DVIDNodeService::put(string keyvalue, string key, Json::Value& data)
@@ -289,554 +327,1552 @@ void DVIDNodeService::put(string keyvalue, string key, Json::Value& data)
 void DVIDNodeService::put(string keyvalue, string key, BinaryDataPtr value)
 {
     string endpoint = "/" + keyvalue + "/key/" + key;
-    custom_request(endpoint, value, POST);
+    if (keyvalue_compress_size) {
+        value = encode_keyvalue(value, keyvalue_compress_size);
+    }
+    try {
+        custom_request(endpoint, value, POST);
+    } catch (...) {
+        // the write may have been applied
+        if (keyvalue_cache) {
+            keyvalue_cache->invalidate(uuid, keyvalue, key);
+        }
+        throw;
+    }
+
+    // invalidated after the write so that reads started before it
+    // are not cached
+    if (keyvalue_cache) {
+        keyvalue_cache->invalidate(uuid, keyvalue, key);
+    }
+}
+
+void DVIDNodeService::put_stream(string keyvalue, string key,
+        RequestSource source, TransferProgress progress, int64 size)
+{
+    string endpoint = "/node/" + uuid + "/" + keyvalue + "/key/" + key;
+    string respdata;
+    BinaryDataPtr binary = BinaryData::create_binary_data();
+    int status_code;
+    try {
+        status_code = connection.make_request(endpoint, POST, source, size,
+                ResponseCallback(), progress, binary, respdata, BINARY);
+    } catch (...) {
+        if (keyvalue_cache) {
+            keyvalue_cache->invalidate(uuid, keyvalue, key);
+        }
+        throw;
+    }
+    if (keyvalue_cache) {
+        keyvalue_cache->invalidate(uuid, keyvalue, key);
+    }
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" + binary->get_data(), status_code);
+    }
+}
+
+//! Reads a request body from an input stream
+struct IStreamSource {
+    explicit IStreamSource(std::istream& in_) : in(in_) {}
+
+    size_t operator()(char* buffer, size_t max_length)
+    {
+        in.read(buffer, max_length);
+        if (in.bad()) {
+            throw ErrMsg("Could not read value from stream");
+        }
+        return size_t(in.gcount());
+    }
+
+    std::istream& in;
+};
+
+void DVIDNodeService::put_stream(string keyvalue, string key, std::istream& in,
+        TransferProgress progress)
+{
+    // use the remaining size if the stream can seek
+    int64 size = -1;
+    std::streampos start = in.tellg();
+    if (start != std::streampos(-1) && in.seekg(0, std::ios::end)) {
+        size = int64(in.tellg() - start);
+        in.seekg(start);
+    }
+    in.clear();
+    put_stream(keyvalue, key, IStreamSource(in), progress, size);
+}
+
+void DVIDNodeService::get_stream(string keyvalue, string key,
+        ResponseCallback sink, TransferProgress progress)
+{
+    string endpoint = "/node/" + uuid + "/" + keyvalue + "/key/" + key;
+    string respdata;
+    BinaryDataPtr binary = BinaryData::create_binary_data();
+    int status_code = connection.make_request(endpoint, GET, RequestSource(),
+            -1, sink, progress, binary, respdata, BINARY);
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" + binary->get_data(), status_code);
+    }
+}
+
+//! Writes a response body to an output stream
+struct OStreamSink {
+    explicit OStreamSink(std::ostream& out_) : out(out_) {}
+
+    void operator()(const char* data, size_t length)
+    {
+        if (!out.write(data, length)) {
+            throw ErrMsg("Could not write value to stream");
+        }
+    }
+
+    std::ostream& out;
+};
+
+void DVIDNodeService::get_stream(string keyvalue, string key,
+        std::ostream& out, TransferProgress progress)
+{
+    get_stream(keyvalue, key, OStreamSink(out), progress);
 }
 
+BinaryDataPtr DVIDNodeService::get_cached(string keyvalue, string key,
+        JsonValuePtr* json)
+{
+    BinaryDataPtr value;
+    if (keyvalue_cache->find(uuid, keyvalue, key, value, json)) {
+        return value;
+    }
+    uint64 generation = keyvalue_cache->generation();
+    value = fetch_value(keyvalue, key);
+    keyvalue_cache->store(uuid, keyvalue, key, value, generation);
+    return value;
+}
+
+BinaryDataPtr DVIDNodeService::fetch_value(string keyvalue, string key)
+{
+    return decode_keyvalue(custom_request("/" + keyvalue + "/key/" + key,
+                BinaryDataPtr(), GET));
+}
 
 BinaryDataPtr DVIDNodeService::get(string keyvalue, string key)
 {
-    return custom_request("/" + keyvalue + "/key/" + key, BinaryDataPtr(), GET);
+    if (!keyvalue_cache) {
+        return fetch_value(keyvalue, key);
+    }
+
+    // the caller may modify the result, so the cached value is copied
+    BinaryDataPtr value = get_cached(keyvalue, key);
+    return BinaryData::create_binary_data(value->get_data().data(),
+            value->length());
 }
 
 Json::Value DVIDNodeService::get_json(string keyvalue, string key)
 {
-    BinaryDataPtr binary = get(keyvalue, key);
+    BinaryDataPtr binary;
+    if (keyvalue_cache) {
+        JsonValuePtr cached_json;
+        binary = get_cached(keyvalue, key, &cached_json);
+        if (cached_json) {
+            return *cached_json;
+        }
+    } else {
+        binary = get(keyvalue, key);
+    }
    
     // read into json from binary string 
+    boost::shared_ptr<Json::Value> data(new Json::Value);
+    Json::Reader json_reader;
+    if (!json_reader.parse(binary->get_data(), *data)) {
+        throw ErrMsg("Could not decode JSON");
+    }
+    if (keyvalue_cache) {
+        keyvalue_cache->store_json(uuid, keyvalue, key, binary, data);
+    }
+    return *data;
+}
+
+void DVIDNodeService::set_keyvalue_cache(KeyValueCachePtr cache)
+{
+    keyvalue_cache = cache;
+    if (keyvalue_cache && is_locked()) {
+        keyvalue_cache->set_locked(uuid);
+    }
+}
+
+bool DVIDNodeService::is_locked()
+{
+    string endpoint = "/repo/" + uuid + "/info";
+    string respdata;
+    BinaryDataPtr binary = BinaryData::create_binary_data();
+    int status_code = connection.make_request(endpoint, GET, BinaryDataPtr(),
+            binary, respdata, DEFAULT);
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" + binary->get_data(), status_code);
+    }
+
     Json::Value data;
     Json::Reader json_reader;
     if (!json_reader.parse(binary->get_data(), data)) {
         throw ErrMsg("Could not decode JSON");
     }
-    return data;
+
+    // find this node in the version DAG (the uuid may be abbreviated)
+    const Json::Value& nodes = data["DAG"]["Nodes"];
+    if (!nodes.isObject()) {
+        throw ErrMsg("Repo info does not contain the version DAG");
+    }
+    for (Json::Value::const_iterator iter = nodes.begin();
+            iter != nodes.end(); ++iter) {
+        string node_uuid = (*iter)["UUID"].asString();
+        if (node_uuid.compare(0, uuid.size(), uuid) == 0) {
+            return (*iter)["Locked"].asBool();
+        }
+    }
+    throw ErrMsg("Node " + uuid + " not found in repo info");
 }
 
-void DVIDNodeService::get_subgraph(string graph_name,
-        const std::vector<Vertex>& vertices, Graph& graph)
+//! Max bytes of values in one put_many batch
+static const size_t MAX_KEYVALUE_BATCH_BYTES = 32 << 20;
+
+//! Records the outcome of a failed single-key request
+static void set_key_error(KeyValueResult& result, std::exception& error)
 {
-    // make temporary graph for query
-    Graph temp_graph;
-    for (unsigned int i = 0; i < vertices.size(); ++i) {
-        temp_graph.vertices.push_back(vertices[i]);
-    }   
-    Json::Value data;
-    temp_graph.export_json(data);
+    DVIDException* dvid_error = dynamic_cast<DVIDException*>(&error);
+    result.status = dvid_error ? dvid_error->get_status() : 0;
+    result.error = error.what();
+    result.value.reset();
+}
 
-    stringstream datastr;
-    datastr << data;
-    BinaryDataPtr binary_data = BinaryData::create_binary_data(
-            datastr.str().c_str(), datastr.str().length());
+//! true if a status shows that the multi-key endpoint is not supported
+static bool multikey_unsupported(int status)
+{
+    return status == 400 || status == 404 || status == 405;
+}
 
-    BinaryDataPtr binary = custom_request("/" + graph_name + "/subgraph",
-           binary_data, GET);
+/*!
+ * Transfers the keys [start, start+count) with one multi-key request,
+ * falling back to single-key requests for keys that were not
+ * transferred.  A multi-key request rejected as unsupported disables
+ * it for the remaining batches; other failures (e.g., timeouts or
+ * server errors) only affect this batch.
+*/
+struct KeyValueBatchTask {
+    KeyValueBatchTask(string keyvalue_, const vector<string>& keys_,
+            const vector<BinaryDataPtr>* values_, size_t start_,
+            size_t count_, boost::atomic<bool>& use_multikey_,
+            vector<KeyValueResult>& results_) : keyvalue(keyvalue_),
+        keys(keys_), values(values_), start(start_), count(count_),
+        use_multikey(use_multikey_), results(results_) {}
+
+    void operator()(DVIDNodeService& service)
+    {
+        if (use_multikey.load()) {
+            try {
+                if (values) {
+                    put_batch(service);
+                } else {
+                    get_batch(service);
+                }
+            } catch (DVIDException& e) {
+                if (multikey_unsupported(e.get_status())) {
+                    use_multikey.store(false);
+                }
+                // keys are retried individually
+            } catch (std::exception&) {
+                // keys are retried individually
+            }
+        }
 
-    // read json from binary string into graph    
-    Json::Reader json_reader;
-    Json::Value returned_data;
-    if (!json_reader.parse(binary->get_data(), returned_data)) {
-        throw ErrMsg("Could not decode JSON");
+        for (size_t i = start; i < start + count; ++i) {
+            if (results[i].ok()) {
+                continue;
+            }
+            try {
+                if (values) {
+                    service.put(keyvalue, keys[i], (*values)[i]);
+                } else {
+                    results[i].value = service.get(keyvalue, keys[i]);
+                }
+                results[i].status = 200;
+                results[i].error.clear();
+            } catch (std::exception& e) {
+                set_key_error(results[i], e);
+            }
+        }
+    }
+
+    void get_batch(DVIDNodeService& service)
+    {
+        BinaryDataPtr payload = BinaryData::create_binary_data();
+        string& keys_json = payload->get_data();
+        keys_json += '[';
+        for (size_t i = start; i < start + count; ++i) {
+            if (i != start) {
+                keys_json += ',';
+            }
+            json_append_string(keys_json, keys[i]);
+        }
+        keys_json += ']';
+
+        BinaryDataPtr archive = service.custom_request("/" + keyvalue +
+                "/keyvalues?jsontar=true", payload, GET);
+        vector<string> names;
+        vector<BinaryDataPtr> contents;
+        read_keyvalue_tar(archive->get_data(), names, contents);
+
+        // missing keys are returned as empty files, so empty values
+        // are checked individually
+        map<string, BinaryDataPtr> found;
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (contents[i]->length() > 0) {
+                found[names[i]] = decode_keyvalue(contents[i]);
+            }
+        }
+        for (size_t i = start; i < start + count; ++i) {
+            map<string, BinaryDataPtr>::iterator iter = found.find(keys[i]);
+            if (iter != found.end()) {
+                results[i].status = 200;
+                results[i].value = iter->second;
+            }
+        }
+    }
+
+    void put_batch(DVIDNodeService& service)
+    {
+        // values are encoded as by put (see set_keyvalue_compression)
+        vector<BinaryDataPtr> encoded(values->begin() + start,
+                values->begin() + start + count);
+        size_t compress_size = service.get_keyvalue_compression();
+        if (compress_size) {
+            for (size_t i = 0; i < count; ++i) {
+                if (encoded[i]) {
+                    encoded[i] = encode_keyvalue(encoded[i], compress_size);
+                }
+            }
+        }
+        BinaryDataPtr payload = BinaryData::create_binary_data();
+        write_keyvalue_protobuf(&keys[start], &encoded[0], count,
+                payload->get_data());
+        service.custom_request("/" + keyvalue + "/keyvalues", payload, POST,
+                PROTOBUF);
+        for (size_t i = start; i < start + count; ++i) {
+            results[i].status = 200;
+        }
     }
-    graph.import_json(returned_data);
+
+    string keyvalue;
+    const vector<string>& keys;
+    const vector<BinaryDataPtr>* values;
+    size_t start, count;
+    boost::atomic<bool>& use_multikey;
+    vector<KeyValueResult>& results;
+};
+
+/*!
+ * Splits keys into batches and runs them on a task pool (or inline
+ * for a single batch).  values is null for gets.
+*/
+static void transfer_keyvalues(DVIDNodeService& service, string keyvalue,
+        const vector<string>& keys, const vector<BinaryDataPtr>* values,
+        vector<KeyValueResult>& results, int num_threads,
+        size_t max_keys_per_request)
+{
+    if (max_keys_per_request < 1) {
+        throw ErrMsg("Key transfers require at least one key per request");
+    }
+    results.assign(keys.size(), KeyValueResult());
+
+    // batch boundaries (puts are also limited by payload size)
+    vector<size_t> starts;
+    size_t batch_bytes = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        size_t value_bytes = (values && (*values)[i]) ?
+            (*values)[i]->length() : 0;
+        if (starts.empty() || (i - starts.back()) >= max_keys_per_request ||
+                (batch_bytes > 0 &&
+                 batch_bytes + value_bytes > MAX_KEYVALUE_BATCH_BYTES)) {
+            starts.push_back(i);
+            batch_bytes = 0;
+        }
+        batch_bytes += value_bytes;
+    }
+    starts.push_back(keys.size());
+
+    boost::atomic<bool> use_multikey(true);
+    size_t num_batches = starts.size() - 1;
+    if (num_threads <= 1 || num_batches <= 1) {
+        for (size_t i = 0; i < num_batches; ++i) {
+            KeyValueBatchTask(keyvalue, keys, values, starts[i],
+                    starts[i+1] - starts[i], use_multikey, results)(service);
+        }
+        return;
+    }
+
+    DVIDTaskPool pool(service, int(std::min(size_t(num_threads), num_batches)));
+    for (size_t i = 0; i < num_batches; ++i) {
+        pool.submit(KeyValueBatchTask(keyvalue, keys, values, starts[i],
+                    starts[i+1] - starts[i], use_multikey, results));
+    }
+    pool.wait();
 }
 
-void DVIDNodeService::get_vertex_neighbors(string graph_name, Vertex vertex,
-        Graph& graph)
+//! Remove written keys from the keyvalue cache (if there is one)
+static void invalidate_keys(KeyValueCache* cache, const string& uuid,
+        const string& keyvalue, const vector<string>& keys)
 {
-    stringstream uri_ending;
-    uri_ending << "/neighbors/" << vertex.id;
-    
-    BinaryDataPtr binary = custom_request("/" + graph_name + uri_ending.str(),
-            BinaryDataPtr(), GET);
-    
-    // read into json from binary string 
-    Json::Reader json_reader;
-    Json::Value data;
-    if (!json_reader.parse(binary->get_data(), data)) {
-        throw ErrMsg("Could not decode JSON");
+    if (cache) {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            cache->invalidate(uuid, keyvalue, keys[i]);
+        }
     }
-    graph.import_json(data);
 }
 
-void DVIDNodeService::update_vertices(string graph_name,
-        const std::vector<Vertex>& vertices)
+void DVIDNodeService::get_many(string keyvalue, const vector<string>& keys,
+        vector<KeyValueResult>& results, int num_threads,
+        size_t max_keys_per_request)
 {
-    unsigned int num_examined = 0;
+    transfer_keyvalues(*this, keyvalue, keys, 0, results, num_threads,
+            max_keys_per_request);
+}
 
-    while (num_examined < vertices.size()) {
-        Graph graph;
-        
-        // grab 1000 vertices at a time
-        unsigned int max_size = ((num_examined + TransactionLimit) > 
-                vertices.size()) ? vertices.size() : (num_examined + TransactionLimit); 
-        for (; num_examined < max_size; ++num_examined) {
-            graph.vertices.push_back(vertices[num_examined]);
+void DVIDNodeService::put_many(string keyvalue, const vector<string>& keys,
+        const vector<BinaryDataPtr>& values, vector<KeyValueResult>& results,
+        int num_threads, size_t max_keys_per_request)
+{
+    if (keys.size() != values.size()) {
+        throw ErrMsg("put_many requires a value for every key");
+    }
+    try {
+        transfer_keyvalues(*this, keyvalue, keys, &values, results,
+                num_threads, max_keys_per_request);
+    } catch (...) {
+        invalidate_keys(keyvalue_cache.get(), uuid, keyvalue, keys);
+        throw;
+    }
+    invalidate_keys(keyvalue_cache.get(), uuid, keyvalue, keys);
+}
+
+/*!
+ * Passes the keys of a streamed listing to a handler in pages.
+*/
+class KeyPageJsonHandler : public StringArrayJsonHandler {
+  public:
+    KeyPageJsonHandler(vector<string>& page_, KeyPageHandler handler_,
+            size_t page_size_) : StringArrayJsonHandler(page_), page(page_),
+        handler(handler_), page_size(page_size_) {}
+
+    //! Pass the remaining keys to the handler
+    void flush()
+    {
+        if (!page.empty()) {
+            handler(page);
+            page.clear();
         }
+    }
 
-        Json::Value data;
-        graph.export_json(data);
+  protected:
+    void add_string(const string& value)
+    {
+        page.push_back(value);
+        if (page.size() >= page_size) {
+            flush();
+        }
+    }
+
+  private:
+    vector<string>& page;
+    KeyPageHandler handler;
+    size_t page_size;
+};
+
+void DVIDNodeService::list_json(string endpoint, JsonHandler& handler)
+{
+    string node_endpoint = "/node/" + uuid + endpoint;
+    string respdata;
+    BinaryDataPtr binary = BinaryData::create_binary_data();
 
-        stringstream datastr;
-        datastr << data;
-        BinaryDataPtr binary = BinaryData::create_binary_data(
-                datastr.str().c_str(), datastr.str().length());
-        custom_request("/" + graph_name + "/weight", binary, POST);
+    // the streamed request only times out stalls
+    JsonStreamParser parser(handler);
+    int status_code = connection.make_request(node_endpoint, GET,
+            RequestSource(), -1, boost::bind(&JsonStreamParser::feed,
+                &parser, _1, _2), TransferProgress(), binary, respdata,
+            BINARY);
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" + binary->get_data(), status_code);
     }
+    parser.finish();
 }
-    
-void DVIDNodeService::update_edges(string graph_name,
-        const std::vector<Edge>& edges)
+
+void DVIDNodeService::list_keys(string endpoint, KeyPageHandler handler,
+        size_t page_size)
 {
+    if (page_size < 1) {
+        throw ErrMsg("Key listings require at least one key per page");
+    }
+    vector<string> page;
+    KeyPageJsonHandler json_handler(page, handler, page_size);
+    list_json(endpoint, json_handler);
+    json_handler.flush();
+}
 
-    unsigned int num_examined = 0;
-    while (num_examined < edges.size()) {
-        VertexSet examined_vertices; 
-        Graph graph;
-        
-        for (; num_examined < edges.size(); ++num_examined) {
-            // break if it is not possible to add another edge transaction
-            // (assuming that both vertices of that edge will be new vertices
-            // for simplicity
-            // for simplicity
-            // for simplicity)
-            if (examined_vertices.size() >= (TransactionLimit - 1)) {
-                break;
-            }
+void DVIDNodeService::get_keys(string keyvalue, KeyPageHandler handler,
+        size_t page_size)
+{
+    list_keys("/" + keyvalue + "/keys", handler, page_size);
+}
 
-            graph.edges.push_back(edges[num_examined]);
-            examined_vertices.insert(edges[num_examined].id1);
-            examined_vertices.insert(edges[num_examined].id2);
-            
+void DVIDNodeService::get_keys(string keyvalue, vector<string>& keys)
+{
+    keys.clear();
+    StringArrayJsonHandler handler(keys);
+    list_json("/" + keyvalue + "/keys", handler);
+}
+
+void DVIDNodeService::get_keyrange(string keyvalue, string key1, string key2,
+        KeyPageHandler handler, size_t page_size)
+{
+    list_keys("/" + keyvalue + "/keyrange/" + key1 + "/" + key2, handler,
+            page_size);
+}
+
+void DVIDNodeService::get_keyrange(string keyvalue, string key1, string key2,
+        vector<string>& keys)
+{
+    keys.clear();
+    StringArrayJsonHandler handler(keys);
+    list_json("/" + keyvalue + "/keyrange/" + key1 + "/" + key2, handler);
+}
+
+//! Keys and values of one page of a key range scan
+struct ScanPage {
+    vector<string> keys;
+    vector<KeyValueResult> results;
+};
+typedef boost::shared_ptr<ScanPage> ScanPagePtr;
+
+//! Creates page page_id of a key listing
+static ScanPagePtr scan_page(const vector<string>& keys, size_t page_id,
+        size_t page_size)
+{
+    ScanPagePtr page(new ScanPage);
+    size_t start = page_id * page_size;
+    page->keys.assign(keys.begin() + start,
+            keys.begin() + std::min(keys.size(), start + page_size));
+    return page;
+}
+
+/*!
+ * Passes the pages of a key range scan to the handler in key order.
+ * Pages fetched out of order wait until the pages before them are
+ * delivered.
+*/
+struct ScanPageDelivery {
+    explicit ScanPageDelivery(KeyValuePageHandler handler_) :
+        handler(handler_), next_page(0), failed(false) {}
+
+    void deliver(size_t page_id, ScanPagePtr page)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (failed) {
+            return;
+        }
+        waiting[page_id] = page;
+        try {
+            map<size_t, ScanPagePtr>::iterator iter;
+            while ((iter = waiting.find(next_page)) != waiting.end()) {
+                ScanPagePtr ready = iter->second;
+                waiting.erase(iter);
+                handler(ready->keys, ready->results);
+                ++next_page;
+            }
+        } catch (...) {
+            // later pages are dropped (the error is reported by the pool)
+            failed = true;
+            waiting.clear();
+            throw;
         }
+    }
+
+    KeyValuePageHandler handler;
+    boost::mutex mutex;
+    map<size_t, ScanPagePtr> waiting;
+    size_t next_page;
+    bool failed;
+};
+
+//! Fetches the values of one page of a key range scan
+struct ScanPageTask {
+    ScanPageTask(string keyvalue_, size_t page_id_, ScanPagePtr page_,
+            ScanPageDelivery& delivery_) : keyvalue(keyvalue_),
+        page_id(page_id_), page(page_), delivery(delivery_) {}
+
+    void operator()(DVIDNodeService& service)
+    {
+        service.get_many(keyvalue, page->keys, page->results, 1,
+                page->keys.size());
+        delivery.deliver(page_id, page);
+    }
+
+    string keyvalue;
+    size_t page_id;
+    ScanPagePtr page;
+    ScanPageDelivery& delivery;
+};
 
-        Json::Value data;
-        graph.export_json(data);
+void DVIDNodeService::scan_keyrange(string keyvalue, string key1,
+        string key2, KeyValuePageHandler handler, int num_threads,
+        size_t page_size)
+{
+    if (page_size < 1) {
+        throw ErrMsg("Key range scans require at least one key per page");
+    }
+
+    // the listing is read first so that no request is held open
+    // while values are fetched or pages are handled
+    vector<string> keys;
+    get_keyrange(keyvalue, key1, key2, keys);
+
+    ScanPageDelivery delivery(handler);
+    size_t num_pages = (keys.size() + page_size - 1) / page_size;
+    if (num_threads <= 1 || num_pages <= 1) {
+        for (size_t i = 0; i < num_pages; ++i) {
+            ScanPageTask(keyvalue, i, scan_page(keys, i, page_size),
+                    delivery)(*this);
+        }
+        return;
+    }
 
-        stringstream datastr;
-        datastr << data;
-        BinaryDataPtr binary = BinaryData::create_binary_data(
-                datastr.str().c_str(), datastr.str().length());
-        custom_request("/" + graph_name + "/weight", binary, POST);
+    DVIDTaskPool pool(*this, num_threads);
+    for (size_t i = 0; i < num_pages; ++i) {
+        // blocks while the pool is busy, so few pages are in memory
+        pool.submit(ScanPageTask(keyvalue, i, scan_page(keys, i, page_size),
+                    delivery));
     }
+    pool.wait();
 }
 
-// vertex list is modified, just use a copy
-void DVIDNodeService::get_properties(string graph_name,
-        std::vector<Vertex> vertices, string key,
-        std::vector<BinaryDataPtr>& properties,
-        VertexTransactions& transactions)
+void DVIDNodeService::get_subgraph(string graph_name,
+        const std::vector<Vertex>& vertices, Graph& graph)
 {
-    unsigned int num_examined = 0;
-        
-    #ifdef __clang__
-    std::unordered_map<VertexID, BinaryDataPtr> properties_map;
-    #else
-    std::tr1::unordered_map<VertexID, BinaryDataPtr> properties_map;
-    #endif
+    // serialize the query vertices directly into the request
+    BinaryDataPtr binary_data = BinaryData::create_binary_data();
+    write_graph_json(vertices.empty() ? 0 : &vertices[0], vertices.size(),
+            0, 0, binary_data->get_data());
+
+    // parse the returned graph while it is downloaded
+    GraphJsonHandler handler(graph);
+    custom_request("/" + graph_name + "/subgraph", binary_data, GET, handler);
+}
+
+void DVIDNodeService::get_vertex_neighbors(string graph_name, Vertex vertex,
+        Graph& graph)
+{
+    stringstream uri_ending;
+    uri_ending << "/neighbors/" << vertex.id;
     
-    int num_verts = vertices.size();
-
-    // keep extending vertices with failed ones
-    while (num_examined < vertices.size()) {
-        // grab 1000 vertices at a time
-        unsigned int max_size = ((num_examined + TransactionLimit) > 
-                vertices.size()) ? vertices.size() : (num_examined + TransactionLimit); 
-
-        VertexTransactions current_transactions;
-        // serialize data to push
-        for (; num_examined < max_size; ++num_examined) {
-            current_transactions[vertices[num_examined].id] = 0;
+    GraphJsonHandler handler(graph);
+    custom_request("/" + graph_name + uri_ending.str(), BinaryDataPtr(),
+            GET, handler);
+}
+
+//! Gets the neighbors of one frontier vertex on a pool thread
+struct FetchNeighbors {
+    FetchNeighbors(string graph_name_, VertexID id_, Graph& graph_) :
+        graph_name(graph_name_), id(id_), graph(graph_) {}
+
+    void operator()(DVIDNodeService& service)
+    {
+        service.get_vertex_neighbors(graph_name, Vertex(id), graph);
+    }
+
+    string graph_name;
+    VertexID id;
+    Graph& graph;
+};
+
+void DVIDNodeService::get_neighborhood(string graph_name,
+        const std::vector<Vertex>& seeds, int num_hops, Graph& graph,
+        int num_threads)
+{
+    if (num_hops < 1) {
+        get_subgraph(graph_name, seeds, graph);
+        return;
+    }
+
+    FlatHashMap<VertexID, char, VertexIDHash> visited(seeds.size() * 4);
+    FlatHashMap<EdgeKey, char, EdgeKeyHash> seen_edges(seeds.size() * 4);
+    vector<VertexID> frontier;
+    for (size_t i = 0; i < seeds.size(); ++i) {
+        char& found = visited[seeds[i].id];
+        if (!found) {
+            found = 1;
+            frontier.push_back(seeds[i].id);
         }
-        BinaryDataPtr transaction_binary = 
-            write_transactions_to_binary(current_transactions);
-        
-        // add vertex list to get properties
-        uint64 * vertex_array =
-            new uint64 [(current_transactions.size()+1)];
-        int pos = 0;
-        vertex_array[pos] = current_transactions.size();
-        ++pos;
-        for (VertexTransactions::iterator iter = current_transactions.begin();
-                iter != current_transactions.end(); ++iter) {
-            vertex_array[pos] = iter->first;
-            ++pos;
+    }
+    // seeds are added with the weights returned by DVID; vertices and
+    // edges already in the graph are not added again
+    FlatHashMap<VertexID, char, VertexIDHash> added(
+            (seeds.size() + graph.vertices.size()) * 4);
+    for (size_t i = 0; i < graph.vertices.size(); ++i) {
+        added[graph.vertices[i].id] = 1;
+    }
+    for (size_t i = 0; i < graph.edges.size(); ++i) {
+        seen_edges[EdgeKey(graph.edges[i])] = 1;
+    }
+
+    // one pool (and set of connections) for all hops
+    DVIDTaskPool pool(*this, num_threads);
+    for (int hop = 0; hop < num_hops && !frontier.empty(); ++hop) {
+        // one neighbor request per frontier vertex
+        vector<Graph> neighborhoods(frontier.size());
+        for (size_t i = 0; i < frontier.size(); ++i) {
+            pool.submit(FetchNeighbors(graph_name, frontier[i],
+                        neighborhoods[i]));
         }
-        string& str_append = transaction_binary->get_data();
+        pool.wait();
+
+        vector<VertexID> next_frontier;
+        for (size_t i = 0; i < neighborhoods.size(); ++i) {
+            const Graph& neighbors = neighborhoods[i];
+            for (size_t j = 0; j < neighbors.vertices.size(); ++j) {
+                const Vertex& vertex = neighbors.vertices[j];
+                char& is_added = added[vertex.id];
+                if (!is_added) {
+                    is_added = 1;
+                    graph.vertices.push_back(vertex);
+                }
+                char& is_visited = visited[vertex.id];
+                if (!is_visited) {
+                    is_visited = 1;
+                    next_frontier.push_back(vertex.id);
+                }
+            }
+            for (size_t j = 0; j < neighbors.edges.size(); ++j) {
+                char& found = seen_edges[EdgeKey(neighbors.edges[j])];
+                if (!found) {
+                    found = 1;
+                    graph.edges.push_back(neighbors.edges[j]);
+                }
+            }
+        }
+        frontier.swap(next_frontier);
+    }
+}
 
-        str_append += string((char*)vertex_array, (current_transactions.size()+1)*8);
-        
-        delete []vertex_array;
+//! Throws an error summarizing the failed batches
+static void throw_batch_errors(const vector<GraphBatchError>& failed_batches,
+        size_t num_elements)
+{
+    if (failed_batches.empty()) {
+        return;
+    }
+    size_t num_failed = 0;
+    for (size_t i = 0; i < failed_batches.size(); ++i) {
+        num_failed += failed_batches[i].count;
+    }
+    stringstream msg;
+    msg << failed_batches.size() << " graph update batch(es) failed (" <<
+        num_failed << " of " << num_elements << " elements); first error at " <<
+        failed_batches[0].start << ": " << failed_batches[0].message;
+    throw ErrMsg(msg.str());
+}
 
-        // get data associated with given graph and 'key'
-        BinaryDataPtr binary = custom_request("/" + graph_name +
-                "/propertytransaction/vertices/" + key + "/", transaction_binary, GET);
+void DVIDNodeService::update_vertices(string graph_name,
+        const std::vector<Vertex>& vertices, int num_threads)
+{
+    vector<GraphBatchError> failed_batches;
+    update_vertices(graph_name, vertices, num_threads, failed_batches);
+    throw_batch_errors(failed_batches, vertices.size());
+}
 
-        VertexSet bad_vertices;
-        size_t byte_pos = load_transactions_from_binary(binary->get_data(),
-                transactions, bad_vertices);
-       
-        // failed vertices should be re-examined 
-        for (VertexSet::iterator iter = bad_vertices.begin();
-                iter != bad_vertices.end(); ++iter) {
-            vertices.push_back(Vertex(*iter, 0));
-            //std::cout << "Failed vertex get!: " << *iter << std::endl; 
-        }
+void DVIDNodeService::update_vertices(string graph_name,
+        const std::vector<Vertex>& vertices, int num_threads,
+        std::vector<GraphBatchError>& failed_batches)
+{
+    // batches are serialized here while the pool sends earlier ones
+    GraphUploader uploader(*this, graph_name, num_threads);
+    if (!vertices.empty()) {
+        uploader.add_vertices(&vertices[0], vertices.size());
+    }
+    uploader.flush();
+    failed_batches = uploader.vertex_errors();
+}
+    
+void DVIDNodeService::update_edges(string graph_name,
+        const std::vector<Edge>& edges, int num_threads)
+{
+    vector<GraphBatchError> failed_batches;
+    update_edges(graph_name, edges, num_threads, failed_batches);
+    throw_batch_errors(failed_batches, edges.size());
+}
 
-        // load properties
-        const unsigned char* bytearray = binary->get_raw();
-       
-        // get number of properties
-        uint64* num_transactions = (uint64 *)(bytearray+byte_pos);
-        byte_pos += 8;
-
-        // iterate through all properties
-        for (int i = 0; i < int(*num_transactions); ++i) {
-            VertexID* vertex_id = (VertexID *)(bytearray+byte_pos);
-            byte_pos += 8;
-            uint64* data_size = (uint64*)(bytearray+byte_pos);
-            byte_pos += 8;
-            properties_map[*vertex_id] = BinaryData::create_binary_data(
-                    (const char *)(bytearray+byte_pos), *data_size);      
-            byte_pos += *data_size;
-        }
+void DVIDNodeService::update_edges(string graph_name,
+        const std::vector<Edge>& edges, int num_threads,
+        std::vector<GraphBatchError>& failed_batches)
+{
+    GraphUploader uploader(*this, graph_name, num_threads);
+    if (!edges.empty()) {
+        uploader.add_edges(&edges[0], edges.size());
     }
+    uploader.flush();
+    failed_batches = uploader.edge_errors();
+}
 
-    for (int i = 0; i < num_verts; ++i) {
-        properties.push_back(properties_map[vertices[i].id]);
+/************* Property transactions ******************/
+
+/*!
+ * Vertex or edge (id2 is 0 for vertices) in a property transaction.
+ * index refers to the position in the caller's list.
+*/
+struct PropertyItem {
+    PropertyItem(VertexID id1_, VertexID id2_, size_t index_) :
+        id1(id1_), id2(id2_), index(index_) {}
+
+    VertexID id1, id2;
+    size_t index;
+};
+
+//! Location of one property in a response buffer
+struct PropertyRecord {
+    VertexID id1, id2;
+    size_t offset, length;
+};
+
+/*!
+ * Result of one property transaction batch, which covers items
+ * [start, end) of the pending item list.
+*/
+struct PropertyBatchResult {
+    PropertyBatchResult(size_t start_, size_t end_, size_t num_vertices_) :
+        start(start_), end(end_), num_vertices(num_vertices_) {}
+
+    size_t start, end;
+
+    //! distinct vertices in the batch (the batch size unit)
+    size_t num_vertices;
+
+    //! vertices held back from other writes while the batch is in flight
+    vector<VertexID> vertices;
+
+    BinaryDataPtr response;
+    vector<std::pair<VertexID, TransactionID> > transactions;
+    vector<VertexID> failed;
+    vector<PropertyRecord> records;
+    string error;
+};
+
+typedef boost::shared_ptr<PropertyBatchResult> PropertyBatchResultPtr;
+
+//! Batches finished by the workers waiting to be merged
+struct PropertyTransactionState {
+    boost::mutex mutex;
+    boost::condition_variable batch_done;
+    std::deque<PropertyBatchResultPtr> completed;
+};
+
+//! Creates the request payload for a batch of items
+typedef boost::function<BinaryDataPtr (const PropertyItem*, size_t)> PropertyPayloadWriter;
+
+//! Merges a finished batch (may append items to retry)
+typedef boost::function<void (PropertyBatchResult&, vector<PropertyItem>&)> PropertyResultHandler;
+
+//! Read a 64 bit number from a response with bounds checking
+static uint64 read_response_uint64(const unsigned char* data, size_t length,
+        size_t& pos)
+{
+    if (pos + 8 > length) {
+        throw ErrMsg("Truncated property transaction response");
     }
+    uint64 value;
+    memcpy(&value, data + pos, 8);
+    pos += 8;
+    return value;
 }
 
-// edge list is modified, just use a copy
-void DVIDNodeService::get_properties(string graph_name, std::vector<Edge> edges, string key,
-            std::vector<BinaryDataPtr>& properties, VertexTransactions& transactions)
+//! Append a 64 bit number to a payload
+static void append_uint64(string& buffer, uint64 value)
 {
-    unsigned int num_examined = 0;
-    
-    #ifdef __clang__
-    std::unordered_map<Edge, BinaryDataPtr, Edge> properties_map;
-    #else
-    std::tr1::unordered_map<Edge, BinaryDataPtr, Edge> properties_map;
-    #endif
-    int num_edges = edges.size();
-
-    // keep extending vertices with failed ones
-    while (num_examined < edges.size()) {
-        VertexSet examined_vertices; 
-
-        unsigned int num_current_edges = 0;
-        unsigned int starting_num = num_examined;
-        for (; num_examined < edges.size(); ++num_current_edges, ++num_examined) {
-            // break if it is not possible to add another edge transaction
-            // (assuming that both vertices of that edge will be new vertices)
-            assert(TransactionLimit > 0);
-            if (examined_vertices.size() >= (TransactionLimit - 1)) {
-                break;
+    buffer.append((const char*) &value, 8);
+}
+
+/*!
+ * Parses the transaction ids, failed vertices and (for reads)
+ * property locations from a response.
+*/
+static void parse_property_response(PropertyBatchResult& result, bool edges,
+        bool has_properties)
+{
+    const unsigned char* data = result.response->get_raw();
+    size_t length = result.response->length();
+    size_t pos = 0;
+
+    uint64 num_transactions = read_response_uint64(data, length, pos);
+    result.transactions.reserve(num_transactions);
+    for (uint64 i = 0; i < num_transactions; ++i) {
+        VertexID id = read_response_uint64(data, length, pos);
+        TransactionID tid = read_response_uint64(data, length, pos);
+        result.transactions.push_back(std::make_pair(id, tid));
+    }
+
+    uint64 num_failed = read_response_uint64(data, length, pos);
+    for (uint64 i = 0; i < num_failed; ++i) {
+        result.failed.push_back(read_response_uint64(data, length, pos));
+    }
+
+    if (!has_properties) {
+        return;
+    }
+
+    uint64 num_properties = read_response_uint64(data, length, pos);
+    result.records.reserve(num_properties);
+    for (uint64 i = 0; i < num_properties; ++i) {
+        PropertyRecord record;
+        record.id1 = read_response_uint64(data, length, pos);
+        record.id2 = edges ? read_response_uint64(data, length, pos) : 0;
+        record.length = read_response_uint64(data, length, pos);
+        record.offset = pos;
+        if (record.length > length - pos) {
+            throw ErrMsg("Truncated property transaction response");
+        }
+        pos += record.length;
+        result.records.push_back(record);
+    }
+}
+
+//! Sends one batch on a pool thread and queues the parsed result
+struct PropertyBatchTask {
+    PropertyBatchTask(string endpoint_, BinaryDataPtr payload_,
+            ConnectionMethod method_, bool edges_,
+            PropertyBatchResultPtr result_, AdaptiveBatchSizerPtr sizer_,
+            PropertyTransactionState& state_) : endpoint(endpoint_),
+        payload(payload_), method(method_), edges(edges_), result(result_),
+        sizer(sizer_), state(state_) {}
+
+    void operator()(DVIDNodeService& service)
+    {
+        BatchTimer timer;
+        try {
+            result->response = service.custom_request(endpoint, payload, method);
+            parse_property_response(*result, edges, method == GET);
+            sizer->record(result->num_vertices, payload->length() +
+                    result->response->length(), timer.elapsed(),
+                    result->failed.size(), false);
+        } catch (std::exception& e) {
+            result->error = e.what();
+            if (result->error.empty()) {
+                result->error = "Property transaction failed";
             }
+            sizer->record(result->num_vertices, payload->length(),
+                    timer.elapsed(), 0, true);
+        }
 
-            examined_vertices.insert(edges[num_examined].id1);
-            examined_vertices.insert(edges[num_examined].id2);
-            
+        boost::mutex::scoped_lock lock(state.mutex);
+        state.completed.push_back(result);
+        state.batch_done.notify_one();
+    }
+
+    string endpoint;
+    BinaryDataPtr payload;
+    ConnectionMethod method;
+    bool edges;
+    PropertyBatchResultPtr result;
+    AdaptiveBatchSizerPtr sizer;
+    PropertyTransactionState& state;
+};
+
+/*!
+ * Determines the end of the batch starting at start.  Edge batches
+ * are limited by the number of distinct vertices (assuming that both
+ * vertices of the next edge are new).  num_vertices is set to the
+ * number of distinct vertices in the batch.
+*/
+static size_t property_batch_end(const vector<PropertyItem>& items,
+        size_t start, bool edges, size_t batch_size,
+        FlatHashMap<VertexID, char, VertexIDHash>& seen, size_t& num_vertices)
+{
+    if (!edges) {
+        size_t end = std::min(items.size(), start + batch_size);
+        num_vertices = end - start;
+        return end;
+    }
+    seen.clear();
+    size_t end = start;
+    for (; end < items.size(); ++end) {
+        if (seen.size() >= (batch_size - 1)) {
+            break;
         }
+        seen[items[end].id1] = 1;
+        seen[items[end].id2] = 1;
+    }
+    num_vertices = seen.size();
+    return end;
+}
 
-        // write out transactions for current edge
-        VertexTransactions current_transactions;
-        for (VertexSet::iterator iter = examined_vertices.begin();
-                iter != examined_vertices.end(); ++iter) {
-            current_transactions[*iter] = 0;
+/*!
+ * Marks the vertices of a batch as in flight unless one of them
+ * already is.  A write must not be serialized with transaction ids that
+ * a batch in flight is about to replace, or DVID rejects it as stale.
+ * \return false if the batch shares a vertex with a batch in flight
+*/
+static bool claim_batch_vertices(const PropertyItem* items, size_t num_items,
+        bool edges, FlatHashMap<VertexID, char, VertexIDHash>& busy,
+        vector<VertexID>& vertices)
+{
+    for (size_t i = 0; i < num_items; ++i) {
+        const char* busy1 = busy.find(items[i].id1);
+        const char* busy2 = edges ? busy.find(items[i].id2) : 0;
+        if ((busy1 && *busy1) || (busy2 && *busy2)) {
+            return false;
         }
-        BinaryDataPtr transaction_binary = write_transactions_to_binary(current_transactions);
-       
-        // add edge list to get properties
-        uint64* edge_array =
-            new uint64 [(num_current_edges*2+1)*8];
-        unsigned int pos = 0;
-        edge_array[pos] = num_current_edges;
-        ++pos;
-        for (unsigned int iter = starting_num; iter < num_examined; ++iter) {
-            edge_array[pos] = edges[iter].id1;
-            ++pos;
-            edge_array[pos] = edges[iter].id2;
-            ++pos;
+    }
+    for (size_t i = 0; i < num_items; ++i) {
+        VertexID ids[] = {items[i].id1, items[i].id2};
+        for (int j = 0; j < (edges ? 2 : 1); ++j) {
+            char& claimed = busy[ids[j]];
+            if (!claimed) {
+                claimed = 1;
+                vertices.push_back(ids[j]);
+            }
         }
-        string& str_append = transaction_binary->get_data();
-        str_append += string((char*)edge_array, (num_current_edges*2+1)*8);
-        delete []edge_array;
+    }
+    return true;
+}
+
+/*!
+ * Runs property transactions for the pending items.  Batches are
+ * serialized on the calling thread and sent by a pool with a bounded
+ * number in flight.  Finished batches are merged on the calling thread
+ * by the handler; items it appends to pending (e.g., retries) are sent
+ * in later batches while other batches are still in flight.  Writes
+ * (POST) that share a vertex with a batch in flight wait until it is
+ * merged so that they are sent with its new transaction ids.
+*/
+static void run_property_transactions(DVIDNodeService& service,
+        string endpoint, ConnectionMethod method, bool edges,
+        vector<PropertyItem>& pending, PropertyPayloadWriter writer,
+        PropertyResultHandler handler, int num_threads)
+{
+    PropertyTransactionState state;
+    string first_error;
+    AdaptiveBatchSizerPtr sizer = service.get_property_batch_sizer();
+    FlatHashMap<VertexID, char, VertexIDHash> seen(sizer->batch_size());
+    FlatHashMap<VertexID, char, VertexIDHash> busy;
+
+    {
+        DVIDTaskPool pool(service, num_threads);
+        size_t max_in_flight = 2 * pool.num_threads();
+        size_t next = 0;
+        size_t in_flight = 0;
+
+        while (true) {
+            // keep the pool busy (stop sending after an error)
+            while (first_error.empty() && next < pending.size() &&
+                    in_flight < max_in_flight) {
+                size_t num_vertices = 0;
+                size_t end = property_batch_end(pending, next, edges,
+                        sizer->batch_size(), seen, num_vertices);
+                PropertyBatchResultPtr result(new PropertyBatchResult(next, end,
+                            num_vertices));
+                if (method == POST && !claim_batch_vertices(&pending[next],
+                            end - next, edges, busy, result->vertices)) {
+                    break;
+                }
+                BinaryDataPtr payload = writer(&pending[next], end - next);
+                pool.submit(PropertyBatchTask(endpoint, payload, method, edges,
+                            result, sizer, state));
+                ++in_flight;
+                next = end;
+            }
+            if (in_flight == 0) {
+                break;
+            }
 
-        // get data associated with given graph and 'key'
-        BinaryDataPtr binary = custom_request("/" + graph_name +
-                "/propertytransaction/edges/" + key + "/", transaction_binary, GET);
+            PropertyBatchResultPtr result;
+            {
+                boost::mutex::scoped_lock lock(state.mutex);
+                while (state.completed.empty()) {
+                    state.batch_done.wait(lock);
+                }
+                result = state.completed.front();
+                state.completed.pop_front();
+            }
+            --in_flight;
 
-        VertexSet bad_vertices;
-        size_t byte_pos = load_transactions_from_binary(
-                binary->get_data(), transactions, bad_vertices);
-       
-        // failed vertices should cause corresponding edges to be re-examined 
-        for (unsigned int iter = starting_num; iter < num_examined; ++iter) {
-            if (bad_vertices.find(edges[iter].id1) != bad_vertices.end()) {
-                edges.push_back(edges[iter]);
-            } else if (bad_vertices.find(edges[iter].id2) != bad_vertices.end()) {
-                edges.push_back(edges[iter]);
+            if (!result->error.empty()) {
+                if (first_error.empty()) {
+                    first_error = result->error;
+                }
+                continue;
+            }
+            handler(*result, pending);
+            for (size_t i = 0; i < result->vertices.size(); ++i) {
+                busy[result->vertices[i]] = 0;
             }
-        }
-        
-        // load properties
-        const unsigned char* bytearray = binary->get_raw();
-        
-        // get number of properties
-        uint64* num_transactions = 
-            (uint64*)(bytearray+byte_pos);
-        byte_pos += 8;
-
-        // iterate through all properties
-        for (int i = 0; i < int(*num_transactions); ++i) {
-            VertexID* vertex_id1 = (VertexID *)(bytearray+byte_pos);
-            byte_pos += 8;
-            VertexID* vertex_id2 = (VertexID *)(bytearray+byte_pos);
-            byte_pos += 8;
-            uint64* data_size = (uint64*)(bytearray+byte_pos);
-            byte_pos += 8;
-            properties_map[Edge(*vertex_id1, *vertex_id2, 0)] =
-                BinaryData::create_binary_data((const char*)
-                        (bytearray+byte_pos), *data_size);      
-            byte_pos += *data_size;
         }
     }
 
-    for (int i = 0; i < num_edges; ++i) {
-        properties.push_back(properties_map[edges[i]]);
+    if (!first_error.empty()) {
+        throw ErrMsg(first_error);
     }
 }
 
-void DVIDNodeService::set_properties(string graph_name, std::vector<Vertex>& vertices,
-        string key, std::vector<BinaryDataPtr>& properties,
-        VertexTransactions& transactions, std::vector<Vertex>& leftover_vertices)
+/*!
+ * Writes the transaction list for a batch.  The transaction ids are
+ * looked up in transactions (0 if not given).
+*/
+static void write_batch_transactions(string& buffer, const PropertyItem* items,
+        size_t num_items, bool edges, const VertexTransactions* transactions)
 {
-    unsigned int num_examined = 0;
+    // distinct vertices in the batch
+    FlatHashMap<VertexID, char, VertexIDHash> seen(num_items * 2);
+    vector<VertexID> vertices;
+    vertices.reserve(edges ? num_items * 2 : num_items);
+    for (size_t i = 0; i < num_items; ++i) {
+        char& found = seen[items[i].id1];
+        if (!found) {
+            found = 1;
+            vertices.push_back(items[i].id1);
+        }
+        if (edges) {
+            char& found2 = seen[items[i].id2];
+            if (!found2) {
+                found2 = 1;
+                vertices.push_back(items[i].id2);
+            }
+        }
+    }
 
-    // only post 1000 properties at a time
-    while (num_examined < vertices.size()) {
-        // add vertex list and properties
-        
-        // grab 1000 vertices at a time
-        unsigned int max_size = ((num_examined + TransactionLimit) > 
-                vertices.size()) ? vertices.size() : (num_examined + TransactionLimit); 
-   
-        VertexTransactions temp_transactions;
-        for (unsigned int i = num_examined; i < max_size; ++i) {
-            temp_transactions[vertices[i].id] = transactions[vertices[i].id];
+    append_uint64(buffer, vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        TransactionID tid = 0;
+        if (transactions) {
+            VertexTransactions::const_iterator iter = transactions->find(vertices[i]);
+            if (iter != transactions->end()) {
+                tid = iter->second;
+            }
         }
-        BinaryDataPtr binary = write_transactions_to_binary(temp_transactions);
-
-        // write out number of trans
-        string& str_append = binary->get_data();
-        uint64 num_trans = temp_transactions.size();
-        str_append += string((char*)&num_trans, 8);
-
-        for (; num_examined < max_size; ++num_examined) {
-            uint64 id = vertices[num_examined].id;
-            BinaryDataPtr databin = properties[num_examined];
-            string& data = databin->get_data();
-            uint64 data_size = data.size();
-
-            str_append += string((char*)&id, 8);
-            str_append += string((char*)&data_size, 8);
-            str_append += data;
-        } 
-
-        // put the data
-        VertexSet failed_trans;
-        VertexTransactions succ_trans;
-        BinaryDataPtr result_binary = custom_request("/" + graph_name +
-                "/propertytransaction/vertices/" + key, binary, POST);
-        load_transactions_from_binary(result_binary->get_data(),
-            succ_trans, failed_trans);
-
-        // update transaction ids for successful trans
-        for (VertexTransactions::iterator iter = succ_trans.begin();
-                iter != succ_trans.end(); ++iter) {
-            transactions[iter->first] = iter->second;
+        append_uint64(buffer, vertices[i]);
+        append_uint64(buffer, tid);
+    }
+}
+
+//! Payload requesting the properties of a batch
+struct GetPropertiesPayload {
+    explicit GetPropertiesPayload(bool edges_) : edges(edges_) {}
+
+    BinaryDataPtr operator()(const PropertyItem* items, size_t num_items)
+    {
+        BinaryDataPtr binary = BinaryData::create_binary_data();
+        string& buffer = binary->get_data();
+        buffer.reserve(8 * (3 + 4 * num_items));
+        write_batch_transactions(buffer, items, num_items, edges, 0);
+
+        append_uint64(buffer, num_items);
+        for (size_t i = 0; i < num_items; ++i) {
+            append_uint64(buffer, items[i].id1);
+            if (edges) {
+                append_uint64(buffer, items[i].id2);
+            }
         }
+        return binary;
+    }
 
-        // add failed vertices to leftover vertices
-        for (VertexSet::iterator iter = failed_trans.begin();
-                iter != failed_trans.end(); ++iter) {
-            leftover_vertices.push_back(Vertex(*iter, 0));
+    bool edges;
+};
+
+//! Payload writing the properties of a batch
+struct SetPropertiesPayload {
+    SetPropertiesPayload(bool edges_, const vector<BinaryDataPtr>& properties_,
+            const VertexTransactions& transactions_) : edges(edges_),
+        properties(properties_), transactions(transactions_) {}
+
+    BinaryDataPtr operator()(const PropertyItem* items, size_t num_items)
+    {
+        BinaryDataPtr binary = BinaryData::create_binary_data();
+        string& buffer = binary->get_data();
+        write_batch_transactions(buffer, items, num_items, edges, &transactions);
+
+        append_uint64(buffer, num_items);
+        for (size_t i = 0; i < num_items; ++i) {
+            const string& data = properties[items[i].index]->get_data();
+            append_uint64(buffer, items[i].id1);
+            if (edges) {
+                append_uint64(buffer, items[i].id2);
+            }
+            append_uint64(buffer, data.size());
+            buffer += data;
         }
+        return binary;
+    }
+
+    bool edges;
+    const vector<BinaryDataPtr>& properties;
+    const VertexTransactions& transactions;
+};
+
+//! Failed vertices of a batch for quick lookup
+static void load_failed_vertices(const PropertyBatchResult& result,
+        FlatHashMap<VertexID, char, VertexIDHash>& failed)
+{
+    failed.clear();
+    for (size_t i = 0; i < result.failed.size(); ++i) {
+        failed[result.failed[i]] = 1;
     }
 }
 
-void DVIDNodeService::set_properties(string graph_name, std::vector<Edge>& edges,
-        string key, std::vector<BinaryDataPtr>& properties,
-        VertexTransactions& transactions, std::vector<Edge>& leftover_edges)
+/*!
+ * Collects the transaction ids returned for a batch (and records
+ * them in the cache).
+*/
+static void load_batch_transactions(const PropertyBatchResult& result,
+        FlatHashMap<VertexID, TransactionID, VertexIDHash>& batch_transactions,
+        PropertyCache* cache, const string& graph_name)
 {
-    unsigned int num_examined = 0;
+    for (size_t i = 0; i < result.transactions.size(); ++i) {
+        batch_transactions[result.transactions[i].first] =
+            result.transactions[i].second;
+        if (cache) {
+            cache->update_transaction(graph_name, result.transactions[i].first,
+                    result.transactions[i].second);
+        }
+    }
+    if (cache) {
+        for (size_t i = 0; i < result.failed.size(); ++i) {
+            cache->invalidate(graph_name, result.failed[i]);
+        }
+    }
+}
 
-    // only post 1000 properties at a time
-    while (num_examined < edges.size()) {
-        VertexSet examined_vertices; 
-        
-        unsigned int num_current_edges = 0;
-        unsigned int starting_num = num_examined;
-        for (; num_examined < edges.size(); ++num_current_edges, ++num_examined) {
-            // break if it is not possible to add another edge transaction
-            // (assuming that both vertices of that edge will be new vertices)
-            assert(TransactionLimit > 0);
-            if (examined_vertices.size() >= (TransactionLimit - 1)) {
-                break;
+/*!
+ * Merges property reads: records transaction ids and property views
+ * (also in the cache if there is one) and retries the items with
+ * failed vertices.
+*/
+struct MergeGetProperties {
+    MergeGetProperties(bool edges_, VertexTransactions& transactions_,
+            FlatHashMap<VertexID, PropertyView, VertexIDHash>& vertex_properties_,
+            FlatHashMap<EdgeKey, PropertyView, EdgeKeyHash>& edge_properties_,
+            PropertyCache* cache_, string graph_name_, string key_) :
+        edges(edges_), transactions(transactions_),
+        vertex_properties(vertex_properties_), edge_properties(edge_properties_),
+        cache(cache_), graph_name(graph_name_), key(key_) {}
+
+    void operator()(PropertyBatchResult& result, vector<PropertyItem>& pending)
+    {
+        FlatHashMap<VertexID, TransactionID, VertexIDHash>
+            batch_transactions(result.transactions.size());
+        load_batch_transactions(result, batch_transactions, cache, graph_name);
+        for (size_t i = 0; i < result.transactions.size(); ++i) {
+            transactions[result.transactions[i].first] = result.transactions[i].second;
+        }
+
+        for (size_t i = 0; i < result.records.size(); ++i) {
+            const PropertyRecord& record = result.records[i];
+            PropertyView view(result.response, record.offset, record.length);
+            if (edges) {
+                EdgeKey edge(record.id1, record.id2);
+                edge_properties[edge] = view;
+                const TransactionID* tid1 = batch_transactions.find(edge.id1);
+                const TransactionID* tid2 = batch_transactions.find(edge.id2);
+                if (cache && tid1 && tid2) {
+                    cache->store(graph_name, key, edge, view, *tid1, *tid2);
+                }
+            } else {
+                vertex_properties[record.id1] = view;
+                const TransactionID* tid = batch_transactions.find(record.id1);
+                if (cache && tid) {
+                    cache->store(graph_name, key, record.id1, view, *tid);
+                }
             }
+        }
 
-            examined_vertices.insert(edges[num_examined].id1);
-            examined_vertices.insert(edges[num_examined].id2);
+        if (result.failed.empty()) {
+            return;
         }
-    
-        // write out transactions for current edge
-        VertexTransactions current_transactions;
-        for (VertexSet::iterator iter = examined_vertices.begin();
-                iter != examined_vertices.end(); ++iter) {
-            current_transactions[*iter] = transactions[*iter];
+        FlatHashMap<VertexID, char, VertexIDHash> failed(result.failed.size());
+        load_failed_vertices(result, failed);
+        for (size_t i = result.start; i < result.end; ++i) {
+            PropertyItem item = pending[i];
+            if (failed.find(item.id1) || (edges && failed.find(item.id2))) {
+                pending.push_back(item);
+            }
         }
-        BinaryDataPtr binary = write_transactions_to_binary(current_transactions);
-        
-        // add vertex list and properties
-        string& str_append = binary->get_data();
-        
-        uint64 num_trans = num_current_edges;
-        str_append += string((char*)&num_trans, 8);
-
-        for (unsigned int iter = starting_num; iter < num_examined; ++iter) {
-            uint64 id1 = edges[iter].id1;
-            uint64 id2 = edges[iter].id2;
-            BinaryDataPtr databin = properties[iter];
-            string& data = databin->get_data();
-            uint64 data_size = data.size();
-
-            str_append += string((char*)&id1, 8);
-            str_append += string((char*)&id2, 8);
-            str_append += string((char*)&data_size, 8);
-            str_append += data;
-        } 
-
-        // put the data
-        VertexSet failed_trans;
-        VertexTransactions succ_trans;
-        BinaryDataPtr result_binary = custom_request("/" + graph_name +
-                "/propertytransaction/edges/" + key, binary, POST);
-        load_transactions_from_binary(result_binary->get_data(),
-            succ_trans, failed_trans);
-
-        // update transaction ids for successful trans
-        for (VertexTransactions::iterator iter = succ_trans.begin();
-                iter != succ_trans.end(); ++iter) {
-            transactions[iter->first] = iter->second;
+    }
+
+    bool edges;
+    VertexTransactions& transactions;
+    FlatHashMap<VertexID, PropertyView, VertexIDHash>& vertex_properties;
+    FlatHashMap<EdgeKey, PropertyView, EdgeKeyHash>& edge_properties;
+    PropertyCache* cache;
+    string graph_name, key;
+};
+
+/*!
+ * Merges property writes: records new transaction ids and returns
+ * the items with failed vertices to the caller.  Written properties
+ * are stored in the cache (if there is one) with their new ids.
+*/
+struct MergeSetProperties {
+    MergeSetProperties(bool edges_, VertexTransactions& transactions_,
+            vector<size_t>& leftover_, const vector<BinaryDataPtr>& properties_,
+            PropertyCache* cache_, string graph_name_, string key_) :
+        edges(edges_), transactions(transactions_), leftover(leftover_),
+        properties(properties_), cache(cache_), graph_name(graph_name_),
+        key(key_) {}
+
+    void operator()(PropertyBatchResult& result, vector<PropertyItem>& pending)
+    {
+        FlatHashMap<VertexID, TransactionID, VertexIDHash>
+            batch_transactions(result.transactions.size());
+        load_batch_transactions(result, batch_transactions, cache, graph_name);
+        for (size_t i = 0; i < result.transactions.size(); ++i) {
+            transactions[result.transactions[i].first] = result.transactions[i].second;
         }
 
-        // add leftover edges from failed vertices
-        for (unsigned int iter = starting_num; iter < num_examined; ++iter) {
-            if (failed_trans.find(edges[iter].id1) != failed_trans.end()) {
-                leftover_edges.push_back(edges[iter]);
-            } else if (failed_trans.find(edges[iter].id2) != failed_trans.end()) {
-                leftover_edges.push_back(edges[iter]);
+        FlatHashMap<VertexID, char, VertexIDHash> failed(result.failed.size());
+        load_failed_vertices(result, failed);
+        for (size_t i = result.start; i < result.end; ++i) {
+            const PropertyItem& item = pending[i];
+            if (failed.find(item.id1) || (edges && failed.find(item.id2))) {
+                leftover.push_back(item.index);
+                continue;
+            }
+            if (!cache) {
+                continue;
+            }
+
+            // the cache stores a copy, so later changes by the caller
+            // are not seen
+            PropertyView view(properties[item.index], 0,
+                    properties[item.index]->length());
+            const TransactionID* tid1 = batch_transactions.find(item.id1);
+            if (edges) {
+                const TransactionID* tid2 = batch_transactions.find(item.id2);
+                if (tid1 && tid2) {
+                    cache->store(graph_name, key, EdgeKey(item.id1, item.id2),
+                            view, (item.id1 < item.id2) ? *tid1 : *tid2,
+                            (item.id1 < item.id2) ? *tid2 : *tid1);
+                }
+            } else if (tid1) {
+                cache->store(graph_name, key, item.id1, view, *tid1);
             }
         }
     }
+
+    bool edges;
+    VertexTransactions& transactions;
+    vector<size_t>& leftover;
+    const vector<BinaryDataPtr>& properties;
+    PropertyCache* cache;
+    string graph_name, key;
+};
+
+void DVIDNodeService::get_properties(string graph_name,
+        const std::vector<Vertex>& vertices, string key,
+        std::vector<PropertyView>& properties,
+        VertexTransactions& transactions, int num_threads)
+{
+    // request each vertex once
+    FlatHashMap<VertexID, PropertyView, VertexIDHash> vertex_properties(vertices.size());
+    FlatHashMap<EdgeKey, PropertyView, EdgeKeyHash> edge_properties;
+    vector<PropertyItem> pending;
+    pending.reserve(vertices.size());
+    {
+        FlatHashMap<VertexID, char, VertexIDHash> seen(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            char& found = seen[vertices[i].id];
+            if (found) {
+                continue;
+            }
+            found = 1;
+
+            // only fetch properties that are not cached or out of date
+            PropertyView cached;
+            TransactionID tid;
+            if (property_cache && property_cache->find(graph_name, key,
+                        vertices[i].id, cached, tid)) {
+                vertex_properties[vertices[i].id] = cached;
+                transactions[vertices[i].id] = tid;
+            } else {
+                pending.push_back(PropertyItem(vertices[i].id, 0, i));
+            }
+        }
+    }
+
+    run_property_transactions(*this, "/" + graph_name +
+            "/propertytransaction/vertices/" + key + "/", GET, false, pending,
+            GetPropertiesPayload(false), MergeGetProperties(false, transactions,
+                vertex_properties, edge_properties, property_cache.get(),
+                graph_name, key), num_threads);
+
+    properties.reserve(properties.size() + vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        PropertyView* view = vertex_properties.find(vertices[i].id);
+        properties.push_back(view ? *view : PropertyView());
+    }
 }
 
-void DVIDNodeService::post_roi(std::string roi_name,
-        const std::vector<BlockXYZ>& blockcoords)
+void DVIDNodeService::get_properties(string graph_name,
+        std::vector<Vertex> vertices, string key,
+        std::vector<BinaryDataPtr>& properties,
+        VertexTransactions& transactions, int num_threads)
 {
-    // Do not assume the blocks are sorted, first
-    // sort and then encode as runlengths in X.
-    // This will also eliminate duplicate blocks
-    set<BlockXYZ> sorted_blocks;
-    for (unsigned int i = 0; i < blockcoords.size(); ++i) {
-        sorted_blocks.insert(blockcoords[i]);    
+    vector<PropertyView> views;
+    get_properties(graph_name, vertices, key, views, transactions, num_threads);
+    for (size_t i = 0; i < views.size(); ++i) {
+        properties.push_back(views[i].copy());
     }
+}
 
-    // encode JSON as z,y,x0,x1 (inclusive)
-    int z = INT_MAX;
-    int y = INT_MAX;
-    int xmin = 0; int xmax = 0;
-    Json::Value blocks_data(Json::arrayValue);
-    unsigned int blockrle_count = 0;
-    for (set<BlockXYZ>::iterator iter = sorted_blocks.begin();
-            iter != sorted_blocks.end(); ++iter) {
-        if (iter->z != z || iter->y != y) {
-            if (z != INT_MAX) {
-                // add run length
-                Json::Value block_data(Json::arrayValue);
-                block_data[0] = z;
-                block_data[1] = y;
-                block_data[2] = xmin;
-                block_data[3] = xmax;
-                blocks_data[blockrle_count] = block_data;
-                ++blockrle_count;
+void DVIDNodeService::get_properties(string graph_name,
+        const std::vector<Edge>& edges, string key,
+        std::vector<PropertyView>& properties,
+        VertexTransactions& transactions, int num_threads)
+{
+    // request each edge once
+    FlatHashMap<VertexID, PropertyView, VertexIDHash> vertex_properties;
+    FlatHashMap<EdgeKey, PropertyView, EdgeKeyHash> edge_properties(edges.size());
+    vector<PropertyItem> pending;
+    pending.reserve(edges.size());
+    {
+        FlatHashMap<EdgeKey, char, EdgeKeyHash> seen(edges.size());
+        for (size_t i = 0; i < edges.size(); ++i) {
+            EdgeKey edge(edges[i]);
+            char& found = seen[edge];
+            if (found) {
+                continue;
+            }
+            found = 1;
+
+            PropertyView cached;
+            TransactionID tid1, tid2;
+            if (property_cache && property_cache->find(graph_name, key,
+                        edge, cached, tid1, tid2)) {
+                edge_properties[edge] = cached;
+                transactions[edge.id1] = tid1;
+                transactions[edge.id2] = tid2;
+            } else {
+                pending.push_back(PropertyItem(edges[i].id1, edges[i].id2, i));
             }
-        
-            z = iter->z;
-            y = iter->y;
-            xmin = iter->x;
-            xmax = xmin;
-        } else {
-            xmax = iter->x;
         }
     }
-    
-    if (z != INT_MAX) {
-        // add run length
-        Json::Value block_data(Json::arrayValue);
-        block_data[0] = z;
-        block_data[1] = y;
-        block_data[2] = xmin;
-        block_data[3] = xmax;
-        blocks_data[blockrle_count] = block_data;
+
+    run_property_transactions(*this, "/" + graph_name +
+            "/propertytransaction/edges/" + key + "/", GET, true, pending,
+            GetPropertiesPayload(true), MergeGetProperties(true, transactions,
+                vertex_properties, edge_properties, property_cache.get(),
+                graph_name, key), num_threads);
+
+    properties.reserve(properties.size() + edges.size());
+    for (size_t i = 0; i < edges.size(); ++i) {
+        PropertyView* view = edge_properties.find(EdgeKey(edges[i]));
+        properties.push_back(view ? *view : PropertyView());
     }
-    
-    // write json to string and post
-    stringstream datastr;
-    datastr << blocks_data;
-    BinaryDataPtr binary_data = BinaryData::create_binary_data(
-            datastr.str().c_str(), datastr.str().length());
-    BinaryDataPtr binary = custom_request("/" + roi_name + "/roi",
-            binary_data, POST);
 }
 
-void DVIDNodeService::get_roi(std::string roi_name,
-        std::vector<BlockXYZ>& blockcoords)
+void DVIDNodeService::get_properties(string graph_name,
+        std::vector<Edge> edges, string key,
+        std::vector<BinaryDataPtr>& properties,
+        VertexTransactions& transactions, int num_threads)
 {
-    // clear blockcoords
-    blockcoords.clear();
-
-    BinaryDataPtr binary = custom_request("/" + roi_name + "/roi",
-            BinaryDataPtr(), GET);
+    vector<PropertyView> views;
+    get_properties(graph_name, edges, key, views, transactions, num_threads);
+    for (size_t i = 0; i < views.size(); ++i) {
+        properties.push_back(views[i].copy());
+    }
+}
 
-    // read json from binary string  
-    Json::Reader json_reader;
-    Json::Value returned_data;
-    if (!json_reader.parse(binary->get_data(), returned_data)) {
-        throw ErrMsg("Could not decode JSON");
+void DVIDNodeService::set_properties(string graph_name, std::vector<Vertex>& vertices,
+        string key, std::vector<BinaryDataPtr>& properties,
+        VertexTransactions& transactions, std::vector<Vertex>& leftover_vertices,
+        int num_threads)
+{
+    vector<PropertyItem> pending;
+    pending.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        pending.push_back(PropertyItem(vertices[i].id, 0, i));
     }
 
-    // order the blocks (might be redundant depending on DVID output order)
-    set<BlockXYZ> sorted_blocks;
+    // transactions is only read by the payload writer and updated by
+    // the merge, both of which run on this thread
+    vector<size_t> leftover;
+    run_property_transactions(*this, "/" + graph_name +
+            "/propertytransaction/vertices/" + key, POST, false, pending,
+            SetPropertiesPayload(false, properties, transactions),
+            MergeSetProperties(false, transactions, leftover, properties,
+                property_cache.get(), graph_name, key), num_threads);
 
-    // insert blocks from JSON (decode block run lengths)
-    for (unsigned int i = 0; i < returned_data.size(); ++i) {
-        int z = returned_data[i][0].asInt();
-        int y = returned_data[i][1].asInt();
-        int xmin = returned_data[i][2].asInt();
-        int xmax = returned_data[i][3].asInt();
+    std::sort(leftover.begin(), leftover.end());
+    for (size_t i = 0; i < leftover.size(); ++i) {
+        leftover_vertices.push_back(Vertex(vertices[leftover[i]].id, 0));
+    }
+}
 
-        for (int xiter = xmin; xiter <= xmax; ++xiter) {
-            sorted_blocks.insert(BlockXYZ(xiter, y, z));
-        }
+void DVIDNodeService::set_properties(string graph_name, std::vector<Edge>& edges,
+        string key, std::vector<BinaryDataPtr>& properties,
+        VertexTransactions& transactions, std::vector<Edge>& leftover_edges,
+        int num_threads)
+{
+    vector<PropertyItem> pending;
+    pending.reserve(edges.size());
+    for (size_t i = 0; i < edges.size(); ++i) {
+        pending.push_back(PropertyItem(edges[i].id1, edges[i].id2, i));
     }
 
-    // returned sorted blocks back to caller
-    for (set<BlockXYZ>::iterator iter = sorted_blocks.begin();
-            iter != sorted_blocks.end(); ++iter) {
-        blockcoords.push_back(*iter);  
+    vector<size_t> leftover;
+    run_property_transactions(*this, "/" + graph_name +
+            "/propertytransaction/edges/" + key, POST, true, pending,
+            SetPropertiesPayload(true, properties, transactions),
+            MergeSetProperties(true, transactions, leftover, properties,
+                property_cache.get(), graph_name, key), num_threads);
+
+    std::sort(leftover.begin(), leftover.end());
+    for (size_t i = 0; i < leftover.size(); ++i) {
+        leftover_edges.push_back(edges[leftover[i]]);
     }
 }
 
+void DVIDNodeService::post_roi(std::string roi_name,
+        const std::vector<BlockXYZ>& blockcoords)
+{
+    // Do not assume the blocks are sorted; encoding as runlengths
+    // in X sorts them if needed and eliminates duplicate blocks
+    vector<BlockSpan> spans;
+    blocks_to_spans(blockcoords, spans);
+    post_roi(roi_name, spans);
+}
+
+void DVIDNodeService::post_roi(std::string roi_name,
+        const std::vector<BlockSpan>& spans)
+{
+    // encode JSON as z,y,x0,x1 (inclusive)
+    vector<BlockSpan> sorted_spans(spans);
+    normalize_spans(sorted_spans);
+    BinaryDataPtr binary_data = BinaryData::create_binary_data();
+    write_roi_json(sorted_spans.empty() ? 0 : &sorted_spans[0],
+            sorted_spans.size(), binary_data->get_data());
+    custom_request("/" + roi_name + "/roi", binary_data, POST);
+}
+
+void DVIDNodeService::get_roi(std::string roi_name,
+        std::vector<BlockXYZ>& blockcoords)
+{
+    // decode block run lengths while the response is downloaded and
+    // order them (might be redundant depending on DVID output order)
+    vector<BlockSpan> spans;
+    get_roi(roi_name, spans);
+    spans_to_blocks(spans, blockcoords);
+}
+
+void DVIDNodeService::get_roi(std::string roi_name,
+        std::vector<BlockSpan>& spans)
+{
+    spans.clear();
+
+    RoiJsonHandler handler(spans);
+    custom_request("/" + roi_name + "/roi", BinaryDataPtr(), GET, handler);
+    normalize_spans(spans);
+}
+
 double DVIDNodeService::get_roi_partition(std::string roi_name,
         std::vector<SubstackXYZ>& substacks, unsigned int partition_size)
 {
@@ -846,79 +1882,130 @@ double DVIDNodeService::get_roi_partition(std::string roi_name,
     stringstream querystring;
     querystring << "/" <<  roi_name << "/partition?batchsize=" << partition_size;
 
-    BinaryDataPtr binary = custom_request(querystring.str(),
-            BinaryDataPtr(), GET);
-
-    // read json from binary string  
-    Json::Reader json_reader;
-    Json::Value returned_data;
-    if (!json_reader.parse(binary->get_data(), returned_data)) {
-        throw ErrMsg("Could not decode JSON");
-    }
+    PartitionJsonHandler handler(substacks, DEFBLOCKSIZE*partition_size);
+    custom_request(querystring.str(), BinaryDataPtr(), GET, handler);
 
     // order the substacks (might be redundant depending on DVID output order)
-    set<SubstackXYZ> sorted_substacks;
-
-    // insert substacks from JSON
-    for (unsigned int i = 0; i < returned_data["Subvolumes"].size(); ++i) {
-        int x = returned_data["Subvolumes"][i]["MinPoint"][0].asInt();
-        int y = returned_data["Subvolumes"][i]["MinPoint"][1].asInt();
-        int z = returned_data["Subvolumes"][i]["MinPoint"][2].asInt();
-        
-        sorted_substacks.insert(SubstackXYZ(x, y, z,
-                    DEFBLOCKSIZE*partition_size));
-    }
-
-    // returned sorted substacks back to caller
-    for (set<SubstackXYZ>::iterator iter = sorted_substacks.begin();
-            iter != sorted_substacks.end(); ++iter) {
-        substacks.push_back(*iter);  
-    }
+    std::sort(substacks.begin(), substacks.end());
+    substacks.erase(std::unique(substacks.begin(), substacks.end()),
+            substacks.end());
 
     // determine the packing factor for the given partition
-    unsigned int total_blocks = returned_data["NumTotalBlocks"].asUInt();
-    unsigned int roi_blocks = returned_data["NumActiveBlocks"].asUInt();
+    return double(handler.active_blocks)/handler.total_blocks;
+}
 
-    return double(roi_blocks)/total_blocks;
+double DVIDNodeService::get_roi_partition(std::string roi_name,
+        std::vector<ROISubvolume>& subvolumes, uint64 max_active_blocks,
+        PartitionMethod method)
+{
+    vector<BlockSpan> spans;
+    get_roi(roi_name, spans);
+    return partition_roi(spans, max_active_blocks, method, subvolumes);
 }
 
-void DVIDNodeService::roi_ptquery(std::string roi_name,
-        const std::vector<PointXYZ>& points,
-        std::vector<bool>& inroi)
+/*!
+ * Queries one chunk of points.  If the binary encoding is rejected,
+ * the chunk is resent as JSON and later chunks use JSON.
+*/
+static void query_roi_points(DVIDNodeService& service, const string& roi_name,
+        const PointXYZ* points, size_t num_points,
+        boost::atomic<bool>& use_binary, unsigned char* results)
 {
-    inroi.clear();
+    if (use_binary.load()) {
+        // int32 x,y,z (assume little endian machine)
+        BinaryDataPtr payload = BinaryData::create_binary_data();
+        string& data = payload->get_data();
+        data.reserve(num_points * 12);
+        for (size_t i = 0; i < num_points; ++i) {
+            data.append((const char*) &points[i].x, 4);
+            data.append((const char*) &points[i].y, 4);
+            data.append((const char*) &points[i].z, 4);
+        }
+        try {
+            BinaryDataPtr binary = service.custom_request("/" + roi_name +
+                    "/ptquery?format=binary", payload, POST);
+            if (size_t(binary->length()) == num_points) {
+                const uint8* raw = binary->get_raw();
+                for (size_t i = 0; i < num_points; ++i) {
+                    results[i] = (raw[i] != 0);
+                }
+                return;
+            }
+        } catch (DVIDException&) {
+            // binary point queries are not supported by the server
+        }
+        use_binary.store(false);
+    }
 
-    // load into JSON array
-    Json::Value points_data(Json::arrayValue);
-    for (unsigned int i = 0; i < points.size(); ++i) {
-        Json::Value point_data(Json::arrayValue);
-        point_data[0] = points[i].x;
-        point_data[1] = points[i].y;
-        point_data[2] = points[i].z;
-        points_data[i] = point_data;
+    BinaryDataPtr payload = BinaryData::create_binary_data();
+    write_points_json(points, num_points, payload->get_data());
+    BoolArrayJsonHandler handler(results, num_points);
+    service.custom_request("/" + roi_name + "/ptquery", payload, POST,
+            handler);
+    if (handler.num_values != num_points) {
+        throw ErrMsg("Point query returned the wrong number of results");
     }
+}
 
-    // make request with point list
-    stringstream datastr;
-    datastr << points_data;
-    BinaryDataPtr binary_data = BinaryData::create_binary_data(
-            datastr.str().c_str(), datastr.str().length());
-    BinaryDataPtr binary = custom_request("/" + roi_name + "/ptquery",
-            binary_data, POST);
+//! Point query of one chunk run on a task pool thread
+struct RoiPointQueryTask {
+    RoiPointQueryTask(string roi_name_, const PointXYZ* points_,
+            size_t num_points_, boost::atomic<bool>& use_binary_,
+            unsigned char* results_) : roi_name(roi_name_), points(points_),
+        num_points(num_points_), use_binary(use_binary_), results(results_) {}
 
-    
-    // read json from binary string  
-    Json::Reader json_reader;
-    Json::Value returned_data;
-    if (!json_reader.parse(binary->get_data(), returned_data)) {
-        throw ErrMsg("Could not decode JSON");
+    void operator()(DVIDNodeService& service)
+    {
+        query_roi_points(service, roi_name, points, num_points, use_binary,
+                results);
     }
 
-    // insert status of each point (true if in ROI) (true if in ROI) (true if in ROI) 
-    for (unsigned int i = 0; i < returned_data.size(); ++i) {
-        bool ptinroi = returned_data[i].asBool();
-        inroi.push_back(ptinroi);
+    string roi_name;
+    const PointXYZ* points;
+    size_t num_points;
+    boost::atomic<bool>& use_binary;
+    unsigned char* results;
+};
+
+void DVIDNodeService::roi_ptquery(std::string roi_name,
+        const std::vector<PointXYZ>& points,
+        std::vector<bool>& inroi, int num_threads,
+        size_t max_points_per_request, PointEncoding encoding)
+{
+    inroi.clear();
+    if (max_points_per_request < 1) {
+        throw ErrMsg("Point query requires at least one point per request");
+    }
+    if (points.empty()) {
+        return;
+    }
+
+    // each chunk writes its own part of the results
+    vector<unsigned char> results(points.size());
+    boost::atomic<bool> use_binary(encoding == BinaryPointEncoding);
+    size_t num_chunks = (points.size() + max_points_per_request - 1) /
+        max_points_per_request;
+    if (num_threads <= 1 || num_chunks == 1) {
+        for (size_t start = 0; start < points.size();
+                start += max_points_per_request) {
+            size_t count = std::min(max_points_per_request,
+                    points.size() - start);
+            query_roi_points(*this, roi_name, &points[start], count,
+                    use_binary, &results[start]);
+        }
+    } else {
+        DVIDTaskPool pool(*this, int(std::min(size_t(num_threads), num_chunks)));
+        for (size_t start = 0; start < points.size();
+                start += max_points_per_request) {
+            size_t count = std::min(max_points_per_request,
+                    points.size() - start);
+            pool.submit(RoiPointQueryTask(roi_name, &points[start], count,
+                        use_binary, &results[start]));
+        }
+        pool.wait();
     }
+
+    inroi.assign(results.begin(), results.end());
 }
     
 bool DVIDNodeService::body_exists(string labelvol_name, uint64 bodyid) 
@@ -0,0 +1,45 @@
+#include "DVIDParallel.h"
+
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+
+namespace libdvid {
+
+struct RangeWorker {
+    RangeWorker(RangeBody body_, size_t begin_, size_t end_, int thread_) :
+        body(body_), begin(begin_), end(end_), thread(thread_) {}
+
+    void operator()()
+    {
+        body(begin, end, thread);
+    }
+
+    RangeBody body;
+    size_t begin, end;
+    int thread;
+};
+
+void parallel_ranges(size_t num_items, int num_threads, RangeBody body)
+{
+    if (num_threads <= 1) {
+        body(0, num_items, 0);
+        return;
+    }
+    boost::thread_group threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.create_thread(RangeWorker(body, num_items * i / num_threads,
+                    num_items * (i + 1) / num_threads, i));
+    }
+    threads.join_all();
+}
+
+int threads_for(size_t num_items, int num_threads, size_t min_items_per_thread)
+{
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    size_t max_threads = num_items / min_items_per_thread + 1;
+    return int(std::min(size_t(num_threads), max_threads));
+}
+
+}
@@ -0,0 +1,192 @@
+#include "DVIDPropertyCache.h"
+
+using std::string;
+
+namespace libdvid {
+
+PropertyCache::PropertyCache(size_t max_bytes_) : max_bytes(max_bytes_),
+    cached_bytes(0), num_hits(0), num_misses(0) {}
+
+bool PropertyCache::is_current(GraphEntries& entries, VertexID id,
+        TransactionID tid)
+{
+    const LatestTransaction* latest = entries.latest.find(id);
+    return latest && latest->known && (latest->tid == tid);
+}
+
+void PropertyCache::add(const EntryLocation& location, Entry& entry,
+        const PropertyView& property)
+{
+    // copy so that the cache does not keep the whole response alive
+    entry.property = PropertyView(property.copy(), 0, property.size());
+    lru.push_front(location);
+    entry.lru_position = lru.begin();
+    cached_bytes += property.size();
+}
+
+void PropertyCache::hold_vertex(GraphEntries& entries, VertexID id,
+        TransactionID tid)
+{
+    LatestTransaction& latest = entries.latest[id];
+    latest.tid = tid;
+    latest.known = true;
+    ++latest.num_entries;
+}
+
+void PropertyCache::release_vertex(GraphEntries& entries, VertexID id)
+{
+    LatestTransaction* latest = entries.latest.find(id);
+    if (latest && --latest->num_entries == 0) {
+        entries.latest.erase(id);
+    }
+}
+
+void PropertyCache::remove(std::list<EntryLocation>::iterator location)
+{
+    GraphEntries& graph = *location->graph;
+    if (location->edge) {
+        EdgeKey edge(location->id1, location->id2);
+        cached_bytes -= location->entries->edges.find(edge)->property.size();
+        location->entries->edges.erase(edge);
+        release_vertex(graph, edge.id1);
+        release_vertex(graph, edge.id2);
+    } else {
+        cached_bytes -=
+            location->entries->vertices.find(location->id1)->property.size();
+        location->entries->vertices.erase(location->id1);
+        release_vertex(graph, location->id1);
+    }
+    lru.erase(location);
+}
+
+void PropertyCache::evict()
+{
+    while (cached_bytes > max_bytes) {
+        remove(--lru.end());
+    }
+}
+
+bool PropertyCache::find(const string& graph_name, const string& key,
+        VertexID id, PropertyView& property, TransactionID& tid)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    GraphEntries& entries = graphs[graph_name];
+    const Entry* entry = entries.keys[key].vertices.find(id);
+    if (!entry) {
+        ++num_misses;
+        return false;
+    }
+    if (!is_current(entries, id, entry->tid1)) {
+        remove(entry->lru_position);
+        ++num_misses;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, entry->lru_position);
+    property = entry->property;
+    tid = entry->tid1;
+    ++num_hits;
+    return true;
+}
+
+bool PropertyCache::find(const string& graph_name, const string& key,
+        const EdgeKey& edge, PropertyView& property, TransactionID& tid1,
+        TransactionID& tid2)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    GraphEntries& entries = graphs[graph_name];
+    const Entry* entry = entries.keys[key].edges.find(edge);
+    if (!entry) {
+        ++num_misses;
+        return false;
+    }
+    if (!is_current(entries, edge.id1, entry->tid1) ||
+            !is_current(entries, edge.id2, entry->tid2)) {
+        remove(entry->lru_position);
+        ++num_misses;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, entry->lru_position);
+    property = entry->property;
+    tid1 = entry->tid1;
+    tid2 = entry->tid2;
+    ++num_hits;
+    return true;
+}
+
+void PropertyCache::store(const string& graph_name, const string& key,
+        VertexID id, const PropertyView& property, TransactionID tid)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    GraphEntries& entries = graphs[graph_name];
+    KeyEntries& key_entries = entries.keys[key];
+    const Entry* old = key_entries.vertices.find(id);
+    if (old) {
+        remove(old->lru_position);
+    }
+    // a property over the budget would evict everything else
+    if (!property.buffer || property.size() > max_bytes) {
+        return;
+    }
+
+    Entry& entry = key_entries.vertices[id];
+    entry.tid1 = tid;
+    add(EntryLocation(&entries, &key_entries, id, 0, false), entry, property);
+    hold_vertex(entries, id, tid);
+    evict();
+}
+
+void PropertyCache::store(const string& graph_name, const string& key,
+        const EdgeKey& edge, const PropertyView& property,
+        TransactionID tid1, TransactionID tid2)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    GraphEntries& entries = graphs[graph_name];
+    KeyEntries& key_entries = entries.keys[key];
+    const Entry* old = key_entries.edges.find(edge);
+    if (old) {
+        remove(old->lru_position);
+    }
+    if (!property.buffer || property.size() > max_bytes) {
+        return;
+    }
+
+    Entry& entry = key_entries.edges[edge];
+    entry.tid1 = tid1;
+    entry.tid2 = tid2;
+    add(EntryLocation(&entries, &key_entries, edge.id1, edge.id2, true),
+            entry, property);
+    hold_vertex(entries, edge.id1, tid1);
+    hold_vertex(entries, edge.id2, tid2);
+    evict();
+}
+
+void PropertyCache::update_transaction(const string& graph_name, VertexID id,
+        TransactionID tid)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    LatestTransaction* latest = graphs[graph_name].latest.find(id);
+    if (latest) {
+        latest->tid = tid;
+        latest->known = true;
+    }
+}
+
+void PropertyCache::invalidate(const string& graph_name, VertexID id)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    LatestTransaction* latest = graphs[graph_name].latest.find(id);
+    if (latest) {
+        latest->known = false;
+    }
+}
+
+void PropertyCache::clear()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    graphs.clear();
+    lru.clear();
+    cached_bytes = 0;
+    num_hits = num_misses = 0;
+}
+
+}
@@ -0,0 +1,669 @@
+#include "DVIDRoi.h"
+#include "DVIDParallel.h"
+#include "DVIDJsonStream.h"
+#include "DVIDException.h"
+
+#include <algorithm>
+
+using std::vector; using std::string;
+
+namespace libdvid {
+
+void normalize_spans(vector<BlockSpan>& spans)
+{
+    // DVID usually returns ordered spans, so only sort if needed
+    bool ordered = true;
+    for (size_t i = 1; i < spans.size() && ordered; ++i) {
+        ordered = !(spans[i] < spans[i-1]);
+    }
+    if (!ordered) {
+        std::sort(spans.begin(), spans.end());
+    }
+
+    // join spans in place
+    size_t num_spans = 0;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        const BlockSpan& span = spans[i];
+        if (span.x1 < span.x0) {
+            continue;
+        }
+        if (num_spans > 0) {
+            BlockSpan& last = spans[num_spans-1];
+            if (last.z == span.z && last.y == span.y &&
+                    (span.x0 <= last.x1 || span.x0 - 1 == last.x1)) {
+                last.x1 = std::max(last.x1, span.x1);
+                continue;
+            }
+        }
+        spans[num_spans++] = span;
+    }
+    spans.erase(spans.begin() + num_spans, spans.end());
+}
+
+//! Appends the runs of ordered blocks (duplicates are skipped)
+static void append_block_runs(const vector<BlockXYZ>& blocks,
+        vector<BlockSpan>& spans)
+{
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const BlockXYZ& block = blocks[i];
+        if (!spans.empty()) {
+            BlockSpan& last = spans.back();
+            if (last.z == block.z && last.y == block.y &&
+                    block.x - 1 <= last.x1) {
+                last.x1 = std::max(last.x1, block.x);
+                continue;
+            }
+        }
+        spans.push_back(BlockSpan(block.z, block.y, block.x, block.x));
+    }
+}
+
+void blocks_to_spans(const vector<BlockXYZ>& blocks, vector<BlockSpan>& spans)
+{
+    spans.clear();
+    bool ordered = true;
+    for (size_t i = 1; i < blocks.size() && ordered; ++i) {
+        ordered = !(blocks[i] < blocks[i-1]);
+    }
+    if (ordered) {
+        append_block_runs(blocks, spans);
+    } else {
+        vector<BlockXYZ> sorted_blocks(blocks);
+        std::sort(sorted_blocks.begin(), sorted_blocks.end());
+        append_block_runs(sorted_blocks, spans);
+    }
+}
+
+void spans_to_blocks(const vector<BlockSpan>& spans, vector<BlockXYZ>& blocks)
+{
+    size_t num_blocks = 0;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        num_blocks += spans[i].size();
+    }
+    blocks.clear();
+    blocks.reserve(num_blocks);
+    for (size_t i = 0; i < spans.size(); ++i) {
+        for (int x = spans[i].x0; x <= spans[i].x1; ++x) {
+            blocks.push_back(BlockXYZ(x, spans[i].y, spans[i].z));
+        }
+    }
+}
+
+void write_roi_json(const BlockSpan* spans, size_t num_spans, string& buffer)
+{
+    // rough upper estimate of the serialized size to avoid regrowth
+    buffer.reserve(buffer.size() + 2 + num_spans*48);
+
+    buffer += '[';
+    for (size_t i = 0; i < num_spans; ++i) {
+        if (i) {
+            buffer += ',';
+        }
+        buffer += '[';
+        json_append_int(buffer, spans[i].z);
+        buffer += ',';
+        json_append_int(buffer, spans[i].y);
+        buffer += ',';
+        json_append_int(buffer, spans[i].x0);
+        buffer += ',';
+        json_append_int(buffer, spans[i].x1);
+        buffer += ']';
+    }
+    buffer += ']';
+}
+
+void write_points_json(const PointXYZ* points, size_t num_points,
+        string& buffer)
+{
+    buffer.reserve(buffer.size() + 2 + num_points*36);
+
+    buffer += '[';
+    for (size_t i = 0; i < num_points; ++i) {
+        if (i) {
+            buffer += ',';
+        }
+        buffer += '[';
+        json_append_int(buffer, points[i].x);
+        buffer += ',';
+        json_append_int(buffer, points[i].y);
+        buffer += ',';
+        json_append_int(buffer, points[i].z);
+        buffer += ']';
+    }
+    buffer += ']';
+}
+
+//! Compares the (z, y) rows of two spans
+static int compare_rows(const BlockSpan& span1, const BlockSpan& span2)
+{
+    if (span1.z != span2.z) {
+        return (span1.z < span2.z) ? -1 : 1;
+    }
+    if (span1.y != span2.y) {
+        return (span1.y < span2.y) ? -1 : 1;
+    }
+    return 0;
+}
+
+//! True if the spans are ordered, non-empty and do not touch
+static bool spans_normalized(const vector<BlockSpan>& spans)
+{
+    for (size_t i = 0; i < spans.size(); ++i) {
+        if (spans[i].x1 < spans[i].x0) {
+            return false;
+        }
+        if (i > 0) {
+            int row_order = compare_rows(spans[i-1], spans[i]);
+            if (row_order > 0 || (row_order == 0 &&
+                        spans[i-1].x1 + 1 >= spans[i].x0)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//! Appends a span, joining it with the last span if they touch
+static void append_span(vector<BlockSpan>& spans, const BlockSpan& span)
+{
+    if (!spans.empty()) {
+        BlockSpan& last = spans.back();
+        if (compare_rows(last, span) == 0 && span.x0 - 1 <= last.x1) {
+            last.x1 = std::max(last.x1, span.x1);
+            return;
+        }
+    }
+    spans.push_back(span);
+}
+
+typedef vector<BlockSpan>::const_iterator SpanIter;
+
+static void merge_union(SpanIter iter1, SpanIter end1, SpanIter iter2,
+        SpanIter end2, vector<BlockSpan>& result)
+{
+    while (iter1 != end1 || iter2 != end2) {
+        if (iter2 == end2 || (iter1 != end1 && !(*iter2 < *iter1))) {
+            append_span(result, *iter1++);
+        } else {
+            append_span(result, *iter2++);
+        }
+    }
+}
+
+// Pieces from different spans of either (normalized) input are separated
+// by a gap, so the intersection is already in canonical form.
+static void merge_intersection(SpanIter iter1, SpanIter end1, SpanIter iter2,
+        SpanIter end2, vector<BlockSpan>& result)
+{
+    while (iter1 != end1 && iter2 != end2) {
+        int row_order = compare_rows(*iter1, *iter2);
+        if (row_order < 0) {
+            ++iter1;
+        } else if (row_order > 0) {
+            ++iter2;
+        } else {
+            int x0 = std::max(iter1->x0, iter2->x0);
+            int x1 = std::min(iter1->x1, iter2->x1);
+            if (x0 <= x1) {
+                result.push_back(BlockSpan(iter1->z, iter1->y, x0, x1));
+            }
+            if (iter1->x1 < iter2->x1) {
+                ++iter1;
+            } else {
+                ++iter2;
+            }
+        }
+    }
+}
+
+static void merge_difference(SpanIter iter1, SpanIter end1, SpanIter iter2,
+        SpanIter end2, vector<BlockSpan>& result)
+{
+    for (; iter1 != end1; ++iter1) {
+        // skip removed spans that end before this span
+        while (iter2 != end2 && (compare_rows(*iter2, *iter1) < 0 ||
+                    (compare_rows(*iter2, *iter1) == 0 &&
+                     iter2->x1 < iter1->x0))) {
+            ++iter2;
+        }
+
+        int x0 = iter1->x0;
+        SpanIter remove = iter2;
+        while (remove != end2 && compare_rows(*remove, *iter1) == 0 &&
+                remove->x0 <= iter1->x1) {
+            if (remove->x0 > x0) {
+                result.push_back(BlockSpan(iter1->z, iter1->y, x0,
+                            remove->x0 - 1));
+            }
+            x0 = std::max(x0, remove->x1 + 1);
+            ++remove;
+        }
+        if (x0 <= iter1->x1) {
+            result.push_back(BlockSpan(iter1->z, iter1->y, x0, iter1->x1));
+        }
+    }
+}
+
+typedef void (*SpanMerge)(SpanIter, SpanIter, SpanIter, SpanIter,
+        vector<BlockSpan>&);
+
+//! Orders a span before z if it is in an earlier plane
+static bool span_plane_before(const BlockSpan& span, int z)
+{
+    return span.z < z;
+}
+
+/*!
+ * Merges the spans of one range of z planes.  Each range is delimited by
+ * its first plane, so both inputs are split at the same planes.
+*/
+struct MergePlanes {
+    MergePlanes(SpanMerge merge_, const vector<BlockSpan>& spans1_,
+            const vector<BlockSpan>& spans2_, const vector<int>& planes_,
+            vector<vector<BlockSpan> >& results_) : merge(merge_),
+        spans1(spans1_), spans2(spans2_), planes(planes_), results(results_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        for (size_t chunk = begin; chunk < end; ++chunk) {
+            SpanIter begin1 = spans1.begin(), end1 = spans1.end();
+            SpanIter begin2 = spans2.begin(), end2 = spans2.end();
+            if (chunk > 0) {
+                begin1 = std::lower_bound(begin1, end1, planes[chunk-1],
+                        span_plane_before);
+                begin2 = std::lower_bound(begin2, end2, planes[chunk-1],
+                        span_plane_before);
+            }
+            if (chunk < planes.size()) {
+                end1 = std::lower_bound(begin1, end1, planes[chunk],
+                        span_plane_before);
+                end2 = std::lower_bound(begin2, end2, planes[chunk],
+                        span_plane_before);
+            }
+            merge(begin1, end1, begin2, end2, results[chunk]);
+        }
+    }
+
+    SpanMerge merge;
+    const vector<BlockSpan>& spans1;
+    const vector<BlockSpan>& spans2;
+    const vector<int>& planes;
+    vector<vector<BlockSpan> >& results;
+};
+
+static void merge_spans(SpanMerge merge, const vector<BlockSpan>& spans1_,
+        const vector<BlockSpan>& spans2_, vector<BlockSpan>& result,
+        int num_threads)
+{
+    // the merges require canonical inputs (only copied if needed)
+    vector<BlockSpan> normalized1, normalized2;
+    const vector<BlockSpan>* spans1 = &spans1_;
+    const vector<BlockSpan>* spans2 = &spans2_;
+    if (!spans_normalized(spans1_)) {
+        normalized1 = spans1_;
+        normalize_spans(normalized1);
+        spans1 = &normalized1;
+    }
+    if (!spans_normalized(spans2_)) {
+        normalized2 = spans2_;
+        normalize_spans(normalized2);
+        spans2 = &normalized2;
+    }
+
+    // split at z planes taken evenly from the larger input (spans of
+    // one plane are never split across threads)
+    const vector<BlockSpan>& larger =
+        (spans1->size() >= spans2->size()) ? *spans1 : *spans2;
+    num_threads = threads_for(spans1->size() + spans2->size(), num_threads);
+    vector<int> planes;
+    for (int i = 1; i < num_threads; ++i) {
+        int plane = larger[larger.size() * i / num_threads].z;
+        if (planes.empty() || plane > planes.back()) {
+            planes.push_back(plane);
+        }
+    }
+
+    vector<vector<BlockSpan> > results(planes.size() + 1);
+    parallel_ranges(results.size(), int(results.size()),
+            MergePlanes(merge, *spans1, *spans2, planes, results));
+
+    size_t num_spans = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        num_spans += results[i].size();
+    }
+    result.clear();
+    result.reserve(num_spans);
+    for (size_t i = 0; i < results.size(); ++i) {
+        result.insert(result.end(), results[i].begin(), results[i].end());
+    }
+}
+
+void roi_union(const vector<BlockSpan>& spans1, const vector<BlockSpan>& spans2,
+        vector<BlockSpan>& result, int num_threads)
+{
+    merge_spans(merge_union, spans1, spans2, result, num_threads);
+}
+
+void roi_intersection(const vector<BlockSpan>& spans1,
+        const vector<BlockSpan>& spans2, vector<BlockSpan>& result,
+        int num_threads)
+{
+    merge_spans(merge_intersection, spans1, spans2, result, num_threads);
+}
+
+void roi_difference(const vector<BlockSpan>& spans1,
+        const vector<BlockSpan>& spans2, vector<BlockSpan>& result,
+        int num_threads)
+{
+    merge_spans(merge_difference, spans1, spans2, result, num_threads);
+}
+
+//! Sets the bounding box and block count of a subvolume from its spans
+static void bound_subvolume(ROISubvolume& subvolume)
+{
+    const vector<BlockSpan>& spans = subvolume.spans;
+    subvolume.active_blocks = 0;
+    if (spans.empty()) {
+        return;
+    }
+    BlockXYZ& min_block = subvolume.min_block;
+    BlockXYZ& max_block = subvolume.max_block;
+    min_block = BlockXYZ(spans[0].x0, spans[0].y, spans.front().z);
+    max_block = BlockXYZ(spans[0].x1, spans[0].y, spans.back().z);
+    for (size_t i = 0; i < spans.size(); ++i) {
+        min_block.x = std::min(min_block.x, spans[i].x0);
+        max_block.x = std::max(max_block.x, spans[i].x1);
+        min_block.y = std::min(min_block.y, spans[i].y);
+        max_block.y = std::max(max_block.y, spans[i].y);
+        subvolume.active_blocks += spans[i].size();
+    }
+}
+
+/*!
+ * Finds the coordinate that splits the blocks of a subvolume in half
+ * along an axis (0: x, 1: y, 2: z).  Blocks with a smaller coordinate
+ * go to the first half.  Both halves are non-empty since the bounding
+ * box is tight.
+*/
+static int median_split(const ROISubvolume& subvolume, int axis)
+{
+    int min_coord = (axis == 0) ? subvolume.min_block.x :
+        ((axis == 1) ? subvolume.min_block.y : subvolume.min_block.z);
+    int max_coord = (axis == 0) ? subvolume.max_block.x :
+        ((axis == 1) ? subvolume.max_block.y : subvolume.max_block.z);
+
+    // number of blocks at each coordinate (x runs use a difference array)
+    vector<boost::int64_t> counts(max_coord - min_coord + 2, 0);
+    const vector<BlockSpan>& spans = subvolume.spans;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        if (axis == 0) {
+            counts[spans[i].x0 - min_coord] += 1;
+            counts[spans[i].x1 - min_coord + 1] -= 1;
+        } else {
+            int coord = (axis == 1) ? spans[i].y : spans[i].z;
+            counts[coord - min_coord] += spans[i].size();
+        }
+    }
+    if (axis == 0) {
+        for (size_t i = 1; i < counts.size(); ++i) {
+            counts[i] += counts[i-1];
+        }
+    }
+
+    uint64 half = subvolume.active_blocks / 2;
+    uint64 below = 0;
+    for (int coord = min_coord; coord < max_coord; ++coord) {
+        below += counts[coord - min_coord];
+        if (below >= half) {
+            return coord + 1;
+        }
+    }
+    return max_coord;
+}
+
+static void kdtree_partition(ROISubvolume& subvolume, uint64 max_active_blocks,
+        vector<ROISubvolume>& subvolumes)
+{
+    if (subvolume.active_blocks <= max_active_blocks) {
+        subvolumes.push_back(ROISubvolume());
+        ROISubvolume& leaf = subvolumes.back();
+        leaf.min_block = subvolume.min_block;
+        leaf.max_block = subvolume.max_block;
+        leaf.active_blocks = subvolume.active_blocks;
+        leaf.spans.swap(subvolume.spans);
+        return;
+    }
+
+    // split the longest axis
+    int extents[] = {subvolume.max_block.x - subvolume.min_block.x,
+        subvolume.max_block.y - subvolume.min_block.y,
+        subvolume.max_block.z - subvolume.min_block.z};
+    int axis = int(std::max_element(extents, extents + 3) - extents);
+    int split = median_split(subvolume, axis);
+
+    ROISubvolume lower, upper;
+    const vector<BlockSpan>& spans = subvolume.spans;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        const BlockSpan& span = spans[i];
+        if (axis == 0) {
+            if (span.x0 < split) {
+                lower.spans.push_back(BlockSpan(span.z, span.y, span.x0,
+                            std::min(span.x1, split - 1)));
+            }
+            if (span.x1 >= split) {
+                upper.spans.push_back(BlockSpan(span.z, span.y,
+                            std::max(span.x0, split), span.x1));
+            }
+        } else if (((axis == 1) ? span.y : span.z) < split) {
+            lower.spans.push_back(span);
+        } else {
+            upper.spans.push_back(span);
+        }
+    }
+    vector<BlockSpan>().swap(subvolume.spans);
+
+    bound_subvolume(lower);
+    bound_subvolume(upper);
+    kdtree_partition(lower, max_active_blocks, subvolumes);
+    kdtree_partition(upper, max_active_blocks, subvolumes);
+}
+
+//! Interleaves the low 21 bits of each coordinate (x in the lowest bit)
+static uint64 morton_code(unsigned int x, unsigned int y, unsigned int z)
+{
+    uint64 code = 0;
+    for (int bit = 0; bit < 21; ++bit) {
+        code |= (uint64((x >> bit) & 1) << (3*bit)) |
+            (uint64((y >> bit) & 1) << (3*bit + 1)) |
+            (uint64((z >> bit) & 1) << (3*bit + 2));
+    }
+    return code;
+}
+
+//! Block index ordered by Morton code
+struct MortonBlock {
+    bool operator<(const MortonBlock& other) const
+    {
+        return code < other.code;
+    }
+    uint64 code;
+    size_t index;
+};
+
+static void morton_partition(const ROISubvolume& roi, uint64 max_active_blocks,
+        vector<ROISubvolume>& subvolumes)
+{
+    vector<BlockXYZ> blocks;
+    spans_to_blocks(roi.spans, blocks);
+    vector<MortonBlock> order(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        order[i].code = morton_code(blocks[i].x - roi.min_block.x,
+                blocks[i].y - roi.min_block.y, blocks[i].z - roi.min_block.z);
+        order[i].index = i;
+    }
+    std::sort(order.begin(), order.end());
+
+    vector<BlockXYZ> chunk;
+    for (size_t start = 0; start < order.size(); start += max_active_blocks) {
+        size_t end = std::min(order.size(), size_t(start + max_active_blocks));
+        chunk.clear();
+        for (size_t i = start; i < end; ++i) {
+            chunk.push_back(blocks[order[i].index]);
+        }
+        subvolumes.push_back(ROISubvolume());
+        blocks_to_spans(chunk, subvolumes.back().spans);
+        bound_subvolume(subvolumes.back());
+    }
+}
+
+double partition_roi(const vector<BlockSpan>& spans, uint64 max_active_blocks,
+        PartitionMethod method, vector<ROISubvolume>& subvolumes)
+{
+    if (max_active_blocks < 1) {
+        throw ErrMsg("ROI partitions must hold at least one block");
+    }
+    subvolumes.clear();
+
+    ROISubvolume roi;
+    roi.spans = spans;
+    normalize_spans(roi.spans);
+    bound_subvolume(roi);
+    if (roi.active_blocks == 0) {
+        return 0.0;
+    }
+
+    if (method == MortonPartition) {
+        morton_partition(roi, max_active_blocks, subvolumes);
+    } else {
+        kdtree_partition(roi, max_active_blocks, subvolumes);
+    }
+
+    // determine the packing factor for the partition
+    uint64 active_blocks = 0;
+    uint64 total_blocks = 0;
+    for (size_t i = 0; i < subvolumes.size(); ++i) {
+        const ROISubvolume& subvolume = subvolumes[i];
+        active_blocks += subvolume.active_blocks;
+        total_blocks += uint64(subvolume.max_block.x - subvolume.min_block.x + 1) *
+            uint64(subvolume.max_block.y - subvolume.min_block.y + 1) *
+            uint64(subvolume.max_block.z - subvolume.min_block.z + 1);
+    }
+    return double(active_blocks) / total_blocks;
+}
+
+//! Key ordering rows by z then y (sign bits flipped for unsigned order)
+static uint64 row_key(int z, int y)
+{
+    return (uint64((unsigned int)(z) ^ 0x80000000u) << 32) |
+        uint64((unsigned int)(y) ^ 0x80000000u);
+}
+
+ROIIndex::ROIIndex(const vector<BlockSpan>& spans_) : spans(spans_),
+    block_count(0)
+{
+    normalize_spans(spans);
+
+    for (size_t i = 0; i < spans.size(); ++i) {
+        uint64 key = row_key(spans[i].z, spans[i].y);
+        if (row_keys.empty() || row_keys.back() != key) {
+            row_keys.push_back(key);
+            row_offsets.push_back(i);
+        }
+        block_count += spans[i].size();
+    }
+    row_offsets.push_back(spans.size());
+}
+
+bool ROIIndex::find_row(int z, int y, size_t& row) const
+{
+    uint64 key = row_key(z, y);
+    vector<uint64>::const_iterator iter =
+        std::lower_bound(row_keys.begin(), row_keys.end(), key);
+    if (iter == row_keys.end() || *iter != key) {
+        return false;
+    }
+    row = iter - row_keys.begin();
+    return true;
+}
+
+//! Orders a span before x if it ends before x
+static bool span_ends_before(const BlockSpan& span, int x)
+{
+    return span.x1 < x;
+}
+
+bool ROIIndex::row_contains(size_t row, int x) const
+{
+    vector<BlockSpan>::const_iterator end = spans.begin() + row_offsets[row+1];
+    vector<BlockSpan>::const_iterator iter = std::lower_bound(
+            spans.begin() + row_offsets[row], end, x, span_ends_before);
+    return (iter != end) && (iter->x0 <= x);
+}
+
+bool ROIIndex::contains(const BlockXYZ& block) const
+{
+    size_t row;
+    return find_row(block.z, block.y, row) && row_contains(row, block.x);
+}
+
+bool ROIIndex::contains(const PointXYZ& point) const
+{
+    return contains(BlockXYZ(block_coordinate(point.x),
+                block_coordinate(point.y), block_coordinate(point.z)));
+}
+
+/*!
+ * Checks a range of blocks.  Consecutive queries in the same row
+ * (common for sorted or spatially clustered points) skip the row search.
+*/
+struct QueryBlocks {
+    QueryBlocks(const ROIIndex& roi_, const vector<BlockXYZ>& blocks_,
+            vector<unsigned char>& results_) : roi(roi_), blocks(blocks_),
+        results(results_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        bool have_row = false;
+        bool row_found = false;
+        int row_z = 0, row_y = 0;
+        size_t row = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const BlockXYZ& block = blocks[i];
+            if (!have_row || block.z != row_z || block.y != row_y) {
+                row_z = block.z;
+                row_y = block.y;
+                row_found = roi.find_row(row_z, row_y, row);
+                have_row = true;
+            }
+            results[i] = row_found && roi.row_contains(row, block.x);
+        }
+    }
+
+    const ROIIndex& roi;
+    const vector<BlockXYZ>& blocks;
+    vector<unsigned char>& results;
+};
+
+void ROIIndex::contains(const vector<BlockXYZ>& blocks, vector<bool>& inroi,
+        int num_threads) const
+{
+    // bytes can be written by several threads (unlike vector<bool>)
+    vector<unsigned char> results(blocks.size());
+    parallel_ranges(blocks.size(), threads_for(blocks.size(), num_threads),
+            QueryBlocks(*this, blocks, results));
+    inroi.assign(results.begin(), results.end());
+}
+
+void ROIIndex::contains(const vector<PointXYZ>& points, vector<bool>& inroi,
+        int num_threads) const
+{
+    vector<BlockXYZ> blocks;
+    blocks.reserve(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        blocks.push_back(BlockXYZ(block_coordinate(points[i].x),
+                    block_coordinate(points[i].y), block_coordinate(points[i].z)));
+    }
+    contains(blocks, inroi, num_threads);
+}
+
+}
@@ -0,0 +1,110 @@
+#include "DVIDTaskPool.h"
+#include "DVIDException.h"
+
+using std::string;
+
+namespace libdvid {
+
+struct DVIDTaskPool::Worker {
+    Worker(DVIDTaskPool& pool_, DVIDNodeService& service_) :
+        pool(pool_), service(service_) {}
+
+    void operator()()
+    {
+        DVIDTask task;
+        while (pool.next_task(task)) {
+            string error;
+            try {
+                task(service);
+            } catch (std::exception& e) {
+                error = e.what();
+                if (error.empty()) {
+                    error = "task failed";
+                }
+            }
+            // release task resources before signalling completion
+            task.clear();
+            pool.task_done(error);
+        }
+    }
+
+    DVIDTaskPool& pool;
+
+    //! each thread has its own connection
+    DVIDNodeService service;
+};
+
+DVIDTaskPool::DVIDTaskPool(DVIDNodeService& service, int num_threads,
+        size_t max_queued_) : thread_count(num_threads > 0 ? num_threads : 1),
+    max_queued(max_queued_), num_pending(0), stopping(false)
+{
+    if (max_queued == 0) {
+        max_queued = 2 * thread_count;
+    }
+    for (int i = 0; i < thread_count; ++i) {
+        threads.create_thread(Worker(*this, service));
+    }
+}
+
+DVIDTaskPool::~DVIDTaskPool()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    task_available.notify_all();
+    threads.join_all();
+}
+
+void DVIDTaskPool::submit(DVIDTask task)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    while (tasks.size() >= max_queued) {
+        space_available.wait(lock);
+    }
+    tasks.push_back(task);
+    ++num_pending;
+    task_available.notify_one();
+}
+
+void DVIDTaskPool::wait()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    while (num_pending > 0) {
+        tasks_finished.wait(lock);
+    }
+    if (!first_error.empty()) {
+        string error = first_error;
+        first_error.clear();
+        throw ErrMsg(error);
+    }
+}
+
+bool DVIDTaskPool::next_task(DVIDTask& task)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    // remaining tasks are still run when stopping
+    while (tasks.empty() && !stopping) {
+        task_available.wait(lock);
+    }
+    if (tasks.empty()) {
+        return false;
+    }
+    task = tasks.front();
+    tasks.pop_front();
+    space_available.notify_one();
+    return true;
+}
+
+void DVIDTaskPool::task_done(const string& error)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    if (!error.empty() && first_error.empty()) {
+        first_error = error;
+    }
+    if (--num_pending == 0) {
+        tasks_finished.notify_all();
+    }
+}
+
+}
@@ -2,7 +2,12 @@
 #include <libdvid/DVIDException.h>
 
 #include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <climits>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 
 using std::string;
 using std::vector;
@@ -12,6 +17,93 @@ static const int MAX_BLOCKS = 4096;
 
 namespace libdvid {
 
+/*!
+ * Copies one block out of a grayscale volume that spans several
+ * blocks along X.
+ * \param raw_data grayscale volume (runlength*DEFBLOCKSIZE along X)
+ * \param runlength number of blocks in the volume
+ * \param index block in the span to copy
+ * \param blockdata destination buffer (DEFBLOCKSIZE^3 bytes)
+*/
+static void copy_span_block(const uint8* raw_data, int runlength, int index,
+        uint8* blockdata)
+{
+    int offsetx = index * DEFBLOCKSIZE;
+    int offsety = runlength*DEFBLOCKSIZE;
+    int offsetz = runlength*DEFBLOCKSIZE*DEFBLOCKSIZE;
+    uint8* mod_data_iter = blockdata; 
+
+    for (int ziter = 0; ziter < DEFBLOCKSIZE; ++ziter) {
+        const uint8* data_iter = raw_data + ziter * offsetz;    
+        data_iter += (offsetx);
+        for (int yiter = 0; yiter < DEFBLOCKSIZE; ++yiter) {
+            for (int xiter = 0; xiter < DEFBLOCKSIZE; ++xiter) {
+                *mod_data_iter = *data_iter;
+                ++mod_data_iter;
+                ++data_iter;
+            }
+            data_iter += ((offsety) - DEFBLOCKSIZE);
+        }
+    }
+}
+
+/*!
+ * Groups a list of blocks (ordered by Z, Y, then X) into spans of
+ * contiguous blocks along X.  Each span is encoded as
+ * xmin, y, z, runlength, index of first block.
+ * \param blockcoords sorted block coordinates
+ * \param max_blocks maximum number of blocks in one span
+ * \param spans resulting spans
+ * \return total number of blocks
+*/
+static int plan_block_spans(const vector<BlockXYZ>& blockcoords,
+        int max_blocks, vector<vector<int> >& spans)
+{
+    int xmin = 0; 
+    int curr_runlength = 0;
+    int start_index = 0;
+    for (unsigned int i = 0; i < blockcoords.size(); ++i) {
+        int z = blockcoords[i].z;
+        int y = blockcoords[i].y;
+        int x = blockcoords[i].x;
+        if (curr_runlength == 0) {
+            xmin = x; 
+        }
+        curr_runlength += 1; 
+       
+        bool requestblocks = false;
+
+        if (curr_runlength >= max_blocks) {
+            // if there are too many blocks to fetch
+            requestblocks = true;  
+        } else if (i == (blockcoords.size()-1)) {
+            // if there are no more blocks fetch
+            requestblocks = true;
+        } else if (i < (blockcoords.size()-1)) {
+            // if y or z are different or x is non-contiguous time to fetch
+            if ((blockcoords[i+1].z != z) || (blockcoords[i+1].y != y) || 
+                    (((blockcoords[i+1].x)) != (x+1))) {
+                requestblocks = true;
+            }
+        }
+
+        if (requestblocks) {
+            // load into queue
+            vector<int> span;
+            span.push_back(xmin);
+            span.push_back(y);
+            span.push_back(z);
+            span.push_back(curr_runlength);
+            span.push_back(start_index);
+            start_index += curr_runlength;
+            spans.push_back(span);
+            curr_runlength = 0;
+        }
+    }
+
+    return start_index;
+}
+
 struct FetchGrayBlocks {
     FetchGrayBlocks(DVIDNodeService& service_, string grayscale_name_,
             bool use_blocks_, int request_efficiency_, int start_, int count_,
@@ -70,23 +162,7 @@ struct FetchGrayBlocks {
 
                     // otherwise create a buffer and do something more complicated 
                     for (int j = 0; j < curr_runlength; ++j) {
-                        int offsetx = j * DEFBLOCKSIZE;
-                        int offsety = curr_runlength*DEFBLOCKSIZE;
-                        int offsetz = curr_runlength*DEFBLOCKSIZE*DEFBLOCKSIZE;
-                        uint8* mod_data_iter = blockdata; 
-
-                        for (int ziter = 0; ziter < DEFBLOCKSIZE; ++ziter) {
-                            const uint8* data_iter = raw_data + ziter * offsetz;    
-                            data_iter += (offsetx);
-                            for (int yiter = 0; yiter < DEFBLOCKSIZE; ++yiter) {
-                                for (int xiter = 0; xiter < DEFBLOCKSIZE; ++xiter) {
-                                    *mod_data_iter = *data_iter;
-                                    ++mod_data_iter;
-                                    ++data_iter;
-                                }
-                                data_iter += ((offsety) - DEFBLOCKSIZE);
-                            }
-                        }
+                        copy_span_block(raw_data, curr_runlength, j, blockdata);
                         BinaryDataPtr ptr = BinaryData::create_binary_data((const char*) blockdata, DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE);
                         (*blocks)[block_index] = ptr;
                         ++block_index;
@@ -139,79 +215,328 @@ struct FetchTiles {
 };
 
 
-vector<BinaryDataPtr> get_body_blocks(DVIDNodeService& service, string labelvol_name,
-        string grayscale_name, uint64 bodyid, int num_threads,
-        bool use_blocks, int request_efficiency)
+/*!
+ * State shared by the threads of a streaming block visit.  Spans are
+ * handed out one at a time so a thread only holds the blocks of the
+ * span it is currently visiting.
+*/
+struct BlockVisitState {
+    BlockVisitState() : next_span(0), failed(false) {}
+
+    //! protects the members below
+    boost::mutex mutex;
+
+    //! next span to be fetched
+    unsigned int next_span;
+
+    //! set when any thread fails to fetch or visit a block
+    bool failed;
+
+    //! error from the first failed thread
+    string error;
+};
+
+struct VisitGrayBlocks {
+    VisitGrayBlocks(DVIDNodeService& service_, string grayscale_name_,
+            const vector<vector<int> >& spans_, const BlockVisitor& visitor_,
+            BlockVisitState& state_) :
+            service(service_), grayscale_name(grayscale_name_),
+            spans(spans_), visitor(visitor_), state(state_) {}
+
+    void operator()()
+    {
+        try {
+            while (true) {
+                unsigned int index;
+                {
+                    boost::mutex::scoped_lock lock(state.mutex);
+                    if (state.failed || state.next_span >= spans.size()) {
+                        break;
+                    }
+                    index = state.next_span;
+                    ++state.next_span;
+                }
+                visit_span(spans[index]);
+            }
+        } catch (std::exception& e) {
+            boost::mutex::scoped_lock lock(state.mutex);
+            if (!state.failed) {
+                state.failed = true;
+                state.error = e.what();
+            }
+        }
+    }
+
+    void visit_span(const vector<int>& span)
+    {
+        int xmin = span[0];
+        int y = span[1];
+        int z = span[2];
+        int runlength = span[3];
+
+        Dims_t dims;
+        dims.push_back(DEFBLOCKSIZE*runlength);
+        dims.push_back(DEFBLOCKSIZE);
+        dims.push_back(DEFBLOCKSIZE);
+        vector<int> offset;
+        offset.push_back(xmin*DEFBLOCKSIZE);
+        offset.push_back(y*DEFBLOCKSIZE);
+        offset.push_back(z*DEFBLOCKSIZE);
+
+        Grayscale3D grayvol = service.get_gray3D(grayscale_name,
+                dims, offset, false); 
+
+        if (runlength == 1) {
+            visitor(BlockXYZ(xmin, y, z), grayvol.get_binary());
+            return;
+        }
+
+        // each block gets its own buffer since the visitor may keep it
+        const uint8* raw_data = grayvol.get_raw();
+        for (int j = 0; j < runlength; ++j) {
+            BinaryDataPtr ptr = BinaryData::create_binary_data();
+            string& blockstr = ptr->get_data();
+            blockstr.resize(DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE);
+            copy_span_block(raw_data, runlength, j, (uint8*) &blockstr[0]);
+            visitor(BlockXYZ(xmin + j, y, z), ptr);
+        }
+    }
+
+    DVIDNodeService service;
+    string grayscale_name;
+    const vector<vector<int> >& spans;
+    const BlockVisitor& visitor;
+    BlockVisitState& state;
+};
+
+
+//! Fetches one request (by index) using the thread's connection
+typedef boost::function<void (DVIDNodeService&, unsigned int)> SpanRequestHandler;
+
+/*!
+ * Pulls requests until all are done (see BlockVisitState).  Each thread
+ * has its own copy of the node service and thus its own connection.
+*/
+struct FetchSpanRequests {
+    FetchSpanRequests(DVIDNodeService& service_, unsigned int num_requests_,
+            const SpanRequestHandler& handler_, BlockVisitState& state_) :
+            service(service_), num_requests(num_requests_),
+            handler(handler_), state(state_) {}
+
+    void operator()()
+    {
+        try {
+            while (true) {
+                unsigned int index;
+                {
+                    boost::mutex::scoped_lock lock(state.mutex);
+                    if (state.failed || state.next_span >= num_requests) {
+                        break;
+                    }
+                    index = state.next_span;
+                    ++state.next_span;
+                }
+                handler(service, index);
+            }
+        } catch (std::exception& e) {
+            boost::mutex::scoped_lock lock(state.mutex);
+            if (!state.failed) {
+                state.failed = true;
+                state.error = e.what();
+            }
+        }
+    }
+
+    DVIDNodeService service;
+    unsigned int num_requests;
+    const SpanRequestHandler& handler;
+    BlockVisitState& state;
+};
+
+static void fetch_span_requests(DVIDNodeService& service,
+        unsigned int num_requests, const SpanRequestHandler& handler,
+        int num_threads)
 {
-    vector<BlockXYZ> blockcoords;
-    vector<vector<int> > spans;
+    if (num_requests == 0) {
+        return;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    if (num_requests < (unsigned int)(num_threads)) {
+        num_threads = num_requests;
+    }
 
-    if (!service.get_coarse_body(labelvol_name, bodyid, blockcoords)) {
-        throw ErrMsg("Body not found, no grayscale blocks could be retrieved");
+    BlockVisitState state;
+    boost::thread_group threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.create_thread(FetchSpanRequests(service, num_requests,
+                    handler, state));
     }
+    threads.join_all();
 
-    int num_requests = 0;
+    if (state.failed) {
+        throw ErrMsg("ROI fetch failed: " + state.error);
+    }
+}
 
-    vector<BinaryDataPtr> blocks;
+/*!
+ * Splits spans into requests of at most max_blocks blocks.
+ * \param spans normalized spans
+ * \param max_blocks maximum number of blocks in one request
+ * \param requests resulting requests
+*/
+static void split_span_requests(const vector<BlockSpan>& spans,
+        int max_blocks, vector<BlockSpan>& requests)
+{
+    if (max_blocks < 1) {
+        throw ErrMsg("ROI fetch requires at least one block per request");
+    }
+    for (unsigned int i = 0; i < spans.size(); ++i) {
+        for (int x0 = spans[i].x0; x0 <= spans[i].x1; x0 += max_blocks) {
+            requests.push_back(BlockSpan(spans[i].z, spans[i].y, x0,
+                        std::min(spans[i].x1, x0 + max_blocks - 1)));
+        }
+    }
+}
 
-    
+//! Fetches a run of blocks and stores each block separately
+struct CopyROIBlocks {
+    CopyROIBlocks(string grayscale_name_, const vector<BlockSpan>& requests_,
+            const vector<unsigned int>& first_blocks_,
+            vector<BinaryDataPtr>& blocks_) : grayscale_name(grayscale_name_),
+        requests(requests_), first_blocks(first_blocks_), blocks(blocks_) {}
 
-    // !! probably unnecessary copying going on
-    // iterate through block coords and call ND or blocks one by one or contig
-    int xmin; 
-    int curr_runlength = 0;
-    int start_index = 0;
-    for (unsigned int i = 0; i < blockcoords.size(); ++i) {
-        int z = blockcoords[i].z;
-        int y = blockcoords[i].y;
-        int x = blockcoords[i].x;
-        if (curr_runlength == 0) {
-            xmin = x; 
+    void operator()(DVIDNodeService& service, unsigned int index)
+    {
+        const BlockSpan& span = requests[index];
+        int runlength = span.size();
+
+        Dims_t dims;
+        dims.push_back(DEFBLOCKSIZE*runlength);
+        dims.push_back(DEFBLOCKSIZE);
+        dims.push_back(DEFBLOCKSIZE);
+        vector<int> offset;
+        offset.push_back(span.x0*DEFBLOCKSIZE);
+        offset.push_back(span.y*DEFBLOCKSIZE);
+        offset.push_back(span.z*DEFBLOCKSIZE);
+
+        Grayscale3D grayvol = service.get_gray3D(grayscale_name,
+                dims, offset, false);
+
+        unsigned int block_index = first_blocks[index];
+        if (runlength == 1) {
+            blocks[block_index] = grayvol.get_binary();
+            return;
         }
-        curr_runlength += 1; 
-       
-        bool requestblocks = false;
+        const uint8* raw_data = grayvol.get_raw();
+        for (int j = 0; j < runlength; ++j) {
+            BinaryDataPtr ptr = BinaryData::create_binary_data();
+            string& blockstr = ptr->get_data();
+            blockstr.resize(DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE);
+            copy_span_block(raw_data, runlength, j, (uint8*) &blockstr[0]);
+            blocks[block_index + j] = ptr;
+        }
+    }
 
-        if (request_efficiency == 0) {
-            // if fetching 1 by 1 always request
-            requestblocks = true;
-        } else if (curr_runlength == MAX_BLOCKS) {
-            // if there are too many blocks to fetch
-            requestblocks = true;  
-        } else if (i == (blockcoords.size()-1)) {
-            // if there are no more blocks fetch
-            requestblocks = true;
-        } else if (i < (blockcoords.size()-1)) {
-            // if y or z are different or x is non-contiguous time to fetch
-            if ((blockcoords[i+1].z != z) || (blockcoords[i+1].y != y) || 
-                    (((blockcoords[i+1].x)) != (x+1))) {
-                requestblocks = true;
+    string grayscale_name;
+    const vector<BlockSpan>& requests;
+    const vector<unsigned int>& first_blocks;
+    vector<BinaryDataPtr>& blocks;
+};
+
+/*!
+ * Fetches the part of a run of blocks inside the volume and copies it
+ * into the volume (requests never overlap, so threads write disjoint
+ * parts of the volume).
+*/
+struct CopyROIVoxels {
+    CopyROIVoxels(string grayscale_name_, const vector<BlockSpan>& requests_,
+            const Dims_t& dims_, const vector<int>& offset_, uint8* volume_) :
+        grayscale_name(grayscale_name_), requests(requests_), dims(dims_),
+        offset(offset_), volume(volume_) {}
+
+    void operator()(DVIDNodeService& service, unsigned int index)
+    {
+        const BlockSpan& span = requests[index];
+
+        // clip the run to the volume
+        vector<int> span_offset(3);
+        span_offset[0] = std::max(span.x0*DEFBLOCKSIZE, offset[0]);
+        span_offset[1] = std::max(span.y*DEFBLOCKSIZE, offset[1]);
+        span_offset[2] = std::max(span.z*DEFBLOCKSIZE, offset[2]);
+        Dims_t span_dims(3);
+        span_dims[0] = std::min((span.x1+1)*DEFBLOCKSIZE,
+                offset[0] + int(dims[0])) - span_offset[0];
+        span_dims[1] = std::min((span.y+1)*DEFBLOCKSIZE,
+                offset[1] + int(dims[1])) - span_offset[1];
+        span_dims[2] = std::min((span.z+1)*DEFBLOCKSIZE,
+                offset[2] + int(dims[2])) - span_offset[2];
+
+        Grayscale3D grayvol = service.get_gray3D(grayscale_name,
+                span_dims, span_offset, false);
+
+        // copy each row of the run
+        const uint8* raw_data = grayvol.get_raw();
+        for (unsigned int z = 0; z < span_dims[2]; ++z) {
+            for (unsigned int y = 0; y < span_dims[1]; ++y) {
+                uint64 dest = (uint64(span_offset[2] - offset[2] + z) * dims[1] +
+                        (span_offset[1] - offset[1] + y)) * dims[0] +
+                    (span_offset[0] - offset[0]);
+                memcpy(volume + dest, raw_data, span_dims[0]);
+                raw_data += span_dims[0];
             }
         }
+    }
 
-        if (requestblocks) {
-            ++num_requests;
+    string grayscale_name;
+    const vector<BlockSpan>& requests;
+    const Dims_t& dims;
+    const vector<int>& offset;
+    uint8* volume;
+};
 
-            // load into queue
-            vector<int> span;
-            span.push_back(xmin);
-            span.push_back(y);
-            span.push_back(z);
-            span.push_back(curr_runlength);
-            span.push_back(start_index);
-            start_index += curr_runlength;
-            spans.push_back(span);
-            curr_runlength = 0;
+struct FetchCoarseBodies {
+    FetchCoarseBodies(DVIDNodeService& service_, string labelvol_name_,
+            int start_, int count_, vector<BodyBlocks>& bodies_) :
+            service(service_), labelvol_name(labelvol_name_),
+            start(start_), count(count_), bodies(bodies_) {}
+
+    void operator()()
+    {
+        // bodies that are not found are left without blocks
+        for (int i = start; i < (start+count); ++i) {
+            service.get_coarse_body(labelvol_name, bodies[i].bodyid,
+                    bodies[i].blockcoords);
         }
     }
 
+    DVIDNodeService service;
+    string labelvol_name;
+    int start; int count;
+    vector<BodyBlocks>& bodies;
+};
+
+/*!
+ * Fetches the grayscale for the provided spans, splitting the spans
+ * evenly between the threads.
+ * \param blocks resulting blocks (must already be sized for all spans)
+*/
+static void fetch_gray_spans(DVIDNodeService& service, string grayscale_name,
+        bool use_blocks, int request_efficiency, vector<vector<int> >& spans,
+        vector<BinaryDataPtr>& blocks, int num_threads)
+{
+    int num_requests = spans.size();
+    if (num_requests == 0) {
+        return;
+    }
+
     // launch threads
     boost::thread_group threads;
 
     if (num_requests < num_threads) {
         num_threads = num_requests;
     }
-    blocks.resize(start_index);
 
     int incr = num_requests / num_threads;
     int start = 0;
@@ -229,10 +554,97 @@ vector<BinaryDataPtr> get_body_blocks(DVIDNodeService& service, string labelvol_
     }
     threads.join_all();
     assert(count_check == num_requests);
+}
+
+
+vector<BinaryDataPtr> get_body_blocks(DVIDNodeService& service, string labelvol_name,
+        string grayscale_name, uint64 bodyid, int num_threads,
+        bool use_blocks, int request_efficiency)
+{
+    vector<BlockXYZ> blockcoords;
+    vector<vector<int> > spans;
+
+    if (!service.get_coarse_body(labelvol_name, bodyid, blockcoords)) {
+        throw ErrMsg("Body not found, no grayscale blocks could be retrieved");
+    }
+
+    vector<BinaryDataPtr> blocks;
+
+    // !! probably unnecessary copying going on
+    // iterate through block coords and call ND or blocks one by one or contig
+    // (if fetching 1 by 1 always request)
+    int max_blocks = (request_efficiency == 0) ? 1 : MAX_BLOCKS;
+    int start_index = plan_block_spans(blockcoords, max_blocks, spans);
+    int num_requests = spans.size();
+
+    blocks.resize(start_index);
+    fetch_gray_spans(service, grayscale_name, use_blocks, request_efficiency,
+            spans, blocks, num_threads);
     std::cout << "Performed " << num_requests << " requests" << std::endl;
     return blocks;
 }
 
+vector<BodyBlocks> get_multibody_blocks(DVIDNodeService& service,
+        string labelvol_name, string grayscale_name,
+        const vector<uint64>& bodyids, int num_threads)
+{
+    vector<BodyBlocks> bodies(bodyids.size());
+    for (unsigned int i = 0; i < bodyids.size(); ++i) {
+        bodies[i].bodyid = bodyids[i];
+    }
+    if (bodyids.empty()) {
+        return bodies;
+    }
+
+    // fetch the coarse volumes in parallel
+    boost::thread_group coarse_threads;
+    int num_coarse_threads = num_threads;
+    if (int(bodyids.size()) < num_coarse_threads) {
+        num_coarse_threads = bodyids.size();
+    }
+    int incr = bodyids.size() / num_coarse_threads;
+    int start = 0;
+    for (int i = 0; i < num_coarse_threads; ++i) {
+        int count = incr;
+        if (i == (num_coarse_threads-1)) {
+            count = bodyids.size() - start;
+        }
+        coarse_threads.create_thread(FetchCoarseBodies(service, labelvol_name,
+                    start, count, bodies));
+        start += incr;
+    }
+    coarse_threads.join_all();
+
+    // union of all blocks (each shared block is fetched once)
+    vector<BlockXYZ> union_coords;
+    for (unsigned int i = 0; i < bodies.size(); ++i) {
+        union_coords.insert(union_coords.end(),
+                bodies[i].blockcoords.begin(), bodies[i].blockcoords.end());
+    }
+    std::sort(union_coords.begin(), union_coords.end());
+    union_coords.erase(std::unique(union_coords.begin(), union_coords.end()),
+            union_coords.end());
+
+    vector<vector<int> > spans;
+    int num_blocks = plan_block_spans(union_coords, MAX_BLOCKS, spans);
+    vector<BinaryDataPtr> union_blocks(num_blocks);
+    fetch_gray_spans(service, grayscale_name, false, 1, spans,
+            union_blocks, num_threads);
+
+    // each body references the shared block buffers
+    for (unsigned int i = 0; i < bodies.size(); ++i) {
+        const vector<BlockXYZ>& coords = bodies[i].blockcoords;
+        bodies[i].blocks.reserve(coords.size());
+        for (unsigned int j = 0; j < coords.size(); ++j) {
+            vector<BlockXYZ>::iterator loc = std::lower_bound(
+                    union_coords.begin(), union_coords.end(), coords[j]);
+            bodies[i].blocks.push_back(union_blocks[loc - union_coords.begin()]);
+        }
+    }
+
+    return bodies;
+}
+
 vector<BinaryDataPtr> get_tile_array_binary(DVIDNodeService& service,
         string datatype_instance, Slice2D orientation, unsigned int scaling,
         const vector<vector<int> >& tile_locs_array, int num_threads)
@@ -264,4 +676,152 @@ vector<BinaryDataPtr> get_tile_array_binary(DVIDNodeService& service,
     return results;
 }
 
+void visit_blocks(DVIDNodeService& service, string grayscale_name,
+        const vector<BlockXYZ>& blockcoords, BlockVisitor visitor,
+        int num_threads, int max_blocks_per_request)
+{
+    if (num_threads < 1 || max_blocks_per_request < 1) {
+        throw ErrMsg("Block visit requires at least one thread and one block per request");
+    }
+
+    vector<vector<int> > spans;
+    plan_block_spans(blockcoords, max_blocks_per_request, spans);
+    if (spans.empty()) {
+        return;
+    }
+
+    if (int(spans.size()) < num_threads) {
+        num_threads = spans.size();
+    }
+
+    // threads pull spans as they finish visiting the previous one
+    BlockVisitState state;
+    boost::thread_group threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.create_thread(VisitGrayBlocks(service, grayscale_name,
+                    spans, visitor, state));
+    }
+    threads.join_all();
+
+    if (state.failed) {
+        throw ErrMsg("Block visit failed: " + state.error);
+    }
+}
+
+void visit_body_blocks(DVIDNodeService& service, string labelvol_name,
+        string grayscale_name, uint64 bodyid, BlockVisitor visitor,
+        int num_threads, int max_blocks_per_request)
+{
+    vector<BlockXYZ> blockcoords;
+    if (!service.get_coarse_body(labelvol_name, bodyid, blockcoords)) {
+        throw ErrMsg("Body not found, no grayscale blocks could be retrieved");
+    }
+    visit_blocks(service, grayscale_name, blockcoords, visitor,
+            num_threads, max_blocks_per_request);
+}
+
+void visit_roi_blocks(DVIDNodeService& service, string roi_name,
+        string grayscale_name, BlockVisitor visitor,
+        int num_threads, int max_blocks_per_request)
+{
+    vector<BlockXYZ> blockcoords;
+    service.get_roi(roi_name, blockcoords);
+    visit_blocks(service, grayscale_name, blockcoords, visitor,
+            num_threads, max_blocks_per_request);
+}
+
+ROIBlocks get_roi_blocks(DVIDNodeService& service,
+        const vector<BlockSpan>& spans, string grayscale_name,
+        int num_threads, int max_blocks_per_request)
+{
+    vector<BlockSpan> roi_spans(spans);
+    normalize_spans(roi_spans);
+
+    ROIBlocks roi_blocks;
+    spans_to_blocks(roi_spans, roi_blocks.blockcoords);
+    roi_blocks.blocks.resize(roi_blocks.blockcoords.size());
+
+    vector<BlockSpan> requests;
+    split_span_requests(roi_spans, max_blocks_per_request, requests);
+    vector<unsigned int> first_blocks;
+    first_blocks.reserve(requests.size());
+    unsigned int num_blocks = 0;
+    for (unsigned int i = 0; i < requests.size(); ++i) {
+        first_blocks.push_back(num_blocks);
+        num_blocks += requests[i].size();
+    }
+
+    SpanRequestHandler handler = CopyROIBlocks(grayscale_name, requests,
+            first_blocks, roi_blocks.blocks);
+    fetch_span_requests(service, requests.size(), handler, num_threads);
+    return roi_blocks;
+}
+
+ROIBlocks get_roi_blocks(DVIDNodeService& service, string roi_name,
+        string grayscale_name, int num_threads, int max_blocks_per_request)
+{
+    vector<BlockSpan> spans;
+    service.get_roi(roi_name, spans);
+    return get_roi_blocks(service, spans, grayscale_name, num_threads,
+            max_blocks_per_request);
+}
+
+Grayscale3D get_roi_gray3D(DVIDNodeService& service,
+        const vector<BlockSpan>& spans, string grayscale_name,
+        Dims_t dims, vector<int> offset, int num_threads,
+        int max_blocks_per_request)
+{
+    if (dims.size() != 3 || offset.size() != 3) {
+        throw ErrMsg("ROI volume fetch requires 3 dimensions");
+    }
+    uint64 total_size = uint64(dims[0]) * uint64(dims[1]) * uint64(dims[2]);
+    if (total_size > INT_MAX) {
+        throw ErrMsg("Cannot allocate larger than INT_MAX");
+    }
+
+    // zero-filled volume (only the ROI is fetched)
+    BinaryDataPtr data = BinaryData::create_binary_data();
+    data->get_data().resize(total_size);
+    Grayscale3D volume(data, dims);
+    if (total_size == 0) {
+        return volume;
+    }
+
+    // keep the parts of the runs inside the volume's blocks
+    int bx0 = block_coordinate(offset[0]);
+    int by0 = block_coordinate(offset[1]);
+    int bz0 = block_coordinate(offset[2]);
+    int bx1 = block_coordinate(offset[0] + int(dims[0]) - 1);
+    int by1 = block_coordinate(offset[1] + int(dims[1]) - 1);
+    int bz1 = block_coordinate(offset[2] + int(dims[2]) - 1);
+    vector<BlockSpan> roi_spans;
+    for (unsigned int i = 0; i < spans.size(); ++i) {
+        const BlockSpan& span = spans[i];
+        if (span.z < bz0 || span.z > bz1 || span.y < by0 || span.y > by1 ||
+                span.x1 < bx0 || span.x0 > bx1) {
+            continue;
+        }
+        roi_spans.push_back(BlockSpan(span.z, span.y, std::max(span.x0, bx0),
+                    std::min(span.x1, bx1)));
+    }
+    normalize_spans(roi_spans);
+
+    vector<BlockSpan> requests;
+    split_span_requests(roi_spans, max_blocks_per_request, requests);
+    SpanRequestHandler handler = CopyROIVoxels(grayscale_name, requests,
+            dims, offset, (uint8*) &(data->get_data()[0]));
+    fetch_span_requests(service, requests.size(), handler, num_threads);
+    return volume;
+}
+
+Grayscale3D get_roi_gray3D(DVIDNodeService& service, string roi_name,
+        string grayscale_name, Dims_t dims, vector<int> offset,
+        int num_threads, int max_blocks_per_request)
+{
+    vector<BlockSpan> spans;
+    service.get_roi(roi_name, spans);
+    return get_roi_gray3D(service, spans, grayscale_name, dims, offset,
+            num_threads, max_blocks_per_request);
+}
+
 }
@@ -0,0 +1,360 @@
+#include "DVIDTileCache.h"
+#include "DVIDException.h"
+
+#include <algorithm>
+
+using std::string; using std::vector;
+
+namespace libdvid {
+
+TileKey TileViewport::tile(int u, int v, int w) const
+{
+    if (orientation == XZ) {
+        return TileKey(instance, orientation, scaling, u, w, v);
+    } else if (orientation == YZ) {
+        return TileKey(instance, orientation, scaling, w, u, v);
+    }
+    return TileKey(instance, orientation, scaling, u, v, w);
+}
+
+//! Fetches tiles from DVID with its own copy of the node service
+struct ServiceTileFetcher {
+    explicit ServiceTileFetcher(DVIDNodeService& service_) :
+        service(service_) {}
+
+    BinaryDataPtr operator()(const TileKey& key)
+    {
+        return service.get_tile_slice_binary(key.instance, key.orientation,
+                key.scaling, key.tile_loc());
+    }
+
+    //! each copy has its own connection
+    DVIDNodeService service;
+};
+
+struct TileCache::Worker {
+    Worker(TileCache& cache_, TileFetcher fetcher_) :
+        cache(cache_), fetcher(fetcher_) {}
+
+    void operator()()
+    {
+        TileKey key("", XY, 0, 0, 0, 0);
+        RequestPtr request;
+        while (cache.next_fetch(key, request)) {
+            BinaryDataPtr data;
+            string error;
+            try {
+                data = fetcher(key);
+                if (!data) {
+                    error = "tile fetch returned no data";
+                }
+            } catch (std::exception& e) {
+                error = e.what();
+                if (error.empty()) {
+                    error = "tile fetch failed";
+                }
+            }
+            cache.fetch_done(key, request, data, error);
+            request.reset();
+        }
+    }
+
+    TileCache& cache;
+    TileFetcher fetcher;
+};
+
+TileCache::TileCache(DVIDNodeService& service, size_t max_bytes_,
+        int num_threads) : max_bytes(max_bytes_), margin(1), planes(1),
+    cached_bytes(0), next_sequence(0), stopping(false), num_hits(0),
+    num_misses(0)
+{
+    start(ServiceTileFetcher(service), num_threads);
+}
+
+TileCache::TileCache(TileFetcher fetcher, size_t max_bytes_,
+        int num_threads) : max_bytes(max_bytes_), margin(1), planes(1),
+    cached_bytes(0), next_sequence(0), stopping(false), num_hits(0),
+    num_misses(0)
+{
+    start(fetcher, num_threads);
+}
+
+void TileCache::start(TileFetcher fetcher, int num_threads)
+{
+    motion[0] = motion[1] = motion[2] = 0;
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        threads.create_thread(Worker(*this, fetcher));
+    }
+}
+
+TileCache::~TileCache()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    fetch_available.notify_all();
+    threads.join_all();
+}
+
+void TileCache::set_prefetch(int margin_, int planes_)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    margin = margin_;
+    planes = planes_;
+}
+
+BinaryDataPtr TileCache::find(const TileKey& key)
+{
+    std::map<TileKey, Entry>::iterator iter = entries.find(key);
+    if (iter == entries.end()) {
+        return BinaryDataPtr();
+    }
+    lru.splice(lru.begin(), lru, iter->second.lru_position);
+    return iter->second.data;
+}
+
+void TileCache::insert(const TileKey& key, BinaryDataPtr data)
+{
+    // a tile over the budget would evict everything else
+    if (size_t(data->length()) > max_bytes || entries.count(key)) {
+        return;
+    }
+    lru.push_front(key);
+    Entry& entry = entries[key];
+    entry.data = data;
+    entry.lru_position = lru.begin();
+    cached_bytes += data->length();
+
+    while (cached_bytes > max_bytes) {
+        std::map<TileKey, Entry>::iterator oldest = entries.find(lru.back());
+        cached_bytes -= oldest->second.data->length();
+        entries.erase(oldest);
+        lru.pop_back();
+    }
+}
+
+TileCache::RequestPtr TileCache::enqueue(const TileKey& key, int priority,
+        bool wait)
+{
+    std::map<TileKey, RequestPtr>::iterator iter = requests.find(key);
+    if (iter != requests.end()) {
+        RequestPtr request = iter->second;
+        if (request->queued && priority < request->priority) {
+            queue.erase(QueueEntry(request->priority, request->sequence, key));
+            request->priority = priority;
+            request->sequence = next_sequence++;
+            queue.insert(QueueEntry(priority, request->sequence, key));
+        }
+        if (wait) {
+            ++request->waiters;
+        }
+        return request;
+    }
+
+    // prefetches skip cached tiles and tiles that failed before
+    if (!wait && (entries.count(key) || failed.count(key))) {
+        return RequestPtr();
+    }
+    RequestPtr request(new Request);
+    request->priority = priority;
+    request->sequence = next_sequence++;
+    request->waiters = wait ? 1 : 0;
+    requests[key] = request;
+    queue.insert(QueueEntry(priority, request->sequence, key));
+    fetch_available.notify_one();
+    return request;
+}
+
+void TileCache::drop_prefetches()
+{
+    std::set<QueueEntry>::iterator iter = queue.begin();
+    while (iter != queue.end()) {
+        RequestPtr request = requests[iter->key];
+        if (request->waiters == 0) {
+            requests.erase(iter->key);
+            queue.erase(iter++);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+BinaryDataPtr TileCache::wait_for(boost::mutex::scoped_lock& lock,
+        RequestPtr request, string& error)
+{
+    while (!request->done) {
+        fetch_finished.wait(lock);
+    }
+    --request->waiters;
+    if (!request->data && error.empty()) {
+        error = request->error;
+    }
+    return request->data;
+}
+
+bool TileCache::next_fetch(TileKey& key, RequestPtr& request)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    while (queue.empty() && !stopping) {
+        fetch_available.wait(lock);
+    }
+    if (stopping) {
+        return false;
+    }
+    key = queue.begin()->key;
+    queue.erase(queue.begin());
+    request = requests[key];
+    request->queued = false;
+    return true;
+}
+
+void TileCache::fetch_done(const TileKey& key, RequestPtr request,
+        BinaryDataPtr data, const string& error)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        request->data = data;
+        request->error = error;
+        request->done = true;
+        requests.erase(key);
+        if (data) {
+            insert(key, data);
+        } else if (request->waiters == 0) {
+            failed.insert(key);
+        }
+    }
+    fetch_finished.notify_all();
+}
+
+BinaryDataPtr TileCache::get_tile(const TileKey& key)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    BinaryDataPtr data = find(key);
+    if (data) {
+        ++num_hits;
+        return data;
+    }
+    ++num_misses;
+    string error;
+    data = wait_for(lock, enqueue(key, 0, true), error);
+    if (!data) {
+        throw ErrMsg(error);
+    }
+    return data;
+}
+
+void TileCache::get_viewport(const TileViewport& viewport,
+        vector<BinaryDataPtr>& tiles)
+{
+    if (viewport.u1 < viewport.u0 || viewport.v1 < viewport.v0 ||
+            viewport.w1 < viewport.w0) {
+        throw ErrMsg("Viewport ranges are empty");
+    }
+    tiles.clear();
+
+    boost::mutex::scoped_lock lock(mutex);
+    drop_prefetches();
+
+    // serve cached tiles and queue the missing ones first
+    vector<std::pair<size_t, RequestPtr> > pending;
+    for (int w = viewport.w0; w <= viewport.w1; ++w) {
+        for (int v = viewport.v0; v <= viewport.v1; ++v) {
+            for (int u = viewport.u0; u <= viewport.u1; ++u) {
+                TileKey key = viewport.tile(u, v, w);
+                BinaryDataPtr data = find(key);
+                if (data) {
+                    ++num_hits;
+                } else {
+                    ++num_misses;
+                    pending.push_back(std::make_pair(tiles.size(),
+                                enqueue(key, 0, true)));
+                }
+                tiles.push_back(data);
+            }
+        }
+    }
+
+    // direction the viewport last moved in (kept while it stays still)
+    if (last_viewport && last_viewport->instance == viewport.instance &&
+            last_viewport->orientation == viewport.orientation &&
+            last_viewport->scaling == viewport.scaling) {
+        const TileViewport& last = *last_viewport;
+        int moves[] = {
+            (viewport.u0 + viewport.u1) - (last.u0 + last.u1),
+            (viewport.v0 + viewport.v1) - (last.v0 + last.v1),
+            (viewport.w0 + viewport.w1) - (last.w0 + last.w1)};
+        if (moves[0] || moves[1] || moves[2]) {
+            for (int i = 0; i < 3; ++i) {
+                motion[i] = (moves[i] > 0) - (moves[i] < 0);
+            }
+        }
+    } else {
+        motion[0] = motion[1] = motion[2] = 0;
+    }
+    last_viewport.reset(new TileViewport(viewport));
+
+    // prefetch by distance from the viewport (adjacent planes and the
+    // ring of neighbouring tiles); at each distance, tiles in the
+    // direction of motion come first
+    int max_distance = std::max(margin, planes);
+    for (int d = 1; d <= max_distance; ++d) {
+        if (d <= planes) {
+            int plane_ws[] = {viewport.w1 + d, viewport.w0 - d};
+            for (int i = 0; i < 2; ++i) {
+                if (plane_ws[i] < 0) {
+                    continue;
+                }
+                bool ahead = motion[2] == (i == 0 ? 1 : -1);
+                for (int v = viewport.v0; v <= viewport.v1; ++v) {
+                    for (int u = viewport.u0; u <= viewport.u1; ++u) {
+                        enqueue(viewport.tile(u, v, plane_ws[i]),
+                                2 * d - ahead, false);
+                    }
+                }
+            }
+        }
+        if (d <= margin) {
+            for (int w = viewport.w0; w <= viewport.w1; ++w) {
+                for (int v = viewport.v0 - d; v <= viewport.v1 + d; ++v) {
+                    for (int u = viewport.u0 - d; u <= viewport.u1 + d; ++u) {
+                        bool on_ring = (v == viewport.v0 - d) ||
+                            (v == viewport.v1 + d) || (u == viewport.u0 - d) ||
+                            (u == viewport.u1 + d);
+                        if (!on_ring || u < 0 || v < 0) {
+                            continue;
+                        }
+                        bool ahead = (motion[0] > 0 && u > viewport.u1) ||
+                            (motion[0] < 0 && u < viewport.u0) ||
+                            (motion[1] > 0 && v > viewport.v1) ||
+                            (motion[1] < 0 && v < viewport.v0);
+                        enqueue(viewport.tile(u, v, w), 2 * d - ahead, false);
+                    }
+                }
+            }
+        }
+    }
+
+    string error;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        tiles[pending[i].first] = wait_for(lock, pending[i].second, error);
+    }
+    if (!error.empty()) {
+        throw ErrMsg(error);
+    }
+}
+
+void TileCache::clear()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    entries.clear();
+    lru.clear();
+    cached_bytes = 0;
+    failed.clear();
+    num_hits = num_misses = 0;
+}
+
+}
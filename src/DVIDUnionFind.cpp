@@ -0,0 +1,257 @@
+#include "DVIDUnionFind.h"
+#include "DVIDParallel.h"
+#include "DVIDException.h"
+
+#include <algorithm>
+#include <iterator>
+
+using std::vector;
+
+namespace libdvid {
+
+ConcurrentUnionFind::ConcurrentUnionFind(size_t num_elements_) :
+    num_elements(num_elements_),
+    parents(new boost::atomic<size_t>[num_elements_])
+{
+    for (size_t i = 0; i < num_elements; ++i) {
+        parents[i].store(i, boost::memory_order_relaxed);
+    }
+}
+
+// Parents only ever move to smaller indices in the same set, so relaxed
+// ordering is sufficient; results are read after the threads are joined.
+size_t ConcurrentUnionFind::find(size_t element)
+{
+    while (true) {
+        size_t parent = parents[element].load(boost::memory_order_relaxed);
+        if (parent == element) {
+            return element;
+        }
+        size_t grandparent = parents[parent].load(boost::memory_order_relaxed);
+        if (grandparent != parent) {
+            // path halving (another thread may have already changed it)
+            parents[element].compare_exchange_weak(parent, grandparent,
+                    boost::memory_order_relaxed);
+        }
+        element = grandparent;
+    }
+}
+
+bool ConcurrentUnionFind::unite(size_t element1, size_t element2)
+{
+    while (true) {
+        size_t root1 = find(element1);
+        size_t root2 = find(element2);
+        if (root1 == root2) {
+            return false;
+        }
+
+        // link the larger root to the smaller one; retry if the larger
+        // root was linked by another thread in the meantime
+        if (root1 < root2) {
+            std::swap(root1, root2);
+        }
+        size_t expected = root1;
+        if (parents[root1].compare_exchange_strong(expected, root2,
+                    boost::memory_order_relaxed)) {
+            return true;
+        }
+        element1 = root1;
+        element2 = root2;
+    }
+}
+
+LabelMapping::LabelMapping(const vector<VertexID>& labels_,
+        const vector<VertexID>& roots_) : labels(labels_), roots(roots_)
+{
+    if (labels.size() != roots.size()) {
+        throw ErrMsg("Label mapping needs a root for every label");
+    }
+}
+
+VertexID LabelMapping::map(VertexID label) const
+{
+    vector<VertexID>::const_iterator iter =
+        std::lower_bound(labels.begin(), labels.end(), label);
+    if (iter == labels.end() || *iter != label) {
+        return label;
+    }
+    return roots[iter - labels.begin()];
+}
+
+//! Relabels a range of voxels (consecutive voxels often share a label)
+struct RelabelVoxels {
+    RelabelVoxels(const LabelMapping& mapping_, uint64* voxels_) :
+        mapping(mapping_), voxels(voxels_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        if (begin == end) {
+            return;
+        }
+        uint64 last_label = voxels[begin];
+        uint64 last_root = mapping.map(last_label);
+        for (size_t i = begin; i < end; ++i) {
+            if (voxels[i] != last_label) {
+                last_label = voxels[i];
+                last_root = mapping.map(last_label);
+            }
+            voxels[i] = last_root;
+        }
+    }
+
+    const LabelMapping& mapping;
+    uint64* voxels;
+};
+
+void LabelMapping::relabel(Labels3D& volume, int num_threads) const
+{
+    std::string& data = volume.get_binary()->get_data();
+    size_t num_voxels = data.size() / sizeof(uint64);
+    if (num_voxels == 0 || labels.empty()) {
+        return;
+    }
+    parallel_ranges(num_voxels, threads_for(num_voxels, num_threads),
+            RelabelVoxels(*this, (uint64*) &data[0]));
+}
+
+//! True if the edge weight is within the merge range
+static bool merge_edge(const Edge& edge, double min_weight, double max_weight)
+{
+    return edge.weight >= min_weight && edge.weight <= max_weight;
+}
+
+//! Collects the sorted, distinct vertex ids of the merged edges per thread
+struct GatherEdgeIds {
+    GatherEdgeIds(const vector<Edge>& edges_, double min_weight_,
+            double max_weight_, vector<vector<VertexID> >& ids_) :
+        edges(edges_), min_weight(min_weight_), max_weight(max_weight_),
+        ids(ids_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        vector<VertexID>& local_ids = ids[thread];
+        for (size_t i = begin; i < end; ++i) {
+            if (merge_edge(edges[i], min_weight, max_weight)) {
+                local_ids.push_back(edges[i].id1);
+                local_ids.push_back(edges[i].id2);
+            }
+        }
+        std::sort(local_ids.begin(), local_ids.end());
+        local_ids.erase(std::unique(local_ids.begin(), local_ids.end()),
+                local_ids.end());
+    }
+
+    const vector<Edge>& edges;
+    double min_weight, max_weight;
+    vector<vector<VertexID> >& ids;
+};
+
+//! Merges pairs of sorted id lists (list 2i+1 into list 2i)
+struct MergeIdLists {
+    explicit MergeIdLists(vector<vector<VertexID> >& ids_) : ids(ids_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        for (size_t pair = begin; pair < end; ++pair) {
+            vector<VertexID>& first = ids[2 * pair];
+            vector<VertexID>& second = ids[2 * pair + 1];
+            vector<VertexID> merged;
+            merged.reserve(first.size() + second.size());
+            std::merge(first.begin(), first.end(), second.begin(),
+                    second.end(), std::back_inserter(merged));
+            merged.erase(std::unique(merged.begin(), merged.end()),
+                    merged.end());
+            first.swap(merged);
+            vector<VertexID>().swap(second);
+        }
+    }
+
+    vector<vector<VertexID> >& ids;
+};
+
+//! Dense index of a vertex id (which must be in ids)
+static size_t dense_index(const vector<VertexID>& ids, VertexID id)
+{
+    return std::lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+}
+
+//! Unites the vertices of the merged edges
+struct UniteEdges {
+    UniteEdges(const vector<Edge>& edges_, double min_weight_,
+            double max_weight_, const vector<VertexID>& ids_,
+            ConcurrentUnionFind& sets_) : edges(edges_),
+        min_weight(min_weight_), max_weight(max_weight_), ids(ids_),
+        sets(sets_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            if (merge_edge(edges[i], min_weight, max_weight)) {
+                sets.unite(dense_index(ids, edges[i].id1),
+                        dense_index(ids, edges[i].id2));
+            }
+        }
+    }
+
+    const vector<Edge>& edges;
+    double min_weight, max_weight;
+    const vector<VertexID>& ids;
+    ConcurrentUnionFind& sets;
+};
+
+//! Looks up the root vertex of each dense index
+struct FindRoots {
+    FindRoots(const vector<VertexID>& ids_, ConcurrentUnionFind& sets_,
+            vector<VertexID>& roots_) : ids(ids_), sets(sets_), roots(roots_) {}
+
+    void operator()(size_t begin, size_t end, int thread)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            roots[i] = ids[sets.find(i)];
+        }
+    }
+
+    const vector<VertexID>& ids;
+    ConcurrentUnionFind& sets;
+    vector<VertexID>& roots;
+};
+
+void agglomerate_edges(const vector<Edge>& edges, double min_weight,
+        double max_weight, LabelMapping& mapping, int num_threads)
+{
+    int edge_threads = threads_for(edges.size(), num_threads);
+
+    // distinct vertices of the merged edges (sorted per thread, then
+    // merged pairwise in parallel)
+    vector<vector<VertexID> > ids(edge_threads);
+    parallel_ranges(edges.size(), edge_threads,
+            GatherEdgeIds(edges, min_weight, max_weight, ids));
+    while (ids.size() > 1) {
+        if (ids.size() % 2) {
+            ids.push_back(vector<VertexID>());
+        }
+        size_t num_pairs = ids.size() / 2;
+        parallel_ranges(num_pairs, int(num_pairs), MergeIdLists(ids));
+        for (size_t i = 0; i < num_pairs; ++i) {
+            ids[i].swap(ids[2 * i]);
+        }
+        ids.resize(num_pairs);
+    }
+    vector<VertexID> vertex_ids;
+    if (!ids.empty()) {
+        vertex_ids.swap(ids[0]);
+    }
+
+    ConcurrentUnionFind sets(vertex_ids.size());
+    parallel_ranges(edges.size(), edge_threads,
+            UniteEdges(edges, min_weight, max_weight, vertex_ids, sets));
+
+    vector<VertexID> roots(vertex_ids.size());
+    parallel_ranges(vertex_ids.size(), threads_for(vertex_ids.size(),
+                num_threads), FindRoots(vertex_ids, sets, roots));
+
+    mapping = LabelMapping(vertex_ids, roots);
+}
+
+}
@@ -11,9 +11,12 @@
 #include <libdvid/DVIDServerService.h>
 #include <libdvid/DVIDNodeService.h>
 #include <libdvid/DVIDThreadedFetch.h>
+#include <libdvid/DVIDMesh.h>
 
 #include <iostream>
 #include <vector>
+#include <map>
+#include <boost/thread/mutex.hpp>
 
 using std::cerr; using std::cout; using std::endl;
 using namespace libdvid;
@@ -25,6 +28,23 @@ using std::string;
 // (label posts must be block aligned)
 int BLK_SIZE = 32;
 
+/*!
+ * Collects blocks streamed by the block visitor.
+*/
+struct CollectBlocks {
+    CollectBlocks(boost::mutex& mutex_, std::map<BlockXYZ, BinaryDataPtr>& blocks_) :
+        mutex(mutex_), blocks(blocks_) {}
+
+    void operator()(const BlockXYZ& block, BinaryDataPtr data)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        blocks[block] = data;
+    }
+
+    boost::mutex& mutex;
+    std::map<BlockXYZ, BinaryDataPtr>& blocks;
+};
+
 /*!
  * Exercises the body interface.
 */
@@ -136,6 +156,19 @@ int main(int argc, char** argv)
             throw ErrMsg("Returned center for body 5, plane 42 is incorrect");
         }
 
+        // body 5 is 4 isolated voxels (each voxel mesh has 14 vertices
+        // and 24 triangles)
+        Mesh mesh = generate_body_mesh(dvid_node, labelvol_datatype_name,
+                label_datatype_name, uint64(5), 2);
+        if ((mesh.num_triangles() != 96) || (mesh.num_vertices() != 56)) {
+            throw ErrMsg("Body 5 mesh has the wrong number of triangles");
+        }
+        Mesh mesh_copy(mesh.export_binary());
+        if ((mesh_copy.vertices != mesh.vertices) ||
+                (mesh_copy.triangles != mesh.triangles)) {
+            throw ErrMsg("Binary mesh does not round trip");
+        }
+
         // ******* test parallel sparse vol fetch ***********
         string gray_datatype_name = "gray1";
         
@@ -172,6 +205,63 @@ int main(int argc, char** argv)
             }
         }
         
+        // streaming visit should see the same blocks (one block per request)
+        boost::mutex visit_mutex;
+        std::map<BlockXYZ, BinaryDataPtr> visited;
+        visit_body_blocks(dvid_node, labelvol_datatype_name, gray_datatype_name,
+                uint64(5), CollectBlocks(visit_mutex, visited), 2, 1);
+        if (visited.size() != 4) {
+            throw ErrMsg("Visited gray blocks is not 4");
+        }
+        for (unsigned int i = 0; i < blockcoords.size(); ++i) {
+            BinaryDataPtr visited_block = visited[blockcoords[i]];
+            if (!visited_block || (visited_block->get_data() !=
+                        grayarray[i]->get_data())) {
+                throw ErrMsg("Visited gray blocks do not match fetched blocks");
+            }
+        }
+
+        // multi-body fetch shares blocks between bodies (body 3 does not exist)
+        vector<uint64> bodyids;
+        bodyids.push_back(5); bodyids.push_back(3); bodyids.push_back(5);
+        vector<BodyBlocks> bodies = get_multibody_blocks(dvid_node,
+                labelvol_datatype_name, gray_datatype_name, bodyids, 2);
+        if ((bodies.size() != 3) || (bodies[0].blocks.size() != 4) ||
+                (!bodies[1].blocks.empty()) || (bodies[2].blocks.size() != 4)) {
+            throw ErrMsg("Multi-body fetch returned the wrong number of blocks");
+        }
+        for (unsigned int i = 0; i < bodies[0].blocks.size(); ++i) {
+            if ((bodies[0].blocks[i] != bodies[2].blocks[i]) ||
+                    (bodies[0].blocks[i]->get_data() != grayarray[i]->get_data())) {
+                throw ErrMsg("Multi-body fetch blocks are not shared or incorrect");
+            }
+        }
+
+        // ROI-masked fetches only transfer the blocks of the ROI
+        string roi_name = "body5_roi";
+        if (!dvid_node.create_roi(roi_name)) {
+            throw ErrMsg(roi_name + " already exists");
+        }
+        dvid_node.post_roi(roi_name, blockcoords);
+        ROIBlocks roi_blocks = get_roi_blocks(dvid_node, roi_name,
+                gray_datatype_name, 2, 2);
+        if (roi_blocks.blockcoords != blockcoords) {
+            throw ErrMsg("ROI fetch returned the wrong blocks");
+        }
+        for (unsigned int i = 0; i < roi_blocks.blocks.size(); ++i) {
+            if (roi_blocks.blocks[i]->get_data() != grayarray[i]->get_data()) {
+                throw ErrMsg("ROI fetch blocks do not match fetched blocks");
+            }
+        }
+        Grayscale3D roi_gray = get_roi_gray3D(dvid_node, roi_name,
+                gray_datatype_name, lsizes, start, 2);
+        Grayscale3D masked_gray = dvid_node.get_gray3D(gray_datatype_name,
+                lsizes, start, false, false, roi_name);
+        if (roi_gray.get_binary()->get_data() !=
+                masked_gray.get_binary()->get_data()) {
+            throw ErrMsg("ROI volume fetch does not match masked volume");
+        }
+
         // should be equal to original gray -- check first row of graybin
         for (int i = 0; i < 3; ++i) {
             for (int j = 0; j < BLK_SIZE; ++j) {
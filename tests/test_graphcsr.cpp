@@ -0,0 +1,125 @@
+/*!
+ * This file tests the CSR graph built from labelgraph data.
+ * It does not require a DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDGraphCSR.h>
+#include <libdvid/DVIDException.h>
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <cstdlib>
+
+using std::cerr; using std::endl;
+using namespace libdvid;
+using std::vector; using std::map; using std::set; using std::pair;
+
+typedef map<pair<VertexID, VertexID>, double> EdgeMap;
+
+//! Canonical key for the reference edge map
+pair<VertexID, VertexID> edge_key(VertexID a, VertexID b)
+{
+    return (a < b) ? std::make_pair(a, b) : std::make_pair(b, a);
+}
+
+//! Compares the CSR graph against reference vertex and edge maps
+void check_graph(const GraphCSR& csr, const map<VertexID, double>& vertices,
+        const EdgeMap& edges)
+{
+    if (csr.num_vertices() != vertices.size() || csr.num_edges() != edges.size()) {
+        throw ErrMsg("CSR graph has the wrong size");
+    }
+
+    map<VertexID, set<VertexID> > adjacency;
+    for (EdgeMap::const_iterator iter = edges.begin(); iter != edges.end(); ++iter) {
+        adjacency[iter->first.first].insert(iter->first.second);
+        adjacency[iter->first.second].insert(iter->first.first);
+        double weight;
+        if (!csr.edge_weight(iter->first.second, iter->first.first, weight) ||
+                weight != iter->second) {
+            throw ErrMsg("CSR edge weight mismatch");
+        }
+    }
+
+    for (map<VertexID, double>::const_iterator iter = vertices.begin();
+            iter != vertices.end(); ++iter) {
+        double weight;
+        if (!csr.vertex_weight(iter->first, weight) || weight != iter->second) {
+            throw ErrMsg("CSR vertex weight mismatch");
+        }
+        vector<VertexID> neighbors;
+        csr.neighbors(iter->first, neighbors);
+        set<VertexID> neighbor_set(neighbors.begin(), neighbors.end());
+        if (neighbor_set != adjacency[iter->first] ||
+                csr.degree(iter->first) != neighbors.size()) {
+            throw ErrMsg("CSR neighbors mismatch");
+        }
+    }
+
+    Graph exported;
+    csr.export_graph(exported);
+    if (exported.vertices.size() != vertices.size() ||
+            exported.edges.size() != edges.size()) {
+        throw ErrMsg("CSR export has the wrong size");
+    }
+}
+
+//! Adds random vertices and edges to the graph and the reference maps
+void random_graph(Graph& graph, map<VertexID, double>& vertices,
+        EdgeMap& edges, int num_edges, VertexID max_id)
+{
+    for (int i = 0; i < num_edges; ++i) {
+        VertexID id1 = rand() % max_id + 1;
+        VertexID id2 = rand() % max_id + 1;
+        double weight = rand() % 100;
+        graph.edges.push_back(Edge(id1, id2, weight));
+        edges[edge_key(id1, id2)] = weight;
+        if (vertices.find(id1) == vertices.end()) {
+            vertices[id1] = 0;
+        }
+        if (vertices.find(id2) == vertices.end()) {
+            vertices[id2] = 0;
+        }
+        if (i % 3 == 0) {
+            graph.vertices.push_back(Vertex(id1, i));
+            vertices[id1] = i;
+        }
+    }
+}
+
+/*!
+ * Builds CSR graphs serially and in parallel, merges new results
+ * and compares them with a simple reference.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        srand(7);
+        for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+            map<VertexID, double> vertices;
+            EdgeMap edges;
+            Graph graph;
+            random_graph(graph, vertices, edges, 50000, 20000);
+            GraphCSR csr(graph, num_threads);
+            check_graph(csr, vertices, edges);
+
+            // merged results override existing weights
+            Graph update;
+            random_graph(update, vertices, edges, 30000, 40000);
+            csr.merge(update, num_threads);
+            check_graph(csr, vertices, edges);
+        }
+
+        GraphCSR empty;
+        if (empty.num_vertices() != 0 || empty.degree(1) != 0) {
+            throw ErrMsg("Empty CSR graph is not empty");
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*!
+ * This file tests reading labelgraph files in chunks with several
+ * threads (JSON and binary formats).  It does not require a DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDGraph.h>
+#include <libdvid/DVIDGraphLoader.h>
+#include <libdvid/DVIDException.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::string; using std::vector;
+
+//! Appends the records passed by the reader to a graph
+struct AppendToGraph {
+    explicit AppendToGraph(Graph& graph_) : graph(graph_) {}
+    void operator()(const vector<Vertex>& vertices)
+    {
+        graph.vertices.insert(graph.vertices.end(), vertices.begin(),
+                vertices.end());
+    }
+    void operator()(const vector<Edge>& edges)
+    {
+        graph.edges.insert(graph.edges.end(), edges.begin(), edges.end());
+    }
+    Graph& graph;
+};
+
+//! Counts the records passed by the reader
+struct CountVertices {
+    explicit CountVertices(size_t& count_) : count(count_) {}
+    void operator()(const vector<Vertex>& vertices)
+    {
+        count += vertices.size();
+    }
+    size_t& count;
+};
+
+//! Throws an error if the graphs differ
+void compare_graphs(const Graph& graph, const Graph& graph_read, string name)
+{
+    if ((graph_read.vertices.size() != graph.vertices.size()) ||
+            (graph_read.edges.size() != graph.edges.size())) {
+        throw ErrMsg(name + " graph has the wrong size");
+    }
+    for (unsigned int i = 0; i < graph.vertices.size(); ++i) {
+        if ((graph_read.vertices[i].id != graph.vertices[i].id) ||
+            (graph_read.vertices[i].weight != graph.vertices[i].weight)) {
+            throw ErrMsg(name + " vertex does not match");
+        }
+    }
+    for (unsigned int i = 0; i < graph.edges.size(); ++i) {
+        if ((graph_read.edges[i].id1 != graph.edges[i].id1) ||
+            (graph_read.edges[i].id2 != graph.edges[i].id2) ||
+            (graph_read.edges[i].weight != graph.edges[i].weight)) {
+            throw ErrMsg(name + " edge does not match");
+        }
+    }
+}
+
+/*!
+ * Writes a graph in both formats and checks that chunked reads
+ * (with chunks much smaller than the file) return the same graph.
+*/
+int main(int argc, char** argv)
+{
+    string json_name = "test_graphloader.json";
+    string binary_name = "test_graphloader.bin";
+    try {
+        Graph graph;
+        for (VertexID id = 1; id <= 50000; ++id) {
+            graph.vertices.push_back(Vertex(id * 7919, id * 0.5));
+            if (id > 1) {
+                graph.edges.push_back(Edge((id - 1) * 7919, id * 7919, -1.25));
+            }
+        }
+        graph.vertices.push_back(Vertex(uint64(1) << 60, 1e-7));
+
+        // edges are written first and other sections are skipped
+        string buffer;
+        graph.export_json(buffer);
+        size_t edges_start = buffer.find("\"Edges\"");
+        string json = "{\"Transactions\": [{\"Id\": 5, \"Trans\": 1}], " +
+            buffer.substr(edges_start, buffer.size() - edges_start - 1) + ", " +
+            buffer.substr(1, edges_start - 2) + "}";
+        std::ofstream fout(json_name.c_str());
+        fout << json;
+        fout.close();
+
+        for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+            Graph graph_read;
+            read_graph_file(json_name, graph_read, num_threads);
+            compare_graphs(graph, graph_read, "JSON");
+
+            // small chunks split records and keys
+            Graph graph_chunked;
+            read_graph_file(json_name, AppendToGraph(graph_chunked),
+                    AppendToGraph(graph_chunked), num_threads, 1024);
+            compare_graphs(graph, graph_chunked, "Chunked JSON");
+        }
+
+        // skipped sections are not passed on
+        size_t num_vertices = 0;
+        read_graph_file(json_name, CountVertices(num_vertices),
+                EdgeBatchHandler(), 2, 4096);
+        if (num_vertices != graph.vertices.size()) {
+            throw ErrMsg("Vertex only read has the wrong size");
+        }
+
+        write_graph_binary(binary_name, graph);
+        Graph graph_binary;
+        read_graph_file(binary_name, graph_binary);
+        compare_graphs(graph, graph_binary, "Binary");
+
+        // truncated files are rejected
+        std::ofstream bad_out(json_name.c_str());
+        bad_out << json.substr(0, json.size() / 2);
+        bad_out.close();
+        bool failed = false;
+        try {
+            Graph graph_bad;
+            read_graph_file(json_name, graph_bad, 2);
+        } catch (ErrMsg&) {
+            failed = true;
+        }
+        if (!failed) {
+            throw ErrMsg("Truncated graph file accepted");
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        remove(json_name.c_str());
+        remove(binary_name.c_str());
+        return -1;
+    }
+    remove(json_name.c_str());
+    remove(binary_name.c_str());
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*!
+ * This file tests the streaming JSON helpers used to exchange
+ * labelgraph data with DVID.  It does not require a DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDGraph.h>
+#include <libdvid/DVIDJsonStream.h>
+#include <libdvid/DVIDException.h>
+
+#include <json/json.h>
+#include <iostream>
+#include <string>
+#include <climits>
+#include <algorithm>
+#include <vector>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::string; using std::vector;
+
+/*!
+ * Parses a document in pieces of the given size to check that
+ * tokens split across pieces are handled.
+*/
+void parse_in_pieces(const string& document, JsonHandler& handler,
+        size_t piece_size)
+{
+    JsonStreamParser parser(handler);
+    for (size_t pos = 0; pos < document.size(); pos += piece_size) {
+        parser.feed(document.data() + pos,
+                std::min(piece_size, document.size() - pos));
+    }
+    parser.finish();
+}
+
+//! Collects string values to check escape decoding
+struct StringCollector : public JsonHandler {
+    void key(const string& name)
+    {
+        values.push_back(name);
+    }
+    void string_value(const string& value)
+    {
+        values.push_back(value);
+    }
+    vector<string> values;
+};
+
+/*!
+ * Checks that graphs written without a JSON document parse back
+ * to the same graph and that the streaming parser decodes the
+ * labelgraph, ROI and partition formats.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        // check number formatting
+        string numbers;
+        json_append_int(numbers, INT_MIN);
+        numbers += ' ';
+        json_append_uint64(numbers, uint64(18446744073709551615ULL));
+        numbers += ' ';
+        json_append_double(numbers, -42.0);
+        numbers += ' ';
+        json_append_double(numbers, 0.1);
+        numbers += ' ';
+        json_append_double(numbers, 0.1 + 0.2);
+        if (numbers != "-2147483648 18446744073709551615 -42 0.1 "
+                "0.30000000000000004") {
+            throw ErrMsg("Incorrect number formatting: " + numbers);
+        }
+
+        Graph graph;
+        graph.vertices.push_back(Vertex(1, 2.5));
+        graph.vertices.push_back(Vertex(uint64(1) << 60, 1e-7));
+        graph.vertices.push_back(Vertex(3, 123456789.0));
+        graph.edges.push_back(Edge(1, uint64(1) << 60, 0.3333));
+        graph.edges.push_back(Edge(3, 1, -4));
+
+        string buffer;
+        graph.export_json(buffer);
+
+        Json::Reader json_reader;
+        Json::Value data;
+        if (!json_reader.parse(buffer, data)) {
+            throw ErrMsg("Written graph is not valid JSON");
+        }
+        Graph graph_read(data);
+
+        if ((graph_read.vertices.size() != graph.vertices.size()) ||
+                (graph_read.edges.size() != graph.edges.size())) {
+            throw ErrMsg("Written graph has the wrong size");
+        }
+        for (unsigned int i = 0; i < graph.vertices.size(); ++i) {
+            if ((graph_read.vertices[i].id != graph.vertices[i].id) ||
+                (graph_read.vertices[i].weight != graph.vertices[i].weight)) {
+                throw ErrMsg("Written vertex does not match");
+            }
+        }
+        for (unsigned int i = 0; i < graph.edges.size(); ++i) {
+            if ((graph_read.edges[i].id1 != graph.edges[i].id1) ||
+                (graph_read.edges[i].id2 != graph.edges[i].id2) ||
+                (graph_read.edges[i].weight != graph.edges[i].weight)) {
+                throw ErrMsg("Written edge does not match");
+            }
+        }
+
+        // streaming parse of the written graph (including 1 byte pieces)
+        for (size_t piece_size = 1; piece_size <= 7; piece_size += 6) {
+            Graph graph_streamed;
+            GraphJsonHandler graph_handler(graph_streamed);
+            parse_in_pieces(buffer, graph_handler, piece_size);
+            if ((graph_streamed.vertices.size() != graph.vertices.size()) ||
+                    (graph_streamed.edges.size() != graph.edges.size())) {
+                throw ErrMsg("Streamed graph has the wrong size");
+            }
+            for (unsigned int i = 0; i < graph.vertices.size(); ++i) {
+                if ((graph_streamed.vertices[i].id != graph.vertices[i].id) ||
+                    (graph_streamed.vertices[i].weight != graph.vertices[i].weight)) {
+                    throw ErrMsg("Streamed vertex does not match");
+                }
+            }
+            for (unsigned int i = 0; i < graph.edges.size(); ++i) {
+                if ((graph_streamed.edges[i].id1 != graph.edges[i].id1) ||
+                    (graph_streamed.edges[i].id2 != graph.edges[i].id2) ||
+                    (graph_streamed.edges[i].weight != graph.edges[i].weight)) {
+                    throw ErrMsg("Streamed edge does not match");
+                }
+            }
+        }
+
+        // DVID may return null lists
+        Graph null_graph;
+        GraphJsonHandler null_handler(null_graph);
+        parse_in_pieces("{\"Vertices\": null, \"Edges\": null}", null_handler, 3);
+        if (!null_graph.vertices.empty() || !null_graph.edges.empty()) {
+            throw ErrMsg("Null graph lists parsed incorrectly");
+        }
+
+        // ROI runs are expanded into blocks
+        vector<BlockXYZ> blocks;
+        RoiJsonHandler roi_handler(blocks);
+        parse_in_pieces("[[1, 2, 3, 5], [ 0,0,-1,-1 ]]", roi_handler, 2);
+        if (blocks.size() != 4 || blocks[0] != BlockXYZ(3, 2, 1) ||
+                blocks[2] != BlockXYZ(5, 2, 1) || blocks[3] != BlockXYZ(-1, 0, 0)) {
+            throw ErrMsg("ROI parsed incorrectly");
+        }
+
+        // point query results are decoded in order
+        unsigned char inroi[3];
+        BoolArrayJsonHandler bool_handler(inroi, 3);
+        parse_in_pieces("[true, false,true]", bool_handler, 4);
+        vector<PointXYZ> points;
+        points.push_back(PointXYZ(-40, 0, 7));
+        points.push_back(PointXYZ(1, 31, 32));
+        string points_buffer;
+        write_points_json(&points[0], points.size(), points_buffer);
+        if (bool_handler.num_values != 3 || !inroi[0] || inroi[1] ||
+                !inroi[2] || points_buffer != "[[-40,0,7],[1,31,32]]") {
+            throw ErrMsg("Point query JSON handled incorrectly");
+        }
+
+        // key listings are decoded with escapes
+        vector<string> keys;
+        StringArrayJsonHandler keys_handler(keys);
+        parse_in_pieces("[\"a\", \"b\\\"c\", \"\\u00e9\"]", keys_handler, 3);
+        if (keys.size() != 3 || keys[0] != "a" || keys[1] != "b\"c" ||
+                keys[2] != "\xc3\xa9") {
+            throw ErrMsg("Key listing JSON handled incorrectly");
+        }
+
+        // partitions skip unused fields
+        vector<SubstackXYZ> substacks;
+        PartitionJsonHandler partition_handler(substacks, 64);
+        parse_in_pieces("{\"NumTotalBlocks\": 16, \"NumActiveBlocks\": 5, "
+                "\"Subvolumes\": [{\"MinPoint\": [0, 32, 64], \"MaxPoint\": [63, 95, 127], "
+                "\"Extra\": {\"MinPoint\": [1, 1, 1]}}, "
+                "{\"MaxPoint\": [1, 2, 3], \"MinPoint\": [64, 0, 0]}]}",
+                partition_handler, 5);
+        if (substacks.size() != 2 || substacks[0] != SubstackXYZ(0, 32, 64, 64) ||
+                substacks[1] != SubstackXYZ(64, 0, 0, 64) ||
+                partition_handler.total_blocks != 16 ||
+                partition_handler.active_blocks != 5) {
+            throw ErrMsg("Partition parsed incorrectly");
+        }
+
+        // escapes (including surrogate pairs) are decoded to UTF-8
+        StringCollector strings;
+        parse_in_pieces("{\"a\\\"b\": [\"\\u00e9\\n\", \"\\ud83d\\ude00\", true, null]}",
+                strings, 1);
+        if (strings.values.size() != 3 || strings.values[0] != "a\"b" ||
+                strings.values[1] != "\xc3\xa9\n" ||
+                strings.values[2] != "\xf0\x9f\x98\x80") {
+            throw ErrMsg("Strings parsed incorrectly");
+        }
+
+        // malformed and truncated documents are rejected
+        const char* bad_documents[] = {"[1, 2", "{\"a\" 1}", "[1,]", "[1] 2",
+            "{\"a\": tru}", "[\"abc"};
+        for (unsigned int i = 0; i < sizeof(bad_documents)/sizeof(char*); ++i) {
+            JsonHandler ignore;
+            bool failed = false;
+            try {
+                parse_in_pieces(bad_documents[i], ignore, 1);
+            } catch (ErrMsg&) {
+                failed = true;
+            }
+            if (!failed) {
+                throw ErrMsg(string("Malformed JSON accepted: ") + bad_documents[i]);
+            }
+        }
+
+        // empty graphs still write both lists
+        string empty_buffer;
+        Graph().export_json(empty_buffer);
+        if (empty_buffer != "{\"Vertices\":[],\"Edges\":[]}") {
+            throw ErrMsg("Empty graph written incorrectly");
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
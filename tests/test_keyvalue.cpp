@@ -10,9 +10,39 @@
 #include <libdvid/DVIDNodeService.h>
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdio>
 using std::cerr; using std::cout; using std::endl;
 using namespace libdvid;
-using std::string;
+using std::string; using std::vector;
+
+/*!
+ * Checks that the pages of a key range scan arrive in key order
+ * with the values that were stored.
+*/
+struct ScanChecker {
+    ScanChecker(size_t& num_keys_, bool& ordered_) : num_keys(num_keys_),
+        ordered(ordered_) {}
+
+    void operator()(const vector<string>& keys,
+            const vector<KeyValueResult>& results)
+    {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            std::stringstream expected;
+            expected << "scan" << 10000 + num_keys;
+            if (keys[i] != expected.str() || !results[i].ok() ||
+                    results[i].value->get_data() != keys[i] + "-value") {
+                ordered = false;
+            }
+            ++num_keys;
+        }
+    }
+
+    size_t& num_keys;
+    bool& ordered;
+};
 
 /*!
  * Test get/put of values using keyvalue type.
@@ -53,6 +83,142 @@ int main(int argc, char** argv)
             cerr << "Key value not stored properly" << endl;
             return -1;
         }
+
+        // batched put and get of several keys (the last key is missing)
+        vector<string> keys;
+        vector<BinaryDataPtr> values;
+        keys.push_back("many0"); keys.push_back("many1"); keys.push_back("many2");
+        for (unsigned int i = 0; i < keys.size(); ++i) {
+            string value = keys[i] + "-value";
+            values.push_back(BinaryData::create_binary_data(value.c_str(),
+                        value.size()));
+        }
+        vector<KeyValueResult> results;
+        dvid_node.put_many(keyvalue_datatype_name, keys, values, results, 2, 2);
+        for (unsigned int i = 0; i < results.size(); ++i) {
+            if (!results[i].ok()) {
+                cerr << "Batched put failed: " << results[i].error << endl;
+                return -1;
+            }
+        }
+        keys.push_back("nokey");
+        dvid_node.get_many(keyvalue_datatype_name, keys, results, 2, 2);
+        for (unsigned int i = 0; i < values.size(); ++i) {
+            if (!results[i].ok() ||
+                    results[i].value->get_data() != values[i]->get_data()) {
+                cerr << "Batched get returned the wrong value" << endl;
+                return -1;
+            }
+        }
+        if (results.back().ok()) {
+            cerr << "Missing key should not be found" << endl;
+            return -1;
+        }
+
+        // list a key range
+        vector<string> range_keys;
+        dvid_node.get_keyrange(keyvalue_datatype_name, "many1", "many9",
+                range_keys);
+        if (range_keys.size() != 2 || range_keys[0] != "many1" ||
+                range_keys[1] != "many2") {
+            cerr << "Key range listed incorrectly" << endl;
+            return -1;
+        }
+        vector<string> all_keys;
+        dvid_node.get_keys(keyvalue_datatype_name, all_keys);
+        if (all_keys.size() != 4) {
+            cerr << "Keys listed incorrectly" << endl;
+            return -1;
+        }
+
+        // scan a range of many keys in small pages
+        vector<string> scan_keys;
+        vector<BinaryDataPtr> scan_values;
+        for (int i = 0; i < 5000; ++i) {
+            std::stringstream key;
+            key << "scan" << 10000 + i;
+            string value = key.str() + "-value";
+            scan_keys.push_back(key.str());
+            scan_values.push_back(BinaryData::create_binary_data(
+                        value.c_str(), value.size()));
+        }
+        dvid_node.put_many(keyvalue_datatype_name, scan_keys, scan_values,
+                results, 4);
+        for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+            size_t num_scanned = 0;
+            bool ordered = true;
+            dvid_node.scan_keyrange(keyvalue_datatype_name, "scan", "scan9",
+                    ScanChecker(num_scanned, ordered), num_threads, 64);
+            if (num_scanned != scan_keys.size() || !ordered) {
+                cerr << "Key range scanned incorrectly" << endl;
+                return -1;
+            }
+        }
+
+        // cached reads are reused until the key is written
+        dvid_node.set_keyvalue_cache(KeyValueCachePtr(new KeyValueCache));
+        dvid_node.get_json(keyvalue_datatype_name, "spot0");
+        data_ret = dvid_node.get_json(keyvalue_datatype_name, "spot0");
+        KeyValueCachePtr cache = dvid_node.get_keyvalue_cache();
+        if (cache->hits() != 1 || cache->misses() != 1 ||
+                data_ret["hello"].asString() != "world") {
+            cerr << "Cached key value read incorrectly" << endl;
+            return -1;
+        }
+        data_init["hello"] = "again";
+        dvid_node.put(keyvalue_datatype_name, "spot0", data_init);
+        data_ret = dvid_node.get_json(keyvalue_datatype_name, "spot0");
+        if (data_ret["hello"].asString() != "again") {
+            cerr << "Key value cache not invalidated by put" << endl;
+            return -1;
+        }
+
+        // values streamed from and to streams
+        string large_value(3 << 20, 'a');
+        for (unsigned int i = 0; i < large_value.size(); i += 1000) {
+            large_value[i] = char(i % 251);
+        }
+        std::istringstream large_in(large_value);
+        dvid_node.put_stream(keyvalue_datatype_name, "large", large_in);
+        std::ostringstream large_out;
+        dvid_node.get_stream(keyvalue_datatype_name, "large", large_out);
+        if (large_out.str() != large_value) {
+            cerr << "Streamed value not stored properly" << endl;
+            return -1;
+        }
+
+        // compressed values are decoded by readers without compression
+        DVIDNodeService compress_node(argv[1], uuid);
+        compress_node.set_keyvalue_compression(true);
+        compress_node.put(keyvalue_datatype_name, "compressed",
+                BinaryData::create_binary_data(large_value.c_str(),
+                    large_value.size()));
+        DVIDNodeService plain_node(argv[1], uuid);
+        if (plain_node.get(keyvalue_datatype_name, "compressed")->get_data() !=
+                large_value) {
+            cerr << "Compressed value not decoded properly" << endl;
+            return -1;
+        }
+
+        // files are compressed too (the stored bytes are smaller)
+        string file_name = "test_keyvalue_file.bin";
+        {
+            std::ofstream fout(file_name.c_str(), std::ios::binary);
+            fout << large_value;
+        }
+        std::ifstream fin(file_name.c_str(), std::ios::binary);
+        compress_node.put(keyvalue_datatype_name, "compressed_file", fin);
+        fin.close();
+        remove(file_name.c_str());
+        std::ostringstream stored;
+        plain_node.get_stream(keyvalue_datatype_name, "compressed_file",
+                stored);
+        if (stored.str().size() >= large_value.size() ||
+                plain_node.get(keyvalue_datatype_name,
+                    "compressed_file")->get_data() != large_value) {
+            cerr << "File value not compressed properly" << endl;
+            return -1;
+        }
     } catch (std::exception& e) {
         cerr << e.what() << endl;
         return -1;
@@ -0,0 +1,107 @@
+/*!
+ * This file tests the byte budget, eviction order and invalidation
+ * of the keyvalue read cache.  It does not require a DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDKeyValueCache.h>
+#include <libdvid/DVIDException.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::string;
+
+//! Value of size bytes
+BinaryDataPtr make_value(size_t size)
+{
+    string data(size, 'v');
+    return BinaryData::create_binary_data(data.c_str(), data.size());
+}
+
+//! Name of key i
+string key_name(int i)
+{
+    std::stringstream name;
+    name << "key" << i;
+    return name.str();
+}
+
+/*!
+ * Fills a small cache past its budget and checks that the least
+ * recently used values are evicted and that writes invalidate keys.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        // room for 10 values of 100 bytes
+        KeyValueCache cache(60.0, 1000);
+        for (int i = 0; i < 10; ++i) {
+            cache.store("uuid", "kv", key_name(i), make_value(100),
+                    cache.generation());
+        }
+        if (cache.bytes() != 1000) {
+            throw ErrMsg("Cached bytes counted incorrectly");
+        }
+
+        // key0 is used, so key1 is the least recently used
+        BinaryDataPtr value;
+        if (!cache.find("uuid", "kv", key_name(0), value)) {
+            throw ErrMsg("Cached value not found");
+        }
+        cache.store("uuid", "kv", key_name(10), make_value(100),
+                cache.generation());
+        if (!cache.find("uuid", "kv", key_name(0), value) ||
+                cache.find("uuid", "kv", key_name(1), value) ||
+                !cache.find("uuid", "kv", key_name(10), value)) {
+            throw ErrMsg("Least recently used value not evicted");
+        }
+        if (cache.bytes() > 1000) {
+            throw ErrMsg("Cache exceeds its byte budget");
+        }
+
+        // a large value evicts several small ones; one over the budget
+        // is not cached
+        cache.store("uuid", "kv", "large", make_value(450),
+                cache.generation());
+        if (cache.bytes() > 1000 ||
+                !cache.find("uuid", "kv", "large", value)) {
+            throw ErrMsg("Large value not cached within the budget");
+        }
+        cache.store("uuid", "kv", "huge", make_value(1001),
+                cache.generation());
+        if (cache.find("uuid", "kv", "huge", value) ||
+                !cache.find("uuid", "kv", "large", value)) {
+            throw ErrMsg("Value over the budget should not be cached");
+        }
+
+        // replacing a value updates the byte count
+        size_t bytes = cache.bytes();
+        cache.store("uuid", "kv", "large", make_value(50), cache.generation());
+        if (cache.bytes() != bytes - 400) {
+            throw ErrMsg("Replaced value counted incorrectly");
+        }
+
+        // reads started before an invalidation are not stored
+        uint64 generation = cache.generation();
+        cache.invalidate("uuid", "kv", "large");
+        cache.store("uuid", "kv", "large", make_value(50), generation);
+        if (cache.find("uuid", "kv", "large", value) ||
+                cache.bytes() != bytes - 450) {
+            throw ErrMsg("Invalidated value still cached");
+        }
+
+        cache.clear();
+        if (cache.bytes() != 0 || cache.find("uuid", "kv", key_name(0), value)) {
+            throw ErrMsg("Cache not cleared");
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
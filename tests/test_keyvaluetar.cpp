@@ -0,0 +1,195 @@
+/*!
+ * This file tests the tar and protobuf encodings used to transfer many
+ * keys of a keyvalue instance at once and the encoding of compressed
+ * values.
+ * It does not require a DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDKeyValue.h>
+#include <libdvid/DVIDException.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::string; using std::vector;
+
+//! Decode a value and check that it matches the original
+void check_decode(BinaryDataPtr encoded, const string& original)
+{
+    if (decode_keyvalue(encoded)->get_data() != original) {
+        throw ErrMsg("Encoded value does not round trip");
+    }
+}
+
+/*!
+ * Round trips keys (including long names and empty values) through
+ * the tar and protobuf encodings and checks that damaged archives
+ * and messages are rejected.
+ * Values are round tripped through the compressed encoding.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        vector<string> keys;
+        vector<BinaryDataPtr> values;
+        keys.push_back("body-1");
+        values.push_back(BinaryData::create_binary_data("annotation", 10));
+        keys.push_back(string(150, 'k'));
+        values.push_back(BinaryData::create_binary_data());
+        keys.push_back("blob");
+        string blob;
+        for (int i = 0; i < 5000; ++i) {
+            blob += char(rand() % 256);
+        }
+        values.push_back(BinaryData::create_binary_data(blob.data(), blob.size()));
+
+        string archive;
+        write_keyvalue_tar(&keys[0], &values[0], keys.size(), archive);
+        if (archive.size() % 512 != 0) {
+            throw ErrMsg("Archive is not padded to tar blocks");
+        }
+
+        vector<string> read_keys;
+        vector<BinaryDataPtr> read_values;
+        read_keyvalue_tar(archive, read_keys, read_values);
+        if (read_keys != keys) {
+            throw ErrMsg("Tar keys do not round trip");
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (read_values[i]->get_data() != values[i]->get_data()) {
+                throw ErrMsg("Tar values do not round trip");
+            }
+        }
+
+        // PAX path records name the next file
+        string pax_record = "22 path=pax-named-key\n";
+        string pax_archive;
+        string pax_names[] = {"PaxHeaders/x", "short"};
+        BinaryDataPtr pax_values[] = {BinaryData::create_binary_data(
+                pax_record.data(), pax_record.size()),
+            BinaryData::create_binary_data("v", 1)};
+        write_keyvalue_tar(pax_names, pax_values, 2, pax_archive);
+        pax_archive[156] = 'x';
+        // header checksum changes with the type (6 digits, NUL, space)
+        unsigned int sum = 0;
+        for (int i = 0; i < 512; ++i) {
+            sum += (i >= 148 && i < 156) ? ' ' : (unsigned char)(pax_archive[i]);
+        }
+        char checksum[8];
+        sprintf(checksum, "%06o", sum);
+        pax_archive.replace(148, 6, checksum, 6);
+        read_keyvalue_tar(pax_archive, read_keys, read_values);
+        if (read_keys.size() != 1 || read_keys[0] != "pax-named-key" ||
+                read_values[0]->get_data() != "v") {
+            throw ErrMsg("PAX path not applied");
+        }
+
+        // truncated and corrupt archives are rejected
+        string truncated = archive.substr(0, 1000);
+        string corrupt = archive;
+        corrupt[10] = 'X';
+        const string* bad_archives[] = {&truncated, &corrupt};
+        for (int i = 0; i < 2; ++i) {
+            bool failed = false;
+            try {
+                read_keyvalue_tar(*bad_archives[i], read_keys, read_values);
+            } catch (ErrMsg&) {
+                failed = true;
+            }
+            if (!failed) {
+                throw ErrMsg("Damaged tar archive accepted");
+            }
+        }
+
+        // KeyValues protobuf messages (field 1: KeyValue {1: key, 2: value})
+        string message;
+        write_keyvalue_protobuf(&keys[0], &values[0], keys.size(), message);
+        read_keyvalue_protobuf(message, read_keys, read_values);
+        if (read_keys != keys) {
+            throw ErrMsg("Protobuf keys do not round trip");
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (read_values[i]->get_data() != values[i]->get_data()) {
+                throw ErrMsg("Protobuf values do not round trip");
+            }
+        }
+        string small_key = "a";
+        BinaryDataPtr small_value = BinaryData::create_binary_data("b", 1);
+        string small_message;
+        write_keyvalue_protobuf(&small_key, &small_value, 1, small_message);
+        if (small_message != string("\x0a\x06\x0a\x01" "a" "\x12\x01" "b")) {
+            throw ErrMsg("Incorrect protobuf encoding");
+        }
+        bool rejected = false;
+        try {
+            read_keyvalue_protobuf(message.substr(0, message.size() - 10),
+                    read_keys, read_values);
+        } catch (ErrMsg&) {
+            rejected = true;
+        }
+        if (!rejected) {
+            throw ErrMsg("Truncated protobuf message accepted");
+        }
+
+        // repetitive values are compressed, small ones are left as is
+        string json_value = "{\"annotations\": [";
+        for (int i = 0; i < 2000; ++i) {
+            json_value += "{\"Pos\": [1, 2, 3], \"Kind\": \"PostSyn\"},";
+        }
+        json_value += "{}]}";
+        BinaryDataPtr json_binary = BinaryData::create_binary_data(
+                json_value.c_str(), json_value.size());
+        BinaryDataPtr compressed = encode_keyvalue(json_binary, 256);
+        if (size_t(compressed->length()) * 10 > json_value.size()) {
+            throw ErrMsg("Value was not compressed");
+        }
+        check_decode(compressed, json_value);
+        if (encode_keyvalue(json_binary, json_value.size() + 1) != json_binary) {
+            throw ErrMsg("Small value should not be compressed");
+        }
+
+        // incompressible values are stored as is unless they look encoded
+        string random_value;
+        for (int i = 0; i < 4000; ++i) {
+            random_value += char(rand() % 256);
+        }
+        BinaryDataPtr random_binary = BinaryData::create_binary_data(
+                random_value.c_str(), random_value.size());
+        if (encode_keyvalue(random_binary, 1) != random_binary) {
+            throw ErrMsg("Incompressible value should be stored as is");
+        }
+        check_decode(random_binary, random_value);
+        string lookalike = compressed->get_data().substr(0, 12) + "xyz";
+        BinaryDataPtr tagged = encode_keyvalue(BinaryData::create_binary_data(
+                    lookalike.c_str(), lookalike.size()), 256);
+        if (tagged->get_data() == lookalike) {
+            throw ErrMsg("Value starting with the header should be tagged");
+        }
+        check_decode(tagged, lookalike);
+
+        // damaged compressed values are rejected
+        string damaged = compressed->get_data();
+        damaged.resize(damaged.size() - 5);
+        bool failed = false;
+        try {
+            decode_keyvalue(BinaryData::create_binary_data(damaged.c_str(),
+                        damaged.size()));
+        } catch (ErrMsg&) {
+            failed = true;
+        }
+        if (!failed) {
+            throw ErrMsg("Damaged compressed value accepted");
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
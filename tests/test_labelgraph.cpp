@@ -97,6 +97,47 @@ int main(int argc, char** argv)
             return -1;
         }
 
+        // add a chain of vertices using several concurrent batches
+        vector<Vertex> chain_vertices;
+        vector<Edge> chain_edges;
+        for (VertexID id = 100; id < 2600; ++id) {
+            chain_vertices.push_back(Vertex(id, 1.0));
+            if (id > 100) {
+                chain_edges.push_back(Edge(id - 1, id, 2.0));
+            }
+        }
+        vector<GraphBatchError> failed_batches;
+        dvid_node.update_vertices(graph_datatype_name, chain_vertices, 4,
+                failed_batches);
+        if (!failed_batches.empty()) {
+            cerr << "Vertex batch failed: " << failed_batches[0].message << endl;
+            return -1;
+        }
+        dvid_node.update_edges(graph_datatype_name, chain_edges, 4,
+                failed_batches);
+        if (!failed_batches.empty()) {
+            cerr << "Edge batch failed: " << failed_batches[0].message << endl;
+            return -1;
+        }
+        Graph graph_chain;
+        dvid_node.get_vertex_neighbors(graph_datatype_name, Vertex(2000),
+                graph_chain);
+        if (graph_chain.vertices.size() != 3 || graph_chain.edges.size() != 2 ||
+                graph_chain.edges[0].weight != 2.0) {
+            cerr << "Concurrent graph update mismatch" << endl;
+            return -1;
+        }
+
+        // two hops from the middle of the chain
+        vector<Vertex> seeds;
+        seeds.push_back(Vertex(2000));
+        Graph graph_hops;
+        dvid_node.get_neighborhood(graph_datatype_name, seeds, 2, graph_hops, 4);
+        if (graph_hops.vertices.size() != 5 || graph_hops.edges.size() != 4) {
+            cerr << "Neighborhood expansion mismatch" << endl;
+            return -1;
+        }
+
 
         // ** Test graph property get/set **
 
@@ -185,6 +226,72 @@ int main(int argc, char** argv)
             }
         }
 
+        // edges sharing a vertex written in many small concurrent
+        // batches should not be rejected as stale
+        vector<Vertex> star_vertices;
+        vector<Edge> star_edges;
+        star_vertices.push_back(Vertex(100, 0.0));
+        for (VertexID i = 101; i <= 160; ++i) {
+            star_vertices.push_back(Vertex(i, 0.0));
+            star_edges.push_back(Edge(100, i, 0.0));
+        }
+        dvid_node.update_vertices(graph_datatype_name, star_vertices);
+        dvid_node.update_edges(graph_datatype_name, star_edges);
+
+        AdaptiveBatchSizerPtr property_sizer = dvid_node.get_property_batch_sizer();
+        dvid_node.set_property_batch_sizer(
+                AdaptiveBatchSizerPtr(new AdaptiveBatchSizer(4, 4, 4)));
+        vector<BinaryDataPtr> star_properties;
+        VertexTransactions star_transactions;
+        dvid_node.get_properties(graph_datatype_name, star_edges,
+                "sfeatures", star_properties, star_transactions, 4);
+        for (unsigned int i = 0; i < star_edges.size(); ++i) {
+            double val = double(star_edges[i].id2);
+            star_properties[i] = BinaryData::create_binary_data(
+                    (const char*) &val, 8);
+        }
+        vector<Edge> star_leftover;
+        dvid_node.set_properties(graph_datatype_name, star_edges,
+                "sfeatures", star_properties, star_transactions,
+                star_leftover, 4);
+        dvid_node.set_property_batch_sizer(property_sizer);
+        if (!star_leftover.empty()) {
+            cerr << "Edges sharing a vertex were rejected" << endl;
+            return -1;
+        }
+
+        // property views fetched concurrently (with the edge reversed)
+        // should match the copied properties
+        vector<Edge> view_edges;
+        view_edges.push_back(Edge(2, 1, 0));
+        vector<BinaryDataPtr> edge_properties;
+        vector<PropertyView> edge_views;
+        VertexTransactions edge_transactions;
+        dvid_node.get_properties(graph_datatype_name, view_edges,
+                "efeatures", edge_properties, edge_transactions);
+        dvid_node.get_properties(graph_datatype_name, view_edges,
+                "efeatures", edge_views, edge_transactions, 2);
+        if (edge_views.size() != 1 || !edge_properties[0] ||
+                edge_views[0].copy()->get_data() != edge_properties[0]->get_data()) {
+            cerr << "Property view mismatch" << endl;
+            return -1;
+        }
+
+        // a second read with a cache attached should not fetch again
+        dvid_node.set_property_cache(PropertyCachePtr(new PropertyCache));
+        vector<PropertyView> cached_views;
+        dvid_node.get_properties(graph_datatype_name, view_edges,
+                "efeatures", cached_views, edge_transactions);
+        cached_views.clear();
+        dvid_node.get_properties(graph_datatype_name, view_edges,
+                "efeatures", cached_views, edge_transactions);
+        if (dvid_node.get_property_cache()->hits() != 1 ||
+                cached_views[0].copy()->get_data() != edge_properties[0]->get_data()) {
+            cerr << "Property cache mismatch" << endl;
+            return -1;
+        }
+        dvid_node.set_property_cache(PropertyCachePtr());
+
     } catch (std::exception& e) {
         cerr << e.what() << endl;
         return -1;
@@ -0,0 +1,119 @@
+/*!
+ * This file tests the byte budget, eviction order and stale entry
+ * removal of the labelgraph property cache.  It does not require a
+ * DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDPropertyCache.h>
+#include <libdvid/DVIDException.h>
+
+#include <iostream>
+#include <string>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::string;
+
+//! Property of size bytes at the start of a larger response buffer
+PropertyView make_property(size_t size, size_t buffer_size)
+{
+    string data(buffer_size, 'p');
+    return PropertyView(BinaryData::create_binary_data(data.c_str(),
+                data.size()), 0, size);
+}
+
+/*!
+ * Fills a small cache past its budget and checks that properties are
+ * copied out of their response, that the least recently used entries
+ * are evicted and that stale entries are removed when found.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        // room for 10 properties of 100 bytes
+        PropertyCache cache(1000);
+        for (VertexID id = 1; id <= 10; ++id) {
+            cache.store("graph", "key", id, make_property(100, 100000), 1);
+        }
+        if (cache.bytes() != 1000) {
+            throw ErrMsg("Cached bytes counted incorrectly");
+        }
+
+        // only the property is kept, not the response it came from
+        PropertyView property;
+        TransactionID tid;
+        if (!cache.find("graph", "key", 1, property, tid) || tid != 1 ||
+                property.size() != 100 || property.buffer->length() != 100) {
+            throw ErrMsg("Property not copied out of its response");
+        }
+
+        // vertex 1 was used, so vertex 2 is evicted first
+        cache.store("graph", "key", 11, make_property(100, 100), 1);
+        if (cache.bytes() != 1000 ||
+                cache.find("graph", "key", 2, property, tid) ||
+                !cache.find("graph", "key", 1, property, tid)) {
+            throw ErrMsg("Least recently used property not evicted");
+        }
+
+        // entries with out of date or failed transactions are removed
+        cache.update_transaction("graph", 3, 2);
+        cache.invalidate("graph", 4);
+        if (cache.find("graph", "key", 3, property, tid) ||
+                cache.find("graph", "key", 4, property, tid) ||
+                cache.bytes() != 800) {
+            throw ErrMsg("Stale properties not removed");
+        }
+
+        // edge entries are stale when either vertex changes
+        EdgeKey edge(21, 20);
+        cache.store("graph", "key", edge, make_property(50, 100), 1, 1);
+        TransactionID tid2;
+        if (!cache.find("graph", "key", edge, property, tid, tid2) ||
+                cache.bytes() != 850) {
+            throw ErrMsg("Edge property not cached");
+        }
+        cache.update_transaction("graph", 21, 3);
+        if (cache.find("graph", "key", edge, property, tid, tid2) ||
+                cache.bytes() != 800) {
+            throw ErrMsg("Stale edge property not removed");
+        }
+
+        // properties over the budget are not cached
+        cache.store("graph", "key", 30, make_property(2000, 2000), 1);
+        if (cache.find("graph", "key", 30, property, tid) ||
+                cache.bytes() != 800) {
+            throw ErrMsg("Property over the budget cached");
+        }
+
+        // removing keys keeps the rest of their probe runs reachable
+        FlatHashMap<VertexID, int, VertexIDHash> map;
+        for (VertexID id = 0; id < 1000; ++id) {
+            map[id] = int(id);
+        }
+        for (VertexID id = 0; id < 1000; id += 3) {
+            if (!map.erase(id)) {
+                throw ErrMsg("Key not erased");
+            }
+        }
+        for (VertexID id = 0; id < 1000; ++id) {
+            const int* value = map.find(id);
+            if ((id % 3 == 0) != !value || (value && *value != int(id))) {
+                throw ErrMsg("Hash map lookup failed after erase");
+            }
+        }
+        if (map.size() != 666 || map.erase(0)) {
+            throw ErrMsg("Hash map size wrong after erase");
+        }
+
+        cache.clear();
+        if (cache.bytes() != 0) {
+            throw ErrMsg("Cache not cleared");
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -126,6 +126,15 @@ int main(int argc, char** argv)
             cerr << "Point query in ROI gives incorrect result" << endl;
             return -1;
         }
+
+        // chunked concurrent query (binary encoding falls back to JSON)
+        vector<bool> chunked_inroi;
+        dvid_node.roi_ptquery(roi_datatype_name, points, chunked_inroi, 2, 1,
+                BinaryPointEncoding);
+        if (chunked_inroi != points_inroi) {
+            cerr << "Chunked point query gives incorrect result" << endl;
+            return -1;
+        }
     } catch (std::exception& e) {
         cerr << e.what() << endl;
         return -1;
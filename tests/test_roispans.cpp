@@ -0,0 +1,211 @@
+/*!
+ * This file tests ROIs stored as runs of blocks (spans) and the
+ * in-memory ROI index.  It does not require a DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDRoi.h>
+#include <libdvid/DVIDException.h>
+
+#include <iostream>
+#include <vector>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <iterator>
+#include <cstdlib>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::vector; using std::set;
+
+//! Random spans in a small volume (overlapping and unordered)
+vector<BlockSpan> random_spans(int num_spans, int extent = 20)
+{
+    vector<BlockSpan> spans;
+    for (int i = 0; i < num_spans; ++i) {
+        int x0 = rand() % (2 * extent) - extent;
+        spans.push_back(BlockSpan(rand() % extent - extent / 2,
+                    rand() % extent - extent / 2, x0, x0 + rand() % 6));
+    }
+    return spans;
+}
+
+//! Expand spans into a set of blocks
+set<BlockXYZ> span_blocks(const vector<BlockSpan>& spans)
+{
+    set<BlockXYZ> blocks;
+    for (unsigned int i = 0; i < spans.size(); ++i) {
+        for (int x = spans[i].x0; x <= spans[i].x1; ++x) {
+            blocks.insert(BlockXYZ(x, spans[i].y, spans[i].z));
+        }
+    }
+    return blocks;
+}
+
+/*!
+ * Checks span normalization, set operations, partitioning and ROI
+ * membership queries against expanded block sets.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        srand(11);
+
+        // touching and overlapping spans are joined
+        vector<BlockSpan> spans;
+        spans.push_back(BlockSpan(1, 2, 5, 7));
+        spans.push_back(BlockSpan(1, 2, 0, 2));
+        spans.push_back(BlockSpan(1, 2, 3, 4));
+        spans.push_back(BlockSpan(0, 9, 3, 4));
+        spans.push_back(BlockSpan(1, 2, 6, 9));
+        spans.push_back(BlockSpan(1, 3, 4, 3));
+        normalize_spans(spans);
+        if (spans.size() != 2 || spans[0] != BlockSpan(0, 9, 3, 4) ||
+                spans[1] != BlockSpan(1, 2, 0, 9)) {
+            throw ErrMsg("Spans normalized incorrectly");
+        }
+
+        vector<BlockSpan> roi_spans = random_spans(2000);
+        set<BlockXYZ> roi_blocks = span_blocks(roi_spans);
+        ROIIndex roi(roi_spans);
+        if (roi.num_blocks() != roi_blocks.size()) {
+            throw ErrMsg("ROI index has the wrong number of blocks");
+        }
+
+        // blocks and spans round trip (ordered and unordered blocks)
+        vector<BlockXYZ> expanded;
+        spans_to_blocks(roi.get_spans(), expanded);
+        if (expanded != vector<BlockXYZ>(roi_blocks.begin(), roi_blocks.end())) {
+            throw ErrMsg("Spans expanded incorrectly");
+        }
+        vector<BlockSpan> encoded;
+        blocks_to_spans(expanded, encoded);
+        if (encoded != roi.get_spans()) {
+            throw ErrMsg("Ordered blocks encoded incorrectly");
+        }
+        vector<BlockXYZ> shuffled(expanded);
+        shuffled.insert(shuffled.end(), expanded.begin(), expanded.begin() + 100);
+        std::random_shuffle(shuffled.begin(), shuffled.end());
+        blocks_to_spans(shuffled, encoded);
+        if (encoded != roi.get_spans()) {
+            throw ErrMsg("Unordered blocks encoded incorrectly");
+        }
+
+        // JSON runs are z, y, x0, x1
+        std::string json;
+        write_roi_json(&spans[0], spans.size(), json);
+        if (json != "[[0,9,3,4],[1,2,0,9]]") {
+            throw ErrMsg("ROI JSON written incorrectly: " + json);
+        }
+
+        // set operations against expanded block sets (large enough to
+        // be split across threads)
+        vector<BlockSpan> spans1 = random_spans(20000, 80);
+        vector<BlockSpan> spans2 = random_spans(20000, 80);
+        set<BlockXYZ> blocks1 = span_blocks(spans1);
+        set<BlockXYZ> blocks2 = span_blocks(spans2);
+        vector<BlockXYZ> union_blocks, intersection_blocks, difference_blocks;
+        std::set_union(blocks1.begin(), blocks1.end(), blocks2.begin(),
+                blocks2.end(), std::back_inserter(union_blocks));
+        std::set_intersection(blocks1.begin(), blocks1.end(), blocks2.begin(),
+                blocks2.end(), std::back_inserter(intersection_blocks));
+        std::set_difference(blocks1.begin(), blocks1.end(), blocks2.begin(),
+                blocks2.end(), std::back_inserter(difference_blocks));
+        vector<BlockSpan> sorted1(spans1);
+        normalize_spans(sorted1);
+        for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+            vector<BlockSpan> result, expected;
+            roi_union(spans1, spans2, result, num_threads);
+            blocks_to_spans(union_blocks, expected);
+            if (result != expected) {
+                throw ErrMsg("ROI union mismatch");
+            }
+            roi_intersection(sorted1, spans2, result, num_threads);
+            blocks_to_spans(intersection_blocks, expected);
+            if (result != expected) {
+                throw ErrMsg("ROI intersection mismatch");
+            }
+            roi_difference(spans1, spans2, result, num_threads);
+            blocks_to_spans(difference_blocks, expected);
+            if (result != expected || expected.empty()) {
+                throw ErrMsg("ROI difference mismatch");
+            }
+            roi_difference(sorted1, vector<BlockSpan>(), result, num_threads);
+            if (result != sorted1) {
+                throw ErrMsg("ROI difference with empty ROI mismatch");
+            }
+        }
+
+        // partitions cover the ROI exactly with bounded subvolumes
+        const PartitionMethod methods[] = {KDTreePartition, MortonPartition};
+        for (int m = 0; m < 2; ++m) {
+            vector<ROISubvolume> subvolumes;
+            double packing = partition_roi(spans1, 500, methods[m], subvolumes);
+            vector<BlockSpan> covered;
+            uint64 active_blocks = 0;
+            for (unsigned int i = 0; i < subvolumes.size(); ++i) {
+                const ROISubvolume& subvolume = subvolumes[i];
+                uint64 span_blocks = 0;
+                for (unsigned int j = 0; j < subvolume.spans.size(); ++j) {
+                    const BlockSpan& span = subvolume.spans[j];
+                    if (span.z < subvolume.min_block.z ||
+                            span.z > subvolume.max_block.z ||
+                            span.y < subvolume.min_block.y ||
+                            span.y > subvolume.max_block.y ||
+                            span.x0 < subvolume.min_block.x ||
+                            span.x1 > subvolume.max_block.x) {
+                        throw ErrMsg("Subvolume span outside of its bounds");
+                    }
+                    span_blocks += span.size();
+                }
+                if (span_blocks != subvolume.active_blocks ||
+                        subvolume.active_blocks > 500 ||
+                        (methods[m] == KDTreePartition &&
+                         subvolume.active_blocks < 100)) {
+                    throw ErrMsg("Subvolume has an unbalanced block count");
+                }
+                covered.insert(covered.end(), subvolume.spans.begin(),
+                        subvolume.spans.end());
+                active_blocks += subvolume.active_blocks;
+            }
+            normalize_spans(covered);
+            if (covered != sorted1 || active_blocks != blocks1.size() ||
+                    packing <= 0.0 || packing > 1.0) {
+                throw ErrMsg("Partition does not cover the ROI");
+            }
+        }
+
+        // block and point queries (including negative coordinates)
+        vector<BlockXYZ> blocks;
+        vector<PointXYZ> points;
+        for (int z = -11; z <= 10; ++z) {
+            for (int y = -11; y <= 10; ++y) {
+                for (int x = -22; x <= 26; ++x) {
+                    blocks.push_back(BlockXYZ(x, y, z));
+                    points.push_back(PointXYZ(x * DEFBLOCKSIZE + rand() % DEFBLOCKSIZE,
+                                y * DEFBLOCKSIZE + rand() % DEFBLOCKSIZE,
+                                z * DEFBLOCKSIZE + rand() % DEFBLOCKSIZE));
+                }
+            }
+        }
+        for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+            vector<bool> block_inroi, point_inroi;
+            roi.contains(blocks, block_inroi, num_threads);
+            roi.contains(points, point_inroi, num_threads);
+            for (unsigned int i = 0; i < blocks.size(); ++i) {
+                bool expected = roi_blocks.count(blocks[i]) > 0;
+                if (block_inroi[i] != expected || point_inroi[i] != expected ||
+                        roi.contains(blocks[i]) != expected ||
+                        roi.contains(points[i]) != expected) {
+                    throw ErrMsg("ROI membership mismatch");
+                }
+            }
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
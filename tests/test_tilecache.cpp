@@ -0,0 +1,203 @@
+/*!
+ * This file tests the tile cache with a local tile source: the byte
+ * budget, the order in which tiles are fetched and that each tile is
+ * fetched once.  It does not require a DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDTileCache.h>
+#include <libdvid/DVIDException.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::vector; using std::map;
+
+//! Fetch order and a gate that holds fetches until it is opened
+struct FetchLog {
+    FetchLog() : open(true), num_started(0) {}
+
+    boost::mutex mutex;
+    boost::condition_variable changed;
+    bool open;
+    int num_started;
+    vector<TileKey> fetched;
+};
+
+//! Returns 100-byte tiles once the gate is open and logs them
+struct LoggedFetcher {
+    explicit LoggedFetcher(boost::shared_ptr<FetchLog> log_) : log(log_) {}
+
+    BinaryDataPtr operator()(const TileKey& key)
+    {
+        boost::mutex::scoped_lock lock(log->mutex);
+        ++log->num_started;
+        log->changed.notify_all();
+        while (!log->open) {
+            log->changed.wait(lock);
+        }
+        log->fetched.push_back(key);
+        log->changed.notify_all();
+        return BinaryData::create_binary_data(std::string(100, 't').c_str(),
+                100);
+    }
+
+    boost::shared_ptr<FetchLog> log;
+};
+
+//! Gets the tiles of a viewport on another thread
+struct ViewportReader {
+    ViewportReader(TileCache& cache_, TileViewport viewport_) :
+        cache(cache_), viewport(viewport_) {}
+
+    void operator()()
+    {
+        vector<BinaryDataPtr> tiles;
+        cache.get_viewport(viewport, tiles);
+    }
+
+    TileCache& cache;
+    TileViewport viewport;
+};
+
+//! Gets one tile on another thread
+struct TileReader {
+    TileReader(TileCache& cache_, TileKey key_) : cache(cache_), key(key_) {}
+
+    void operator()()
+    {
+        cache.get_tile(key);
+    }
+
+    TileCache& cache;
+    TileKey key;
+};
+
+//! Wait until num tiles have been fetched
+void wait_for_fetches(FetchLog& log, size_t num)
+{
+    boost::mutex::scoped_lock lock(log.mutex);
+    while (log.fetched.size() < num) {
+        log.changed.wait(lock);
+    }
+}
+
+/*!
+ * Checks LRU eviction under the byte budget, that a waiting caller
+ * moves a queued prefetch ahead of the others without a second fetch,
+ * and that prefetches are ordered by distance and motion.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        // room for 10 tiles; the least recently used are evicted
+        {
+            boost::shared_ptr<FetchLog> log(new FetchLog);
+            TileCache cache(LoggedFetcher(log), 1000, 1);
+            for (int i = 0; i < 12; ++i) {
+                cache.get_tile(TileKey("tiles", XY, 0, i, 0, 0));
+                if (i == 9) {
+                    cache.get_tile(TileKey("tiles", XY, 0, 0, 0, 0));
+                }
+            }
+            if (cache.bytes() != 1000 || cache.hits() != 1) {
+                throw ErrMsg("Tile budget not enforced");
+            }
+            cache.get_tile(TileKey("tiles", XY, 0, 0, 0, 0));
+            cache.get_tile(TileKey("tiles", XY, 0, 1, 0, 0));
+            if (cache.hits() != 2 || log->fetched.size() != 13) {
+                throw ErrMsg("Least recently used tile not evicted");
+            }
+        }
+
+        // a caller waiting for a queued prefetch moves it ahead
+        boost::shared_ptr<FetchLog> log(new FetchLog);
+        log->open = false;
+        TileCache cache(LoggedFetcher(log), 1 << 20, 1);
+        cache.set_prefetch(2, 0);
+        TileViewport viewport("tiles", XY, 0, 5, 5, 5, 5, 0, 0);
+        boost::thread viewport_thread(ViewportReader(cache, viewport));
+        {
+            // the visible tile is being fetched, the rings are queued
+            boost::mutex::scoped_lock lock(log->mutex);
+            while (log->num_started < 1) {
+                log->changed.wait(lock);
+            }
+        }
+        TileKey far_tile = viewport.tile(7, 3, 0);
+        boost::thread tile_thread(TileReader(cache, far_tile));
+        while (cache.misses() < 2) {
+            boost::this_thread::yield();
+        }
+        {
+            boost::mutex::scoped_lock lock(log->mutex);
+            log->open = true;
+            log->changed.notify_all();
+        }
+        viewport_thread.join();
+        tile_thread.join();
+
+        // visible tile, requested tile, 8 tiles at distance 1 and the
+        // other 15 at distance 2
+        wait_for_fetches(*log, 25);
+        map<TileKey, int> fetch_counts;
+        for (size_t i = 0; i < log->fetched.size(); ++i) {
+            ++fetch_counts[log->fetched[i]];
+        }
+        if (fetch_counts.size() != log->fetched.size()) {
+            throw ErrMsg("Tile fetched more than once");
+        }
+        if (!(log->fetched[0].x == 5 && log->fetched[0].y == 5) ||
+                !(log->fetched[1].x == 7 && log->fetched[1].y == 3)) {
+            throw ErrMsg("Waiting requests not fetched first");
+        }
+        for (size_t i = 2; i < 10; ++i) {
+            if (std::abs(log->fetched[i].x - 5) > 1 ||
+                    std::abs(log->fetched[i].y - 5) > 1) {
+                throw ErrMsg("Prefetches not ordered by distance");
+            }
+        }
+
+        // after moving right, tiles right of the viewport come first at
+        // each distance: the visible tile, 3 ahead and 5 others at
+        // distance 1, then 7 ahead at distance 2
+        size_t num_fetched = log->fetched.size();
+        vector<BinaryDataPtr> tiles;
+        cache.get_viewport(TileViewport("tiles", XY, 0, 20, 5, 20, 5, 0, 0),
+                tiles);
+        wait_for_fetches(*log, num_fetched + 25);
+        const TileKey* order = &log->fetched[num_fetched];
+        if (order[0].x != 20 || order[0].y != 5) {
+            throw ErrMsg("Visible tile not fetched first");
+        }
+        for (int i = 1; i < 16; ++i) {
+            bool ahead = order[i].x > 20;
+            bool near = std::abs(order[i].x - 20) <= 1 &&
+                std::abs(order[i].y - 5) <= 1;
+            if (ahead != (i < 4 || i >= 9) || near != (i < 9)) {
+                throw ErrMsg("Prefetches not ordered by motion");
+            }
+        }
+
+        // cached tiles are served without fetching
+        cache.get_viewport(TileViewport("tiles", XY, 0, 20, 5, 20, 5, 0, 0),
+                tiles);
+        if (log->fetched.size() != num_fetched + 25 || tiles.size() != 1 ||
+                !tiles[0]) {
+            throw ErrMsg("Cached tile fetched again");
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*!
+ * This file tests the concurrent agglomeration of labelgraph edges
+ * and relabeling of label volumes.  It does not require a DVID server.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDUnionFind.h>
+#include <libdvid/DVIDException.h>
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <cstdlib>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::vector; using std::map;
+
+//! Simple sequential union-find used as the reference
+VertexID find_root(map<VertexID, VertexID>& parents, VertexID id)
+{
+    while (parents[id] != id) {
+        id = parents[id];
+    }
+    return id;
+}
+
+/*!
+ * Compares multi-threaded agglomeration of a random graph against
+ * a sequential union-find and relabels a small volume.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        // random edges between sparse ids with weights in [0, 1)
+        srand(7);
+        vector<Edge> edges;
+        for (int i = 0; i < 200000; ++i) {
+            VertexID id1 = (rand() % 100000) * 13 + 5;
+            VertexID id2 = (rand() % 100000) * 13 + 5;
+            edges.push_back(Edge(id1, id2, (rand() % 1000) / 1000.0));
+        }
+
+        // reference: merge edges with weight below 0.3 (roots are
+        // the smallest id)
+        map<VertexID, VertexID> parents;
+        for (unsigned int i = 0; i < edges.size(); ++i) {
+            if (edges[i].weight > 0.3) {
+                continue;
+            }
+            if (parents.find(edges[i].id1) == parents.end()) {
+                parents[edges[i].id1] = edges[i].id1;
+            }
+            if (parents.find(edges[i].id2) == parents.end()) {
+                parents[edges[i].id2] = edges[i].id2;
+            }
+            VertexID root1 = find_root(parents, edges[i].id1);
+            VertexID root2 = find_root(parents, edges[i].id2);
+            if (root1 < root2) {
+                parents[root2] = root1;
+            } else {
+                parents[root1] = root2;
+            }
+        }
+
+        for (int num_threads = 1; num_threads <= 8; num_threads *= 8) {
+            LabelMapping mapping;
+            agglomerate_edges(edges, -1.0, 0.3, mapping, num_threads);
+            if (mapping.size() != parents.size()) {
+                throw ErrMsg("Agglomeration has the wrong number of labels");
+            }
+            for (map<VertexID, VertexID>::iterator iter = parents.begin();
+                    iter != parents.end(); ++iter) {
+                if (mapping.map(iter->first) != find_root(parents, iter->first)) {
+                    throw ErrMsg("Agglomeration root mismatch");
+                }
+            }
+        }
+
+        // a chain merges into its smallest id; the heavy edge is kept
+        vector<Edge> chain;
+        chain.push_back(Edge(9, 4, 0.5));
+        chain.push_back(Edge(4, 7, 0.5));
+        chain.push_back(Edge(7, 2, 0.9));
+        LabelMapping chain_mapping;
+        agglomerate_edges(chain, 0.0, 0.5, chain_mapping, 2);
+        if (chain_mapping.map(9) != 4 || chain_mapping.map(7) != 4 ||
+                chain_mapping.map(2) != 2 || chain_mapping.map(100) != 100) {
+            throw ErrMsg("Chain agglomerated incorrectly");
+        }
+
+        // relabel a volume in place
+        Dims_t dims;
+        dims.push_back(4); dims.push_back(4); dims.push_back(2);
+        vector<uint64> voxels(32, 9);
+        voxels[5] = 7; voxels[6] = 100; voxels[31] = 2;
+        Labels3D volume(&voxels[0], voxels.size(), dims);
+        chain_mapping.relabel(volume, 4);
+        const uint64* relabeled = volume.get_raw();
+        if (relabeled[0] != 4 || relabeled[5] != 4 || relabeled[6] != 100 ||
+                relabeled[31] != 2) {
+            throw ErrMsg("Volume relabeled incorrectly");
+        }
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}